@@ -0,0 +1,53 @@
+#version 450
+
+// Same as test.vert, for gltf::QuantizedVertex
+layout (location = 0) in vec4 in_position;
+layout (location = 1) in vec2 in_normal;
+layout (location = 2) in vec2 in_tangent;
+layout (location = 3) in vec2 in_tex_coord;
+
+layout (location = 0) out vec3 out_position_ws;
+layout (location = 1) out mat3 out_tbn;
+layout (location = 4) out vec2 out_tex_coord;
+
+layout (std140, set = 0, binding = 0) uniform SceneUniforms {
+    mat4 view;
+    mat4 proj;
+    vec4 camera;
+} scene_uniforms;
+
+layout (push_constant) uniform constants
+{
+    mat4 model;
+    vec4 position_offset;
+    vec4 position_scale;
+} PushConstants;
+
+vec3 decode_octahedral(vec2 e) {
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.xy += mix(vec2(t), vec2(-t), greaterThanEqual(n.xy, vec2(0.0)));
+    return normalize(n);
+}
+
+void main() {
+    // positions are unorm relative to the bounding box of the primitive
+    vec3 position = PushConstants.position_offset.xyz + in_position.xyz * PushConstants.position_scale.xyz;
+    vec3 normal = decode_octahedral(in_normal);
+    // the bitangent sign is folded into the sign of y
+    float tangent_w = in_tangent.y < 0.0 ? -1.0 : 1.0;
+    vec3 tangent = decode_octahedral(vec2(in_tangent.x, abs(in_tangent.y) * 2.0 - 1.0));
+
+    vec4 position_ws = PushConstants.model * vec4(position, 1.0);
+    gl_Position = scene_uniforms.proj * scene_uniforms.view * position_ws;
+    out_position_ws = position_ws.xyz;
+    out_tex_coord = in_tex_coord;
+
+    // Only correct with non uniform scaling
+    mat3 normal_matrix = mat3(PushConstants.model);
+    vec3 T = normalize(normal_matrix * tangent);
+    vec3 N = normalize(normal_matrix * normal);
+    vec3 bitangent = cross(normal, tangent) * tangent_w;
+    vec3 B = normalize(normal_matrix * bitangent);
+    out_tbn = mat3(T, B, N);
+}
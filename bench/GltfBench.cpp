@@ -0,0 +1,160 @@
+#include <benchmark/benchmark.h>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <set>
+#include <vector>
+
+#include "Logger.h"
+#include "SyntheticGlb.h"
+#include "gltf/Bounds.h"
+#include "gltf/Glb.h"
+#include "gltf/Gltf.h"
+#include "gltf/Meshlets.h"
+
+namespace {
+    // Writes the file the first time the configuration is used by this process, so a changed generator can't leave
+    // stale files behind
+    std::filesystem::path synthetic_glb(const SyntheticGlbOptions &options) {
+        static std::set<std::filesystem::path> written;
+        const auto path = std::filesystem::temp_directory_path() /
+                          std::format(
+                                  "cpp_vulkan_playground_bench_{}x{}{}{}.glb", options.primitives,
+                                  options.verticesPerPrimitive, options.meshopt ? "_meshopt" : "",
+                                  options.interleaved ? "" : "_packed"
+                          );
+        if (written.insert(path).second)
+            writeSyntheticGlb(path, options);
+        return path;
+    }
+
+    // Loads without the scene cache and texture compression, the file has no textures anyway
+    gltf::LoadOptions load_options(bool parallel) {
+        return {.parallel = parallel, .cacheDirectory = {}, .compressTextures = false};
+    }
+
+    // interleaved 0 has a tightly packed view per attribute, 1 one view with all of them, which the loader
+    // de-interleaves
+    void load_glb(benchmark::State &state) {
+        const SyntheticGlbOptions glb_options = {
+            .primitives = static_cast<size_t>(state.range(0)),
+            .verticesPerPrimitive = static_cast<size_t>(state.range(1)),
+            .meshopt = state.range(2) != 0,
+            .interleaved = state.range(3) != 0,
+        };
+        const auto path = synthetic_glb(glb_options);
+        const auto options = load_options(state.range(4) != 0);
+
+        size_t vertex_count = 0;
+        for (auto _: state) {
+            const auto scene_data = gltf::load(path, options);
+            vertex_count = scene_data.vertex_count;
+            benchmark::DoNotOptimize(scene_data.vertex_position_data.data());
+        }
+        state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * vertex_count));
+        state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * std::filesystem::file_size(path)));
+    }
+    BENCHMARK(load_glb)
+            ->ArgsProduct({{16, 128}, {1024, 16384}, {0, 1}, {0, 1}, {0, 1}})
+            ->ArgNames({"primitives", "vertices", "meshopt", "interleaved", "parallel"})
+            ->Unit(benchmark::kMillisecond)
+            ->UseRealTime();
+
+    // Only the decoding of the compressed views, without parsing and copying into the streams
+    void decode_meshopt_views(benchmark::State &state) {
+        const SyntheticGlbOptions glb_options = {
+            .primitives = static_cast<size_t>(state.range(0)),
+            .verticesPerPrimitive = 16384,
+            .meshopt = true,
+        };
+        auto glb = gltf::GlbFile::open(synthetic_glb(glb_options));
+        const bool parallel = state.range(1) != 0;
+
+        size_t decoded_bytes = 0;
+        for (const auto &view: glb.bufferViews) {
+            if (view.meshopt)
+                decoded_bytes += view.byteLength;
+        }
+        for (auto _: state) {
+            glb.decodeCompressedViews(parallel);
+            glb.releaseDecodedViews();
+        }
+        state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * decoded_bytes));
+    }
+    BENCHMARK(decode_meshopt_views)
+            ->ArgsProduct({{1, 64}, {0, 1}})
+            ->ArgNames({"primitives", "parallel"})
+            ->Unit(benchmark::kMillisecond)
+            ->UseRealTime();
+
+    void compute_primitive_bounds(benchmark::State &state) {
+        const SyntheticGlbOptions glb_options = {
+            .primitives = static_cast<size_t>(state.range(0)),
+            .verticesPerPrimitive = 4096,
+        };
+        const bool parallel = state.range(1) != 0;
+        auto scene_data = gltf::load(synthetic_glb(glb_options), load_options(parallel));
+
+        for (auto _: state) {
+            gltf::computePrimitiveBounds(scene_data, parallel);
+            benchmark::ClobberMemory();
+        }
+        state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * scene_data.vertex_count));
+    }
+    BENCHMARK(compute_primitive_bounds)
+            ->ArgsProduct({{16, 1024}, {0, 1}})
+            ->ArgNames({"primitives", "parallel"})
+            ->Unit(benchmark::kMicrosecond)
+            ->UseRealTime();
+
+    struct MeshletTable {
+        std::vector<gltf::Meshlet> meshlets;
+        std::vector<uint32_t> vertices;
+        std::vector<uint32_t> triangles;
+
+        static MeshletTable of(const gltf::SceneData &scene_data) {
+            return {scene_data.meshlets, scene_data.meshlet_vertex_data, scene_data.meshlet_triangle_data};
+        }
+
+        // Meshlet is std430 without padding, so the bytes compare its members
+        bool operator==(const MeshletTable &other) const {
+            return meshlets.size() == other.meshlets.size() &&
+                   std::memcmp(meshlets.data(), other.meshlets.data(), meshlets.size() * sizeof(gltf::Meshlet)) == 0 &&
+                   vertices == other.vertices && triangles == other.triangles;
+        }
+    };
+
+    // One high-poly primitive, built in fixed chunks of triangles that run concurrently
+    void build_meshlets(benchmark::State &state) {
+        const SyntheticGlbOptions glb_options = {
+            .primitives = 1,
+            .verticesPerPrimitive = static_cast<size_t>(state.range(0)),
+        };
+        const bool parallel = state.range(1) != 0;
+        auto scene_data = gltf::load(synthetic_glb(glb_options), load_options(true));
+
+        // the output must not depend on the thread count or the scheduling. Fails the whole run instead of skipping
+        // a row, a different table is a bug and not a slow configuration.
+        gltf::buildMeshlets(scene_data, {.parallel = false});
+        const auto expected = MeshletTable::of(scene_data);
+        for (int run = 0; run < 3; run++) {
+            gltf::buildMeshlets(scene_data, {.parallel = true});
+            if (MeshletTable::of(scene_data) != expected)
+                Logger::panic("Meshlets built in parallel differ from the serial ones");
+        }
+
+        size_t triangle_count = 0;
+        for (const auto &primitive: scene_data.primitives)
+            triangle_count += primitive.indexCount / 3;
+        for (auto _: state) {
+            gltf::buildMeshlets(scene_data, {.parallel = parallel});
+            benchmark::DoNotOptimize(scene_data.meshlets.data());
+        }
+        state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * triangle_count));
+    }
+    BENCHMARK(build_meshlets)
+            ->ArgsProduct({{1 << 16, 1 << 20}, {0, 1}})
+            ->ArgNames({"vertices", "parallel"})
+            ->Unit(benchmark::kMillisecond)
+            ->UseRealTime();
+} // namespace
@@ -0,0 +1,219 @@
+#include <array>
+#include <benchmark/benchmark.h>
+#include <cstring>
+#include <vector>
+
+#include "BlockCompression.h"
+#include "Image.h"
+#include "PixelCopy.h"
+#include "gltf/Ktx2.h"
+
+namespace {
+    constexpr int IMAGE_SIZE = 1024;
+    // block compression is a lot slower than everything else here
+    constexpr int COMPRESSED_IMAGE_SIZE = 512;
+
+    // A gradient with some noise, closer to a real texture than random bytes
+    std::vector<unsigned char> test_pixels(int width, int height, int channels) {
+        std::vector<unsigned char> pixels(static_cast<size_t>(width) * height * channels);
+        uint32_t state = 0x12345678;
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                for (int c = 0; c < channels; c++) {
+                    state = state * 1664525u + 1013904223u;
+                    const int value = (x * (c + 1) + y * (3 - c)) / 8 + static_cast<int>(state >> 28);
+                    pixels[(static_cast<size_t>(y) * width + x) * channels + c] = static_cast<unsigned char>(value);
+                }
+            }
+        }
+        return pixels;
+    }
+
+    PlainImageData test_image(vk::Format format, int size) {
+        constexpr int channels = 4;
+        const auto pixels = test_pixels(size, size, channels);
+        return PlainImageData::create(format, size, size, channels, pixels.data());
+    }
+
+    // Checks the kernel against the scalar one before timing it, unsupported kernels are skipped
+    void copy_pixels(benchmark::State &state) {
+        const auto src_channels = static_cast<int>(state.range(0));
+        const auto dst_channels = static_cast<int>(state.range(1));
+        const auto kernel = static_cast<PixelCopyKernel>(state.range(2));
+        if (!pixelCopyKernelSupported(kernel)) {
+            state.SkipWithError("The kernel isn't supported by this CPU");
+            return;
+        }
+        // odd, so the scalar tail of the SIMD kernels runs as well
+        const size_t elements = static_cast<size_t>(IMAGE_SIZE) * IMAGE_SIZE - 7;
+        const auto src = test_pixels(IMAGE_SIZE, IMAGE_SIZE, src_channels);
+        std::vector<unsigned char> dst(elements * dst_channels);
+        std::vector<unsigned char> expected(elements * dst_channels);
+        copyPixels(PixelCopyKernel::Scalar, src.data(), src_channels, expected.data(), dst_channels, elements);
+        copyPixels(kernel, src.data(), src_channels, dst.data(), dst_channels, elements);
+        if (dst != expected) {
+            state.SkipWithError("The kernel's result differs from the scalar one");
+            return;
+        }
+
+        for (auto _: state) {
+            copyPixels(kernel, src.data(), src_channels, dst.data(), dst_channels, elements);
+            benchmark::ClobberMemory();
+        }
+        state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * elements * (src_channels + dst_channels)));
+    }
+    BENCHMARK(copy_pixels)
+            ->ArgsProduct({{1, 2, 3, 4}, {1, 2, 3, 4}, {0, 1, 2, 3}})
+            ->ArgNames({"src", "dst", "kernel"});
+
+    // The conversions textures are loaded with, with the best kernel
+    void copy_pixels_parallel(benchmark::State &state) {
+        const auto src_channels = static_cast<int>(state.range(0));
+        const auto dst_channels = static_cast<int>(state.range(1));
+        const bool parallel = state.range(2) != 0;
+        constexpr int size = 4 * IMAGE_SIZE;
+        const size_t elements = static_cast<size_t>(size) * size;
+        const auto src = test_pixels(size, size, src_channels);
+        std::vector<unsigned char> dst(elements * dst_channels);
+
+        for (auto _: state) {
+            copyPixels(src.data(), src_channels, dst.data(), dst_channels, elements, parallel);
+            benchmark::ClobberMemory();
+        }
+        state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * elements * (src_channels + dst_channels)));
+    }
+    BENCHMARK(copy_pixels_parallel)
+            ->ArgsProduct({{3, 4}, {4}, {0, 1}})
+            ->Args({4, 2, 0})
+            ->Args({4, 2, 1})
+            ->ArgNames({"src", "dst", "parallel"})
+            ->Unit(benchmark::kMicrosecond)
+            ->UseRealTime();
+
+    // mapping 0 merges green and blue like the occlusion and metallic-roughness textures, 1 swizzles all channels
+    void copy_channels(benchmark::State &state) {
+        const auto src = test_image(vk::Format::eR8G8B8A8Unorm, IMAGE_SIZE);
+        auto dst = test_image(vk::Format::eR8G8B8A8Unorm, IMAGE_SIZE);
+        const bool swizzle = state.range(0) != 0;
+        const bool parallel = state.range(1) != 0;
+
+        for (auto _: state) {
+            if (swizzle)
+                src.copyChannels(dst, {2, 1, 0, 3}, parallel);
+            else
+                src.copyChannels(dst, {-1, 1, 2, -1}, parallel);
+            benchmark::ClobberMemory();
+        }
+        state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * src.pixels.size_bytes()));
+    }
+    BENCHMARK(copy_channels)->ArgsProduct({{0, 1}, {0, 1}})->ArgNames({"swizzle", "parallel"})->UseRealTime();
+
+    void fill(benchmark::State &state) {
+        auto image = test_image(vk::Format::eR8G8B8A8Unorm, IMAGE_SIZE);
+        const bool parallel = state.range(0) != 0;
+        for (auto _: state) {
+            image.fill({1, 2}, {0xff, 0xff}, parallel);
+            benchmark::ClobberMemory();
+        }
+        state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * image.pixels.size_bytes()));
+    }
+    BENCHMARK(fill)->Arg(0)->Arg(1)->ArgName("parallel")->UseRealTime();
+
+    // Merging an 8K metallic-roughness texture into the occlusion one, as gltf::materializeImage does
+    void pack_omr(benchmark::State &state) {
+        constexpr int size = 8192;
+        const bool parallel = state.range(0) != 0;
+        const auto metallic_roughness = PlainImageData::create(vk::Format::eR8G8B8A8Unorm, size, size);
+        auto occlusion = PlainImageData::create(vk::Format::eR8G8B8A8Unorm, size, size);
+        std::memset(metallic_roughness.pixels.data(), 0x80, metallic_roughness.pixels.size_bytes());
+        std::memset(occlusion.pixels.data(), 0xff, occlusion.pixels.size_bytes());
+
+        for (auto _: state) {
+            metallic_roughness.copyChannels(occlusion, {-1, 1, 2, -1}, parallel);
+            benchmark::ClobberMemory();
+        }
+        state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * occlusion.pixels.size_bytes()));
+    }
+    BENCHMARK(pack_omr)->Arg(0)->Arg(1)->ArgName("parallel")->Unit(benchmark::kMillisecond)->UseRealTime();
+
+    void generate_mipmaps(benchmark::State &state) {
+        const auto format = state.range(0) != 0 ? vk::Format::eR8G8B8A8Srgb : vk::Format::eR8G8B8A8Unorm;
+        const auto filter = static_cast<MipFilter>(state.range(1));
+        const bool parallel = state.range(2) != 0;
+        const auto image = test_image(format, IMAGE_SIZE);
+        for (auto _: state) {
+            const auto mipmapped = image.generateMipmaps(filter, parallel);
+            benchmark::DoNotOptimize(mipmapped.pixels.data());
+        }
+        state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * image.pixels.size_bytes()));
+    }
+    BENCHMARK(generate_mipmaps)
+            ->ArgsProduct({{0, 1}, {0, 1}, {0, 1}})
+            ->ArgNames({"srgb", "filter", "parallel"})
+            ->Unit(benchmark::kMillisecond)
+            ->UseRealTime();
+
+    // Encodes the full mip chain, to BC7 for color and BC5 for normal maps
+    void compress_blocks(benchmark::State &state) {
+        const bool normal_map = state.range(0) != 0;
+        const bool parallel = state.range(1) != 0;
+        const auto format = normal_map ? vk::Format::eR8G8Unorm : vk::Format::eR8G8B8A8Srgb;
+        const auto pixels = test_pixels(COMPRESSED_IMAGE_SIZE, COMPRESSED_IMAGE_SIZE, 4);
+        const auto image =
+                PlainImageData::create(format, COMPRESSED_IMAGE_SIZE, COMPRESSED_IMAGE_SIZE, 4, pixels.data())
+                        .generateMipmaps();
+        const auto compressed_format = blockCompressedFormat(format);
+
+        for (auto _: state) {
+            const auto compressed = compressBlocks(image, compressed_format, parallel);
+            benchmark::DoNotOptimize(compressed.pixels.data());
+        }
+        // megapixels of all levels per second, the unit encoders are compared in
+        const size_t channels = normal_map ? 2 : 4;
+        const double pixel_count = static_cast<double>(state.iterations() * image.pixels.size_bytes() / channels);
+        state.counters["MP/s"] = benchmark::Counter(pixel_count / 1e6, benchmark::Counter::kIsRate);
+    }
+    BENCHMARK(compress_blocks)
+            ->ArgsProduct({{0, 1}, {0, 1}})
+            ->ArgNames({"normal_map", "parallel"})
+            ->Unit(benchmark::kMillisecond)
+            ->UseRealTime();
+
+    // An uncompressed KTX2 container around the levels, largest level first in the index and in the file
+    std::vector<uint8_t> ktx2_file(const PlainImageData &image) {
+        constexpr std::array<uint8_t, 12> identifier = {
+            0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A
+        };
+        constexpr size_t header_size = 80;
+        constexpr size_t level_entry_size = 3 * sizeof(uint64_t);
+        const size_t data_offset = header_size + image.mipLevels * level_entry_size;
+
+        std::vector<uint8_t> file(data_offset + image.pixels.size_bytes());
+        std::memcpy(file.data(), identifier.data(), identifier.size());
+        const std::array<uint32_t, 9> fields = {
+            static_cast<uint32_t>(image.format), 1, image.width, image.height, 0, 0, 1, image.mipLevels, 0
+        };
+        std::memcpy(file.data() + identifier.size(), fields.data(), sizeof(fields));
+        for (uint32_t level = 0; level < image.mipLevels; level++) {
+            const std::array<uint64_t, 3> entry = {
+                data_offset + image.levelOffset(level),
+                PlainImageData::levelSize(image.format, image.width, image.height, level),
+                PlainImageData::levelSize(image.format, image.width, image.height, level),
+            };
+            std::memcpy(file.data() + header_size + level * level_entry_size, entry.data(), sizeof(entry));
+        }
+        std::memcpy(file.data() + data_offset, image.pixels.data(), image.pixels.size_bytes());
+        return file;
+    }
+
+    void load_ktx2(benchmark::State &state) {
+        const auto image = test_image(vk::Format::eR8G8B8A8Srgb, COMPRESSED_IMAGE_SIZE).generateMipmaps();
+        const auto file = ktx2_file(compressBlocks(image, vk::Format::eBc7SrgbBlock));
+        for (auto _: state) {
+            auto loaded = gltf::loadKtx2(file, vk::Format::eR8G8B8A8Srgb);
+            benchmark::DoNotOptimize(loaded->pixels.data());
+        }
+        state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * file.size()));
+    }
+    BENCHMARK(load_ktx2);
+} // namespace
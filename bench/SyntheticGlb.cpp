@@ -0,0 +1,311 @@
+#include "SyntheticGlb.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <nlohmann/json.hpp>
+#include <string>
+
+#include "Logger.h"
+
+namespace {
+    constexpr uint32_t GLB_MAGIC = 0x46546C67; // "glTF"
+    constexpr uint32_t GLB_CHUNK_JSON = 0x4E4F534A; // "JSON"
+    constexpr uint32_t GLB_CHUNK_BIN = 0x004E4942; // "BIN\0"
+    constexpr uint32_t COMPONENT_FLOAT = 5126;
+    constexpr uint32_t COMPONENT_UNSIGNED_INT = 5125;
+
+    // same constants as the decoder in gltf/Meshopt.cpp
+    constexpr uint8_t MESHOPT_VERTEX_HEADER = 0xa0;
+    constexpr size_t MESHOPT_BLOCK_SIZE_BYTES = 8192;
+    constexpr size_t MESHOPT_BLOCK_MAX_SIZE = 256;
+    constexpr size_t MESHOPT_GROUP_SIZE = 16;
+    constexpr size_t MESHOPT_TAIL_MIN_SIZE = 32;
+
+    struct SyntheticVertex {
+        std::array<float, 3> position;
+        std::array<float, 3> normal;
+        std::array<float, 4> tangent;
+        std::array<float, 2> texCoord;
+    };
+
+    struct SyntheticAttribute {
+        const char *name;
+        const char *type;
+        size_t offset;
+        size_t size;
+    };
+
+    constexpr std::array<SyntheticAttribute, 4> ATTRIBUTES = {{
+        {"POSITION", "VEC3", offsetof(SyntheticVertex, position), sizeof(SyntheticVertex::position)},
+        {"NORMAL", "VEC3", offsetof(SyntheticVertex, normal), sizeof(SyntheticVertex::normal)},
+        {"TANGENT", "VEC4", offsetof(SyntheticVertex, tangent), sizeof(SyntheticVertex::tangent)},
+        {"TEXCOORD_0", "VEC2", offsetof(SyntheticVertex, texCoord), sizeof(SyntheticVertex::texCoord)},
+    }};
+
+    // The attribute of every vertex, one after the other
+    std::vector<uint8_t> pack_attribute(std::span<const uint8_t> vertices, const SyntheticAttribute &attribute) {
+        const size_t count = vertices.size() / sizeof(SyntheticVertex);
+        std::vector<uint8_t> packed(count * attribute.size);
+        for (size_t i = 0; i < count; i++) {
+            std::memcpy(
+                    packed.data() + i * attribute.size, vertices.data() + i * sizeof(SyntheticVertex) + attribute.offset,
+                    attribute.size
+            );
+        }
+        return packed;
+    }
+
+    void append_u32(std::vector<uint8_t> &bytes, uint32_t value) {
+        const auto *raw = reinterpret_cast<const uint8_t *>(&value);
+        bytes.insert(bytes.end(), raw, raw + sizeof(value));
+    }
+
+    // Appends the bytes and pads them to 4 bytes, as every buffer view and GLB chunk must be aligned
+    size_t append_aligned(std::vector<uint8_t> &bytes, std::span<const uint8_t> data, uint8_t padding = 0) {
+        const size_t offset = bytes.size();
+        bytes.insert(bytes.end(), data.begin(), data.end());
+        bytes.resize((bytes.size() + 3) & ~size_t{3}, padding);
+        return offset;
+    }
+
+    // A height field over the grid, so the vertex streams aren't trivially compressible
+    void make_grid(size_t side, float offset, std::vector<SyntheticVertex> &vertices, std::vector<uint32_t> &indices) {
+        vertices.clear();
+        indices.clear();
+        for (size_t z = 0; z < side; z++) {
+            for (size_t x = 0; x < side; x++) {
+                const float fx = static_cast<float>(x) + offset;
+                const float fz = static_cast<float>(z);
+                const float height = std::sin(fx * 0.3f) * std::cos(fz * 0.2f);
+                const float dx = 0.3f * std::cos(fx * 0.3f) * std::cos(fz * 0.2f);
+                const float dz = -0.2f * std::sin(fx * 0.3f) * std::sin(fz * 0.2f);
+                const float normal_length = std::sqrt(dx * dx + 1.0f + dz * dz);
+                const float tangent_length = std::sqrt(1.0f + dx * dx);
+                vertices.push_back({
+                    .position = {fx, height, fz},
+                    .normal = {-dx / normal_length, 1.0f / normal_length, -dz / normal_length},
+                    .tangent = {1.0f / tangent_length, dx / tangent_length, 0.0f, 1.0f},
+                    .texCoord = {static_cast<float>(x) / static_cast<float>(side - 1),
+                                 static_cast<float>(z) / static_cast<float>(side - 1)},
+                });
+            }
+        }
+        for (size_t z = 0; z + 1 < side; z++) {
+            for (size_t x = 0; x + 1 < side; x++) {
+                const auto i = static_cast<uint32_t>(z * side + x);
+                const auto row = static_cast<uint32_t>(side);
+                indices.insert(indices.end(), {i, i + row, i + 1, i + 1, i + row, i + row + 1});
+            }
+        }
+    }
+
+    uint8_t zigzag8(uint8_t delta) { return static_cast<uint8_t>((delta << 1) ^ (static_cast<int8_t>(delta) >> 7)); }
+
+    // Encodes 16 deltas in the smallest of the 2-bit, 4-bit and raw modes, returns the mode
+    uint32_t encode_byte_group(const uint8_t *deltas, std::vector<uint8_t> &out) {
+        if (std::all_of(deltas, deltas + MESHOPT_GROUP_SIZE, [](uint8_t delta) { return delta == 0; }))
+            return 0;
+
+        std::vector<uint8_t> best(deltas, deltas + MESHOPT_GROUP_SIZE);
+        uint32_t best_mode = 3;
+        for (uint32_t mode = 1; mode <= 2; mode++) {
+            const uint32_t bits = mode == 1 ? 2 : 4;
+            const uint32_t per_byte = 8 / bits;
+            const auto escape = static_cast<uint8_t>((1u << bits) - 1);
+            std::vector<uint8_t> encoded(MESHOPT_GROUP_SIZE / per_byte);
+            for (size_t i = 0; i < MESHOPT_GROUP_SIZE; i++) {
+                const uint8_t value = std::min(deltas[i], escape);
+                encoded[i / per_byte] |= static_cast<uint8_t>(value << (8 - bits * (i % per_byte + 1)));
+            }
+            for (size_t i = 0; i < MESHOPT_GROUP_SIZE; i++) {
+                if (deltas[i] >= escape)
+                    encoded.push_back(deltas[i]);
+            }
+            if (encoded.size() < best.size()) {
+                best = std::move(encoded);
+                best_mode = mode;
+            }
+        }
+        out.insert(out.end(), best.begin(), best.end());
+        return best_mode;
+    }
+} // namespace
+
+std::vector<uint8_t> encodeMeshoptVertices(std::span<const uint8_t> vertices, size_t stride) {
+    if (stride == 0 || stride % 4 != 0 || stride > 256)
+        Logger::panic("meshopt vertex stride must be a multiple of 4 up to 256");
+    const size_t count = vertices.size() / stride;
+    std::vector<uint8_t> out = {MESHOPT_VERTEX_HEADER};
+    if (count == 0)
+        return out;
+
+    const size_t block_size =
+            std::min((MESHOPT_BLOCK_SIZE_BYTES / stride) & ~(MESHOPT_GROUP_SIZE - 1), MESHOPT_BLOCK_MAX_SIZE);
+    std::vector<uint8_t> last_vertex(vertices.begin(), vertices.begin() + static_cast<ptrdiff_t>(stride));
+    std::vector<uint8_t> deltas;
+    std::vector<uint8_t> groups;
+    for (size_t first = 0; first < count; first += block_size) {
+        const size_t block_count = std::min(block_size, count - first);
+        const size_t group_count = (block_count + MESHOPT_GROUP_SIZE - 1) / MESHOPT_GROUP_SIZE;
+        for (size_t k = 0; k < stride; k++) {
+            deltas.assign(group_count * MESHOPT_GROUP_SIZE, 0);
+            uint8_t previous = last_vertex[k];
+            for (size_t i = 0; i < block_count; i++) {
+                const uint8_t value = vertices[(first + i) * stride + k];
+                deltas[i] = zigzag8(static_cast<uint8_t>(value - previous));
+                previous = value;
+            }
+            std::vector<uint8_t> header((group_count + 3) / 4);
+            groups.clear();
+            for (size_t i = 0; i < group_count; i++) {
+                const uint32_t mode = encode_byte_group(deltas.data() + i * MESHOPT_GROUP_SIZE, groups);
+                header[i / 4] |= static_cast<uint8_t>(mode << ((i % 4) * 2));
+            }
+            out.insert(out.end(), header.begin(), header.end());
+            out.insert(out.end(), groups.begin(), groups.end());
+        }
+        const auto last = vertices.subspan((first + block_count - 1) * stride, stride);
+        last_vertex.assign(last.begin(), last.end());
+    }
+
+    // the first vertex, padded to the minimum tail size
+    out.resize(out.size() + std::max(stride, MESHOPT_TAIL_MIN_SIZE) - stride);
+    out.insert(out.end(), vertices.begin(), vertices.begin() + static_cast<ptrdiff_t>(stride));
+    return out;
+}
+
+void writeSyntheticGlb(const std::filesystem::path &path, const SyntheticGlbOptions &options) {
+    const size_t side = std::max<size_t>(static_cast<size_t>(std::sqrt(options.verticesPerPrimitive)), 2);
+    constexpr size_t stride = sizeof(SyntheticVertex);
+    nlohmann::json json = {
+        {"asset", {{"version", "2.0"}}},
+        {"scene", 0},
+        {"materials", {{{"pbrMetallicRoughness", {{"metallicFactor", 0.0f}}}}}},
+    };
+    if (options.meshopt) {
+        json["extensionsUsed"] = {"EXT_meshopt_compression"};
+        json["extensionsRequired"] = {"EXT_meshopt_compression"};
+    }
+
+    std::vector<uint8_t> bin;
+    size_t fallback_size = 0;
+    std::vector<SyntheticVertex> vertices;
+    std::vector<uint32_t> indices;
+    auto &views = json["bufferViews"] = nlohmann::json::array();
+    auto &accessors = json["accessors"] = nlohmann::json::array();
+    auto &meshes = json["meshes"] = nlohmann::json::array();
+    auto &nodes = json["nodes"] = nlohmann::json::array();
+    for (size_t p = 0; p < options.primitives; p++) {
+        make_grid(side, static_cast<float>(p * side), vertices, indices);
+        const auto vertex_bytes = std::as_bytes(std::span(vertices));
+        const std::span raw_vertices(reinterpret_cast<const uint8_t *>(vertex_bytes.data()), vertex_bytes.size());
+
+        // Adds a view of vertex data with the stride, returns its index
+        const auto add_vertex_view = [&](std::span<const uint8_t> data, size_t view_stride) {
+            nlohmann::json vertex_view = {{"byteLength", data.size()}};
+            // packed views leave the stride out, like most exporters do
+            if (options.interleaved)
+                vertex_view["byteStride"] = view_stride;
+            if (options.meshopt) {
+                const auto encoded = encodeMeshoptVertices(data, view_stride);
+                vertex_view["buffer"] = 1;
+                vertex_view["byteOffset"] = fallback_size;
+                vertex_view["extensions"]["EXT_meshopt_compression"] = {
+                    {"buffer", 0},
+                    {"byteOffset", append_aligned(bin, encoded)},
+                    {"byteLength", encoded.size()},
+                    {"byteStride", view_stride},
+                    {"count", vertices.size()},
+                    {"mode", "ATTRIBUTES"},
+                };
+                fallback_size += data.size();
+            } else {
+                vertex_view["buffer"] = 0;
+                vertex_view["byteOffset"] = append_aligned(bin, data);
+            }
+            views.push_back(vertex_view);
+            return views.size() - 1;
+        };
+
+        const size_t first_accessor = accessors.size();
+        const auto attribute_accessor = [&](size_t view, size_t offset, const char *type) {
+            accessors.push_back({
+                {"bufferView", view},
+                {"byteOffset", offset},
+                {"componentType", COMPONENT_FLOAT},
+                {"count", vertices.size()},
+                {"type", type},
+            });
+        };
+        if (options.interleaved) {
+            const size_t view = add_vertex_view(raw_vertices, stride);
+            for (const auto &attribute: ATTRIBUTES)
+                attribute_accessor(view, attribute.offset, attribute.type);
+        } else {
+            for (const auto &attribute: ATTRIBUTES) {
+                const size_t view = add_vertex_view(pack_attribute(raw_vertices, attribute), attribute.size);
+                attribute_accessor(view, 0, attribute.type);
+            }
+        }
+
+        const auto index_bytes = std::as_bytes(std::span(indices));
+        const size_t index_offset = append_aligned(
+                bin, std::span(reinterpret_cast<const uint8_t *>(index_bytes.data()), index_bytes.size())
+        );
+        views.push_back({{"buffer", 0}, {"byteOffset", index_offset}, {"byteLength", index_bytes.size()}});
+        accessors.push_back({
+            {"bufferView", views.size() - 1},
+            {"componentType", COMPONENT_UNSIGNED_INT},
+            {"count", indices.size()},
+            {"type", "SCALAR"},
+        });
+
+        meshes.push_back({{"primitives", {{
+            {"attributes", {
+                {ATTRIBUTES[0].name, first_accessor},
+                {ATTRIBUTES[1].name, first_accessor + 1},
+                {ATTRIBUTES[2].name, first_accessor + 2},
+                {ATTRIBUTES[3].name, first_accessor + 3},
+            }},
+            {"indices", first_accessor + 4},
+            {"material", 0},
+        }}}});
+        nodes.push_back({{"mesh", p}});
+    }
+
+    std::vector<size_t> roots(options.primitives);
+    for (size_t i = 0; i < roots.size(); i++)
+        roots[i] = i;
+    json["scenes"] = {{{"nodes", roots}}};
+    json["buffers"] = {{{"byteLength", bin.size()}}};
+    if (options.meshopt) {
+        json["buffers"].push_back({
+            {"byteLength", fallback_size},
+            {"extensions", {{"EXT_meshopt_compression", {{"fallback", true}}}}},
+        });
+    }
+
+    const std::string text = json.dump();
+    std::vector<uint8_t> json_chunk;
+    append_aligned(json_chunk, std::span(reinterpret_cast<const uint8_t *>(text.data()), text.size()), ' ');
+
+    std::vector<uint8_t> glb;
+    append_u32(glb, GLB_MAGIC);
+    append_u32(glb, 2);
+    append_u32(glb, static_cast<uint32_t>(12 + 8 + json_chunk.size() + 8 + bin.size()));
+    append_u32(glb, static_cast<uint32_t>(json_chunk.size()));
+    append_u32(glb, GLB_CHUNK_JSON);
+    glb.insert(glb.end(), json_chunk.begin(), json_chunk.end());
+    append_u32(glb, static_cast<uint32_t>(bin.size()));
+    append_u32(glb, GLB_CHUNK_BIN);
+    glb.insert(glb.end(), bin.begin(), bin.end());
+
+    std::ofstream file(path, std::ios::binary);
+    if (!file)
+        Logger::panic("Failed to open " + path.string());
+    file.write(reinterpret_cast<const char *>(glb.data()), static_cast<std::streamsize>(glb.size()));
+}
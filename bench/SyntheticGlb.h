@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <span>
+#include <vector>
+
+struct SyntheticGlbOptions {
+    size_t primitives = 16;
+    // rounded down to a square grid
+    size_t verticesPerPrimitive = 4096;
+    // compress the vertex streams with EXT_meshopt_compression
+    bool meshopt = false;
+    // all attributes in one buffer view with a byte stride, otherwise a tightly packed view per attribute
+    bool interleaved = true;
+};
+
+/**
+ * Writes a GLB with one mesh and node per primitive. Every primitive is a wavy grid with positions, normals, tangents
+ * and texture coordinates, interleaved or packed, and 32-bit indices. There are no textures.
+ */
+void writeSyntheticGlb(const std::filesystem::path &path, const SyntheticGlbOptions &options);
+
+// Encodes vertices with the EXT_meshopt_compression attribute codec, stride must be a multiple of 4
+std::vector<uint8_t> encodeMeshoptVertices(std::span<const uint8_t> vertices, size_t stride);
@@ -0,0 +1,89 @@
+#include <benchmark/benchmark.h>
+
+#include "ShaderObject.h"
+#include "util/spsc_queue.h"
+#include "util/static_vector.h"
+
+namespace {
+    void static_vector_push_back(benchmark::State &state) {
+        for (auto _: state) {
+            util::static_vector<vk::Viewport, 32> viewports;
+            for (size_t i = 0; i < viewports.capacity(); i++)
+                viewports.push_back({.width = static_cast<float>(i), .height = 1.0f});
+            benchmark::DoNotOptimize(viewports.data());
+        }
+        state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * 32));
+    }
+    BENCHMARK(static_vector_push_back);
+
+    // PipelineConfig copies its static_vectors around by value
+    void static_vector_copy(benchmark::State &state) {
+        util::static_vector<vk::ColorBlendEquationEXT, 32> equations;
+        for (size_t i = 0; i < 8; i++)
+            equations.push_back({.srcColorBlendFactor = vk::BlendFactor::eSrcAlpha});
+        for (auto _: state) {
+            auto copy = equations;
+            benchmark::DoNotOptimize(copy.data());
+        }
+    }
+    BENCHMARK(static_vector_copy);
+
+    void static_vector_erase(benchmark::State &state) {
+        for (auto _: state) {
+            util::static_vector<uint32_t, 32> values;
+            for (uint32_t i = 0; i < values.capacity(); i++)
+                values.push_back(i);
+            while (!values.empty())
+                values.erase(values.begin());
+            benchmark::DoNotOptimize(values.data());
+        }
+    }
+    BENCHMARK(static_vector_erase);
+
+    void static_vector_iterate(benchmark::State &state) {
+        util::static_vector<uint32_t, 32> values;
+        for (uint32_t i = 0; i < values.capacity(); i++)
+            values.push_back(i);
+        for (auto _: state) {
+            uint32_t sum = 0;
+            for (const uint32_t value: values)
+                sum += value;
+            benchmark::DoNotOptimize(sum);
+        }
+    }
+    BENCHMARK(static_vector_iterate);
+
+    void pipeline_config_default(benchmark::State &state) {
+        for (auto _: state) {
+            PipelineConfig config = {};
+            benchmark::DoNotOptimize(&config);
+        }
+    }
+    BENCHMARK(pipeline_config_default);
+
+    // The config the application builds every frame
+    void pipeline_config_frame(benchmark::State &state) {
+        for (auto _: state) {
+            PipelineConfig config = {
+                .viewports = {{vk::Viewport{0.0f, 900.0f, 1600.0f, -900.0f, 0.0f, 1.0f}}},
+                .scissors = {{vk::Rect2D{.extent = {1600, 900}}}},
+                .cullMode = vk::CullModeFlagBits::eNone,
+                .frontFace = vk::FrontFace::eCounterClockwise,
+                .depthCompareOp = vk::CompareOp::eGreaterOrEqual,
+            };
+            benchmark::DoNotOptimize(&config);
+        }
+    }
+    BENCHMARK(pipeline_config_frame);
+
+    void spsc_queue_round_trip(benchmark::State &state) {
+        util::SpscQueue<uint64_t> queue(64);
+        uint64_t value = 0;
+        for (auto _: state) {
+            queue.tryPush(value++);
+            benchmark::DoNotOptimize(queue.tryPop());
+        }
+        state.SetItemsProcessed(static_cast<int64_t>(state.iterations()));
+    }
+    BENCHMARK(spsc_queue_round_trip);
+} // namespace
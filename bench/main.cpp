@@ -0,0 +1,22 @@
+#include <benchmark/benchmark.h>
+#include <string_view>
+#include <vector>
+
+// Same as BENCHMARK_MAIN, but reports JSON unless another format is asked for, so runs can be diffed between versions
+int main(int argc, char **argv) {
+    std::vector<char *> args(argv, argv + argc);
+    bool has_format = false;
+    for (const char *arg: args)
+        has_format |= std::string_view(arg).starts_with("--benchmark_format");
+    char json_format[] = "--benchmark_format=json";
+    if (!has_format)
+        args.push_back(json_format);
+
+    int count = static_cast<int>(args.size());
+    benchmark::Initialize(&count, args.data());
+    if (benchmark::ReportUnrecognizedArguments(count, args.data()))
+        return 1;
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
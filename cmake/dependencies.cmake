@@ -12,6 +12,9 @@ find_package(nlohmann_json CONFIG REQUIRED)
 find_package(VulkanUtilityLibraries CONFIG REQUIRED)
 find_package(cpptrace CONFIG REQUIRED)
 find_package(imgui CONFIG REQUIRED)
+if (BUILD_BENCHMARKS)
+    find_package(benchmark CONFIG REQUIRED)
+endif ()
 
 option(TRACY_ENABLE "" OFF)
 set(TRACY_TIMER_FALLBACK ON)
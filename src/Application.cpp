@@ -1,14 +1,26 @@
 #include "Application.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
 #include <cstring>
+#include <format>
 #include <glfw/glfw3.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtx/fast_trigonometry.hpp>
+#include <numeric>
+#include <optional>
+#include <span>
+#include <utility>
+#include <tuple>
+#include <vector>
 #include <vulkan/vulkan.hpp>
 
+#include "BarrierBatch.h"
 #include "Camera.h"
 #include "CommandPool.h"
+#include "ComputeMipGenerator.h"
 #include "Descriptors.h"
 #include "FrameResource.h"
 #include "Framebuffer.h"
@@ -23,6 +35,11 @@
 #include "debug/Tracy.h"
 #include "glfw/Input.h"
 #include "gltf/Gltf.h"
+#include "gltf/MeshOptimizer.h"
+#include "gltf/Meshlets.h"
+#include "gltf/SceneStream.h"
+#include "gltf/Simplifier.h"
+#include "gltf/VertexQuantization.h"
 #include "imgui/ImGui.h"
 #include "util/buffer_struct.h"
 
@@ -41,21 +58,100 @@ struct TRIVIAL_ABI alignas(16) MaterialUniforms {
     MEMCPY_ASSIGNMENT(MaterialUniforms)
 };
 
-inline Image load_image(Commands &commands, IStagingBuffer &staging, const PlainImageData &data) {
-    auto [buffer, ptr] = staging.upload(commands, data.pixels.size_bytes(), data.pixels.data());
-    Image image = Image::create(staging.allocator(), ImageCreateInfo::from(data));
-    image.barrier(*commands, ImageResourceAccess::TransferWrite);
-    image.load(*commands, 0, {}, buffer);
-    commands.trash += buffer;
-    return image;
+struct TRIVIAL_ABI InstancePushConstants {
+    glm::mat4 model;
+    // dequantization of the positions, unused with float vertices
+    glm::vec4 positionOffset;
+    glm::vec4 positionScale;
+};
+
+// Vertex layout that is uploaded and drawn, the quantized one takes 20 instead of 48 bytes per vertex
+constexpr auto VERTEX_FORMAT = gltf::VertexFormat::Quantized;
+constexpr std::span<const vk::VertexInputBindingDescription2EXT> VERTEX_BINDINGS =
+        VERTEX_FORMAT == gltf::VertexFormat::Quantized ? std::span(gltf::QuantizedVertex::bindingDescriptors)
+                                                       : std::span(gltf::Vertex::bindingDescriptors);
+constexpr std::span<const vk::VertexInputAttributeDescription2EXT> VERTEX_ATTRIBUTES =
+        VERTEX_FORMAT == gltf::VertexFormat::Quantized ? std::span(gltf::QuantizedVertex::attributeDescriptors)
+                                                       : std::span(gltf::Vertex::attributeDescriptors);
+
+// Largest projected error in pixels, that is accepted when picking the LOD of an instance
+constexpr float LOD_PIXEL_ERROR = 1.0f;
+
+// Bytes that are uploaded per frame while the scene streams in, the rest waits for the following frames
+constexpr size_t UPLOAD_BUDGET = 16 * 1024 * 1024;
+
+inline size_t index_size(vk::IndexType index_type) {
+    return index_type == vk::IndexType::eUint16 ? sizeof(uint16_t) : sizeof(uint32_t);
+}
+
+/**
+ * Picks the coarsest index range of the instance which stays within LOD_PIXEL_ERROR.
+ * @param bounding_sphere the world space bounding sphere of the instance
+ * @param pixels_per_unit the size of a world space unit in pixels, at distance one from the camera
+ * @param resident_index_bytes the search stops at the first LOD whose indices reach past this, they aren't uploaded yet
+ * @return index offset and count
+ */
+inline std::tuple<uint32_t, uint32_t> select_lod(
+        const gltf::Instance &instance, const glm::vec4 &bounding_sphere, const Camera &camera, float pixels_per_unit,
+        size_t resident_index_bytes
+) {
+    const float distance = std::max(
+            glm::distance(camera.position, glm::vec3(bounding_sphere)) - bounding_sphere.w, camera.nearPlane()
+    );
+    std::tuple<uint32_t, uint32_t> result = {instance.indexOffset, instance.indexCount};
+    for (uint32_t i = 0; i < instance.lodCount; i++) {
+        const auto &lod = instance.lods[i];
+        if (lod.error * pixels_per_unit > LOD_PIXEL_ERROR * distance ||
+            (size_t{lod.indexOffset} + lod.indexCount) * index_size(instance.indexType) > resident_index_bytes)
+            break;
+        result = {lod.indexOffset, lod.indexCount};
+    }
+    return result;
+}
+
+// A texture to upload, the image may have more levels than data, which are generated afterwards
+struct ImageUpload {
+    const PlainImageData &data;
+    ImageCreateInfo createInfo;
+};
+
+/**
+ * Creates the images and copies the levels of their data. The images share one barrier before the copies and are
+ * left in ImageResourceAccess::TransferWrite, the caller adds the ones after the copies to the batch.
+ */
+inline std::vector<Image> load_images(
+        Commands &commands, IStagingBuffer &staging, std::span<const ImageUpload> uploads, BarrierBatch &barriers
+) {
+    std::vector<Image> images;
+    images.reserve(uploads.size());
+    for (const auto &upload: uploads) {
+        images.push_back(Image::create(staging.allocator(), upload.createInfo));
+        images.back().barrier(barriers, ImageResourceAccess::TransferWrite);
+    }
+    // before staging, which may submit the commands to make room
+    barriers.flush(*commands);
+
+    for (size_t i = 0; i < uploads.size(); i++) {
+        const auto &data = uploads[i].data;
+        auto [buffer, offset, ptr] = staging.upload(commands, data.pixels.size_bytes(), data.pixels.data());
+        for (uint32_t level = 0; level < data.mipLevels; level++)
+            images[i].load(*commands, level, {}, buffer, offset + data.levelOffset(level));
+    }
+    return images;
 }
 
 struct SceneUploadData {
     vk::UniqueSampler sampler;
+    // indexed by texture, the textures that haven't landed yet have no view
     std::vector<Image> images;
     std::vector<vk::UniqueImageView> views;
 
-    std::vector<DescriptorSet> descriptors;
+    // indexed by frame in flight and material. The sets of a frame are only rewritten while it isn't in flight, stale
+    // marks the ones with textures that landed since they were last written.
+    std::vector<std::vector<DescriptorSet>> descriptors;
+    std::vector<std::vector<uint8_t>> staleDescriptors;
+    // textures whose mip chains the ComputeMipGenerator still has to generate, after their first level landed
+    std::vector<size_t> pendingMipmaps;
 
     Image defaultAlbedo;
     vk::UniqueImageView defaultAlbedoView;
@@ -74,26 +170,55 @@ struct SceneUploadData {
     vma::UniqueAllocation texcoordsAlloc;
     vma::UniqueBuffer indices;
     vma::UniqueAllocation indicesAlloc;
+
+    vma::UniqueBuffer meshlets;
+    vma::UniqueAllocation meshletsAlloc;
+    vma::UniqueBuffer meshletVertices;
+    vma::UniqueAllocation meshletVerticesAlloc;
+    vma::UniqueBuffer meshletTriangles;
+    vma::UniqueAllocation meshletTrianglesAlloc;
+
+    // the vertex and index streams are uploaded front to back, everything in front of these is resident
+    size_t residentVertices = 0;
+    size_t residentIndexBytes = 0;
+    // the vertex and index streams and the meshlet tables are completely uploaded
+    bool geometryResident = false;
 };
 
+// The vertices and the full detail indices of the instance are uploaded
+inline bool is_resident(
+        const SceneUploadData &upload, const gltf::Instance &instance, const gltf::Primitive &primitive
+) {
+    return static_cast<size_t>(instance.vertexOffset) + primitive.vertexCount <= upload.residentVertices &&
+           (size_t{instance.indexOffset} + instance.indexCount) * index_size(instance.indexType) <=
+                   upload.residentIndexBytes;
+}
 
-inline auto create_default_resources(Commands &commands, IStagingBuffer &staging) {
+inline auto create_default_resources(Commands &commands, IStagingBuffer &staging, BarrierBatch &barriers) {
+    // the mip chains are filtered on the CPU and go up with the first level
     std::vector<uint8_t> albedo_pixels(16 * 16 * 4);
     std::ranges::fill(albedo_pixels, 0xff);
-    Image default_albedo = load_image(commands, staging, {albedo_pixels, 16, 16, vk::Format::eR8G8B8A8Unorm});
-    default_albedo.generateMipmaps(*commands);
+    const auto albedo = PlainImageData(albedo_pixels, 16, 16, vk::Format::eR8G8B8A8Unorm).generateMipmaps();
 
     std::vector<uint8_t> normal_pixels(16 * 16 * 2);
     std::ranges::fill(normal_pixels, 0x7f);
-    Image default_normal = load_image(commands, staging, {normal_pixels, 16, 16, vk::Format::eR8G8Unorm});
-    default_normal.generateMipmaps(*commands);
+    const auto normal = PlainImageData(normal_pixels, 16, 16, vk::Format::eR8G8Unorm).generateMipmaps();
 
     std::vector<uint8_t> omr_pixels(16 * 16 * 4);
     std::ranges::fill(omr_pixels, 0xff);
-    Image default_omr = load_image(commands, staging, {omr_pixels, 16, 16, vk::Format::eR8G8B8A8Unorm});
-    default_omr.generateMipmaps(*commands);
-
-    return std::tuple{std::move(default_albedo), std::move(default_normal), std::move(default_omr)};
+    const auto omr = PlainImageData(omr_pixels, 16, 16, vk::Format::eR8G8B8A8Unorm).generateMipmaps();
+
+    const std::array<ImageUpload, 3> uploads = {{
+        {albedo, ImageCreateInfo::from(albedo)},
+        {normal, ImageCreateInfo::from(normal)},
+        {omr, ImageCreateInfo::from(omr)},
+    }};
+    auto images = load_images(commands, staging, uploads, barriers);
+    for (auto &image: images)
+        image.barrier(barriers, ImageResourceAccess::FragmentShaderRead);
+    barriers.flush(*commands);
+
+    return std::tuple{std::move(images[0]), std::move(images[1]), std::move(images[2])};
 }
 
 struct MaterialDescriptorSetLayout : DescriptorSetLayoutBase {
@@ -121,19 +246,23 @@ struct SceneDescriptorSetLayout : DescriptorSetLayoutBase {
     ~SceneDescriptorSetLayout() override {}
 };
 
-inline SceneUploadData upload_gltf_data(
-        const AppContext &ctx, gltf::SceneData &gltf_data, DescriptorAllocator &descriptor_allocator
+/**
+ * Creates the buffers, the samplers and the material descriptor sets of the scene and uploads the default textures.
+ * The geometry and the textures are streamed in afterwards by stream_geometry and stream_textures.
+ * @param frame_count frames in flight, each gets its own material descriptor sets
+ * @param barriers records the barriers of the default textures
+ */
+inline SceneUploadData create_scene_upload_data(
+        const AppContext &ctx, Commands &commands, IStagingBuffer &staging, const gltf::SceneData &gltf_data,
+        DescriptorAllocator &descriptor_allocator, int frame_count, BarrierBatch &barriers
 ) {
     SceneUploadData result;
 
     const auto &allocator = *ctx.device.allocator;
     const auto &device = ctx.device.get();
 
-    auto staging = DoubleStagingBuffer(*ctx.device.allocator, device, 64000000);
-    auto commands = Commands(device, ctx.device.mainQueue, ctx.device.mainQueueFamily, Commands::UseMode::Single);
-    commands.begin();
-
-    std::tie(result.defaultAlbedo, result.defaultNormal, result.defaultOmr) = create_default_resources(commands, staging);
+    std::tie(result.defaultAlbedo, result.defaultNormal, result.defaultOmr) =
+            create_default_resources(commands, staging, barriers);
     result.defaultAlbedoView = result.defaultAlbedo.createDefaultView(device);
     result.defaultNormalView = result.defaultNormal.createDefaultView(device);
     result.defaultOmrView = result.defaultOmr.createDefaultView(device);
@@ -149,59 +278,17 @@ inline SceneUploadData upload_gltf_data(
              .borderColor = vk::BorderColor::eFloatOpaqueBlack}
     );
 
-    result.images.reserve(gltf_data.images.size());
-    result.views.reserve(gltf_data.images.size());
-    for (const auto &image_data: gltf_data.images) {
-        if (image_data.pixels.empty()) {
-            result.views.emplace_back() = result.defaultAlbedo.createDefaultView(device);
-            continue;
-        }
-        auto &image = result.images.emplace_back();
-        image = load_image(commands, staging, image_data);
-        image.generateMipmaps(*commands);
-        image.barrier(*commands, ImageResourceAccess::FragmentShaderRead);
-
-        result.views.emplace_back() = image.createDefaultView(device);
-    }
-
-    commands.submit();
-    commands.begin();
+    result.images.resize(gltf_data.images.size());
+    result.views.resize(gltf_data.images.size());
 
     auto descriptor_layout = MaterialDescriptorSetLayout(device);
-    result.descriptors.reserve(gltf_data.materials.size());
-    for (auto &material: gltf_data.materials) {
-        result.descriptors.emplace_back() = descriptor_allocator.allocate(descriptor_layout);
-        const auto &descriptor_set = result.descriptors.back();
-        vk::DescriptorImageInfo albedo_image_info = {
-            .sampler = *result.sampler,
-            .imageView = material.albedo == -1 ? *result.defaultAlbedoView : *result.views.at(material.albedo),
-            .imageLayout = vk::ImageLayout::eReadOnlyOptimal
-        };
-        vk::DescriptorImageInfo normal_image_info = {
-            .sampler = *result.sampler,
-            .imageView = material.normal == -1 ? *result.defaultNormalView : *result.views.at(material.normal),
-            .imageLayout = vk::ImageLayout::eReadOnlyOptimal
-        };
-        vk::DescriptorImageInfo omr_image_info = {
-            .sampler = *result.sampler,
-            .imageView = material.omr == -1 ? *result.defaultOmrView : *result.views.at(material.omr),
-            .imageLayout = vk::ImageLayout::eReadOnlyOptimal
-        };
-        MaterialUniforms material_uniforms = {
-            .albedoFectors = material.albedoFactor,
-            .mrnFactors = glm::vec4(material.metaillicFactor, material.roughnessFactor, material.normalFactor, 0.0),
-        };
-        vk::WriteDescriptorSetInlineUniformBlock mat_info = {.dataSize = sizeof(MaterialUniforms), .pData = &material_uniforms};
-        device.updateDescriptorSets(
-                {
-                    descriptor_set.write(MaterialDescriptorSetLayout::Albedo, albedo_image_info),
-                    descriptor_set.write(MaterialDescriptorSetLayout::Normal, normal_image_info),
-                    descriptor_set.write(MaterialDescriptorSetLayout::Omr, omr_image_info),
-                    descriptor_set.write(MaterialDescriptorSetLayout::MaterialFactors, mat_info),
-                },
-                {}
-        );
+    result.descriptors.resize(frame_count);
+    for (auto &frame_descriptors: result.descriptors) {
+        frame_descriptors.reserve(gltf_data.materials.size());
+        for (size_t i = 0; i < gltf_data.materials.size(); i++)
+            frame_descriptors.emplace_back() = descriptor_allocator.allocate(descriptor_layout);
     }
+    result.staleDescriptors.assign(frame_count, std::vector<uint8_t>(gltf_data.materials.size(), true));
 
     vma::AllocationCreateInfo allocation_create_info = {
         .usage = vma::MemoryUsage::eAutoPreferDevice,
@@ -227,15 +314,206 @@ inline SceneUploadData upload_gltf_data(
             allocation_create_info
     );
 
-    staging.upload(commands, gltf_data.vertex_position_data, *result.positions);
-    staging.upload(commands, gltf_data.vertex_normal_data, *result.normals);
-    staging.upload(commands, gltf_data.vertex_tangent_data, *result.tangents);
-    staging.upload(commands, gltf_data.vertex_texcoord_data, *result.texcoords);
-    staging.upload(commands, gltf_data.index_data, *result.indices);
-    commands.submit();
+    // cluster table for culling, not read by any shader yet
+    if (!gltf_data.meshlets.empty()) {
+        auto storage_usage = vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst;
+        std::tie(result.meshlets, result.meshletsAlloc) = allocator.createBufferUnique(
+                {.size = gltf_data.meshlets.size() * sizeof(gltf::Meshlet), .usage = storage_usage},
+                allocation_create_info
+        );
+        std::tie(result.meshletVertices, result.meshletVerticesAlloc) = allocator.createBufferUnique(
+                {.size = gltf_data.meshlet_vertex_data.size() * sizeof(uint32_t), .usage = storage_usage},
+                allocation_create_info
+        );
+        std::tie(result.meshletTriangles, result.meshletTrianglesAlloc) = allocator.createBufferUnique(
+                {.size = gltf_data.meshlet_triangle_data.size() * sizeof(uint32_t), .usage = storage_usage},
+                allocation_create_info
+        );
+    }
     return result;
 }
 
+/**
+ * Uploads the next part of the vertex and index streams. Both advance at the same rate relative to their size, so
+ * the primitives at their front become resident together. The meshlet tables follow in one go once they are done.
+ * @param budget bytes that may still be uploaded this frame, reduced by the uploaded ones
+ * @param barriers gets the barriers that make the copies visible to the vertex input, the caller flushes them
+ */
+inline void stream_geometry(
+        Commands &commands, IStagingBuffer &staging, const gltf::SceneData &gltf_data, SceneUploadData &upload,
+        size_t &budget, BarrierBatch &barriers
+) {
+    // the copies are read by the draws of this frame
+    const auto copied = [&barriers](
+                                vk::Buffer buffer, size_t offset, size_t size, vk::PipelineStageFlags2 stage,
+                                vk::AccessFlags2 access
+                        ) {
+        barriers.add(vk::BufferMemoryBarrier2{
+            .srcStageMask = vk::PipelineStageFlagBits2::eCopy,
+            .srcAccessMask = vk::AccessFlagBits2::eTransferWrite,
+            .dstStageMask = stage,
+            .dstAccessMask = access,
+            .srcQueueFamilyIndex = vk::QueueFamilyIgnored,
+            .dstQueueFamilyIndex = vk::QueueFamilyIgnored,
+            .buffer = buffer,
+            .offset = offset,
+            .size = size,
+        });
+    };
+    const std::array<std::pair<std::span<const unsigned char>, vk::Buffer>, 4> vertex_streams = {{
+        {gltf_data.vertex_position_data, *upload.positions},
+        {gltf_data.vertex_normal_data, *upload.normals},
+        {gltf_data.vertex_tangent_data, *upload.tangents},
+        {gltf_data.vertex_texcoord_data, *upload.texcoords},
+    }};
+    size_t vertex_size = 0;
+    for (const auto &binding: VERTEX_BINDINGS)
+        vertex_size += binding.stride;
+    const size_t vertex_count = gltf_data.vertex_position_data.size() / VERTEX_BINDINGS[0].stride;
+    const size_t vertex_bytes = vertex_count * vertex_size;
+    const size_t index_bytes = gltf_data.index_data.size();
+
+    if (upload.residentVertices < vertex_count) {
+        const auto vertex_budget =
+                static_cast<size_t>(budget * (static_cast<double>(vertex_bytes) / (vertex_bytes + index_bytes)));
+        const size_t vertices =
+                std::min(vertex_count - upload.residentVertices, std::max<size_t>(vertex_budget / vertex_size, 1));
+        for (size_t i = 0; i < vertex_streams.size(); i++) {
+            const size_t stride = VERTEX_BINDINGS[i].stride;
+            const size_t offset = upload.residentVertices * stride;
+            staging.upload(
+                    commands, vertex_streams[i].first.subspan(offset, vertices * stride), vertex_streams[i].second,
+                    offset
+            );
+            copied(
+                    vertex_streams[i].second, offset, vertices * stride,
+                    vk::PipelineStageFlagBits2::eVertexAttributeInput, vk::AccessFlagBits2::eVertexAttributeRead
+            );
+        }
+        upload.residentVertices += vertices;
+        budget -= std::min(budget, vertices * vertex_size);
+    }
+    if (upload.residentIndexBytes < index_bytes && budget > 0) {
+        const size_t size = std::min(index_bytes - upload.residentIndexBytes, budget);
+        staging.upload(
+                commands, std::span(gltf_data.index_data).subspan(upload.residentIndexBytes, size), *upload.indices,
+                upload.residentIndexBytes
+        );
+        copied(
+                *upload.indices, upload.residentIndexBytes, size, vk::PipelineStageFlagBits2::eIndexInput,
+                vk::AccessFlagBits2::eIndexRead
+        );
+        upload.residentIndexBytes += size;
+        budget -= size;
+    }
+    if (upload.residentVertices < vertex_count || upload.residentIndexBytes < index_bytes)
+        return;
+
+    // not read by any shader yet, so they need no barrier
+    if (!gltf_data.meshlets.empty()) {
+        staging.upload(commands, gltf_data.meshlets, *upload.meshlets);
+        staging.upload(commands, gltf_data.meshlet_vertex_data, *upload.meshletVertices);
+        staging.upload(commands, gltf_data.meshlet_triangle_data, *upload.meshletTriangles);
+    }
+    upload.geometryResident = true;
+}
+
+/**
+ * Uploads the textures that landed and marks the descriptor sets of the materials using them as stale. They share
+ * one barrier before and one after the copies.
+ * @param mip_generator generates the missing mip chains, the loader only leaves out those it supports. Their textures
+ * are added to SceneUploadData::pendingMipmaps.
+ * @param barriers the batch the barriers after the copies are flushed with
+ */
+inline void stream_textures(
+        const vk::Device &device, Commands &commands, IStagingBuffer &staging, const gltf::SceneData &gltf_data,
+        SceneUploadData &upload, std::span<const gltf::StreamedTexture> textures,
+        const ComputeMipGenerator *mip_generator, BarrierBatch &barriers
+) {
+    std::vector<uint8_t> gpu_mipmaps(textures.size());
+    std::vector<ImageUpload> uploads;
+    uploads.reserve(textures.size());
+    for (size_t i = 0; i < textures.size(); i++) {
+        const auto &data = textures[i].image;
+        const auto create_info = ImageCreateInfo::from(data);
+        if (!data.needsMipmaps()) {
+            uploads.push_back({data, create_info});
+            continue;
+        }
+        // filtering them here would stall the frames, the streaming threads do it
+        if (!mip_generator || !mip_generator->supports(create_info))
+            Logger::panic(std::format("Texture {} has no mip chain and the GPU can't generate it", textures[i].index));
+        uploads.push_back({data, mip_generator->prepare(create_info)});
+        gpu_mipmaps[i] = true;
+    }
+    auto images = load_images(commands, staging, uploads, barriers);
+
+    for (size_t i = 0; i < textures.size(); i++) {
+        const size_t index = textures[i].index;
+        auto &image = upload.images.at(index);
+        image = std::move(images[i]);
+        if (gpu_mipmaps[i])
+            upload.pendingMipmaps.push_back(index);
+        else
+            image.barrier(barriers, ImageResourceAccess::FragmentShaderRead);
+        upload.views[index] = image.createDefaultView(device);
+
+        const int texture_index = static_cast<int>(index);
+        for (const auto &material: gltf_data.materials) {
+            if (material.albedo != texture_index && material.normal != texture_index && material.omr != texture_index)
+                continue;
+            for (auto &stale: upload.staleDescriptors)
+                stale[material.index] = true;
+        }
+    }
+    barriers.flush(*commands);
+}
+
+// Rewrites the stale material descriptor sets of the frame, the default textures stand in for the missing ones
+inline void write_material_descriptors(
+        const vk::Device &device, SceneUploadData &upload, const gltf::SceneData &gltf_data, int frame
+) {
+    const auto texture_view = [&upload](int texture, const vk::UniqueImageView &fallback) {
+        return texture == -1 || !upload.views[texture] ? *fallback : *upload.views[texture];
+    };
+    for (const auto &material: gltf_data.materials) {
+        if (!upload.staleDescriptors[frame][material.index])
+            continue;
+        upload.staleDescriptors[frame][material.index] = false;
+
+        const auto &descriptor_set = upload.descriptors[frame][material.index];
+        vk::DescriptorImageInfo albedo_image_info = {
+            .sampler = *upload.sampler,
+            .imageView = texture_view(material.albedo, upload.defaultAlbedoView),
+            .imageLayout = vk::ImageLayout::eReadOnlyOptimal
+        };
+        vk::DescriptorImageInfo normal_image_info = {
+            .sampler = *upload.sampler,
+            .imageView = texture_view(material.normal, upload.defaultNormalView),
+            .imageLayout = vk::ImageLayout::eReadOnlyOptimal
+        };
+        vk::DescriptorImageInfo omr_image_info = {
+            .sampler = *upload.sampler,
+            .imageView = texture_view(material.omr, upload.defaultOmrView),
+            .imageLayout = vk::ImageLayout::eReadOnlyOptimal
+        };
+        MaterialUniforms material_uniforms = {
+            .albedoFectors = material.albedoFactor,
+            .mrnFactors = glm::vec4(material.metaillicFactor, material.roughnessFactor, material.normalFactor, 0.0),
+        };
+        vk::WriteDescriptorSetInlineUniformBlock mat_info = {.dataSize = sizeof(MaterialUniforms), .pData = &material_uniforms};
+        device.updateDescriptorSets(
+                {
+                    descriptor_set.write(MaterialDescriptorSetLayout::Albedo, albedo_image_info),
+                    descriptor_set.write(MaterialDescriptorSetLayout::Normal, normal_image_info),
+                    descriptor_set.write(MaterialDescriptorSetLayout::Omr, omr_image_info),
+                    descriptor_set.write(MaterialDescriptorSetLayout::MaterialFactors, mat_info),
+                },
+                {}
+        );
+    }
+}
+
 Application::Application(AppContext &ctx) : ctx(ctx), input_(*ctx.window.input) {};
 
 Application::~Application() = default;
@@ -246,10 +524,15 @@ void Application::loadShader() {
 
     ShaderInterfaceLayout shader_layout = {
         .descriptorSetLayouts = {scene_layout.layout, material_layout.layout},
-        .pushConstantRanges = {{.stageFlags = vk::ShaderStageFlagBits::eVertex, .offset = 0, .size = sizeof(glm::mat4)}}
+        .pushConstantRanges = {
+                {.stageFlags = vk::ShaderStageFlagBits::eVertex, .offset = 0, .size = sizeof(InstancePushConstants)}
+        }
     };
 
-    auto vert_sh = shaderLoader_->load("assets/shaders/test.vert");
+    auto vert_sh = shaderLoader_->load(
+            VERTEX_FORMAT == gltf::VertexFormat::Quantized ? "assets/shaders/test_quantized.vert"
+                                                           : "assets/shaders/test.vert"
+    );
     auto frag_sh = shaderLoader_->load("assets/shaders/test.frag");
     shader_ = std::make_unique<Shader>(
             ctx.device.get(), std::initializer_list<ShaderStage>{vert_sh, frag_sh},
@@ -316,8 +599,48 @@ void Application::run() {
 
     auto scene_descriptor_layout = SceneDescriptorSetLayout(device);
 
-    gltf::SceneData gltf_data = gltf::load("assets/models/sponza.glb");
-    auto scene_data = upload_gltf_data(ctx, gltf_data, descriptor_allocator);
+    shaderLoader_ = std::make_unique<ShaderLoader>();
+#ifndef NDEBUG
+    shaderLoader_->debug = true;
+#endif
+    loadShader();
+
+    // generates the mip chains of the uncompressed textures, unless the device can't run it
+    auto mip_generator = ComputeMipGenerator::create(ctx.device, *shaderLoader_);
+    std::optional<Commands> mip_commands;
+    if (mip_generator)
+        mip_commands.emplace(device, mip_generator->queue(), mip_generator->queueFamily(), Commands::UseMode::Single);
+
+    // the scene is empty until the stream delivers it, the first frames don't wait for it
+    // without BC support the textures stay uncompressed and the KTX2 ones are left out
+    const bool block_compression = ctx.device.enabledFeatures.textureCompressionBC;
+    const gltf::LoadOptions load_options = {
+        .compressTextures = block_compression,
+        .ktx2Textures = block_compression,
+        // the others are filtered on the streaming threads
+        .gpuMipmapFormats = mip_generator ? mip_generator->formats() : std::vector<vk::Format>{},
+        .gpuMipmapMaxSize = ComputeMipGenerator::MAX_SIZE,
+    };
+    gltf::SceneStream scene_stream("assets/models/sponza.glb", load_options, [](gltf::SceneData &scene) {
+        gltf::optimizeMeshes(scene);
+        gltf::buildMeshlets(scene);
+        gltf::generateLods(scene);
+        if constexpr (VERTEX_FORMAT == gltf::VertexFormat::Quantized)
+            gltf::quantizeVertices(scene);
+    });
+    gltf::SceneData gltf_data;
+    std::optional<SceneUploadData> scene_data;
+    std::vector<uint32_t> draw_order;
+    bool scene_streaming = true;
+    // the barriers of the last upload, of the frame being recorded and of the one before it
+    BarrierStats upload_barrier_stats = {};
+    BarrierStats frame_barrier_stats = {};
+    BarrierStats last_frame_barrier_stats = {};
+    // the timeline value of the last mip generation, the frames sample its images once the compute queue reached it
+    uint64_t mip_value = 0;
+    auto staging = RingStagingBuffer(allocator, 64000000);
+    auto upload_commands =
+            Commands(device, ctx.device.mainQueue, ctx.device.mainQueueFamily, Commands::UseMode::Single);
 
     auto frame_resources = FrameResourceManager(ctx.swapchain->imageCount());
     auto uniform_buffers = frame_resources.create([&] { return UnifromBuffer<SceneUniforms>(allocator); });
@@ -335,12 +658,6 @@ void Application::run() {
         );
     });
 
-    shaderLoader_ = std::make_unique<ShaderLoader>();
-#ifndef NDEBUG
-    shaderLoader_->debug = true;
-#endif
-    loadShader();
-
     const auto create_semaphore = [&] {
         return device.createSemaphoreUnique(vk::SemaphoreCreateInfo{});
     };
@@ -392,6 +709,66 @@ void Application::run() {
             device.resetFences({in_flight_fence});
         }
 
+        if (scene_streaming) {
+            ZoneScopedN("Stream Scene");
+            std::optional<gltf::SceneData> loaded = scene_data ? std::nullopt : scene_stream.pollScene();
+            if (loaded || scene_data) {
+                upload_barrier_stats = {};
+                BarrierBatch upload_barriers(&upload_barrier_stats);
+                upload_commands.begin();
+                if (loaded) {
+                    gltf_data = std::move(*loaded);
+                    scene_data = create_scene_upload_data(
+                            ctx, upload_commands, staging, gltf_data, descriptor_allocator, frame_resources.size(),
+                            upload_barriers
+                    );
+                    // group the draws by index type, so the index buffer is only rebound once per frame. The
+                    // instances stay in place, SceneData::instance_bounds is indexed like them.
+                    draw_order.resize(gltf_data.instances.size());
+                    std::iota(draw_order.begin(), draw_order.end(), 0);
+                    std::ranges::stable_partition(draw_order, [&gltf_data](uint32_t instance) {
+                        return gltf_data.instances[instance].indexType == vk::IndexType::eUint16;
+                    });
+                }
+
+                size_t budget = UPLOAD_BUDGET;
+                stream_geometry(upload_commands, staging, gltf_data, *scene_data, budget, upload_barriers);
+                std::vector<gltf::StreamedTexture> textures;
+                while (budget > 0) {
+                    auto texture = scene_stream.pollTexture();
+                    if (!texture)
+                        break;
+                    budget -= std::min(budget, texture->image.pixels.size_bytes());
+                    textures.push_back(std::move(*texture));
+                }
+                stream_textures(
+                        device, upload_commands, staging, gltf_data, *scene_data, textures, mip_generator.get(),
+                        upload_barriers
+                );
+                upload_barriers.flush(*upload_commands);
+                // doesn't wait, the frame is submitted to the same queue after the copies and their barriers order
+                // the draws after them. Only the staging ring waits, when it runs out of free segments.
+                const uint64_t upload_value = upload_commands.submitAsync();
+                // on the compute queue after the copies finished, so their first levels are there
+                if (!scene_data->pendingMipmaps.empty()) {
+                    ZoneScopedN("Generate Mipmaps");
+                    std::vector<Image *> images;
+                    for (auto index: scene_data->pendingMipmaps)
+                        images.push_back(&scene_data->images[index]);
+                    mip_commands->begin();
+                    mip_generator->generate(**mip_commands, images, mip_commands->trash, &upload_barrier_stats);
+                    const auto upload_wait =
+                            upload_commands.waitInfo(upload_value, vk::PipelineStageFlagBits2::eAllCommands);
+                    // doesn't wait either, the frames wait for mip_value on the device
+                    mip_value = mip_commands->submitAsync(std::span(&upload_wait, 1));
+                    scene_data->pendingMipmaps.clear();
+                }
+                scene_streaming = !scene_data->geometryResident || !scene_stream.finished();
+            }
+        }
+        if (scene_data)
+            write_material_descriptors(device, *scene_data, gltf_data, frame_resources.frame());
+
         //
         // Start of rendering and application code
         //
@@ -424,18 +801,20 @@ void Application::run() {
             auto &framebuffer = framebuffers.current();
             framebuffer.colorAttachments[0].image = swapchain.colorImage();
             framebuffer.colorAttachments[0].view = swapchain.colorViewSrgb();
-            framebuffer.barrierColor(cmd_buf, ImageResourceAccess::ColorAttachmentWrite);
+            BarrierBatch frame_barriers(&frame_barrier_stats);
+            framebuffer.barrierColor(frame_barriers, ImageResourceAccess::ColorAttachmentWrite);
             framebuffer.barrierDepth(
-                    cmd_buf, ImageResourceAccess::DepthAttachmentRead, ImageResourceAccess::DepthAttachmentWrite
+                    frame_barriers, ImageResourceAccess::DepthAttachmentRead, ImageResourceAccess::DepthAttachmentWrite
             );
+            frame_barriers.flush(cmd_buf);
             cmd_buf.beginRendering(framebuffer.renderingInfo(
                     swapchain.area(),
                     {.colorLoadOps = {vk::AttachmentLoadOp::eClear}, .depthLoadOp = vk::AttachmentLoadOp::eClear}
             ));
 
             PipelineConfig pipeline_config = {
-                .vertexBindingDescriptions = gltf::Vertex::bindingDescriptors,
-                .vertexAttributeDescriptions = gltf::Vertex::attributeDescriptors,
+                .vertexBindingDescriptions = VERTEX_BINDINGS,
+                .vertexAttributeDescriptions = VERTEX_ATTRIBUTES,
                 .viewports = {{vk::Viewport{0.0f, swapchain.height(), swapchain.width(), -swapchain.height(), 0.0f, 1.0f}}},
                 .scissors = {{swapchain.area()}},
                 .cullMode = vk::CullModeFlagBits::eNone,
@@ -445,45 +824,98 @@ void Application::run() {
             pipeline_config.apply(cmd_buf, shader_->stageFlags());
 
             cmd_buf.bindShadersEXT(shader_->stages(), shader_->shaders());
-            cmd_buf.bindVertexBuffers(
-                    0, {*scene_data.positions, *scene_data.normals, *scene_data.tangents, *scene_data.texcoords},
-                    {0, 0, 0, 0}
-            );
-            cmd_buf.bindIndexBuffer(*scene_data.indices, 0, vk::IndexType::eUint32);
+            if (scene_data) {
+                cmd_buf.bindVertexBuffers(
+                        0,
+                        {*scene_data->positions, *scene_data->normals, *scene_data->tangents, *scene_data->texcoords},
+                        {0, 0, 0, 0}
+                );
+            }
             shader_->bindDescriptorSet(cmd_buf, 0, scene_descriptor_sets.current().set);
 
-            for (const auto &instance: gltf_data.instances) {
-                shader_->bindDescriptorSet(cmd_buf, 1, scene_data.descriptors[instance.material.index].set);
+            const float pixels_per_unit = swapchain.height() / (2.0f * std::tan(camera.fov() / 2.0f));
+            std::optional<vk::IndexType> bound_index_type;
+            for (const uint32_t instance_index: draw_order) {
+                const auto &instance = gltf_data.instances[instance_index];
+                const auto &primitive = gltf_data.primitives[instance.primitive];
+                // the geometry lands front to back, the instances further back follow in later frames
+                if (!is_resident(*scene_data, instance, primitive))
+                    continue;
+                if (bound_index_type != instance.indexType) {
+                    // offsets are in elements of the index type, so the buffer is always bound at 0
+                    cmd_buf.bindIndexBuffer(*scene_data->indices, 0, instance.indexType);
+                    bound_index_type = instance.indexType;
+                }
+                shader_->bindDescriptorSet(
+                        cmd_buf, 1, scene_data->descriptors[frame_resources.frame()][instance.material.index].set
+                );
 
+                InstancePushConstants push_constants = {
+                    .model = instance.transformation,
+                    .positionOffset = glm::vec4(primitive.quantizationOffset, 0.0f),
+                    .positionScale = glm::vec4(primitive.quantizationScale, 0.0f),
+                };
                 cmd_buf.pushConstants(
-                        shader_->pipelineLayout(), vk::ShaderStageFlagBits::eVertex, 0, sizeof(glm::mat4), &instance.transformation
+                        shader_->pipelineLayout(), vk::ShaderStageFlagBits::eVertex, 0, sizeof(push_constants),
+                        &push_constants
+                );
+                auto [index_offset, index_count] = select_lod(
+                        instance, gltf_data.instance_bounds.spheres[instance_index], camera, pixels_per_unit,
+                        scene_data->residentIndexBytes
                 );
-                cmd_buf.drawIndexed(instance.indexCount, 1, instance.indexOffset, instance.vertexOffset, 0);
+                cmd_buf.drawIndexed(index_count, 1, index_offset, instance.vertexOffset, 0);
             }
             cmd_buf.endRendering();
 
             frame_times.update(input.timeDelta());
             frame_times.draw();
+            // appended to the window of the frame times
+            ImGui::Begin("Performance");
+            ImGui::Text(
+                    "Barriers - frame %u calls, upload %u calls (%u of %u merged)", last_frame_barrier_stats.calls,
+                    upload_barrier_stats.calls, upload_barrier_stats.added - upload_barrier_stats.barriers,
+                    upload_barrier_stats.added
+            );
+            const auto &staging_stats = staging.stats();
+            ImGui::Text(
+                    "Staging - %.1f MB/s, %u stalls (%.1f ms)", staging_stats.bytesPerSecond() / 1e6,
+                    staging_stats.stalls,
+                    std::chrono::duration<double, std::milli>(staging_stats.stallTime).count()
+            );
+            ImGui::End();
 
             framebuffer.colorAttachments[0].view = swapchain.colorViewLinear();
             cmd_buf.beginRendering(framebuffer.renderingInfo(swapchain.area(), {}));
             im_gui_backend.render(cmd_buf);
             cmd_buf.endRendering();
 
-            framebuffer.barrierColor(cmd_buf, ImageResourceAccess::PresentSrc);
+            framebuffer.barrierColor(frame_barriers, ImageResourceAccess::PresentSrc);
+            frame_barriers.flush(cmd_buf);
+            last_frame_barrier_stats = std::exchange(frame_barrier_stats, {});
         }
         cmd_buf.end();
 
         {
             ZoneScopedN("Submit & Present");
             auto &render_finished_semaphore = render_finished_semaphores.current();
-            vk::PipelineStageFlags pipe_stage_flags = vk::PipelineStageFlagBits::eColorAttachmentOutput;
-            vk::SubmitInfo submit_info = vk::SubmitInfo()
-                                                 .setCommandBuffers(cmd_buf)
-                                                 .setWaitSemaphores(image_available_semaphore)
-                                                 .setWaitDstStageMask(pipe_stage_flags)
-                                                 .setSignalSemaphores(render_finished_semaphore);
-            ctx.device.mainQueue.submit({submit_info}, in_flight_fence);
+            std::vector<vk::SemaphoreSubmitInfo> wait_infos = {{
+                .semaphore = image_available_semaphore,
+                .stageMask = vk::PipelineStageFlagBits2::eColorAttachmentOutput,
+            }};
+            // only the fragment shaders sample the textures, the work before them overlaps the mip generation
+            if (mip_commands)
+                wait_infos.push_back(mip_commands->waitInfo(mip_value, vk::PipelineStageFlagBits2::eFragmentShader));
+            const vk::CommandBufferSubmitInfo command_buffer_info = {.commandBuffer = cmd_buf};
+            const vk::SemaphoreSubmitInfo signal_info = {
+                .semaphore = render_finished_semaphore, .stageMask = vk::PipelineStageFlagBits2::eAllCommands
+            };
+            ctx.device.mainQueue.submit2(
+                    vk::SubmitInfo2()
+                            .setWaitSemaphoreInfos(wait_infos)
+                            .setCommandBufferInfos(command_buffer_info)
+                            .setSignalSemaphoreInfos(signal_info),
+                    in_flight_fence
+            );
 
             swapchain.present(ctx.device.mainQueue, vk::PresentInfoKHR().setWaitSemaphores(render_finished_semaphore));
         }
@@ -0,0 +1,152 @@
+#include "BarrierBatch.h"
+
+#include <algorithm>
+
+#include "Logger.h"
+
+namespace {
+    template<typename Barrier>
+    bool same_masks(const Barrier &a, const Barrier &b) {
+        return a.srcStageMask == b.srcStageMask && a.srcAccessMask == b.srcAccessMask &&
+               a.dstStageMask == b.dstStageMask && a.dstAccessMask == b.dstAccessMask;
+    }
+
+    template<typename Barrier>
+    void merge_masks(Barrier &into, const Barrier &other) {
+        into.srcStageMask |= other.srcStageMask;
+        into.srcAccessMask |= other.srcAccessMask;
+        into.dstStageMask |= other.dstStageMask;
+        into.dstAccessMask |= other.dstAccessMask;
+    }
+
+    template<typename Barrier>
+    bool same_queue_families(const Barrier &a, const Barrier &b) {
+        return a.srcQueueFamilyIndex == b.srcQueueFamilyIndex && a.dstQueueFamilyIndex == b.dstQueueFamilyIndex;
+    }
+
+    // end of the range, vk::WholeSize if it reaches to the end of the buffer
+    vk::DeviceSize range_end(const vk::BufferMemoryBarrier2 &barrier) {
+        return barrier.size == vk::WholeSize ? vk::WholeSize : barrier.offset + barrier.size;
+    }
+
+    bool merge_buffer(vk::BufferMemoryBarrier2 &into, const vk::BufferMemoryBarrier2 &other) {
+        if (into.buffer != other.buffer || !same_queue_families(into, other))
+            return false;
+        if (into.offset == other.offset && into.size == other.size) {
+            merge_masks(into, other);
+            return true;
+        }
+        // overlapping or touching ranges become their union
+        if (!same_masks(into, other) || other.offset > range_end(into) || into.offset > range_end(other))
+            return false;
+        const auto end = std::max(range_end(into), range_end(other));
+        into.offset = std::min(into.offset, other.offset);
+        into.size = end == vk::WholeSize ? vk::WholeSize : end - into.offset;
+        return true;
+    }
+
+    bool same_range(const vk::ImageSubresourceRange &a, const vk::ImageSubresourceRange &b) {
+        return a.aspectMask == b.aspectMask && a.baseMipLevel == b.baseMipLevel && a.levelCount == b.levelCount &&
+               a.baseArrayLayer == b.baseArrayLayer && a.layerCount == b.layerCount;
+    }
+
+    // Extends into by other, if their union is a range as well. Counts must not be the remaining ones.
+    bool merge_neighbour_range(vk::ImageSubresourceRange &into, const vk::ImageSubresourceRange &other) {
+        if (into.aspectMask != other.aspectMask || into.levelCount == vk::RemainingMipLevels ||
+            other.levelCount == vk::RemainingMipLevels || into.layerCount == vk::RemainingArrayLayers ||
+            other.layerCount == vk::RemainingArrayLayers)
+            return false;
+        if (into.baseArrayLayer == other.baseArrayLayer && into.layerCount == other.layerCount) {
+            if (into.baseMipLevel + into.levelCount == other.baseMipLevel) {
+                into.levelCount += other.levelCount;
+                return true;
+            }
+            if (other.baseMipLevel + other.levelCount == into.baseMipLevel) {
+                into.baseMipLevel = other.baseMipLevel;
+                into.levelCount += other.levelCount;
+                return true;
+            }
+        }
+        if (into.baseMipLevel == other.baseMipLevel && into.levelCount == other.levelCount) {
+            if (into.baseArrayLayer + into.layerCount == other.baseArrayLayer) {
+                into.layerCount += other.layerCount;
+                return true;
+            }
+            if (other.baseArrayLayer + other.layerCount == into.baseArrayLayer) {
+                into.baseArrayLayer = other.baseArrayLayer;
+                into.layerCount += other.layerCount;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool merge_image(vk::ImageMemoryBarrier2 &into, const vk::ImageMemoryBarrier2 &other) {
+        if (into.image != other.image || !same_queue_families(into, other))
+            return false;
+        if (same_range(into.subresourceRange, other.subresourceRange)) {
+            // the same transition twice, or the second one continuing the first. Nothing runs between them, so the
+            // subresources go straight to the last layout.
+            bool same_transition = into.oldLayout == other.oldLayout && into.newLayout == other.newLayout;
+            if (!same_transition && into.newLayout != other.oldLayout)
+                return false;
+            into.newLayout = other.newLayout;
+            merge_masks(into, other);
+            return true;
+        }
+        return into.oldLayout == other.oldLayout && into.newLayout == other.newLayout && same_masks(into, other) &&
+               merge_neighbour_range(into.subresourceRange, other.subresourceRange);
+    }
+} // namespace
+
+BarrierBatch::~BarrierBatch() {
+    Logger::check(empty(), "Barrier batch destroyed without flushing it");
+}
+
+void BarrierBatch::add(const vk::MemoryBarrier2 &barrier) {
+    if (stats_)
+        stats_->added++;
+    if (memoryBarriers_.empty())
+        memoryBarriers_.push_back(barrier);
+    else
+        merge_masks(memoryBarriers_.front(), barrier);
+}
+
+void BarrierBatch::add(const vk::BufferMemoryBarrier2 &barrier) {
+    if (stats_)
+        stats_->added++;
+    for (auto &existing: bufferBarriers_) {
+        if (merge_buffer(existing, barrier))
+            return;
+    }
+    bufferBarriers_.push_back(barrier);
+}
+
+void BarrierBatch::add(const vk::ImageMemoryBarrier2 &barrier) {
+    if (stats_)
+        stats_->added++;
+    for (auto &existing: imageBarriers_) {
+        if (merge_image(existing, barrier))
+            return;
+    }
+    imageBarriers_.push_back(barrier);
+}
+
+void BarrierBatch::flush(const vk::CommandBuffer &cmd_buf) {
+    if (empty())
+        return;
+    cmd_buf.pipelineBarrier2(
+            vk::DependencyInfo{}
+                    .setMemoryBarriers(memoryBarriers_)
+                    .setBufferMemoryBarriers(bufferBarriers_)
+                    .setImageMemoryBarriers(imageBarriers_)
+    );
+    if (stats_) {
+        stats_->calls++;
+        stats_->barriers +=
+                static_cast<uint32_t>(memoryBarriers_.size() + bufferBarriers_.size() + imageBarriers_.size());
+    }
+    memoryBarriers_.clear();
+    bufferBarriers_.clear();
+    imageBarriers_.clear();
+}
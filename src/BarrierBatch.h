@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <vulkan/vulkan.hpp>
+
+// What the barrier batches that count into it recorded, e.g. during one frame or one upload
+struct BarrierStats {
+    // pipelineBarrier2 calls
+    uint32_t calls = 0;
+    // barriers recorded by the calls
+    uint32_t barriers = 0;
+    // barriers that were added to a batch, the difference to barriers was merged
+    uint32_t added = 0;
+};
+
+/**
+ * Collects image, buffer and memory barriers and records them with a single pipelineBarrier2. Barriers of the same
+ * image or buffer are merged when they can be expressed as one:
+ * - the same subresources or buffer range, with the same transition or one continuing the other
+ * - neighbouring mip levels, array layers or buffer ranges with the same transition and masks
+ * Memory barriers are merged into one. Merging only widens the synchronization, so it is always safe. Like those of
+ * a single pipelineBarrier2, the barriers of a batch must not depend on each other apart from such continued
+ * transitions.
+ */
+class BarrierBatch {
+    std::vector<vk::MemoryBarrier2> memoryBarriers_;
+    std::vector<vk::BufferMemoryBarrier2> bufferBarriers_;
+    std::vector<vk::ImageMemoryBarrier2> imageBarriers_;
+    BarrierStats *stats_ = nullptr;
+
+public:
+    // counts the flushes into stats, unless it is null
+    explicit BarrierBatch(BarrierStats *stats = nullptr) : stats_(stats) {}
+
+    ~BarrierBatch();
+
+    BarrierBatch(const BarrierBatch &other) = delete;
+
+    BarrierBatch &operator=(const BarrierBatch &other) = delete;
+
+    void add(const vk::MemoryBarrier2 &barrier);
+
+    void add(const vk::BufferMemoryBarrier2 &barrier);
+
+    void add(const vk::ImageMemoryBarrier2 &barrier);
+
+    [[nodiscard]] bool empty() const {
+        return memoryBarriers_.empty() && bufferBarriers_.empty() && imageBarriers_.empty();
+    }
+
+    // Records the collected barriers, if there are any, and starts a new batch
+    void flush(const vk::CommandBuffer &cmd_buf);
+};
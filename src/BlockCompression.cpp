@@ -0,0 +1,659 @@
+#include "BlockCompression.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <format>
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vulkan/utility/vk_format_utils.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BLOCK_COMPRESSION_SSE2
+#include <emmintrin.h>
+#endif
+
+#include "Image.h"
+#include "Logger.h"
+#include "util/thread_pool.h"
+
+namespace {
+    // blocks encoded side by side, one per SIMD lane
+    constexpr int LANES = 4;
+    constexpr int BLOCK_TEXELS = 16;
+    // rows of blocks are split into chunks of at least this many blocks
+    constexpr size_t PARALLEL_GRAIN = 256;
+    constexpr int POWER_ITERATIONS = 4;
+    constexpr int REFINE_ITERATIONS = 2;
+
+#ifdef BLOCK_COMPRESSION_SSE2
+    // One value for each of the LANES blocks
+    struct Lanes {
+        __m128 v;
+
+        Lanes() : v(_mm_setzero_ps()) {}
+        Lanes(float value) : v(_mm_set1_ps(value)) {}
+        explicit Lanes(__m128 value) : v(value) {}
+
+        static Lanes load(const float *values) { return Lanes(_mm_loadu_ps(values)); }
+        void store(float *values) const { _mm_storeu_ps(values, v); }
+
+        friend Lanes operator+(Lanes a, Lanes b) { return Lanes(_mm_add_ps(a.v, b.v)); }
+        friend Lanes operator-(Lanes a, Lanes b) { return Lanes(_mm_sub_ps(a.v, b.v)); }
+        friend Lanes operator*(Lanes a, Lanes b) { return Lanes(_mm_mul_ps(a.v, b.v)); }
+        friend Lanes operator/(Lanes a, Lanes b) { return Lanes(_mm_div_ps(a.v, b.v)); }
+        friend Lanes min(Lanes a, Lanes b) { return Lanes(_mm_min_ps(a.v, b.v)); }
+        friend Lanes max(Lanes a, Lanes b) { return Lanes(_mm_max_ps(a.v, b.v)); }
+        // to the nearest integer, all values are far inside the 32-bit range
+        friend Lanes nearest(Lanes a) { return Lanes(_mm_cvtepi32_ps(_mm_cvtps_epi32(a.v))); }
+        friend Lanes truncate(Lanes a) { return Lanes(_mm_cvtepi32_ps(_mm_cvttps_epi32(a.v))); }
+    };
+
+    struct LaneMask {
+        __m128 m;
+    };
+
+    LaneMask operator<(Lanes a, Lanes b) { return {_mm_cmplt_ps(a.v, b.v)}; }
+
+    Lanes blend(LaneMask mask, Lanes a, Lanes b) {
+        return Lanes(_mm_or_ps(_mm_and_ps(mask.m, a.v), _mm_andnot_ps(mask.m, b.v)));
+    }
+#else
+    struct Lanes {
+        std::array<float, LANES> v = {};
+
+        Lanes() = default;
+        Lanes(float value) { v.fill(value); }
+
+        static Lanes load(const float *values) {
+            Lanes result;
+            std::copy_n(values, LANES, result.v.begin());
+            return result;
+        }
+        void store(float *values) const { std::ranges::copy(v, values); }
+
+        template<typename F>
+        static Lanes map(Lanes a, Lanes b, F &&f) {
+            Lanes result;
+            for (int lane = 0; lane < LANES; lane++)
+                result.v[lane] = f(a.v[lane], b.v[lane]);
+            return result;
+        }
+
+        friend Lanes operator+(Lanes a, Lanes b) { return map(a, b, std::plus{}); }
+        friend Lanes operator-(Lanes a, Lanes b) { return map(a, b, std::minus{}); }
+        friend Lanes operator*(Lanes a, Lanes b) { return map(a, b, std::multiplies{}); }
+        friend Lanes operator/(Lanes a, Lanes b) { return map(a, b, std::divides{}); }
+        friend Lanes min(Lanes a, Lanes b) { return map(a, b, [](float x, float y) { return std::min(x, y); }); }
+        friend Lanes max(Lanes a, Lanes b) { return map(a, b, [](float x, float y) { return std::max(x, y); }); }
+        friend Lanes nearest(Lanes a) { return map(a, a, [](float x, float) { return std::nearbyint(x); }); }
+        friend Lanes truncate(Lanes a) { return map(a, a, [](float x, float) { return std::trunc(x); }); }
+    };
+
+    struct LaneMask {
+        std::array<bool, LANES> m;
+    };
+
+    LaneMask operator<(Lanes a, Lanes b) {
+        LaneMask result;
+        for (int lane = 0; lane < LANES; lane++)
+            result.m[lane] = a.v[lane] < b.v[lane];
+        return result;
+    }
+
+    Lanes blend(LaneMask mask, Lanes a, Lanes b) {
+        Lanes result;
+        for (int lane = 0; lane < LANES; lane++)
+            result.v[lane] = mask.m[lane] ? a.v[lane] : b.v[lane];
+        return result;
+    }
+#endif
+
+    Lanes clamp(Lanes value, float low, float high) { return min(max(value, low), high); }
+
+    std::array<float, LANES> split(Lanes value) {
+        std::array<float, LANES> result;
+        value.store(result.data());
+        return result;
+    }
+
+    template<int C>
+    using Color = std::array<Lanes, C>;
+
+    template<int C>
+    using Texels = std::array<Color<C>, BLOCK_TEXELS>;
+
+    // Palettes of the block formats, every texel is one of the interpolations between the two endpoints of its block.
+    // WEIGHTS are the fractions of the second endpoint in index order.
+
+    // BC7 mode 6: one RGBA line with 7-bit endpoints and a p-bit each that completes them to 8 bits, 4-bit indices
+    struct Bc7Mode6Palette {
+        static constexpr int CHANNELS = 4;
+        static constexpr std::array<float, 16> WEIGHTS = {
+            0 / 64.0f,  4 / 64.0f,  9 / 64.0f,  13 / 64.0f, 17 / 64.0f, 21 / 64.0f, 26 / 64.0f, 30 / 64.0f,
+            34 / 64.0f, 38 / 64.0f, 43 / 64.0f, 47 / 64.0f, 51 / 64.0f, 55 / 64.0f, 60 / 64.0f, 64 / 64.0f,
+        };
+
+        // exactly the integer interpolation of the decoder
+        static Lanes interpolate(Lanes low, Lanes high, Lanes weight) {
+            weight = weight * 64;
+            return truncate(((64 - weight) * low + weight * high + 32) * (1.0f / 64));
+        }
+
+        static Color<4> quantize(const Color<4> &endpoint) {
+            // the p-bit is the lowest bit of all channels, keep the one that is closer
+            Color<4> best;
+            Lanes best_error = 1e30f;
+            for (const float p_bit: {0.0f, 1.0f}) {
+                Color<4> candidate;
+                Lanes error = 0;
+                for (int c = 0; c < 4; c++) {
+                    candidate[c] = clamp(nearest((endpoint[c] - p_bit) * 0.5f), 0, 127) * 2 + p_bit;
+                    const Lanes difference = candidate[c] - endpoint[c];
+                    error = error + difference * difference;
+                }
+                const LaneMask closer = error < best_error;
+                best_error = blend(closer, error, best_error);
+                for (int c = 0; c < 4; c++)
+                    best[c] = blend(closer, candidate[c], best[c]);
+            }
+            return best;
+        }
+    };
+
+    // BC1 in four color mode: RGB565 endpoints and 2-bit indices
+    struct Bc1Palette {
+        static constexpr int CHANNELS = 3;
+        static constexpr std::array<float, 4> WEIGHTS = {0, 1, 1 / 3.0f, 2 / 3.0f};
+
+        // decoders round the thirds differently
+        static Lanes interpolate(Lanes low, Lanes high, Lanes weight) { return low + (high - low) * weight; }
+
+        static Color<3> quantize(const Color<3> &endpoint) {
+            Color<3> result;
+            // the decoder expands to 8 bits by repeating the high bits in the low ones
+            for (const int c: {0, 2}) {
+                const Lanes value = clamp(nearest(endpoint[c] * (31.0f / 255)), 0, 31);
+                result[c] = value * 8 + truncate(value * (1.0f / 4));
+            }
+            const Lanes green = clamp(nearest(endpoint[1] * (63.0f / 255)), 0, 63);
+            result[1] = green * 4 + truncate(green * (1.0f / 16));
+            return result;
+        }
+    };
+
+    // BC4 with the first endpoint larger: 8-bit endpoints, six interpolated values and 3-bit indices
+    struct Bc4Palette {
+        static constexpr int CHANNELS = 1;
+        static constexpr std::array<float, 8> WEIGHTS = {
+            0, 1, 1 / 7.0f, 2 / 7.0f, 3 / 7.0f, 4 / 7.0f, 5 / 7.0f, 6 / 7.0f,
+        };
+
+        static Lanes interpolate(Lanes low, Lanes high, Lanes weight) { return low + (high - low) * weight; }
+
+        static Color<1> quantize(const Color<1> &endpoint) { return {clamp(nearest(endpoint[0]), 0, 255)}; }
+    };
+
+    template<typename Palette>
+    struct Fit {
+        static constexpr int C = Palette::CHANNELS;
+
+        // quantized, as the decoder sees them
+        Color<C> low;
+        Color<C> high;
+        std::array<Lanes, BLOCK_TEXELS> indices;
+        // fraction of high for each texel
+        std::array<Lanes, BLOCK_TEXELS> weights;
+        // sum of squared differences
+        Lanes error;
+
+        void replace(LaneMask mask, const Fit &other) {
+            for (int c = 0; c < C; c++) {
+                low[c] = blend(mask, other.low[c], low[c]);
+                high[c] = blend(mask, other.high[c], high[c]);
+            }
+            for (int i = 0; i < BLOCK_TEXELS; i++) {
+                indices[i] = blend(mask, other.indices[i], indices[i]);
+                weights[i] = blend(mask, other.weights[i], weights[i]);
+            }
+            error = blend(mask, other.error, error);
+        }
+    };
+
+    // Endpoints along the principal axis of the texels that span all of them
+    template<int C>
+    std::pair<Color<C>, Color<C>> fit_line(const Texels<C> &texels) {
+        Color<C> mean = {};
+        for (const auto &texel: texels) {
+            for (int c = 0; c < C; c++)
+                mean[c] = mean[c] + texel[c];
+        }
+        for (auto &channel: mean)
+            channel = channel * (1.0f / BLOCK_TEXELS);
+
+        std::array<Color<C>, C> covariance = {};
+        for (const auto &texel: texels) {
+            for (int a = 0; a < C; a++) {
+                for (int b = a; b < C; b++)
+                    covariance[a][b] = covariance[a][b] + (texel[a] - mean[a]) * (texel[b] - mean[b]);
+            }
+        }
+        for (int a = 0; a < C; a++) {
+            for (int b = 0; b < a; b++)
+                covariance[a][b] = covariance[b][a];
+        }
+
+        // power iteration, starting with the column of the channel that varies the most
+        Color<C> axis = covariance[0];
+        Lanes variance = covariance[0][0];
+        for (int c = 1; c < C; c++) {
+            const LaneMask larger = variance < covariance[c][c];
+            variance = blend(larger, covariance[c][c], variance);
+            for (int d = 0; d < C; d++)
+                axis[d] = blend(larger, covariance[c][d], axis[d]);
+        }
+        for (int iteration = 0; iteration < POWER_ITERATIONS; iteration++) {
+            Color<C> next = {};
+            Lanes scale = 0;
+            for (int a = 0; a < C; a++) {
+                for (int b = 0; b < C; b++)
+                    next[a] = next[a] + covariance[a][b] * axis[b];
+                scale = max(scale, max(next[a], 0 - next[a]));
+            }
+            // flat blocks have no axis, the endpoints collapse onto the mean then
+            const Lanes inverse_scale = blend(1e-12f < scale, 1 / scale, 0);
+            for (int a = 0; a < C; a++)
+                axis[a] = next[a] * inverse_scale;
+        }
+
+        Lanes length2 = 0;
+        for (int c = 0; c < C; c++)
+            length2 = length2 + axis[c] * axis[c];
+        Lanes t_low = 0;
+        Lanes t_high = 0;
+        for (const auto &texel: texels) {
+            Lanes t = 0;
+            for (int c = 0; c < C; c++)
+                t = t + (texel[c] - mean[c]) * axis[c];
+            t_low = min(t_low, t);
+            t_high = max(t_high, t);
+        }
+        const Lanes inverse_length2 = blend(1e-12f < length2, 1 / length2, 0);
+        t_low = t_low * inverse_length2;
+        t_high = t_high * inverse_length2;
+
+        std::pair<Color<C>, Color<C>> endpoints;
+        for (int c = 0; c < C; c++) {
+            endpoints.first[c] = clamp(mean[c] + axis[c] * t_low, 0, 255);
+            endpoints.second[c] = clamp(mean[c] + axis[c] * t_high, 0, 255);
+        }
+        return endpoints;
+    }
+
+    // Picks the palette entry closest to the projection of every texel onto the line between the endpoints
+    template<typename Palette>
+    Fit<Palette> assign_indices(
+            const Texels<Palette::CHANNELS> &texels, const Color<Palette::CHANNELS> &low,
+            const Color<Palette::CHANNELS> &high
+    ) {
+        constexpr int C = Palette::CHANNELS;
+        Color<C> direction;
+        Lanes length2 = 0;
+        for (int c = 0; c < C; c++) {
+            direction[c] = high[c] - low[c];
+            length2 = length2 + direction[c] * direction[c];
+        }
+        const Lanes inverse_length2 = blend(1e-12f < length2, 1 / length2, 0);
+
+        Fit<Palette> fit = {.low = low, .high = high, .error = 0};
+        for (int i = 0; i < BLOCK_TEXELS; i++) {
+            Lanes t = 0;
+            for (int c = 0; c < C; c++)
+                t = t + (texels[i][c] - low[c]) * direction[c];
+            t = t * inverse_length2;
+
+            Lanes best_distance = 1e30f;
+            Lanes best_index = 0;
+            Lanes best_weight = 0;
+            for (int index = 0; index < static_cast<int>(Palette::WEIGHTS.size()); index++) {
+                const Lanes difference = t - Palette::WEIGHTS[index];
+                const Lanes distance = difference * difference;
+                const LaneMask closer = distance < best_distance;
+                best_distance = blend(closer, distance, best_distance);
+                best_index = blend(closer, static_cast<float>(index), best_index);
+                best_weight = blend(closer, Palette::WEIGHTS[index], best_weight);
+            }
+            fit.indices[i] = best_index;
+            fit.weights[i] = best_weight;
+            for (int c = 0; c < C; c++) {
+                const Lanes difference = texels[i][c] - Palette::interpolate(low[c], high[c], best_weight);
+                fit.error = fit.error + difference * difference;
+            }
+        }
+        return fit;
+    }
+
+    // The endpoints with the least squared error for the weights, the current ones where all weights are the same
+    template<int C>
+    std::pair<Color<C>, Color<C>> solve_endpoints(
+            const Texels<C> &texels, const std::array<Lanes, BLOCK_TEXELS> &weights, const Color<C> &low,
+            const Color<C> &high
+    ) {
+        Lanes low_low = 0;
+        Lanes low_high = 0;
+        Lanes high_high = 0;
+        Color<C> low_texel = {};
+        Color<C> high_texel = {};
+        for (int i = 0; i < BLOCK_TEXELS; i++) {
+            const Lanes w_high = weights[i];
+            const Lanes w_low = 1 - w_high;
+            low_low = low_low + w_low * w_low;
+            low_high = low_high + w_low * w_high;
+            high_high = high_high + w_high * w_high;
+            for (int c = 0; c < C; c++) {
+                low_texel[c] = low_texel[c] + w_low * texels[i][c];
+                high_texel[c] = high_texel[c] + w_high * texels[i][c];
+            }
+        }
+
+        const Lanes determinant = low_low * high_high - low_high * low_high;
+        const LaneMask solvable = 1e-4f < determinant;
+        const Lanes inverse = blend(solvable, 1 / determinant, 0);
+        std::pair<Color<C>, Color<C>> endpoints;
+        for (int c = 0; c < C; c++) {
+            const Lanes solved_low = (high_high * low_texel[c] - low_high * high_texel[c]) * inverse;
+            const Lanes solved_high = (low_low * high_texel[c] - low_high * low_texel[c]) * inverse;
+            endpoints.first[c] = blend(solvable, clamp(solved_low, 0, 255), low[c]);
+            endpoints.second[c] = blend(solvable, clamp(solved_high, 0, 255), high[c]);
+        }
+        return endpoints;
+    }
+
+    template<typename Palette>
+    Fit<Palette> fit_blocks(const Texels<Palette::CHANNELS> &texels) {
+        auto [low, high] = fit_line<Palette::CHANNELS>(texels);
+        Fit<Palette> best = assign_indices<Palette>(texels, Palette::quantize(low), Palette::quantize(high));
+        for (int iteration = 0; iteration < REFINE_ITERATIONS; iteration++) {
+            std::tie(low, high) = solve_endpoints<Palette::CHANNELS>(texels, best.weights, best.low, best.high);
+            const auto refined = assign_indices<Palette>(texels, Palette::quantize(low), Palette::quantize(high));
+            best.replace(refined.error < best.error, refined);
+        }
+        return best;
+    }
+
+    // A block is filled starting with the least significant bit of the first byte
+    class BlockWriter {
+        std::array<uint64_t, 2> bits = {};
+        int position = 0;
+
+    public:
+        void write(uint32_t value, int count) {
+            if (position < 64) {
+                bits[0] |= static_cast<uint64_t>(value) << position;
+                if (position + count > 64)
+                    bits[1] |= static_cast<uint64_t>(value) >> (64 - position);
+            } else {
+                bits[1] |= static_cast<uint64_t>(value) << (position - 64);
+            }
+            position += count;
+        }
+
+        void store(unsigned char *block) const { std::memcpy(block, bits.data(), position / 8); }
+    };
+
+    template<typename Palette>
+    struct LaneFit {
+        std::array<std::array<float, LANES>, Palette::CHANNELS> low;
+        std::array<std::array<float, LANES>, Palette::CHANNELS> high;
+        std::array<std::array<float, LANES>, BLOCK_TEXELS> indices;
+
+        explicit LaneFit(const Fit<Palette> &fit) {
+            for (int c = 0; c < Palette::CHANNELS; c++) {
+                low[c] = split(fit.low[c]);
+                high[c] = split(fit.high[c]);
+            }
+            for (int i = 0; i < BLOCK_TEXELS; i++)
+                indices[i] = split(fit.indices[i]);
+        }
+    };
+
+    struct Bc7Encoder {
+        static constexpr int CHANNELS = 4;
+        static constexpr size_t BLOCK_SIZE = 16;
+
+        static void encode(const Texels<CHANNELS> &texels, unsigned char *blocks, int count) {
+            const LaneFit<Bc7Mode6Palette> fit(fit_blocks<Bc7Mode6Palette>(texels));
+            for (int lane = 0; lane < count; lane++) {
+                std::array<uint32_t, 4> low;
+                std::array<uint32_t, 4> high;
+                for (int c = 0; c < 4; c++) {
+                    low[c] = static_cast<uint32_t>(fit.low[c][lane]);
+                    high[c] = static_cast<uint32_t>(fit.high[c][lane]);
+                }
+                std::array<uint32_t, BLOCK_TEXELS> indices;
+                for (int i = 0; i < BLOCK_TEXELS; i++)
+                    indices[i] = static_cast<uint32_t>(fit.indices[i][lane]);
+                // the highest bit of the first index is implicitly 0
+                if (indices[0] >= 8) {
+                    std::swap(low, high);
+                    for (auto &index: indices)
+                        index = 15 - index;
+                }
+
+                BlockWriter writer;
+                writer.write(1 << 6, 7);
+                for (int c = 0; c < 4; c++) {
+                    writer.write(low[c] >> 1, 7);
+                    writer.write(high[c] >> 1, 7);
+                }
+                writer.write(low[0] & 1, 1);
+                writer.write(high[0] & 1, 1);
+                writer.write(indices[0], 3);
+                for (int i = 1; i < BLOCK_TEXELS; i++)
+                    writer.write(indices[i], 4);
+                writer.store(blocks + lane * BLOCK_SIZE);
+            }
+        }
+    };
+
+    struct Bc1Encoder {
+        static constexpr int CHANNELS = 3;
+        static constexpr size_t BLOCK_SIZE = 8;
+
+        static void encode(const Texels<CHANNELS> &texels, unsigned char *blocks, int count) {
+            const LaneFit<Bc1Palette> fit(fit_blocks<Bc1Palette>(texels));
+            for (int lane = 0; lane < count; lane++) {
+                const auto pack = [&](const auto &color) {
+                    return static_cast<uint32_t>(color[0][lane]) >> 3 << 11 |
+                           static_cast<uint32_t>(color[1][lane]) >> 2 << 5 | static_cast<uint32_t>(color[2][lane]) >> 3;
+                };
+                uint32_t low = pack(fit.low);
+                uint32_t high = pack(fit.high);
+                std::array<uint32_t, BLOCK_TEXELS> indices;
+                for (int i = 0; i < BLOCK_TEXELS; i++)
+                    indices[i] = static_cast<uint32_t>(fit.indices[i][lane]);
+                // four color mode needs the first endpoint to be larger, equal ones are a single color
+                if (low < high) {
+                    std::swap(low, high);
+                    for (auto &index: indices)
+                        index ^= 1;
+                } else if (low == high) {
+                    indices.fill(0);
+                }
+
+                BlockWriter writer;
+                writer.write(low, 16);
+                writer.write(high, 16);
+                for (const uint32_t index: indices)
+                    writer.write(index, 2);
+                writer.store(blocks + lane * BLOCK_SIZE);
+            }
+        }
+    };
+
+    struct Bc4Encoder {
+        static constexpr int CHANNELS = 1;
+        static constexpr size_t BLOCK_SIZE = 8;
+
+        static void encode(const Texels<CHANNELS> &texels, unsigned char *blocks, int count, size_t stride) {
+            const LaneFit<Bc4Palette> fit(fit_blocks<Bc4Palette>(texels));
+            for (int lane = 0; lane < count; lane++) {
+                auto low = static_cast<uint32_t>(fit.low[0][lane]);
+                auto high = static_cast<uint32_t>(fit.high[0][lane]);
+                std::array<uint32_t, BLOCK_TEXELS> indices;
+                for (int i = 0; i < BLOCK_TEXELS; i++)
+                    indices[i] = static_cast<uint32_t>(fit.indices[i][lane]);
+                // eight value mode needs the first endpoint to be larger, the interpolated values mirror
+                if (low < high) {
+                    std::swap(low, high);
+                    for (auto &index: indices)
+                        index = index < 2 ? index ^ 1 : 9 - index;
+                } else if (low == high) {
+                    indices.fill(0);
+                }
+
+                BlockWriter writer;
+                writer.write(low, 8);
+                writer.write(high, 8);
+                for (const uint32_t index: indices)
+                    writer.write(index, 3);
+                writer.store(blocks + lane * stride);
+            }
+        }
+
+        static void encode(const Texels<CHANNELS> &texels, unsigned char *blocks, int count) {
+            encode(texels, blocks, count, BLOCK_SIZE);
+        }
+    };
+
+    // Two BC4 blocks, red first
+    struct Bc5Encoder {
+        static constexpr int CHANNELS = 2;
+        static constexpr size_t BLOCK_SIZE = 16;
+
+        static void encode(const Texels<CHANNELS> &texels, unsigned char *blocks, int count) {
+            for (int c = 0; c < CHANNELS; c++) {
+                Texels<1> channel;
+                for (int i = 0; i < BLOCK_TEXELS; i++)
+                    channel[i][0] = texels[i][c];
+                Bc4Encoder::encode(channel, blocks + c * Bc4Encoder::BLOCK_SIZE, count, BLOCK_SIZE);
+            }
+        }
+    };
+
+    // Texels outside of the image repeat the edge, missing color channels are 0 and a missing alpha is opaque
+    template<int C>
+    Texels<C> load_texels(
+            const unsigned char *pixels, uint32_t channels, uint32_t width, uint32_t height, uint32_t block_x,
+            uint32_t block_y, int count
+    ) {
+        std::array<std::array<std::array<float, LANES>, C>, BLOCK_TEXELS> values;
+        for (int lane = 0; lane < LANES; lane++) {
+            // unused lanes repeat the last block
+            const uint32_t lane_x = (block_x + std::min(lane, count - 1)) * 4;
+            for (int i = 0; i < BLOCK_TEXELS; i++) {
+                const uint32_t x = std::min(lane_x + i % 4, width - 1);
+                const uint32_t y = std::min(block_y * 4 + i / 4, height - 1);
+                const unsigned char *pixel = pixels + (static_cast<size_t>(y) * width + x) * channels;
+                for (int c = 0; c < C; c++)
+                    values[i][c][lane] = c < static_cast<int>(channels) ? pixel[c] : c == 3 ? 255.0f : 0.0f;
+            }
+        }
+
+        Texels<C> texels;
+        for (int i = 0; i < BLOCK_TEXELS; i++) {
+            for (int c = 0; c < C; c++)
+                texels[i][c] = Lanes::load(values[i][c].data());
+        }
+        return texels;
+    }
+
+    template<typename Encoder>
+    void compress_level(
+            const unsigned char *pixels, uint32_t channels, uint32_t width, uint32_t height, unsigned char *blocks,
+            bool parallel
+    ) {
+        const uint32_t blocks_x = (width + 3) / 4;
+        const uint32_t blocks_y = (height + 3) / 4;
+        const auto compress_rows = [&](size_t begin, size_t end) {
+            for (auto block_y = static_cast<uint32_t>(begin); block_y < end; block_y++) {
+                unsigned char *row = blocks + static_cast<size_t>(block_y) * blocks_x * Encoder::BLOCK_SIZE;
+                for (uint32_t block_x = 0; block_x < blocks_x; block_x += LANES) {
+                    const int count = static_cast<int>(std::min<uint32_t>(LANES, blocks_x - block_x));
+                    const auto texels = load_texels<Encoder::CHANNELS>(
+                            pixels, channels, width, height, block_x, block_y, count
+                    );
+                    Encoder::encode(texels, row + block_x * Encoder::BLOCK_SIZE, count);
+                }
+            }
+        };
+
+        if (parallel)
+            util::parallel_for(blocks_y, std::max<size_t>(PARALLEL_GRAIN / blocks_x, 1), compress_rows);
+        else
+            compress_rows(0, blocks_y);
+    }
+} // namespace
+
+vk::Format blockCompressedFormat(vk::Format format) {
+    switch (format) {
+        case vk::Format::eR8G8B8A8Srgb:
+            return vk::Format::eBc7SrgbBlock;
+        case vk::Format::eR8G8B8A8Unorm:
+            return vk::Format::eBc7UnormBlock;
+        case vk::Format::eR8G8Unorm:
+            return vk::Format::eBc5UnormBlock;
+        case vk::Format::eR8Unorm:
+            return vk::Format::eBc4UnormBlock;
+        default:
+            return vk::Format::eUndefined;
+    }
+}
+
+PlainImageData compressBlocks(const PlainImageData &image, vk::Format format, bool parallel) {
+    const auto source_format = static_cast<VkFormat>(image.format);
+    const uint32_t channels = vkuFormatComponentCount(source_format);
+    Logger::check(
+            !image.isCompressed() && vkuFormatElementSize(source_format) == channels,
+            std::format("Can't compress images in {}", vk::to_string(image.format))
+    );
+
+    void (*compress)(const unsigned char *, uint32_t, uint32_t, uint32_t, unsigned char *, bool) = nullptr;
+    switch (format) {
+        case vk::Format::eBc7UnormBlock:
+        case vk::Format::eBc7SrgbBlock:
+            compress = compress_level<Bc7Encoder>;
+            break;
+        case vk::Format::eBc1RgbUnormBlock:
+        case vk::Format::eBc1RgbSrgbBlock:
+        case vk::Format::eBc1RgbaUnormBlock:
+        case vk::Format::eBc1RgbaSrgbBlock:
+            compress = compress_level<Bc1Encoder>;
+            break;
+        case vk::Format::eBc4UnormBlock:
+            compress = compress_level<Bc4Encoder>;
+            break;
+        case vk::Format::eBc5UnormBlock:
+            compress = compress_level<Bc5Encoder>;
+            break;
+        default:
+            Logger::panic(std::format("Can't compress images to {}", vk::to_string(format)));
+    }
+
+    size_t size = 0;
+    for (uint32_t level = 0; level < image.mipLevels; level++)
+        size += PlainImageData::levelSize(format, image.width, image.height, level);
+    auto *blocks = static_cast<unsigned char *>(std::malloc(size));
+
+    size_t offset = 0;
+    for (uint32_t level = 0; level < image.mipLevels; level++) {
+        const uint32_t width = std::max(image.width >> level, 1u);
+        const uint32_t height = std::max(image.height >> level, 1u);
+        compress(image.pixels.data() + image.levelOffset(level), channels, width, height, blocks + offset, parallel);
+        offset += PlainImageData::levelSize(format, image.width, image.height, level);
+    }
+    return {std::unique_ptr<unsigned char>(blocks), size, image.width, image.height, format, image.mipLevels};
+}
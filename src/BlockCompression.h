@@ -0,0 +1,17 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+
+class PlainImageData;
+
+// The block compressed format textures of the format are encoded to, eUndefined for formats without one
+vk::Format blockCompressedFormat(vk::Format format);
+
+/**
+ * Encodes all mip levels of an 8-bit per channel image into BC1, BC4, BC5 or BC7 blocks.
+ * BC7 only uses mode 6, a single RGBA line per block. BC1 never uses its punch-through alpha mode.
+ * BC4 and BC5 take the first one and two channels.
+ * @param format the block compressed format of the result
+ * @param parallel encode the rows of blocks concurrently on the global thread pool
+ */
+PlainImageData compressBlocks(const PlainImageData &image, vk::Format format, bool parallel = true);
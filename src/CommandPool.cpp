@@ -67,10 +67,19 @@ Commands::Commands(vk::Device device, vk::Queue queue, uint32_t queue_index, Use
         flags |= vk::CommandPoolCreateFlagBits::eTransient;
     pool_ = device.createCommandPoolUnique({.flags = flags, .queueFamilyIndex = queue_index});
 
-    fence_ = device.createFenceUnique({});
+    vk::SemaphoreTypeCreateInfo type_info = {.semaphoreType = vk::SemaphoreType::eTimeline, .initialValue = 0};
+    timeline_ = device.createSemaphoreUnique({.pNext = &type_info});
+}
+
+Commands::~Commands() {
+    if (submitted_ == 0)
+        return;
+    waitValue(submitted_);
+    collect();
 }
 
 void Commands::begin() {
+    collect();
     if (!active_) {
         active_ = device_.allocateCommandBuffers({
             .commandPool = *pool_,
@@ -86,6 +95,10 @@ void Commands::begin() {
 }
 
 void Commands::reset() {
+    // the pending command buffers are in the pool as well
+    waitValue(submitted_);
+    collect();
+
     vk::CommandPoolResetFlags flags = {};
     if (mode_ == UseMode::Single)
         flags |= vk::CommandPoolResetFlagBits::eReleaseResources;
@@ -145,6 +158,44 @@ void Commands::wait(vk::Fence fence, bool reset) const {
         device_.resetFences(fence);
 }
 
+uint64_t Commands::completedValue() const { return device_.getSemaphoreCounterValue(*timeline_); }
+
+void Commands::waitValue(uint64_t value) const {
+    const vk::SemaphoreWaitInfo wait_info = {.semaphoreCount = 1, .pSemaphores = &*timeline_, .pValues = &value};
+    while (device_.waitSemaphores(wait_info, UINT64_MAX) == vk::Result::eTimeout) {
+    }
+}
+
+void Commands::collect() {
+    if (pending_.empty())
+        return;
+    const uint64_t completed = completedValue();
+    while (!pending_.empty() && pending_.front().value <= completed) {
+        auto &pending = pending_.front();
+        pending.trash.clear();
+        free(pending.buffer);
+        pending_.pop_front();
+    }
+}
+
+void Commands::submit(vk::Fence fence, uint64_t value, std::span<const vk::SemaphoreSubmitInfo> wait_infos) const {
+    const vk::CommandBufferSubmitInfo command_buffer_info = {.commandBuffer = active_};
+    const vk::SemaphoreSubmitInfo signal_info = {
+        .semaphore = *timeline_, .value = value, .stageMask = vk::PipelineStageFlagBits2::eAllCommands
+    };
+    queue_.submit2(
+            vk::SubmitInfo2{
+                .waitSemaphoreInfoCount = static_cast<uint32_t>(wait_infos.size()),
+                .pWaitSemaphoreInfos = wait_infos.data(),
+                .commandBufferInfoCount = 1,
+                .pCommandBufferInfos = &command_buffer_info,
+                .signalSemaphoreInfoCount = 1,
+                .pSignalSemaphoreInfos = &signal_info,
+            },
+            fence
+    );
+}
+
 
 vk::CommandBuffer Commands::end() {
     active_.end();
@@ -152,22 +203,28 @@ vk::CommandBuffer Commands::end() {
 }
 
 
-void Commands::submit() {
+void Commands::submit(std::span<const vk::SemaphoreSubmitInfo> wait_infos) {
     if (!active_) {
         Logger::error("Command buffer not begun");
         return;
     }
 
-    active_.end();
-    queue_.submit(vk::SubmitInfo{.commandBufferCount = 1, .pCommandBuffers = &active_}, *fence_);
-
-    wait(*fence_, true);
-    trash.clear();
+    waitValue(submitAsync(wait_infos));
+    collect();
+}
 
-    if (mode_ == UseMode::Single) {
-        free(active_);
-        active_ = vk::CommandBuffer{};
+uint64_t Commands::submitAsync(std::span<const vk::SemaphoreSubmitInfo> wait_infos) {
+    if (!active_) {
+        Logger::error("Command buffer not begun");
+        return submitted_;
     }
+
+    active_.end();
+    submit({}, ++submitted_, wait_infos);
+
+    pending_.push_back({submitted_, std::exchange(active_, {}), std::exchange(trash, Trash(device_))});
+    collect();
+    return submitted_;
 }
 
 vk::CommandBuffer Commands::submit(vk::Fence fence) {
@@ -177,7 +234,7 @@ vk::CommandBuffer Commands::submit(vk::Fence fence) {
     }
 
     active_.end();
-    queue_.submit(vk::SubmitInfo{.commandBufferCount = 1, .pCommandBuffers = &active_}, fence);
+    submit(fence, ++submitted_);
 
     return std::exchange(active_, {});
 }
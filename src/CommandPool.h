@@ -1,8 +1,10 @@
 #pragma once
 
 #include <cstdint>
+#include <deque>
 #include <functional>
 #include <queue>
+#include <span>
 #include <vulkan/vulkan.hpp>
 
 class CommandPool {
@@ -58,9 +60,9 @@ public:
         rhs = T{};
         using deleter_t = typename vk::UniqueHandleTraits<T, VULKAN_HPP_DEFAULT_DISPATCHER_TYPE>::deleter;
         if constexpr (std::is_same_v<deleter_t, vk::ObjectDestroy<vk::Device, VULKAN_HPP_DEFAULT_DISPATCHER_TYPE>>) {
-            trash_.emplace_back([this, val] { device_.destroy(val); });
+            trash_.emplace_back([device = device_, val] { device.destroy(val); });
         } else if constexpr (std::is_same_v<deleter_t, vk::ObjectFree<vk::Device, VULKAN_HPP_DEFAULT_DISPATCHER_TYPE>>) {
-            trash_.emplace_back([this, val] { device_.free(val); });
+            trash_.emplace_back([device = device_, val] { device.free(val); });
         } else {
             static_assert(false, "Unsupported type");
         }
@@ -76,10 +78,27 @@ private:
     vk::Device device_ = {};
     vk::Queue queue_ = {};
     UseMode mode_ = UseMode::Single;
-    vk::UniqueFence fence_ = {};
+    // every submission signals the next value once it completed
+    vk::UniqueSemaphore timeline_ = {};
+    uint64_t submitted_ = 0;
     vk::UniqueCommandPool pool_;
     vk::CommandBuffer active_;
 
+    // A submission the device may still run, its command buffer and trash are released once it signalled value
+    struct Pending {
+        uint64_t value;
+        vk::CommandBuffer buffer;
+        Trash trash;
+    };
+
+    // in the order they were submitted
+    std::deque<Pending> pending_;
+
+    void submit(vk::Fence fence, uint64_t value, std::span<const vk::SemaphoreSubmitInfo> wait_infos = {}) const;
+
+    // Releases the pending submissions that completed
+    void collect();
+
 public:
     Trash trash;
 
@@ -87,16 +106,46 @@ public:
 
     Commands(vk::Device device, vk::Queue queue, uint32_t queue_index, UseMode mode);
 
+    // Waits for everything submitted, so the pending trash can be released
+    ~Commands();
+
+    Commands(const Commands &other) = delete;
+
+    Commands &operator=(const Commands &other) = delete;
+
     void begin();
 
     vk::CommandBuffer end();
 
-    void submit();
+    // Submits and blocks until the commands completed
+    void submit(std::span<const vk::SemaphoreSubmitInfo> wait_infos = {});
+
+    /**
+     * Submits without waiting. The command buffer and the trash are kept until the submission completed, the next
+     * begin or submission releases them then.
+     * @param wait_infos semaphores the submission waits on, e.g. waitInfo of other Commands
+     * @return the timeline value the submission signals once it completed
+     */
+    uint64_t submitAsync(std::span<const vk::SemaphoreSubmitInfo> wait_infos = {});
 
     [[nodiscard]] vk::CommandBuffer submit(vk::Fence fence);
 
     void wait(vk::Fence fence, bool reset) const;
 
+    // The timeline value the commands being recorded signal once they completed
+    [[nodiscard]] uint64_t pendingValue() const { return submitted_ + 1; }
+
+    // The value of the last submission that completed
+    [[nodiscard]] uint64_t completedValue() const;
+
+    // Blocks until the submission that signals the value completed
+    void waitValue(uint64_t value) const;
+
+    // Makes another submission wait at stage until the submission that signals the value completed
+    [[nodiscard]] vk::SemaphoreSubmitInfo waitInfo(uint64_t value, vk::PipelineStageFlags2 stage) const {
+        return {.semaphore = *timeline_, .value = value, .stageMask = stage};
+    }
+
     void free(vk::CommandBuffer buffer) const;
 
     void reset();
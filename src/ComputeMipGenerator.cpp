@@ -0,0 +1,253 @@
+#include "ComputeMipGenerator.h"
+
+#include <algorithm>
+#include <array>
+#include <format>
+#include <glm/glm.hpp>
+
+#include "BarrierBatch.h"
+#include "CommandPool.h"
+#include "Descriptors.h"
+#include "GraphicsBackend.h"
+#include "Logger.h"
+
+namespace {
+    struct MipPushConstants {
+        glm::uvec2 size;
+        // levels to generate below level 0
+        uint32_t levelCount;
+        uint32_t srgb;
+    };
+
+    // scratch slots in the ring, dispatches recorded back to back only wait on each other after this many
+    constexpr uint32_t SLOT_COUNT = 8;
+    // the tile counter, padded to the alignment of the vec4 array after it, and level 6 of the largest image
+    constexpr vk::DeviceSize SCRATCH_SLOT_SIZE = 16 + 64 * 64 * sizeof(glm::vec4);
+
+    struct MipDescriptorSetLayout : DescriptorSetLayoutBase {
+        static constexpr auto Source = combinedImageSampler(0, ShaderStage::eCompute);
+        static constexpr auto Levels = storageImage(1, ShaderStage::eCompute, ComputeMipGenerator::MAX_LEVELS);
+        static constexpr auto Scratch = storageBuffer(2, ShaderStage::eCompute);
+
+        inline static const auto Bindings = validate(Source, Levels, Scratch);
+
+        explicit MipDescriptorSetLayout(const vk::Device &device, vk::DescriptorSetLayoutCreateFlags flags = {})
+            : DescriptorSetLayoutBase(device, flags, Bindings) {}
+
+        ~MipDescriptorSetLayout() override = default;
+    };
+
+    // The format of the storage views of an image of the format, eUndefined if it is not supported
+    vk::Format storage_format(vk::Format format) {
+        switch (format) {
+            case vk::Format::eR8Unorm:
+            case vk::Format::eR8Srgb:
+                return vk::Format::eR8Unorm;
+            case vk::Format::eR8G8Unorm:
+            case vk::Format::eR8G8Srgb:
+                return vk::Format::eR8G8Unorm;
+            case vk::Format::eR8G8B8A8Unorm:
+            case vk::Format::eR8G8B8A8Srgb:
+                return vk::Format::eR8G8B8A8Unorm;
+            default:
+                return vk::Format::eUndefined;
+        }
+    }
+
+    bool is_srgb(vk::Format format) {
+        return format == vk::Format::eR8Srgb || format == vk::Format::eR8G8Srgb || format == vk::Format::eR8G8B8A8Srgb;
+    }
+} // namespace
+
+ComputeMipGenerator::ComputeMipGenerator(const DeviceContext &ctx, const ShaderLoader &loader, bool subgroup_quad)
+    : device_(ctx.get()),
+      mainQueueFamily_(ctx.mainQueueFamily),
+      queueFamily_(ctx.computeQueueFamily),
+      queue_(ctx.computeQueue) {
+    for (auto format: {vk::Format::eR8Unorm, vk::Format::eR8G8Unorm, vk::Format::eR8G8B8A8Unorm}) {
+        auto features = ctx.physicalDevice.getFormatProperties(format).optimalTilingFeatures;
+        if (features & vk::FormatFeatureFlagBits::eStorageImage)
+            storageFormats_.push_back(format);
+    }
+
+    // pushed instead of allocated, a new set for every image would need a pool sized for the whole scene
+    descriptorLayout_ = std::make_unique<MipDescriptorSetLayout>(
+            device_, vk::DescriptorSetLayoutCreateFlagBits::ePushDescriptorKHR
+    );
+    std::array descriptor_set_layouts = {descriptorLayout_->layout};
+    std::array push_constant_ranges = {vk::PushConstantRange{
+        .stageFlags = vk::ShaderStageFlagBits::eCompute, .offset = 0, .size = sizeof(MipPushConstants)
+    }};
+    auto stage = subgroup_quad ? loader.load("assets/shaders/generate_mipmaps.comp", {}, {"SUBGROUP_QUAD"})
+                               : loader.load("assets/shaders/generate_mipmaps.comp");
+    shader_ = std::make_unique<Shader>(
+            device_, stage, vk::ShaderStageFlagBits{}, descriptor_set_layouts, push_constant_ranges
+    );
+
+    // level 0 is read with texelFetch, the sampler only has to exist
+    sampler_ = device_.createSamplerUnique({
+        .magFilter = vk::Filter::eNearest,
+        .minFilter = vk::Filter::eNearest,
+        .mipmapMode = vk::SamplerMipmapMode::eNearest,
+        .addressModeU = vk::SamplerAddressMode::eClampToEdge,
+        .addressModeV = vk::SamplerAddressMode::eClampToEdge,
+        .addressModeW = vk::SamplerAddressMode::eClampToEdge,
+    });
+
+    auto alignment = ctx.physicalDevice.getProperties().limits.minStorageBufferOffsetAlignment;
+    scratchStride_ = (SCRATCH_SLOT_SIZE + alignment - 1) / alignment * alignment;
+    std::tie(scratch_, scratchAllocation_) = ctx.allocator->createBufferUnique(
+            {
+                .size = scratchStride_ * SLOT_COUNT,
+                .usage = vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst,
+            },
+            {
+                .usage = vma::MemoryUsage::eAuto,
+                .requiredFlags = vk::MemoryPropertyFlagBits::eDeviceLocal,
+            }
+    );
+}
+
+ComputeMipGenerator::~ComputeMipGenerator() = default;
+
+std::unique_ptr<ComputeMipGenerator> ComputeMipGenerator::create(const DeviceContext &ctx, const ShaderLoader &loader) {
+    const auto &features = ctx.enabledFeatures;
+    if (!ctx.supportedExtensions.contains(vk::KHRPushDescriptorExtensionName) ||
+        !features.shaderStorageImageWriteWithoutFormat || !features.shaderStorageImageArrayDynamicIndexing)
+        return nullptr;
+
+    auto properties = ctx.physicalDevice
+                              .getProperties2<vk::PhysicalDeviceProperties2, vk::PhysicalDeviceSubgroupProperties>()
+                              .get<vk::PhysicalDeviceSubgroupProperties>();
+    const auto quad_operations = vk::SubgroupFeatureFlagBits::eBasic | vk::SubgroupFeatureFlagBits::eQuad;
+    bool subgroup_quad = (properties.supportedStages & vk::ShaderStageFlagBits::eCompute) &&
+                         (properties.supportedOperations & quad_operations) == quad_operations;
+
+    return std::unique_ptr<ComputeMipGenerator>(new ComputeMipGenerator(ctx, loader, subgroup_quad));
+}
+
+bool ComputeMipGenerator::supports(const ImageCreateInfo &info) const {
+    auto format = storage_format(info.format);
+    return format != vk::Format::eUndefined && std::ranges::contains(storageFormats_, format) &&
+           info.type == vk::ImageType::e2D && info.depth == 1 && info.array_layers == 1 &&
+           std::max(info.width, info.height) <= MAX_SIZE;
+}
+
+std::vector<vk::Format> ComputeMipGenerator::formats() const {
+    std::vector<vk::Format> formats;
+    for (auto format: {vk::Format::eR8Unorm, vk::Format::eR8Srgb, vk::Format::eR8G8Unorm, vk::Format::eR8G8Srgb,
+                       vk::Format::eR8G8B8A8Unorm, vk::Format::eR8G8B8A8Srgb}) {
+        if (std::ranges::contains(storageFormats_, storage_format(format)))
+            formats.push_back(format);
+    }
+    return formats;
+}
+
+ImageCreateInfo ComputeMipGenerator::prepare(ImageCreateInfo info) const {
+    info.usage |= vk::ImageUsageFlagBits::eStorage;
+    if (is_srgb(info.format))
+        info.view_format = storage_format(info.format);
+    info.queue_families = {mainQueueFamily_};
+    if (queueFamily_ != mainQueueFamily_)
+        info.queue_families.push_back(queueFamily_);
+    return info;
+}
+
+void ComputeMipGenerator::generate(
+        const vk::CommandBuffer &cmd_buf, std::span<Image *const> images, Trash &trash, BarrierStats *barrier_stats
+) {
+    for (const auto *image: images) {
+        const auto &info = image->createInfo();
+        if (!supports(info))
+            Logger::panic(std::format("Can't generate the mip levels of a {} image", vk::to_string(info.format)));
+    }
+    if (images.empty())
+        return;
+
+    if (!scratchCleared_) {
+        cmd_buf.fillBuffer(*scratch_, 0, vk::WholeSize, 0);
+        scratchCleared_ = true;
+    }
+    // level 0 is only sampled and can stay in a read-only layout, just the generated levels become storage images
+    BarrierBatch barriers(barrier_stats);
+    for (auto *image: images) {
+        const auto levels = image->createInfo().mip_levels;
+        image->barrier(barriers, 0, 1, ImageResourceAccess::ComputeShaderRead);
+        if (levels > 1)
+            image->barrier(barriers, 1, levels - 1, ImageResourceAccess::ComputeShaderReadWrite);
+    }
+    for (auto *image: images) {
+        // the slot was last used SLOT_COUNT dispatches ago, the whole ring waits for those
+        if (nextSlot_ == 0) {
+            barriers.add(vk::MemoryBarrier2{
+                .srcStageMask = vk::PipelineStageFlagBits2::eComputeShader | vk::PipelineStageFlagBits2::eClear,
+                .srcAccessMask = vk::AccessFlagBits2::eShaderStorageWrite | vk::AccessFlagBits2::eTransferWrite,
+                .dstStageMask = vk::PipelineStageFlagBits2::eComputeShader,
+                .dstAccessMask = vk::AccessFlagBits2::eShaderStorageRead | vk::AccessFlagBits2::eShaderStorageWrite,
+            });
+        }
+        barriers.flush(cmd_buf);
+        dispatch(cmd_buf, *image, trash, nextSlot_ * scratchStride_);
+        nextSlot_ = (nextSlot_ + 1) % SLOT_COUNT;
+    }
+
+    // a compute queue has no fragment stage, only the layout changes there. The caller makes the main queue wait for
+    // the submission before it samples the images, e.g. with Commands::waitInfo.
+    ImageResourceAccess sampled = ImageResourceAccess::FragmentShaderRead;
+    if (queueFamily_ != mainQueueFamily_) {
+        sampled.stage = vk::PipelineStageFlagBits2::eComputeShader;
+        sampled.access = vk::AccessFlagBits2::eShaderSampledRead;
+    }
+    for (auto *image: images)
+        image->barrier(barriers, sampled);
+    barriers.flush(cmd_buf);
+}
+
+void ComputeMipGenerator::dispatch(
+        const vk::CommandBuffer &cmd_buf, const Image &image, Trash &trash, vk::DeviceSize slot_offset
+) const {
+    const auto &info = image.createInfo();
+    if (info.mip_levels <= 1)
+        return;
+
+    // the views only have to live until the commands finished
+    auto source_view = image.createLevelView(device_, 0, info.format).release();
+    const vk::DescriptorImageInfo source_info = {
+        .sampler = *sampler_, .imageView = source_view, .imageLayout = vk::ImageLayout::eReadOnlyOptimal
+    };
+    trash += source_view;
+    std::array<vk::DescriptorImageInfo, MAX_LEVELS> level_infos = {};
+    const auto format = storage_format(info.format);
+    for (uint32_t level = 1; level < info.mip_levels; level++) {
+        auto view = image.createLevelView(device_, level, format).release();
+        level_infos[level - 1] = {.imageView = view, .imageLayout = vk::ImageLayout::eGeneral};
+        trash += view;
+    }
+    // every array element needs a valid descriptor, the unused ones repeat the last level
+    std::fill(level_infos.begin() + info.mip_levels - 1, level_infos.end(), level_infos[info.mip_levels - 2]);
+    const vk::DescriptorBufferInfo scratch_info = {
+        .buffer = *scratch_, .offset = slot_offset, .range = SCRATCH_SLOT_SIZE
+    };
+
+    // push descriptors ignore the set
+    const DescriptorSet descriptor_set({}, MipDescriptorSetLayout::Bindings);
+    shader_->pushDescriptorSet(
+            cmd_buf, 0,
+            {
+                descriptor_set.write(MipDescriptorSetLayout::Source, source_info),
+                descriptor_set.write(MipDescriptorSetLayout::Levels, level_infos),
+                descriptor_set.write(MipDescriptorSetLayout::Scratch, scratch_info),
+            }
+    );
+    const MipPushConstants push_constants = {
+        .size = {info.width, info.height},
+        .levelCount = info.mip_levels - 1,
+        .srgb = is_srgb(info.format),
+    };
+    cmd_buf.pushConstants(
+            shader_->pipelineLayout(), vk::ShaderStageFlagBits::eCompute, 0, sizeof(push_constants), &push_constants
+    );
+    cmd_buf.bindShadersEXT(shader_->stages(), shader_->shaders());
+    // a workgroup per 64x64 tile of level 0
+    cmd_buf.dispatch((info.width + 63) / 64, (info.height + 63) / 64, 1);
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <memory>
+#include <span>
+#include <vector>
+#include <vulkan-memory-allocator-hpp/vk_mem_alloc.hpp>
+#include <vulkan/vulkan.hpp>
+
+#include "Image.h"
+#include "ShaderObject.h"
+
+struct BarrierStats;
+class DescriptorSetLayoutBase;
+class DeviceContext;
+class Trash;
+
+/**
+ * Generates the mip chain of an image in a single compute dispatch (assets/shaders/generate_mipmaps.comp), an
+ * alternative to the blits of Image::generateMipmaps. Each level is the 2x2 box filtered previous one like
+ * PlainImageData::generateMipmaps with MipFilter::Box, sRGB images are filtered as linear colors.
+ * Runs on the async compute queue if there is one, the images it generates are shared with the main queue then.
+ */
+class ComputeMipGenerator {
+public:
+    // levels generated below level 0, enough for a 4096x4096 image
+    static constexpr uint32_t MAX_LEVELS = 12;
+    static constexpr uint32_t MAX_SIZE = 1u << MAX_LEVELS;
+
+private:
+    vk::Device device_;
+    uint32_t mainQueueFamily_;
+    uint32_t queueFamily_;
+    vk::Queue queue_;
+    // the unorm formats that storage images can have
+    std::vector<vk::Format> storageFormats_;
+
+    std::unique_ptr<DescriptorSetLayoutBase> descriptorLayout_;
+    std::unique_ptr<Shader> shader_;
+    vk::UniqueSampler sampler_;
+
+    // ring of scratch slots, consecutive dispatches use different ones so they can overlap
+    vma::UniqueBuffer scratch_;
+    vma::UniqueAllocation scratchAllocation_;
+    vk::DeviceSize scratchStride_ = 0;
+    uint32_t nextSlot_ = 0;
+    bool scratchCleared_ = false;
+
+    ComputeMipGenerator(const DeviceContext &ctx, const ShaderLoader &loader, bool subgroup_quad);
+
+    void dispatch(const vk::CommandBuffer &cmd_buf, const Image &image, Trash &trash, vk::DeviceSize slot_offset) const;
+
+public:
+    ~ComputeMipGenerator();
+
+    // Null if the device lacks VK_KHR_push_descriptor or the storage image features the shader needs
+    static std::unique_ptr<ComputeMipGenerator> create(const DeviceContext &ctx, const ShaderLoader &loader);
+
+    [[nodiscard]] vk::Queue queue() const { return queue_; }
+
+    [[nodiscard]] uint32_t queueFamily() const { return queueFamily_; }
+
+    // 2D images with one layer in an 8-bit unorm or sRGB format with 1, 2 or 4 channels, no larger than MAX_SIZE
+    [[nodiscard]] bool supports(const ImageCreateInfo &info) const;
+
+    // The formats supports accepts on this device, for gltf::LoadOptions::gpuMipmapFormats
+    [[nodiscard]] std::vector<vk::Format> formats() const;
+
+    // Adds what generate needs to the create info of a supported image: storage usage, the unorm view format and
+    // the queue families
+    [[nodiscard]] ImageCreateInfo prepare(ImageCreateInfo info) const;
+
+    /**
+     * Records the generation of all levels of the images from their level 0, which has to be loaded. The images are
+     * ready for the fragment shader afterwards, their barriers are recorded in one batch before and after the
+     * dispatches.
+     * @param images created with a create info from prepare
+     * @param trash takes the image views, which must live until the commands finished
+     * @param barrier_stats counts the barriers, unless it is null
+     */
+    void generate(
+            const vk::CommandBuffer &cmd_buf, std::span<Image *const> images, Trash &trash,
+            BarrierStats *barrier_stats = nullptr
+    );
+};
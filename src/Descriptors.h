@@ -90,6 +90,14 @@ protected:
         return DescriptorBinding<vk::DescriptorType::eUniformBuffer>{index, count, stages};
     }
 
+    static consteval auto storageImage(uint32_t index, ShaderStages stages, uint32_t count = 1) {
+        return DescriptorBinding<vk::DescriptorType::eStorageImage>{index, count, stages};
+    }
+
+    static consteval auto storageBuffer(uint32_t index, ShaderStages stages, uint32_t count = 1) {
+        return DescriptorBinding<vk::DescriptorType::eStorageBuffer>{index, count, stages};
+    }
+
 private:
     static void validateBindings(std::span<const vk::DescriptorSetLayoutBinding> bindings);
 };
@@ -139,6 +147,23 @@ public:
         return write(binding).setBufferInfo(buffer_info);
     }
 
+    // one image info per array element of the binding
+    [[nodiscard]] vk::WriteDescriptorSet write(
+            const DescriptorBinding<vk::DescriptorType::eStorageImage> &binding,
+            std::span<const vk::DescriptorImageInfo> image_infos
+    ) const {
+        auto result = write(binding);
+        result.descriptorCount = static_cast<uint32_t>(image_infos.size());
+        result.pImageInfo = image_infos.data();
+        return result;
+    }
+
+    [[nodiscard]] vk::WriteDescriptorSet write(
+            const DescriptorBinding<vk::DescriptorType::eStorageBuffer> &binding, const vk::DescriptorBufferInfo &buffer_info
+    ) const {
+        return write(binding).setBufferInfo(buffer_info);
+    }
+
     DescriptorSet(const DescriptorSet &other) = default;
 
     DescriptorSet(DescriptorSet &&other) noexcept
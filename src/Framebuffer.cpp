@@ -8,6 +8,14 @@ void Attachment::barrier(const vk::CommandBuffer &cmd_buf, const ImageResourceAc
     barrier(cmd_buf, single, single);
 }
 
+void Attachment::barrier(BarrierBatch &batch, const ImageResourceAccess &begin, const ImageResourceAccess &end) {
+    ImageResource::barrier(image, range, batch, begin, end);
+}
+
+void Attachment::barrier(BarrierBatch &batch, const ImageResourceAccess &single) {
+    barrier(batch, single, single);
+}
+
 vk::RenderingInfo Framebuffer::renderingInfo(const vk::Rect2D &area, const FramebufferRenderingConfig &config) {
     vk::RenderingInfo result = {
         .flags = config.flags,
@@ -117,3 +125,37 @@ void Framebuffer::barrierStencil(const vk::CommandBuffer &cmd_buf, const ImageRe
 
     stencilAttachment.barrier(cmd_buf, single);
 }
+
+void Framebuffer::barrierColor(BarrierBatch &batch, const ImageResourceAccess &begin, const ImageResourceAccess &end) {
+    for (auto &attachment: colorAttachments) {
+        if (!attachment)
+            continue;
+        attachment.barrier(batch, begin, end);
+    }
+}
+
+void Framebuffer::barrierColor(BarrierBatch &batch, const ImageResourceAccess &single) {
+    barrierColor(batch, single, single);
+}
+
+void Framebuffer::barrierDepth(BarrierBatch &batch, const ImageResourceAccess &begin, const ImageResourceAccess &end) {
+    if (!depthAttachment)
+        return;
+
+    depthAttachment.barrier(batch, begin, end);
+}
+
+void Framebuffer::barrierDepth(BarrierBatch &batch, const ImageResourceAccess &single) {
+    barrierDepth(batch, single, single);
+}
+
+void Framebuffer::barrierStencil(BarrierBatch &batch, const ImageResourceAccess &begin, const ImageResourceAccess &end) {
+    if (!stencilAttachment)
+        return;
+
+    stencilAttachment.barrier(batch, begin, end);
+}
+
+void Framebuffer::barrierStencil(BarrierBatch &batch, const ImageResourceAccess &single) {
+    barrierStencil(batch, single, single);
+}
@@ -15,6 +15,10 @@ struct Attachment : ImageResource {
 
     void barrier(const vk::CommandBuffer &cmd_buf, const ImageResourceAccess &single);
 
+    void barrier(BarrierBatch &batch, const ImageResourceAccess &begin, const ImageResourceAccess &end);
+
+    void barrier(BarrierBatch &batch, const ImageResourceAccess &single);
+
     explicit operator bool() const { return image && view; }
 };
 
@@ -72,11 +76,23 @@ public:
 
     void barrierColor(const vk::CommandBuffer &cmd_buf, const ImageResourceAccess &single);
 
+    void barrierColor(BarrierBatch &batch, const ImageResourceAccess &begin, const ImageResourceAccess &end);
+
+    void barrierColor(BarrierBatch &batch, const ImageResourceAccess &single);
+
     void barrierDepth(const vk::CommandBuffer &cmd_buf, const ImageResourceAccess &begin, const ImageResourceAccess &end);
 
     void barrierDepth(const vk::CommandBuffer &cmd_buf, const ImageResourceAccess &single);
 
+    void barrierDepth(BarrierBatch &batch, const ImageResourceAccess &begin, const ImageResourceAccess &end);
+
+    void barrierDepth(BarrierBatch &batch, const ImageResourceAccess &single);
+
     void barrierStencil(const vk::CommandBuffer &cmd_buf, const ImageResourceAccess &begin, const ImageResourceAccess &end);
 
     void barrierStencil(const vk::CommandBuffer &cmd_buf, const ImageResourceAccess &single);
+
+    void barrierStencil(BarrierBatch &batch, const ImageResourceAccess &begin, const ImageResourceAccess &end);
+
+    void barrierStencil(BarrierBatch &batch, const ImageResourceAccess &single);
 };
@@ -33,7 +33,9 @@ static VkBool32 vulkanErrorCallback(
     return VK_FALSE;
 }
 
-InstanceContext::InstanceContext() {
+InstanceContext::InstanceContext(bool headless) {
+    if (!headless)
+        glfw.emplace();
     VULKAN_HPP_DEFAULT_DISPATCHER.init();
 
     vk::ApplicationInfo application_info{
@@ -54,9 +56,12 @@ InstanceContext::InstanceContext() {
 #endif
     instance_create_info.setPEnabledLayerNames(layers);
 
-    std::vector extensions = glfw::Context::getRequiredInstanceExtensions();
+    std::vector<const char *> extensions;
+    if (!headless) {
+        extensions = glfw::Context::getRequiredInstanceExtensions();
+        extensions.push_back(vk::KHRGetSurfaceCapabilities2ExtensionName);
+    }
     extensions.push_back(vk::EXTDebugUtilsExtensionName);
-    extensions.push_back(vk::KHRGetSurfaceCapabilities2ExtensionName);
     instance_create_info.setPEnabledExtensionNames(extensions);
 
     Logger::info("Available Layers:");
@@ -95,6 +100,7 @@ class DeviceSelector {
     vk::Instance instance;
     std::vector<vk::PhysicalDevice> physicalDevices;
     std::vector<std::string> requriedExtensions;
+    bool presentation;
 
     static bool hasExtensions(vk::PhysicalDevice device, std::span<std::string> names) {
         auto extension_properties = device.enumerateDeviceExtensionProperties();
@@ -124,7 +130,7 @@ class DeviceSelector {
     bool isAcceptable(vk::PhysicalDevice device) {
         return hasExtensions(device, requriedExtensions) &&
                hasQueues(device, vk::QueueFlagBits::eGraphics | vk::QueueFlagBits::eCompute) &&
-               hasPresentationSupport(instance, device);
+               (!presentation || hasPresentationSupport(instance, device));
     }
 
     float static score(vk::PhysicalDevice device) {
@@ -145,8 +151,8 @@ class DeviceSelector {
     }
 
 public:
-    explicit DeviceSelector(vk::Instance instance, std::vector<vk::PhysicalDevice> &&devices) :
-        instance(instance), physicalDevices(std::move(devices)) {}
+    DeviceSelector(vk::Instance instance, std::vector<vk::PhysicalDevice> &&devices, bool presentation) :
+        instance(instance), physicalDevices(std::move(devices)), presentation(presentation) {}
 
     void setRequiredExtensions(std::span<const char *> names) {
         requriedExtensions.clear();
@@ -165,19 +171,24 @@ public:
     }
 };
 
-DeviceContext::DeviceContext() {
+DeviceContext::DeviceContext(bool headless) : instace(headless) {
     const auto &ctx = instace;
-    std::array required_extensions = {
-        vk::KHRSwapchainExtensionName,
+    std::vector required_extensions = {
         vk::EXTMemoryBudgetExtensionName,
         vk::KHRDynamicRenderingExtensionName,
         vk::EXTShaderObjectExtensionName,
         vk::KHRUniformBufferStandardLayoutExtensionName,
         vk::EXTScalarBlockLayoutExtensionName
     };
-    std::array optional_extensions = {vk::KHRSwapchainMutableFormatExtensionName};
+    std::vector optional_extensions = {
+        vk::KHRPushDescriptorExtensionName,
+    };
+    if (!headless) {
+        required_extensions.push_back(vk::KHRSwapchainExtensionName);
+        optional_extensions.push_back(vk::KHRSwapchainMutableFormatExtensionName);
+    }
 
-    DeviceSelector selector(*ctx.instance, ctx.instance->enumeratePhysicalDevices());
+    DeviceSelector selector(*ctx.instance, ctx.instance->enumeratePhysicalDevices(), !headless);
     selector.setRequiredExtensions(required_extensions);
     auto physical_device_opt = selector.select();
     if (!physical_device_opt.has_value())
@@ -263,17 +274,23 @@ DeviceContext::DeviceContext() {
         }
     }
 
-    vk::PhysicalDeviceFeatures enabled_features = {
+    // optional features are enabled when they are supported
+    auto supported_features = physicalDevice.getFeatures();
+    enabledFeatures = {
         .depthClamp = true,
         .samplerAnisotropy = true,
+        .textureCompressionBC = supported_features.textureCompressionBC,
+        .shaderStorageImageWriteWithoutFormat = supported_features.shaderStorageImageWriteWithoutFormat,
+        .shaderStorageImageArrayDynamicIndexing = supported_features.shaderStorageImageArrayDynamicIndexing,
     };
     vk::StructureChain device_create_info = {
         vk::DeviceCreateInfo{
-            .pEnabledFeatures = &enabled_features,
+            .pEnabledFeatures = &enabledFeatures,
         }
                 .setQueueCreateInfos(queue_create_infos)
                 .setPEnabledExtensionNames(enabled_extensions),
         vk::PhysicalDeviceSynchronization2Features{.synchronization2 = true},
+        vk::PhysicalDeviceTimelineSemaphoreFeatures{.timelineSemaphore = true},
         vk::PhysicalDeviceDynamicRenderingFeaturesKHR{.dynamicRendering = true},
         vk::PhysicalDeviceShaderObjectFeaturesEXT{.shaderObject = true},
         vk::PhysicalDeviceInlineUniformBlockFeatures{.inlineUniformBlock = true},
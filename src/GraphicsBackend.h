@@ -1,5 +1,6 @@
 #pragma once
 
+#include <optional>
 #include <set>
 #include <vulkan-memory-allocator-hpp/vk_mem_alloc.hpp>
 #include <vulkan/vulkan.hpp>
@@ -14,13 +15,17 @@ class Swapchain;
 
 class InstanceContext {
 public:
-    glfw::Context glfw = {};
+    // not initialized for headless instances
+    std::optional<glfw::Context> glfw;
     vk::UniqueInstance instance = {};
     vk::UniqueDebugUtilsMessengerEXT debugMessenger = {};
 
     std::set<std::string> supportedExtensions;
 
-    InstanceContext();
+    vk::PhysicalDeviceFeatures enabledFeatures = {};
+
+    // Headless instances don't have the surface extensions, e.g. for tests without a window
+    explicit InstanceContext(bool headless = false);
 
     [[nodiscard]] vk::Instance get() const { return *instance; }
 
@@ -55,7 +60,10 @@ public:
 
     std::set<std::string> supportedExtensions;
 
-    DeviceContext();
+    vk::PhysicalDeviceFeatures enabledFeatures = {};
+
+    // Headless devices have no swapchain extension and don't need a queue that can present
+    explicit DeviceContext(bool headless = false);
 
     [[nodiscard]] vk::Device get() const { return *device; }
 
@@ -1,14 +1,26 @@
 #include "Image.h"
 
+#include <algorithm>
+#include <array>
+#include <bit>
 #include <cmath>
+#include <cstring>
 #include <filesystem>
 #include <ranges>
 #include <stb_image.h>
 #include <utility>
 #include <vulkan/utility/vk_format_utils.h>
 
+#include "BarrierBatch.h"
 #include "GraphicsBackend.h"
 #include "Logger.h"
+#include "PixelCopy.h"
+
+constexpr ImageResourceAccess ImageResourceAccess::TransferRead = {
+    .stage = vk::PipelineStageFlagBits2::eTransfer,
+    .access = vk::AccessFlagBits2::eTransferRead,
+    .layout = vk::ImageLayout::eTransferSrcOptimal
+};
 
 constexpr ImageResourceAccess ImageResourceAccess::TransferWrite = {
     .stage = vk::PipelineStageFlagBits2::eTransfer,
@@ -19,7 +31,20 @@ constexpr ImageResourceAccess ImageResourceAccess::TransferWrite = {
 constexpr ImageResourceAccess ImageResourceAccess::FragmentShaderRead = {
     .stage = vk::PipelineStageFlagBits2::eFragmentShader,
     .access = vk::AccessFlagBits2::eShaderRead,
-    .layout = vk::ImageLayout::eTransferDstOptimal
+    .layout = vk::ImageLayout::eReadOnlyOptimal
+};
+
+constexpr ImageResourceAccess ImageResourceAccess::ComputeShaderRead = {
+    .stage = vk::PipelineStageFlagBits2::eComputeShader,
+    .access = vk::AccessFlagBits2::eShaderSampledRead,
+    .layout = vk::ImageLayout::eReadOnlyOptimal
+};
+
+constexpr ImageResourceAccess ImageResourceAccess::ComputeShaderReadWrite = {
+    .stage = vk::PipelineStageFlagBits2::eComputeShader,
+    .access = vk::AccessFlagBits2::eShaderSampledRead | vk::AccessFlagBits2::eShaderStorageRead |
+              vk::AccessFlagBits2::eShaderStorageWrite,
+    .layout = vk::ImageLayout::eGeneral
 };
 
 constexpr ImageResourceAccess ImageResourceAccess::ColorAttachmentWrite = {
@@ -44,62 +69,48 @@ constexpr ImageResourceAccess ImageResourceAccess::PresentSrc = {
     .stage = vk::PipelineStageFlagBits2::eBottomOfPipe, .access = vk::AccessFlagBits2::eNone, .layout = vk::ImageLayout::ePresentSrcKHR
 };
 
-template<int SrcCh, int DstCh>
-    requires(SrcCh >= 1) && (SrcCh <= 4) && (DstCh >= 1) && (DstCh <= 4)
-static void copy_pixels(const unsigned char *src, unsigned char *dst, size_t elements) {
-    // clang-format off
-    for (size_t i = 0; i < elements; i++) {
-        // always copy first
-        dst[i * DstCh] = src[i * SrcCh];
-        if constexpr (DstCh < SrcCh) {
-            if constexpr (DstCh > 1) dst[i * DstCh + 1] = src[i * SrcCh + 1];
-            if constexpr (DstCh > 2) dst[i * DstCh + 2] = src[i * SrcCh + 2];
-            if constexpr (DstCh > 3) dst[i * DstCh + 3] = src[i * SrcCh + 3];
-        } else {
-            if constexpr (SrcCh > 1) dst[i * DstCh + 1] = src[i * SrcCh + 1];
-            if constexpr (SrcCh > 2) dst[i * DstCh + 2] = src[i * SrcCh + 2];
-            if constexpr (SrcCh > 3) dst[i * DstCh + 3] = src[i * SrcCh + 3];
-
-            // extend
-            if constexpr (DstCh > SrcCh) {
-                // This might be wrong
-                if constexpr (DstCh - SrcCh >= 1) dst[i * DstCh + SrcCh] = 0;
-                if constexpr (DstCh - SrcCh >= 2) dst[i * DstCh + SrcCh + 1] = 0;
-                if constexpr (DstCh - SrcCh >= 3) dst[i * DstCh + SrcCh + 2] = 0;
-                if constexpr (DstCh == 4) dst[i * DstCh + 3] = 255;
-            }
-        }
+namespace {
+    constexpr vk::AccessFlags2 WRITE_ACCESS = vk::AccessFlagBits2::eShaderWrite |
+                                              vk::AccessFlagBits2::eShaderStorageWrite |
+                                              vk::AccessFlagBits2::eColorAttachmentWrite |
+                                              vk::AccessFlagBits2::eDepthStencilAttachmentWrite |
+                                              vk::AccessFlagBits2::eTransferWrite | vk::AccessFlagBits2::eHostWrite |
+                                              vk::AccessFlagBits2::eMemoryWrite;
+
+    // Both only read in the same layout and the previous barrier already made the subresources visible to the stages
+    // and accesses of next, so they can run concurrently without a barrier
+    bool is_repeated_read(const ImageResourceAccess &prev, const ImageResourceAccess &next) {
+        return prev.layout == next.layout && prev.layout != vk::ImageLayout::eUndefined &&
+               !(prev.access & WRITE_ACCESS) && !(next.access & WRITE_ACCESS) &&
+               (prev.stage & next.stage) == next.stage && (prev.access & next.access) == next.access;
     }
-    // clang-format on
-}
+} // namespace
 
-static void copy_pixels(const unsigned char *src, int src_channels, unsigned char *dst, int dst_chanels, size_t elements) {
-    constexpr std::array jmp = {
-        &copy_pixels<1, 1>, &copy_pixels<2, 1>, &copy_pixels<3, 1>, &copy_pixels<4, 1>,
-        &copy_pixels<1, 2>, &copy_pixels<2, 2>, &copy_pixels<3, 2>, &copy_pixels<4, 2>,
-        &copy_pixels<1, 3>, &copy_pixels<2, 3>, &copy_pixels<3, 3>, &copy_pixels<4, 3>,
-        &copy_pixels<1, 4>, &copy_pixels<2, 4>, &copy_pixels<3, 4>, &copy_pixels<4, 4>,
-    };
-    const int index = (src_channels - 1) + 4 * (dst_chanels - 1);
-    jmp[index](src, dst, elements);
-}
-
-PlainImageData::PlainImageData(std::span<unsigned char> pixels, uint32_t width, uint32_t height, vk::Format format) noexcept
+PlainImageData::PlainImageData(
+        std::span<unsigned char> pixels, uint32_t width, uint32_t height, vk::Format format, uint32_t mip_levels
+) noexcept
     : data(pixels.data()), //
       width(width),
       height(height),
       pixels(pixels),
-      format(format) {}
+      format(format),
+      mipLevels(mip_levels) {}
 
 PlainImageData::PlainImageData(
-        std::unique_ptr<unsigned char> data, size_t size, uint32_t width, uint32_t height, vk::Format format
+        std::unique_ptr<unsigned char> data,
+        size_t size,
+        uint32_t width,
+        uint32_t height,
+        vk::Format format,
+        uint32_t mip_levels
 ) noexcept
     : data(data.release()), //
       owning(true),
       width(width),
       height(height),
       pixels(std::span{this->data, size}),
-      format(format) {}
+      format(format),
+      mipLevels(mip_levels) {}
 
 PlainImageData::~PlainImageData() noexcept {
     if (!owning)
@@ -113,7 +124,8 @@ PlainImageData::PlainImageData(PlainImageData &&other) noexcept
       width(std::exchange(other.width, 0)),
       height(std::exchange(other.height, 0)),
       pixels(std::exchange(other.pixels, {})),
-      format(std::exchange(other.format, vk::Format::eUndefined)) {}
+      format(std::exchange(other.format, vk::Format::eUndefined)),
+      mipLevels(std::exchange(other.mipLevels, 1)) {}
 
 PlainImageData &PlainImageData::operator=(PlainImageData &&other) noexcept {
     if (this == &other)
@@ -127,9 +139,56 @@ PlainImageData &PlainImageData::operator=(PlainImageData &&other) noexcept {
     height = std::exchange(other.height, 0);
     pixels = std::exchange(other.pixels, {});
     format = std::exchange(other.format, vk::Format::eUndefined);
+    mipLevels = std::exchange(other.mipLevels, 1);
     return *this;
 }
 
+bool PlainImageData::isCompressed() const {
+    return vkuFormatIsCompressed(static_cast<VkFormat>(format));
+}
+
+size_t PlainImageData::levelOffset(uint32_t level) const {
+    size_t offset = 0;
+    for (uint32_t i = 0; i < level; i++)
+        offset += levelSize(format, width, height, i);
+    return offset;
+}
+
+size_t PlainImageData::levelSize(vk::Format format, uint32_t width, uint32_t height, uint32_t level) {
+    const VkExtent3D block = vkuFormatTexelBlockExtent(static_cast<VkFormat>(format));
+    const size_t blocks_x = (std::max(width >> level, 1u) + block.width - 1) / block.width;
+    const size_t blocks_y = (std::max(height >> level, 1u) + block.height - 1) / block.height;
+    return blocks_x * blocks_y * vkuFormatElementSize(static_cast<VkFormat>(format));
+}
+
+PlainImageData PlainImageData::generateMipmaps(MipFilter filter, bool parallel) const {
+    const auto channels = vkuFormatComponentCount(static_cast<VkFormat>(format));
+    Logger::check(
+            mipLevels == 1 && !isCompressed() && vkuFormatElementSize(static_cast<VkFormat>(format)) == channels,
+            "Mip levels can only be generated from a single level with 8-bit channels"
+    );
+
+    // as many as Image::create makes
+    const auto levels = static_cast<uint32_t>(std::bit_width(std::max(width, height)));
+    size_t size = 0;
+    for (uint32_t level = 0; level < levels; level++)
+        size += levelSize(format, width, height, level);
+    auto *result = static_cast<unsigned char *>(std::malloc(size));
+    std::memcpy(result, pixels.data(), pixels.size_bytes());
+
+    const bool srgb = vkuFormatIsSRGB(static_cast<VkFormat>(format));
+    const unsigned char *src = result;
+    unsigned char *dst = result + pixels.size_bytes();
+    for (uint32_t level = 1; level < levels; level++) {
+        const uint32_t src_width = std::max(width >> (level - 1), 1u);
+        const uint32_t src_height = std::max(height >> (level - 1), 1u);
+        downsampleMipLevel(src, src_width, src_height, channels, srgb, filter, dst, parallel);
+        src = dst;
+        dst += levelSize(format, width, height, level);
+    }
+    return {std::unique_ptr<unsigned char>(result), size, width, height, format, levels};
+}
+
 PlainImageData PlainImageData::create(vk::Format format, int width, int height, int src_channels, const unsigned char *src_data) {
     int dst_channels = static_cast<int>(vkuFormatComponentCount(static_cast<VkFormat>(format)));
 
@@ -137,56 +196,39 @@ PlainImageData PlainImageData::create(vk::Format format, int width, int height,
     size_t size = elements * dst_channels;
     auto dst_data = static_cast<unsigned char *>(std::malloc(size));
     if (src_data) {
-        copy_pixels(src_data, src_channels, dst_data, dst_channels, elements);
+        copyPixels(src_data, src_channels, dst_data, dst_channels, elements);
     }
 
     return {std::unique_ptr<unsigned char>(dst_data), size, static_cast<uint32_t>(width), static_cast<uint32_t>(height), format};
 }
 
-void PlainImageData::copyChannels(PlainImageData &dst, std::initializer_list<int> mapping) const {
+void PlainImageData::copyChannels(PlainImageData &dst, std::initializer_list<int> mapping, bool parallel) const {
     if (dst.width != width || dst.height != height) {
         Logger::panic("Image dimensions do not match");
     }
 
-    auto channel_map = std::span(mapping);
     uint32_t s_channels = vkuFormatComponentCount(static_cast<VkFormat>(format));
     uint32_t d_channels = vkuFormatComponentCount(static_cast<VkFormat>(dst.format));
 
-    if (channel_map.size() != s_channels) {
+    if (mapping.size() != s_channels) {
         Logger::panic("Not enough channels specified in mapping");
     }
 
-    for (uint32_t y = 0; y < height; ++y) {
-        for (uint32_t x = 0; x < width; ++x) {
-            for (uint32_t sc = 0; sc < s_channels; ++sc) {
-                int dc = channel_map[sc];
-                if (dc < 0)
-                    continue;
-
-                size_t i = x + width * y;
-                size_t si = i * s_channels + sc;
-                size_t di = i * d_channels + dc;
-                dst.pixels[di] = pixels[si];
-            }
-        }
-    }
+    size_t elements = static_cast<size_t>(width) * height;
+    copyPixelChannels(
+            pixels.data(), static_cast<int>(s_channels), dst.pixels.data(), static_cast<int>(d_channels), elements,
+            std::span(mapping), parallel
+    );
 }
 
-void PlainImageData::fill(std::initializer_list<int> channels, std::initializer_list<unsigned char> values) {
+void PlainImageData::fill(
+        std::initializer_list<int> channels, std::initializer_list<unsigned char> values, bool parallel
+) {
     uint32_t s_channels = vkuFormatComponentCount(static_cast<VkFormat>(format));
-    auto channels_span = std::span(channels);
-    auto values_span = std::span(values);
-    for (int y = 0; y < height; ++y) {
-        for (int x = 0; x < width; ++x) {
-            for (int c = 0; c < channels_span.size(); ++c) {
-                int sc = channels_span[c];
-                size_t i = x + width * y;
-                size_t si = i * s_channels + sc;
-                unsigned char value = values_span[c];
-                pixels[si] = value;
-            }
-        }
-    }
+    size_t elements = static_cast<size_t>(width) * height;
+    fillPixelChannels(
+            pixels.data(), static_cast<int>(s_channels), elements, std::span(channels), std::span(values), parallel
+    );
 }
 
 PlainImageData PlainImageData::create(vk::Format format, const std::filesystem::path &path) {
@@ -202,29 +244,97 @@ PlainImageData PlainImageData::create(vk::Format format, const std::filesystem::
 
 void ImageResource::barrier(
         vk::Image image,
+        vk::ImageSubresourceRange resource,
         vk::ImageSubresourceRange range,
-        const vk::CommandBuffer &cmd_buf,
+        BarrierBatch &batch,
         const ImageResourceAccess &begin,
         const ImageResourceAccess &end
 ) {
-    vk::ImageMemoryBarrier2 barrier{
-        .srcStageMask = prevAccess.stage,
-        .srcAccessMask = prevAccess.access,
-        .dstStageMask = begin.stage,
-        .dstAccessMask = begin.access,
-        .oldLayout = prevAccess.layout,
-        .newLayout = begin.layout,
-        .srcQueueFamilyIndex = vk::QueueFamilyIgnored,
-        .dstQueueFamilyIndex = vk::QueueFamilyIgnored,
-        .image = image,
-        .subresourceRange = range,
+    // a skipped read keeps the previous access, the next barrier has to wait for its stages as well
+    auto needs_barrier = [&](const ImageResourceAccess &prev) { return begin != end || !is_repeated_read(prev, begin); };
+    auto add = [&](const ImageResourceAccess &prev, const vk::ImageSubresourceRange &subresources) {
+        batch.add(vk::ImageMemoryBarrier2{
+            .srcStageMask = prev.stage,
+            .srcAccessMask = prev.access,
+            .dstStageMask = begin.stage,
+            .dstAccessMask = begin.access,
+            .oldLayout = prev.layout,
+            .newLayout = begin.layout,
+            .srcQueueFamilyIndex = vk::QueueFamilyIgnored,
+            .dstQueueFamilyIndex = vk::QueueFamilyIgnored,
+            .image = image,
+            .subresourceRange = subresources,
+        });
     };
-    prevAccess = end;
 
-    cmd_buf.pipelineBarrier2({
-        .imageMemoryBarrierCount = 1,
-        .pImageMemoryBarriers = &barrier,
-    });
+    if (accesses_.size() == 1) {
+        if (range == resource) {
+            if (needs_barrier(accesses_.front())) {
+                add(accesses_.front(), range);
+                accesses_.front() = end;
+            }
+            return;
+        }
+        if (resource.levelCount == vk::RemainingMipLevels || resource.layerCount == vk::RemainingArrayLayers)
+            Logger::panic("Barriers of a part of an image resource need its level and layer counts");
+        levelCount_ = resource.levelCount;
+        accesses_.assign(static_cast<size_t>(resource.levelCount) * resource.layerCount, accesses_.front());
+    }
+
+    const auto layer_count = static_cast<uint32_t>(accesses_.size()) / levelCount_;
+    const uint32_t first_level = range.baseMipLevel - resource.baseMipLevel;
+    const uint32_t first_layer = range.baseArrayLayer - resource.baseArrayLayer;
+    const uint32_t end_level =
+            range.levelCount == vk::RemainingMipLevels ? levelCount_ : first_level + range.levelCount;
+    const uint32_t end_layer =
+            range.layerCount == vk::RemainingArrayLayers ? layer_count : first_layer + range.layerCount;
+    if (range.baseMipLevel < resource.baseMipLevel || range.baseArrayLayer < resource.baseArrayLayer ||
+        end_level > levelCount_ || end_layer > layer_count)
+        Logger::panic("Barrier range outside of the image resource");
+
+    // one barrier per layer and run of levels, the batch merges those of neighbouring layers again
+    for (uint32_t layer = first_layer; layer < end_layer; layer++) {
+        auto *accesses = accesses_.data() + static_cast<size_t>(layer) * levelCount_;
+        for (uint32_t level = first_level; level < end_level;) {
+            const ImageResourceAccess prev = accesses[level];
+            uint32_t run_end = level + 1;
+            while (run_end < end_level && accesses[run_end] == prev)
+                run_end++;
+            if (needs_barrier(prev)) {
+                add(prev,
+                    {
+                        .aspectMask = range.aspectMask,
+                        .baseMipLevel = resource.baseMipLevel + level,
+                        .levelCount = run_end - level,
+                        .baseArrayLayer = resource.baseArrayLayer + layer,
+                        .layerCount = 1,
+                    });
+                std::fill(accesses + level, accesses + run_end, end);
+            }
+            level = run_end;
+        }
+    }
+
+    if (std::ranges::all_of(accesses_, [&](const auto &access) { return access == accesses_.front(); }))
+        accesses_.resize(1);
+}
+
+void ImageResource::barrier(
+        vk::Image image,
+        vk::ImageSubresourceRange range,
+        const vk::CommandBuffer &cmd_buf,
+        const ImageResourceAccess &begin,
+        const ImageResourceAccess &end
+) {
+    BarrierBatch batch;
+    barrier(image, range, batch, begin, end);
+    batch.flush(cmd_buf);
+}
+
+const ImageResourceAccess &ImageResource::lastAccess(uint32_t level, uint32_t layer) const {
+    if (accesses_.size() == 1)
+        return accesses_.front();
+    return accesses_[static_cast<size_t>(layer) * levelCount_ + level];
 }
 
 Image::Image(vma::UniqueImage &&image, vma::UniqueAllocation &&allocation, const ImageCreateInfo &create_info)
@@ -233,14 +343,16 @@ Image::Image(vma::UniqueImage &&image, vma::UniqueAllocation &&allocation, const
 Image &Image::operator=(Image &&other) noexcept {
     if (this == &other)
         return *this;
+    ImageResource::operator=(other);
     image = std::move(other.image);
     allocation = std::move(other.allocation);
     info = other.info;
     return *this;
 }
 
+// the tracked access moves along, or the next barrier would discard the contents
 Image::Image(Image &&other) noexcept
-    : image(std::move(other.image)), allocation(std::move(other.allocation)), info(other.info) {}
+    : ImageResource(other), image(std::move(other.image)), allocation(std::move(other.allocation)), info(other.info) {}
 
 Image Image::create(const vma::Allocator &allocator, ImageCreateInfo create_info) {
     if (create_info.mip_levels == -1) {
@@ -248,24 +360,36 @@ Image Image::create(const vma::Allocator &allocator, ImageCreateInfo create_info
                 static_cast<uint32_t>(std::floor(std::log2(std::max(create_info.width, create_info.height)))) + 1;
     }
 
-    // TODO: VK_IMAGE_CREATE_MUTABLE_FORMAT_BIT
     // TODO: Handle unsupported formats
     // auto properties = physical_device.getImageFormatProperties2({
     //     .format = create_info.format,
     //     .type = create_info.type,
-    //     .usage = vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eTransferDst |
-    //     vk::ImageUsageFlagBits::eSampled,
+    //     .usage = create_info.usage,
     // });
 
+    std::array view_formats = {create_info.format, create_info.view_format};
+    vk::ImageFormatListCreateInfo format_list = {
+        .viewFormatCount = static_cast<uint32_t>(view_formats.size()),
+        .pViewFormats = view_formats.data(),
+    };
+    bool mutable_format = create_info.view_format != vk::Format::eUndefined;
+    bool concurrent = create_info.queue_families.size() > 1;
+
     auto [image, allocation] = allocator.createImageUnique(
             vk::ImageCreateInfo{
+                .pNext = mutable_format ? &format_list : nullptr,
+                // the storage usage of a view format may not be supported by the image's format
+                .flags = mutable_format ? vk::ImageCreateFlagBits::eMutableFormat | vk::ImageCreateFlagBits::eExtendedUsage
+                                        : vk::ImageCreateFlags{},
                 .imageType = create_info.type,
                 .format = create_info.format,
                 .extent = {.width = create_info.width, .height = create_info.height, .depth = create_info.depth},
                 .mipLevels = create_info.mip_levels,
                 .arrayLayers = create_info.array_layers,
-                .usage = vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eTransferDst |
-                         vk::ImageUsageFlagBits::eSampled,
+                .usage = create_info.usage,
+                .sharingMode = concurrent ? vk::SharingMode::eConcurrent : vk::SharingMode::eExclusive,
+                .queueFamilyIndexCount = concurrent ? static_cast<uint32_t>(create_info.queue_families.size()) : 0,
+                .pQueueFamilyIndices = concurrent ? create_info.queue_families.data() : nullptr,
             },
             {
                 .usage = vma::MemoryUsage::eAuto,
@@ -276,17 +400,22 @@ Image Image::create(const vma::Allocator &allocator, ImageCreateInfo create_info
     return {std::move(image), std::move(allocation), create_info};
 }
 
-void Image::load(const vk::CommandBuffer &cmd_buf, uint32_t level, vk::Extent3D region, const vk::Buffer &data) {
+void Image::load(
+        const vk::CommandBuffer &cmd_buf,
+        uint32_t level,
+        vk::Extent3D region,
+        const vk::Buffer &data,
+        vk::DeviceSize offset
+) {
     if (region.width == 0)
-        region.width = info.width;
+        region.width = std::max(info.width >> level, 1u);
     if (region.height == 0)
-        region.height = info.height;
+        region.height = std::max(info.height >> level, 1u);
     if (region.depth == 0)
-        region.depth = info.depth;
-
-    barrier(cmd_buf, ImageResourceAccess::TransferWrite);
+        region.depth = std::max(info.depth >> level, 1u);
 
     vk::BufferImageCopy image_copy = {
+        .bufferOffset = offset,
         .imageSubresource = {.aspectMask = imageAspectFlags(), .mipLevel = level, .layerCount = 1},
         .imageExtent = region,
     };
@@ -294,21 +423,11 @@ void Image::load(const vk::CommandBuffer &cmd_buf, uint32_t level, vk::Extent3D
 }
 
 void Image::generateMipmaps(const vk::CommandBuffer &cmd_buf) {
-    barrier(cmd_buf, ImageResourceAccess::TransferWrite);
-
-    vk::ImageMemoryBarrier2 barrier = {
-        .srcQueueFamilyIndex = vk::QueueFamilyIgnored,
-        .dstQueueFamilyIndex = vk::QueueFamilyIgnored,
-        .image = *image,
-        .subresourceRange =
-                {
-                    .aspectMask = vk::ImageAspectFlagBits::eColor,
-                    .baseMipLevel = 0,
-                    .levelCount = 1,
-                    .baseArrayLayer = 0,
-                    .layerCount = info.array_layers,
-                },
-    };
+    // each level is read once it was written, the ones below can still be written in the meantime
+    BarrierBatch barriers;
+    barrier(barriers, 0, 1, ImageResourceAccess::TransferRead);
+    if (info.mip_levels > 1)
+        barrier(barriers, 1, info.mip_levels - 1, ImageResourceAccess::TransferWrite);
 
     // TODO:
     // auto format_properties = backend.phyicalDevice.getFormatProperties(format);
@@ -324,18 +443,9 @@ void Image::generateMipmaps(const vk::CommandBuffer &cmd_buf) {
         int32_t next_level_width = std::max(level_width / 2, 1);
         int32_t next_level_height = std::max(level_height / 2, 1);
 
-        // transition layout of lower mip to src
-        if (prevAccess.layout != vk::ImageLayout::eTransferSrcOptimal) {
-            barrier.subresourceRange.baseMipLevel = lvl - 1;
-            barrier.oldLayout = prevAccess.layout;
-            barrier.newLayout = vk::ImageLayout::eTransferSrcOptimal;
-            barrier.srcAccessMask = vk::AccessFlagBits2::eTransferWrite;
-            barrier.dstAccessMask = vk::AccessFlagBits2::eTransferRead;
-            barrier.srcStageMask = vk::PipelineStageFlagBits2::eTransfer;
-            barrier.dstStageMask = vk::PipelineStageFlagBits2::eTransfer;
-
-            cmd_buf.pipelineBarrier2({.imageMemoryBarrierCount = 1, .pImageMemoryBarriers = &barrier});
-        }
+        if (lvl > 1)
+            barrier(barriers, lvl - 1, 1, ImageResourceAccess::TransferRead);
+        barriers.flush(cmd_buf);
 
         vk::ImageBlit blit = {
             .srcSubresource =
@@ -364,25 +474,7 @@ void Image::generateMipmaps(const vk::CommandBuffer &cmd_buf) {
         level_width = next_level_width;
         level_height = next_level_height;
     }
-
-    // final transition, kinda useless, but brings all levels to the same layout
-    if (prevAccess.layout != vk::ImageLayout::eTransferSrcOptimal) {
-        barrier.subresourceRange.baseMipLevel = info.mip_levels - 1;
-        barrier.oldLayout = prevAccess.layout;
-        barrier.newLayout = vk::ImageLayout::eTransferSrcOptimal;
-        barrier.srcAccessMask = vk::AccessFlagBits2::eTransferWrite;
-        barrier.dstAccessMask = vk::AccessFlagBits2::eTransferRead;
-        barrier.srcStageMask = vk::PipelineStageFlagBits2::eTransfer;
-        barrier.dstStageMask = vk::PipelineStageFlagBits2::eTransfer;
-
-        cmd_buf.pipelineBarrier2({.imageMemoryBarrierCount = 1, .pImageMemoryBarriers = &barrier});
-    }
-
-    prevAccess = {
-        .stage = vk::PipelineStageFlagBits2::eTransfer,
-        .access = vk::AccessFlagBits2::eTransferRead,
-        .layout = vk::ImageLayout::eTransferSrcOptimal
-    };
+    barriers.flush(cmd_buf);
 }
 
 vk::UniqueImageView Image::createDefaultView(const vk::Device &device) {
@@ -394,6 +486,15 @@ vk::UniqueImageView Image::createDefaultView(const vk::Device &device) {
     });
 }
 
+vk::UniqueImageView Image::createLevelView(const vk::Device &device, uint32_t level, vk::Format format) const {
+    return device.createImageViewUnique({
+        .image = *image,
+        .viewType = static_cast<vk::ImageViewType>(info.type),
+        .format = format,
+        .subresourceRange = {.aspectMask = vk::ImageAspectFlagBits::eColor, .baseMipLevel = level, .levelCount = 1, .layerCount = info.array_layers},
+    });
+}
+
 void Image::barrier(const vk::CommandBuffer &cmd_buf, const ImageResourceAccess &begin, const ImageResourceAccess &end) {
     ImageResource::barrier(
             *image, {.aspectMask = imageAspectFlags(), .levelCount = info.mip_levels, .layerCount = info.array_layers},
@@ -405,6 +506,32 @@ void Image::barrier(const vk::CommandBuffer &cmd_buf, const ImageResourceAccess
     barrier(cmd_buf, single, single);
 }
 
+void Image::barrier(BarrierBatch &batch, const ImageResourceAccess &begin, const ImageResourceAccess &end) {
+    ImageResource::barrier(*image, getResourceRange(), batch, begin, end);
+}
+
+void Image::barrier(BarrierBatch &batch, const ImageResourceAccess &single) {
+    barrier(batch, single, single);
+}
+
+void Image::barrier(
+        BarrierBatch &batch,
+        uint32_t base_level,
+        uint32_t level_count,
+        const ImageResourceAccess &begin,
+        const ImageResourceAccess &end
+) {
+    const auto resource = getResourceRange();
+    auto range = resource;
+    range.baseMipLevel = base_level;
+    range.levelCount = level_count;
+    ImageResource::barrier(*image, resource, range, batch, begin, end);
+}
+
+void Image::barrier(BarrierBatch &batch, uint32_t base_level, uint32_t level_count, const ImageResourceAccess &single) {
+    barrier(batch, base_level, level_count, single, single);
+}
+
 
 vk::ImageAspectFlags Image::imageAspectFlags() const {
     switch (info.format) {
@@ -437,3 +564,11 @@ void ImageRef::barrier(const vk::CommandBuffer &cmd_buf, const ImageResourceAcce
 void ImageRef::barrier(const vk::CommandBuffer &cmd_buf, const ImageResourceAccess &single) {
     barrier(cmd_buf, single, single);
 }
+
+void ImageRef::barrier(BarrierBatch &batch, const ImageResourceAccess &begin, const ImageResourceAccess &end) {
+    ImageResource::barrier(image, range, batch, begin, end);
+}
+
+void ImageRef::barrier(BarrierBatch &batch, const ImageResourceAccess &single) {
+    barrier(batch, single, single);
+}
@@ -2,9 +2,14 @@
 
 #include <filesystem>
 #include <span>
+#include <vector>
 #include <vulkan-memory-allocator-hpp/vk_mem_alloc.hpp>
 #include <vulkan/vulkan.hpp>
 
+#include "Mipmaps.h"
+
+class BarrierBatch;
+
 class PlainImageData {
     unsigned char *data;
     bool owning = false;
@@ -12,14 +17,25 @@ class PlainImageData {
 public:
     uint32_t width;
     uint32_t height;
+    // all mip levels, tightly packed one after the other starting with the largest
     std::span<unsigned char> pixels;
     vk::Format format;
+    uint32_t mipLevels = 1;
 
     PlainImageData() noexcept : data(nullptr), width(0), height(0), pixels({}), format(vk::Format::eUndefined) {}
 
-    PlainImageData(std::span<unsigned char> pixels, uint32_t width, uint32_t height, vk::Format format) noexcept;
+    PlainImageData(
+            std::span<unsigned char> pixels, uint32_t width, uint32_t height, vk::Format format, uint32_t mip_levels = 1
+    ) noexcept;
 
-    PlainImageData(std::unique_ptr<unsigned char> data, size_t size, uint32_t width, uint32_t height, vk::Format format) noexcept;
+    PlainImageData(
+            std::unique_ptr<unsigned char> data,
+            size_t size,
+            uint32_t width,
+            uint32_t height,
+            vk::Format format,
+            uint32_t mip_levels = 1
+    ) noexcept;
 
     ~PlainImageData() noexcept;
 
@@ -33,9 +49,29 @@ public:
 
     explicit operator bool() const { return static_cast<bool>(data); }
 
-    void copyChannels(PlainImageData &dst, std::initializer_list<int> mapping) const;
+    // Block compressed images can't be blitted, so their mip levels can't be generated on the GPU
+    [[nodiscard]] bool isCompressed() const;
+
+    // Only the base level is present and the remaining ones can be generated
+    [[nodiscard]] bool needsMipmaps() const { return mipLevels == 1 && !isCompressed(); }
+
+    // Byte offset of the mip level in pixels
+    [[nodiscard]] size_t levelOffset(uint32_t level) const;
+
+    // Size in bytes of a mip level of the format, whole blocks for block compressed formats
+    static size_t levelSize(vk::Format format, uint32_t width, uint32_t height, uint32_t level);
+
+    /**
+     * A copy with the full mip chain, each level is filtered from the previous one. sRGB formats are filtered as
+     * linear colors. Needs a single 8-bit level.
+     * @param parallel filter the rows of each level concurrently on the global thread pool
+     */
+    [[nodiscard]] PlainImageData generateMipmaps(MipFilter filter = MipFilter::Box, bool parallel = true) const;
 
-    void fill(std::initializer_list<int> channels, std::initializer_list<unsigned char> values);
+    // Copies every channel sc of the first level to channel mapping[sc] of dst, -1 skips it
+    void copyChannels(PlainImageData &dst, std::initializer_list<int> mapping, bool parallel = true) const;
+
+    void fill(std::initializer_list<int> channels, std::initializer_list<unsigned char> values, bool parallel = true);
 
     static PlainImageData create(vk::Format format, const std::filesystem::path &path);
 
@@ -51,12 +87,20 @@ struct ImageCreateInfo {
     uint32_t depth = 1;
     uint32_t mip_levels = -1u;
     uint32_t array_layers = 1;
-
-    static constexpr ImageCreateInfo from(const PlainImageData &plain_image_data) {
+    vk::ImageUsageFlags usage =
+            vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled;
+    // A second format views of the image can have, like the unorm one of an sRGB format for storage image access
+    vk::Format view_format = vk::Format::eUndefined;
+    // The queue families that access the image, shared concurrently if there is more than one
+    std::vector<uint32_t> queue_families = {};
+
+    static ImageCreateInfo from(const PlainImageData &plain_image_data) {
         return {
             .format = plain_image_data.format,
             .width = plain_image_data.width,
             .height = plain_image_data.height,
+            // a full chain to generate, or exactly the levels that are there
+            .mip_levels = plain_image_data.needsMipmaps() ? -1u : plain_image_data.mipLevels,
         };
     }
 };
@@ -66,8 +110,13 @@ struct ImageResourceAccess {
     vk::AccessFlags2 access = vk::AccessFlagBits2::eNone;
     vk::ImageLayout layout = vk::ImageLayout::eUndefined;
 
+    bool operator==(const ImageResourceAccess &other) const = default;
+
+    static const ImageResourceAccess TransferRead;
     static const ImageResourceAccess TransferWrite;
     static const ImageResourceAccess FragmentShaderRead;
+    static const ImageResourceAccess ComputeShaderRead;
+    static const ImageResourceAccess ComputeShaderReadWrite;
     static const ImageResourceAccess ColorAttachmentWrite;
     static const ImageResourceAccess DepthAttachmentWrite;
     static const ImageResourceAccess DepthAttachmentRead;
@@ -75,9 +124,40 @@ struct ImageResourceAccess {
 };
 
 class ImageResource {
+    // The last access of every subresource, the levels of a layer after each other. Only one while they all share it,
+    // which barriers of the whole resource keep it at.
+    std::vector<ImageResourceAccess> accesses_ = {ImageResourceAccess{}};
+    uint32_t levelCount_ = 1;
+
 protected:
-    ImageResourceAccess prevAccess = {};
+    /**
+     * Adds the barriers from the previous accesses of the subresources to begin to the batch, one for each run of
+     * levels with the same previous access. Reading again what the previous access already read in the same layout
+     * needs no barrier.
+     * @param resource all subresources, its counts can only be the remaining ones if range is the same
+     * @param range the subresources within resource
+     * @param end the access after the barriers
+     */
+    void barrier(
+            vk::Image image,
+            vk::ImageSubresourceRange resource,
+            vk::ImageSubresourceRange range,
+            BarrierBatch &batch,
+            const ImageResourceAccess &begin,
+            const ImageResourceAccess &end
+    );
+
+    void barrier(
+            vk::Image image,
+            vk::ImageSubresourceRange range,
+            BarrierBatch &batch,
+            const ImageResourceAccess &begin,
+            const ImageResourceAccess &end
+    ) {
+        barrier(image, range, range, batch, begin, end);
+    }
 
+    // Records the barrier right away, a BarrierBatch can merge it with others instead
     void barrier(
             vk::Image image,
             vk::ImageSubresourceRange range,
@@ -85,12 +165,14 @@ protected:
             const ImageResourceAccess &begin,
             const ImageResourceAccess &end
     );
+
+public:
+    // The last access of a subresource, relative to the start of the resource
+    [[nodiscard]] const ImageResourceAccess &lastAccess(uint32_t level = 0, uint32_t layer = 0) const;
 };
 
 
 class Image : ImageResource {
-    [[nodiscard]] vk::Image getImage() const { return *image; }
-
     [[nodiscard]] vk::ImageSubresourceRange getResourceRange() const {
         return {
             .aspectMask = imageAspectFlags(),
@@ -114,16 +196,51 @@ public:
 
     Image &operator=(Image &&other) noexcept;
 
-    void load(const vk::CommandBuffer &cmd_buf, uint32_t level, vk::Extent3D region, const vk::Buffer &data);
+    [[nodiscard]] vk::Image getImage() const { return *image; }
 
+    [[nodiscard]] const ImageCreateInfo &createInfo() const { return info; }
+
+    // An empty region is the whole level. Block compressed data is tightly packed blocks. The image has to be in
+    // ImageResourceAccess::TransferWrite already, so the levels of several images can share one barrier.
+    void load(
+            const vk::CommandBuffer &cmd_buf,
+            uint32_t level,
+            vk::Extent3D region,
+            const vk::Buffer &data,
+            vk::DeviceSize offset = 0
+    );
+
+    // Blits every level from the previous one, level 0 has to be loaded. Filters sRGB formats in sRGB space, the
+    // loaders use PlainImageData::generateMipmaps or ComputeMipGenerator instead. Leaves the levels in
+    // ImageResourceAccess::TransferRead, except for the last one still in TransferWrite.
     void generateMipmaps(const vk::CommandBuffer &cmd_buf);
 
     vk::UniqueImageView createDefaultView(const vk::Device &device);
 
+    // A view of a single level, the format is either the image's or its view_format
+    vk::UniqueImageView createLevelView(const vk::Device &device, uint32_t level, vk::Format format) const;
+
     void barrier(const vk::CommandBuffer &cmd_buf, const ImageResourceAccess &begin, const ImageResourceAccess &end);
 
     void barrier(const vk::CommandBuffer &cmd_buf, const ImageResourceAccess &single);
 
+    void barrier(BarrierBatch &batch, const ImageResourceAccess &begin, const ImageResourceAccess &end);
+
+    void barrier(BarrierBatch &batch, const ImageResourceAccess &single);
+
+    // Only the levels of all layers, the others keep their access. One level can be sampled while the next is written.
+    void barrier(
+            BarrierBatch &batch,
+            uint32_t base_level,
+            uint32_t level_count,
+            const ImageResourceAccess &begin,
+            const ImageResourceAccess &end
+    );
+
+    void barrier(BarrierBatch &batch, uint32_t base_level, uint32_t level_count, const ImageResourceAccess &single);
+
+    using ImageResource::lastAccess;
+
 private:
     vma::UniqueImage image;
     vma::UniqueAllocation allocation;
@@ -143,4 +260,8 @@ public:
     void barrier(const vk::CommandBuffer &cmd_buf, const ImageResourceAccess &begin, const ImageResourceAccess &end);
 
     void barrier(const vk::CommandBuffer &cmd_buf, const ImageResourceAccess &single);
+
+    void barrier(BarrierBatch &batch, const ImageResourceAccess &begin, const ImageResourceAccess &end);
+
+    void barrier(BarrierBatch &batch, const ImageResourceAccess &single);
 };
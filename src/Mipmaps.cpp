@@ -0,0 +1,356 @@
+#include "Mipmaps.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <format>
+#include <limits>
+#include <numbers>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MIPMAPS_SSE2
+#include <emmintrin.h>
+#endif
+
+#include "Logger.h"
+#include "util/thread_pool.h"
+
+namespace {
+    constexpr int MAX_TAPS = 8;
+    // chunks of rows have at least this many dst texels
+    constexpr size_t PARALLEL_GRAIN = 16384;
+    // the Kaiser window reaches this many dst texels to each side, the same shape as NVTT's default
+    constexpr float KAISER_RADIUS = 2.0f;
+    constexpr float KAISER_ALPHA = 4.0f;
+    // linear values are split into this many buckets for encoding to sRGB, each holds at most one code boundary
+    constexpr int SRGB_ENCODE_BUCKETS = 4096;
+
+    // The weights of the src texels 2 * x + first + i that dst texel x is the sum of, the same in both directions
+    struct Taps {
+        int count = 0;
+        int first = 0;
+        std::array<float, MAX_TAPS> weights{};
+    };
+
+    // The modified Bessel function of the first kind of order 0, its series converges quickly for the window
+    float bessel_i0(float x) {
+        float sum = 1.0f;
+        float term = 1.0f;
+        for (int k = 1; k < 32; k++) {
+            term *= (x / (2.0f * static_cast<float>(k))) * (x / (2.0f * static_cast<float>(k)));
+            sum += term;
+            if (term < sum * 1e-7f)
+                break;
+        }
+        return sum;
+    }
+
+    // Taps of the Kaiser windowed sinc, normalized so a constant level stays constant
+    const Taps &kaiser_taps() {
+        static const Taps taps = [] {
+            constexpr float pi = std::numbers::pi_v<float>;
+            Taps result = {.count = MAX_TAPS, .first = 1 - MAX_TAPS / 2};
+            float sum = 0.0f;
+            for (int i = 0; i < result.count; i++) {
+                // distance between the centers of the src and the dst texel, in dst texels
+                const float t = (static_cast<float>(result.first + i) - 0.5f) / 2.0f;
+                const float sinc = t == 0.0f ? 1.0f : std::sin(pi * t) / (pi * t);
+                const float w = t / KAISER_RADIUS;
+                const float window = bessel_i0(KAISER_ALPHA * std::sqrt(std::max(1.0f - w * w, 0.0f))) /
+                                     bessel_i0(KAISER_ALPHA);
+                result.weights[i] = sinc * window;
+                sum += result.weights[i];
+            }
+            for (int i = 0; i < result.count; i++)
+                result.weights[i] /= sum;
+            return result;
+        }();
+        return taps;
+    }
+
+    float srgb_to_linear(float srgb) {
+        return srgb <= 0.04045f ? srgb / 12.92f : std::pow((srgb + 0.055f) / 1.055f, 2.4f);
+    }
+
+    // Linear values are scaled to 0..255 like unorm ones, so both are filtered the same way
+    struct SrgbTables {
+        std::array<float, 256> decode;
+        // a linear value from thresholds[c] on is encoded to code c + 1 or above, these are halfway between the codes
+        // and there's none above 255
+        std::array<float, 256> thresholds;
+        // the code at the start of each bucket
+        std::array<uint8_t, SRGB_ENCODE_BUCKETS> encode;
+    };
+
+    const SrgbTables &srgb_tables() {
+        static const SrgbTables tables = [] {
+            SrgbTables result;
+            for (int code = 0; code < 256; code++)
+                result.decode[code] = 255.0f * srgb_to_linear(static_cast<float>(code) / 255.0f);
+            for (int code = 0; code < 255; code++)
+                result.thresholds[code] = 255.0f * srgb_to_linear((static_cast<float>(code) + 0.5f) / 255.0f);
+            result.thresholds[255] = std::numeric_limits<float>::infinity();
+            int code = 0;
+            for (int bucket = 0; bucket < SRGB_ENCODE_BUCKETS; bucket++) {
+                const float start = static_cast<float>(bucket) * 255.0f / SRGB_ENCODE_BUCKETS;
+                while (code < 255 && start >= result.thresholds[code])
+                    code++;
+                result.encode[bucket] = static_cast<uint8_t>(code);
+            }
+            return result;
+        }();
+        return tables;
+    }
+
+    uint8_t encode_srgb(const SrgbTables &tables, float linear) {
+        linear = std::clamp(linear, 0.0f, 255.0f);
+        const int bucket = std::min(static_cast<int>(linear * (SRGB_ENCODE_BUCKETS / 255.0f)), SRGB_ENCODE_BUCKETS - 1);
+        const int code = tables.encode[bucket];
+        return static_cast<uint8_t>(code + (linear >= tables.thresholds[code]));
+    }
+
+    uint8_t encode_unorm(float value) {
+        return static_cast<uint8_t>(std::clamp(value, 0.0f, 255.0f) + 0.5f);
+    }
+
+    // Channel values of the unorm channels, sRGB ones use SrgbTables::decode
+    const std::array<float, 256> &unorm_table() {
+        static const std::array<float, 256> table = [] {
+            std::array<float, 256> result;
+            for (int value = 0; value < 256; value++)
+                result[value] = static_cast<float>(value);
+            return result;
+        }();
+        return table;
+    }
+
+    struct Level {
+        const unsigned char *src;
+        uint32_t width;
+        uint32_t height;
+        unsigned char *dst;
+        uint32_t dst_width;
+    };
+
+    // Filters a decoded src row horizontally into a dst texel, src is its first tap and none of them need clamping
+    template<uint32_t Channels>
+    void filter_horizontal(const Taps &taps, const float *src, float *texel) {
+#ifdef MIPMAPS_SSE2
+        if constexpr (Channels == 4) {
+            __m128 sum = _mm_setzero_ps();
+            for (int t = 0; t < taps.count; t++)
+                sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(taps.weights[t]), _mm_loadu_ps(src + t * 4)));
+            _mm_storeu_ps(texel, sum);
+            return;
+        }
+#endif
+        for (uint32_t c = 0; c < Channels; c++)
+            texel[c] = 0.0f;
+        for (int t = 0; t < taps.count; t++) {
+            for (uint32_t c = 0; c < Channels; c++)
+                texel[c] += taps.weights[t] * src[t * Channels + c];
+        }
+    }
+
+    /**
+     * The src rows of a chunk decoded and filtered horizontally, so each is done once while the filter slides down.
+     * Holds the taps of one dst row and the two rows the next one needs on top.
+     */
+    template<uint32_t Channels, bool Srgb>
+    class RowCache {
+        // the decoded row is padded with its edge texels, so the horizontal taps never need clamping
+        static constexpr int PADDING = MAX_TAPS;
+
+        const Taps &taps_;
+        const Level &level_;
+        size_t row_floats_;
+        std::vector<float> rows_;
+        std::vector<int64_t> tags_;
+        std::vector<float> decoded_;
+        std::array<const float *, Channels> decode_;
+
+    public:
+        RowCache(const Taps &taps, const Level &level)
+            : taps_(taps),
+              level_(level),
+              row_floats_(static_cast<size_t>(level.dst_width) * Channels),
+              rows_(row_floats_ * static_cast<size_t>(taps.count + 2)),
+              tags_(static_cast<size_t>(taps.count + 2), -1),
+              decoded_((static_cast<size_t>(level.width) + 2 * PADDING) * Channels) {
+            // alpha stays linear in sRGB formats
+            for (uint32_t c = 0; c < Channels; c++)
+                decode_[c] = Srgb && c < 3 ? srgb_tables().decode.data() : unorm_table().data();
+        }
+
+        const float *row(uint32_t y) {
+            const size_t slot = y % tags_.size();
+            float *row = rows_.data() + slot * row_floats_;
+            if (tags_[slot] == y)
+                return row;
+            tags_[slot] = y;
+
+            const unsigned char *src = level_.src + static_cast<size_t>(y) * level_.width * Channels;
+            float *decoded = decoded_.data() + PADDING * Channels;
+            for (size_t x = 0; x < level_.width; x++) {
+                for (uint32_t c = 0; c < Channels; c++)
+                    decoded[x * Channels + c] = decode_[c][src[x * Channels + c]];
+            }
+            const size_t last = level_.width - 1;
+            for (size_t x = 1; x <= PADDING; x++) {
+                std::copy_n(decoded, Channels, decoded - x * Channels);
+                std::copy_n(decoded + last * Channels, Channels, decoded + (last + x) * Channels);
+            }
+
+            for (size_t x = 0; x < level_.dst_width; x++) {
+                // a level 1 texel wide repeats its column, like the padding does
+                const ptrdiff_t first = static_cast<ptrdiff_t>(std::min(2 * x, last)) + taps_.first;
+                filter_horizontal<Channels>(taps_, decoded + first * Channels, row + x * Channels);
+            }
+            return row;
+        }
+    };
+
+    // dst[i] = sum of weights[t] * rows[t][i]
+    void filter_vertical(const Taps &taps, const std::array<const float *, MAX_TAPS> &rows, float *dst, size_t size) {
+        size_t i = 0;
+#ifdef MIPMAPS_SSE2
+        for (; i + 4 <= size; i += 4) {
+            __m128 sum = _mm_mul_ps(_mm_set1_ps(taps.weights[0]), _mm_loadu_ps(rows[0] + i));
+            for (int t = 1; t < taps.count; t++)
+                sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(taps.weights[t]), _mm_loadu_ps(rows[t] + i)));
+            _mm_storeu_ps(dst + i, sum);
+        }
+#endif
+        for (; i < size; i++) {
+            float sum = 0.0f;
+            for (int t = 0; t < taps.count; t++)
+                sum += taps.weights[t] * rows[t][i];
+            dst[i] = sum;
+        }
+    }
+
+    template<uint32_t Channels, bool Srgb>
+    void encode_texel(const SrgbTables &tables, const float *texel, unsigned char *dst) {
+#ifdef MIPMAPS_SSE2
+        if constexpr (Channels == 4 && !Srgb) {
+            const __m128 clamped = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(texel), _mm_setzero_ps()), _mm_set1_ps(255.0f));
+            const __m128i values = _mm_cvttps_epi32(_mm_add_ps(clamped, _mm_set1_ps(0.5f)));
+            const __m128i bytes = _mm_packus_epi16(_mm_packs_epi32(values, values), _mm_setzero_si128());
+            const auto packed = static_cast<uint32_t>(_mm_cvtsi128_si32(bytes));
+            std::memcpy(dst, &packed, sizeof(packed));
+            return;
+        }
+#endif
+        for (uint32_t c = 0; c < Channels; c++)
+            dst[c] = Srgb && c < 3 ? encode_srgb(tables, texel[c]) : encode_unorm(texel[c]);
+    }
+
+    // The separable filter of rows [begin, end) of dst, horizontally first so the vertical taps work on half the width
+    template<uint32_t Channels, bool Srgb>
+    void filter_rows(const Taps &taps, const Level &level, size_t begin, size_t end) {
+        RowCache<Channels, Srgb> cache(taps, level);
+        std::vector<float> texels(static_cast<size_t>(level.dst_width) * Channels);
+        const auto &tables = srgb_tables();
+        const int last_row = static_cast<int>(level.height) - 1;
+
+        for (size_t y = begin; y < end; y++) {
+            std::array<const float *, MAX_TAPS> rows{};
+            for (int t = 0; t < taps.count; t++)
+                rows[t] = cache.row(std::clamp(static_cast<int>(2 * y) + taps.first + t, 0, last_row));
+            filter_vertical(taps, rows, texels.data(), texels.size());
+
+            unsigned char *dst = level.dst + y * level.dst_width * Channels;
+            for (size_t x = 0; x < level.dst_width; x++)
+                encode_texel<Channels, Srgb>(tables, texels.data() + x * Channels, dst + x * Channels);
+        }
+    }
+
+    // The average of 2x2 src texels, exact for unorm channels. Much faster than the separable filter with these taps.
+    template<uint32_t Channels, bool Srgb>
+    void box_rows(const Level &level, size_t begin, size_t end) {
+        const auto &tables = srgb_tables();
+        const size_t src_row = static_cast<size_t>(level.width) * Channels;
+        // a level 1 texel wide repeats its column
+        const size_t right = level.width > 1 ? Channels : 0;
+
+        for (size_t y = begin; y < end; y++) {
+            const unsigned char *row0 = level.src + std::min<size_t>(2 * y, level.height - 1) * src_row;
+            const unsigned char *row1 = level.src + std::min<size_t>(2 * y + 1, level.height - 1) * src_row;
+            unsigned char *dst = level.dst + y * level.dst_width * Channels;
+            uint32_t x = 0;
+#ifdef MIPMAPS_SSE2
+            if constexpr (Channels == 4 && !Srgb) {
+                // 2 dst texels from 4 src texels of each row
+                const __m128i zero = _mm_setzero_si128();
+                for (; right != 0 && x + 2 <= level.dst_width; x += 2) {
+                    const __m128i top = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row0 + x * 8));
+                    const __m128i bottom = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row1 + x * 8));
+                    const __m128i low = _mm_add_epi16(_mm_unpacklo_epi8(top, zero), _mm_unpacklo_epi8(bottom, zero));
+                    const __m128i high = _mm_add_epi16(_mm_unpackhi_epi8(top, zero), _mm_unpackhi_epi8(bottom, zero));
+                    const __m128i sums = _mm_add_epi16(
+                            _mm_unpacklo_epi64(low, high), _mm_unpackhi_epi64(low, high)
+                    );
+                    const __m128i averages = _mm_srli_epi16(_mm_add_epi16(sums, _mm_set1_epi16(2)), 2);
+                    _mm_storel_epi64(reinterpret_cast<__m128i *>(dst + x * 4), _mm_packus_epi16(averages, zero));
+                }
+            }
+#endif
+            for (; x < level.dst_width; x++) {
+                const unsigned char *top = row0 + 2 * x * Channels;
+                const unsigned char *bottom = row1 + 2 * x * Channels;
+                for (uint32_t c = 0; c < Channels; c++) {
+                    if (Srgb && c < 3) {
+                        const auto &decode = tables.decode;
+                        const float sum = decode[top[c]] + decode[top[c + right]] + decode[bottom[c]] +
+                                          decode[bottom[c + right]];
+                        dst[x * Channels + c] = encode_srgb(tables, 0.25f * sum);
+                    } else {
+                        const uint32_t sum = top[c] + top[c + right] + bottom[c] + bottom[c + right];
+                        dst[x * Channels + c] = static_cast<unsigned char>((sum + 2) / 4);
+                    }
+                }
+            }
+        }
+    }
+
+    template<uint32_t Channels, bool Srgb>
+    void filter_level(MipFilter filter, const Level &level, uint32_t dst_height, bool parallel) {
+        const auto filter_chunk = [&](size_t begin, size_t end) {
+            if (filter == MipFilter::Box)
+                box_rows<Channels, Srgb>(level, begin, end);
+            else
+                filter_rows<Channels, Srgb>(kaiser_taps(), level, begin, end);
+        };
+        if (parallel)
+            util::parallel_for(dst_height, std::max<size_t>(PARALLEL_GRAIN / level.dst_width, 1), filter_chunk);
+        else
+            filter_chunk(0, dst_height);
+    }
+} // namespace
+
+void downsampleMipLevel(
+        const unsigned char *src, uint32_t width, uint32_t height, uint32_t channels, bool srgb, MipFilter filter,
+        unsigned char *dst, bool parallel
+) {
+    const Level level = {
+        .src = src,
+        .width = width,
+        .height = height,
+        .dst = dst,
+        .dst_width = std::max(width / 2, 1u),
+    };
+    const uint32_t dst_height = std::max(height / 2, 1u);
+
+    using FilterLevel = void (*)(MipFilter, const Level &, uint32_t, bool);
+    constexpr std::array<std::array<FilterLevel, 2>, 4> filter_levels = {{
+        {&filter_level<1, false>, &filter_level<1, true>},
+        {&filter_level<2, false>, &filter_level<2, true>},
+        {&filter_level<3, false>, &filter_level<3, true>},
+        {&filter_level<4, false>, &filter_level<4, true>},
+    }};
+    if (channels < 1 || channels > 4)
+        Logger::panic(std::format("Can't filter mip levels of {} channels", channels));
+    filter_levels[channels - 1][srgb](filter, level, dst_height, parallel);
+}
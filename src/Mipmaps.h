@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstdint>
+
+// How a mip level is filtered down from the previous one
+enum class MipFilter {
+    // the average of 2x2 texels
+    Box,
+    // a Kaiser windowed sinc over 8x8 texels, sharper than Box
+    Kaiser,
+};
+
+/**
+ * Filters a level of 8-bit channels down to the next one, half the size rounded down but at least 1.
+ * Odd sizes repeat the last row or column. Kaiser results outside the channel range are clamped.
+ * @param srgb the color channels are sRGB encoded, they are filtered as linear values. Alpha is always linear.
+ * @param parallel filter chunks of rows concurrently on the global thread pool
+ */
+void downsampleMipLevel(
+        const unsigned char *src, uint32_t width, uint32_t height, uint32_t channels, bool srgb, MipFilter filter,
+        unsigned char *dst, bool parallel = true
+);
@@ -0,0 +1,634 @@
+#include "PixelCopy.h"
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <format>
+#include <span>
+#include <utility>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define PIXEL_COPY_X86
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(__aarch64__) || defined(_M_ARM64)
+#define PIXEL_COPY_NEON
+#include <arm_neon.h>
+#endif
+
+// GCC and Clang only emit instructions the function is compiled for, MSVC allows all of them everywhere
+#if defined(PIXEL_COPY_X86) && (defined(__GNUC__) || defined(__clang__))
+#define PIXEL_COPY_TARGET(isa) __attribute__((target(isa)))
+#else
+#define PIXEL_COPY_TARGET(isa)
+#endif
+
+// The loops over the registers of a block have to be unrolled for the arrays of them to stay in registers
+#if defined(__clang__)
+#define PIXEL_COPY_UNROLL _Pragma("unroll")
+#elif defined(__GNUC__)
+#define PIXEL_COPY_UNROLL _Pragma("GCC unroll 4")
+#else
+#define PIXEL_COPY_UNROLL
+#endif
+
+#include "Logger.h"
+#include "util/thread_pool.h"
+
+namespace {
+    // the SIMD kernels convert blocks of this many pixels, the rest is left to the scalar one
+    constexpr size_t BLOCK_PIXELS = 16;
+    // images smaller than this many pixels aren't worth splitting, the chunks are at least this large as well
+    constexpr size_t PARALLEL_MIN_PIXELS = 1 << 18;
+    constexpr size_t PARALLEL_GRAIN = 1 << 16;
+
+    // a value per channel, -1 if unused
+    using ChannelArray = std::array<int, 4>;
+
+    using CopyFunction = void (*)(const unsigned char *src, unsigned char *dst, size_t elements);
+    using ChannelFunction =
+            void (*)(const unsigned char *src, unsigned char *dst, size_t elements, const ChannelArray &mapping);
+    using FillFunction = void (*)(unsigned char *pixels, size_t elements, const ChannelArray &fill);
+
+    template<int SrcCh, int DstCh>
+        requires(SrcCh >= 1) && (SrcCh <= 4) && (DstCh >= 1) && (DstCh <= 4)
+    void copy_pixels(const unsigned char *src, unsigned char *dst, size_t elements) {
+        // clang-format off
+        for (size_t i = 0; i < elements; i++) {
+            // always copy first
+            dst[i * DstCh] = src[i * SrcCh];
+            if constexpr (DstCh < SrcCh) {
+                if constexpr (DstCh > 1) dst[i * DstCh + 1] = src[i * SrcCh + 1];
+                if constexpr (DstCh > 2) dst[i * DstCh + 2] = src[i * SrcCh + 2];
+                if constexpr (DstCh > 3) dst[i * DstCh + 3] = src[i * SrcCh + 3];
+            } else {
+                if constexpr (SrcCh > 1) dst[i * DstCh + 1] = src[i * SrcCh + 1];
+                if constexpr (SrcCh > 2) dst[i * DstCh + 2] = src[i * SrcCh + 2];
+                if constexpr (SrcCh > 3) dst[i * DstCh + 3] = src[i * SrcCh + 3];
+
+                // extend
+                if constexpr (DstCh > SrcCh) {
+                    // This might be wrong
+                    if constexpr (DstCh - SrcCh >= 1) dst[i * DstCh + SrcCh] = 0;
+                    if constexpr (DstCh - SrcCh >= 2) dst[i * DstCh + SrcCh + 1] = 0;
+                    if constexpr (DstCh - SrcCh >= 3) dst[i * DstCh + SrcCh + 2] = 0;
+                    if constexpr (DstCh == 4) dst[i * DstCh + 3] = 255;
+                }
+            }
+        }
+        // clang-format on
+    }
+
+    template<int SrcCh, int DstCh>
+    void copy_channels(const unsigned char *src, unsigned char *dst, size_t elements, const ChannelArray &mapping) {
+        for (size_t i = 0; i < elements; i++) {
+            for (int sc = 0; sc < SrcCh; sc++) {
+                if (mapping[sc] != -1)
+                    dst[i * DstCh + mapping[sc]] = src[i * SrcCh + sc];
+            }
+        }
+    }
+
+    template<int Channels>
+    void fill_pixels(unsigned char *pixels, size_t elements, const ChannelArray &fill) {
+        for (size_t i = 0; i < elements; i++) {
+            for (int c = 0; c < Channels; c++) {
+                if (fill[c] != -1)
+                    pixels[i * Channels + c] = static_cast<unsigned char>(fill[c]);
+            }
+        }
+    }
+
+    /**
+     * How the x86 and NEON kernels convert a block of BLOCK_PIXELS pixels, SrcCh 16-byte registers in and DstCh
+     * registers out. Output register k is the or of the byte shuffles of the input registers l it takes bytes from,
+     * masks[k][l] picks them, mask bytes with the high bit set give 0. The constant bytes are or-ed in afterwards,
+     * the bytes in keep are taken from dst when merging into it.
+     */
+    template<int SrcCh, int DstCh>
+    struct BlockShuffle {
+        std::array<std::array<std::array<int8_t, 16>, SrcCh>, DstCh> masks{};
+        std::array<std::array<bool, SrcCh>, DstCh> used{};
+        std::array<std::array<uint8_t, 16>, DstCh> constant{};
+        std::array<std::array<uint8_t, 16>, DstCh> keep{};
+    };
+
+    /**
+     * @param mapping the dst channel of each src channel, -1 drops it
+     * @param fill the value of each dst channel no src channel is mapped to, -1 keeps the dst value
+     */
+    template<int SrcCh, int DstCh>
+    constexpr BlockShuffle<SrcCh, DstCh> block_shuffle(const ChannelArray &mapping, const ChannelArray &fill) {
+        BlockShuffle<SrcCh, DstCh> shuffle;
+        for (auto &register_masks: shuffle.masks) {
+            for (auto &mask: register_masks)
+                mask.fill(-128);
+        }
+        for (int k = 0; k < DstCh; k++) {
+            for (int b = 0; b < 16; b++) {
+                const int pixel = (k * 16 + b) / DstCh;
+                const int channel = (k * 16 + b) % DstCh;
+                int src_channel = -1;
+                for (int sc = 0; sc < SrcCh; sc++) {
+                    if (mapping[sc] == channel)
+                        src_channel = sc;
+                }
+                if (src_channel != -1) {
+                    const int s = pixel * SrcCh + src_channel;
+                    shuffle.masks[k][s / 16][b] = static_cast<int8_t>(s % 16);
+                    shuffle.used[k][s / 16] = true;
+                } else if (fill[channel] != -1) {
+                    shuffle.constant[k][b] = static_cast<uint8_t>(fill[channel]);
+                } else {
+                    shuffle.keep[k][b] = 0xff;
+                }
+            }
+        }
+        return shuffle;
+    }
+
+    // copyPixels keeps the channels in place, the missing ones become 0 and alpha 255
+    template<int SrcCh, int DstCh>
+    constexpr auto PIXEL_SHUFFLE = block_shuffle<SrcCh, DstCh>({0, 1, 2, 3}, {0, 0, 0, 255});
+
+    // The same for filling channels without a source, a block is Channels registers
+    template<int Channels>
+    struct BlockFill {
+        std::array<std::array<uint8_t, 16>, Channels> values{};
+        std::array<std::array<uint8_t, 16>, Channels> keep{};
+    };
+
+    template<int Channels>
+    BlockFill<Channels> block_fill(const ChannelArray &fill) {
+        BlockFill<Channels> block;
+        for (int k = 0; k < Channels; k++) {
+            for (int b = 0; b < 16; b++) {
+                const int channel = (k * 16 + b) % Channels;
+                if (fill[channel] != -1)
+                    block.values[k][b] = static_cast<uint8_t>(fill[channel]);
+                else
+                    block.keep[k][b] = 0xff;
+            }
+        }
+        return block;
+    }
+
+#ifdef PIXEL_COPY_X86
+    // Returns the number of pixels converted, a multiple of BLOCK_PIXELS
+    template<int SrcCh, int DstCh, bool Merge>
+    PIXEL_COPY_TARGET("ssse3")
+    size_t shuffle_blocks_ssse3(
+            const BlockShuffle<SrcCh, DstCh> &shuffle, const unsigned char *src, unsigned char *dst, size_t elements
+    ) {
+        __m128i masks[DstCh][SrcCh];
+        __m128i constant[DstCh];
+        __m128i keep[DstCh];
+        for (int k = 0; k < DstCh; k++) {
+            PIXEL_COPY_UNROLL
+            for (int l = 0; l < SrcCh; l++)
+                masks[k][l] = _mm_loadu_si128(reinterpret_cast<const __m128i *>(shuffle.masks[k][l].data()));
+            constant[k] = _mm_loadu_si128(reinterpret_cast<const __m128i *>(shuffle.constant[k].data()));
+            keep[k] = _mm_loadu_si128(reinterpret_cast<const __m128i *>(shuffle.keep[k].data()));
+        }
+
+        const size_t blocks = elements / BLOCK_PIXELS;
+        for (size_t i = 0; i < blocks; i++) {
+            const auto *block_src = reinterpret_cast<const __m128i *>(src + i * BLOCK_PIXELS * SrcCh);
+            auto *block_dst = reinterpret_cast<__m128i *>(dst + i * BLOCK_PIXELS * DstCh);
+            __m128i in[SrcCh];
+            PIXEL_COPY_UNROLL
+            for (int l = 0; l < SrcCh; l++)
+                in[l] = _mm_loadu_si128(block_src + l);
+            PIXEL_COPY_UNROLL
+            for (int k = 0; k < DstCh; k++) {
+                __m128i out = constant[k];
+                if constexpr (Merge)
+                    out = _mm_or_si128(out, _mm_and_si128(_mm_loadu_si128(block_dst + k), keep[k]));
+                PIXEL_COPY_UNROLL
+                for (int l = 0; l < SrcCh; l++) {
+                    if (shuffle.used[k][l])
+                        out = _mm_or_si128(out, _mm_shuffle_epi8(in[l], masks[k][l]));
+                }
+                _mm_storeu_si128(block_dst + k, out);
+            }
+        }
+        return blocks * BLOCK_PIXELS;
+    }
+
+    // AVX2 only shuffles within 128-bit lanes, so each register holds the same part of two consecutive blocks
+    template<int SrcCh, int DstCh, bool Merge>
+    PIXEL_COPY_TARGET("avx2")
+    size_t shuffle_blocks_avx2(
+            const BlockShuffle<SrcCh, DstCh> &shuffle, const unsigned char *src, unsigned char *dst, size_t elements
+    ) {
+        __m256i masks[DstCh][SrcCh];
+        __m256i constant[DstCh];
+        __m256i keep[DstCh];
+        for (int k = 0; k < DstCh; k++) {
+            for (int l = 0; l < SrcCh; l++) {
+                masks[k][l] = _mm256_broadcastsi128_si256(
+                        _mm_loadu_si128(reinterpret_cast<const __m128i *>(shuffle.masks[k][l].data()))
+                );
+            }
+            constant[k] = _mm256_broadcastsi128_si256(
+                    _mm_loadu_si128(reinterpret_cast<const __m128i *>(shuffle.constant[k].data()))
+            );
+            keep[k] = _mm256_broadcastsi128_si256(
+                    _mm_loadu_si128(reinterpret_cast<const __m128i *>(shuffle.keep[k].data()))
+            );
+        }
+
+        const size_t pairs = elements / (2 * BLOCK_PIXELS);
+        for (size_t i = 0; i < pairs; i++) {
+            const auto *block_src = reinterpret_cast<const __m128i *>(src + i * 2 * BLOCK_PIXELS * SrcCh);
+            auto *block_dst = reinterpret_cast<__m128i *>(dst + i * 2 * BLOCK_PIXELS * DstCh);
+            __m256i in[SrcCh];
+            PIXEL_COPY_UNROLL
+            for (int l = 0; l < SrcCh; l++) {
+                const __m128i first = _mm_loadu_si128(block_src + l);
+                const __m128i second = _mm_loadu_si128(block_src + SrcCh + l);
+                in[l] = _mm256_inserti128_si256(_mm256_castsi128_si256(first), second, 1);
+            }
+            PIXEL_COPY_UNROLL
+            for (int k = 0; k < DstCh; k++) {
+                __m256i out = constant[k];
+                if constexpr (Merge) {
+                    const __m128i first = _mm_loadu_si128(block_dst + k);
+                    const __m128i second = _mm_loadu_si128(block_dst + DstCh + k);
+                    const __m256i current = _mm256_inserti128_si256(_mm256_castsi128_si256(first), second, 1);
+                    out = _mm256_or_si256(out, _mm256_and_si256(current, keep[k]));
+                }
+                PIXEL_COPY_UNROLL
+                for (int l = 0; l < SrcCh; l++) {
+                    if (shuffle.used[k][l])
+                        out = _mm256_or_si256(out, _mm256_shuffle_epi8(in[l], masks[k][l]));
+                }
+                _mm_storeu_si128(block_dst + k, _mm256_castsi256_si128(out));
+                _mm_storeu_si128(block_dst + DstCh + k, _mm256_extracti128_si256(out, 1));
+            }
+        }
+        return pairs * 2 * BLOCK_PIXELS;
+    }
+
+    // Just ands and ors, SSE2 keeps up with the memory as well as anything wider would
+    template<int Channels>
+    PIXEL_COPY_TARGET("sse2")
+    size_t fill_blocks_sse2(const BlockFill<Channels> &fill, unsigned char *pixels, size_t elements) {
+        __m128i values[Channels];
+        __m128i keep[Channels];
+        for (int k = 0; k < Channels; k++) {
+            values[k] = _mm_loadu_si128(reinterpret_cast<const __m128i *>(fill.values[k].data()));
+            keep[k] = _mm_loadu_si128(reinterpret_cast<const __m128i *>(fill.keep[k].data()));
+        }
+
+        const size_t blocks = elements / BLOCK_PIXELS;
+        for (size_t i = 0; i < blocks; i++) {
+            auto *block = reinterpret_cast<__m128i *>(pixels + i * BLOCK_PIXELS * Channels);
+            PIXEL_COPY_UNROLL
+            for (int k = 0; k < Channels; k++) {
+                const __m128i current = _mm_loadu_si128(block + k);
+                _mm_storeu_si128(block + k, _mm_or_si128(values[k], _mm_and_si128(current, keep[k])));
+            }
+        }
+        return blocks * BLOCK_PIXELS;
+    }
+
+    bool cpu_supports_ssse3() {
+#if defined(__GNUC__) || defined(__clang__)
+        return __builtin_cpu_supports("ssse3");
+#else
+        int info[4];
+        __cpuid(info, 1);
+        return (info[2] & (1 << 9)) != 0;
+#endif
+    }
+
+    bool cpu_supports_avx2() {
+#if defined(__GNUC__) || defined(__clang__)
+        return __builtin_cpu_supports("avx2");
+#else
+        int info[4];
+        __cpuid(info, 0);
+        if (info[0] < 7)
+            return false;
+        // the OS has to save the AVX registers as well
+        __cpuid(info, 1);
+        const bool osxsave = (info[2] & (1 << 27)) != 0;
+        if (!osxsave || (_xgetbv(0) & 0x6) != 0x6)
+            return false;
+        __cpuidex(info, 7, 0);
+        return (info[1] & (1 << 5)) != 0;
+#endif
+    }
+#endif
+
+#ifdef PIXEL_COPY_NEON
+    // NEON loads and stores deinterleave and interleave up to 4 channels on their own
+    template<int SrcCh, int DstCh>
+    size_t copy_blocks_neon(const unsigned char *src, unsigned char *dst, size_t elements) {
+        const size_t blocks = elements / BLOCK_PIXELS;
+        for (size_t i = 0; i < blocks; i++) {
+            const unsigned char *block_src = src + i * BLOCK_PIXELS * SrcCh;
+            unsigned char *block_dst = dst + i * BLOCK_PIXELS * DstCh;
+            uint8x16_t channels[4];
+            if constexpr (SrcCh == 1) {
+                channels[0] = vld1q_u8(block_src);
+            } else if constexpr (SrcCh == 2) {
+                const uint8x16x2_t in = vld2q_u8(block_src);
+                channels[0] = in.val[0], channels[1] = in.val[1];
+            } else if constexpr (SrcCh == 3) {
+                const uint8x16x3_t in = vld3q_u8(block_src);
+                channels[0] = in.val[0], channels[1] = in.val[1], channels[2] = in.val[2];
+            } else {
+                const uint8x16x4_t in = vld4q_u8(block_src);
+                channels[0] = in.val[0], channels[1] = in.val[1], channels[2] = in.val[2], channels[3] = in.val[3];
+            }
+            for (int c = SrcCh; c < DstCh; c++)
+                channels[c] = vdupq_n_u8(c == 3 ? 255 : 0);
+
+            if constexpr (DstCh == 1) {
+                vst1q_u8(block_dst, channels[0]);
+            } else if constexpr (DstCh == 2) {
+                vst2q_u8(block_dst, uint8x16x2_t{{channels[0], channels[1]}});
+            } else if constexpr (DstCh == 3) {
+                vst3q_u8(block_dst, uint8x16x3_t{{channels[0], channels[1], channels[2]}});
+            } else {
+                vst4q_u8(block_dst, uint8x16x4_t{{channels[0], channels[1], channels[2], channels[3]}});
+            }
+        }
+        return blocks * BLOCK_PIXELS;
+    }
+
+    // Table lookups with the same masks as the x86 kernels, indices out of range give 0
+    template<int SrcCh, int DstCh, bool Merge>
+    size_t shuffle_blocks_neon(
+            const BlockShuffle<SrcCh, DstCh> &shuffle, const unsigned char *src, unsigned char *dst, size_t elements
+    ) {
+        uint8x16_t masks[DstCh][SrcCh];
+        uint8x16_t constant[DstCh];
+        uint8x16_t keep[DstCh];
+        for (int k = 0; k < DstCh; k++) {
+            for (int l = 0; l < SrcCh; l++)
+                masks[k][l] = vld1q_u8(reinterpret_cast<const uint8_t *>(shuffle.masks[k][l].data()));
+            constant[k] = vld1q_u8(shuffle.constant[k].data());
+            keep[k] = vld1q_u8(shuffle.keep[k].data());
+        }
+
+        const size_t blocks = elements / BLOCK_PIXELS;
+        for (size_t i = 0; i < blocks; i++) {
+            const unsigned char *block_src = src + i * BLOCK_PIXELS * SrcCh;
+            unsigned char *block_dst = dst + i * BLOCK_PIXELS * DstCh;
+            uint8x16_t in[SrcCh];
+            for (int l = 0; l < SrcCh; l++)
+                in[l] = vld1q_u8(block_src + l * 16);
+            for (int k = 0; k < DstCh; k++) {
+                uint8x16_t out = constant[k];
+                if constexpr (Merge)
+                    out = vorrq_u8(out, vandq_u8(vld1q_u8(block_dst + k * 16), keep[k]));
+                for (int l = 0; l < SrcCh; l++) {
+                    if (shuffle.used[k][l])
+                        out = vorrq_u8(out, vqtbl1q_u8(in[l], masks[k][l]));
+                }
+                vst1q_u8(block_dst + k * 16, out);
+            }
+        }
+        return blocks * BLOCK_PIXELS;
+    }
+
+    template<int Channels>
+    size_t fill_blocks_neon(const BlockFill<Channels> &fill, unsigned char *pixels, size_t elements) {
+        uint8x16_t values[Channels];
+        uint8x16_t keep[Channels];
+        for (int k = 0; k < Channels; k++) {
+            values[k] = vld1q_u8(fill.values[k].data());
+            keep[k] = vld1q_u8(fill.keep[k].data());
+        }
+
+        const size_t blocks = elements / BLOCK_PIXELS;
+        for (size_t i = 0; i < blocks; i++) {
+            unsigned char *block = pixels + i * BLOCK_PIXELS * Channels;
+            for (int k = 0; k < Channels; k++)
+                vst1q_u8(block + k * 16, vorrq_u8(values[k], vandq_u8(vld1q_u8(block + k * 16), keep[k])));
+        }
+        return blocks * BLOCK_PIXELS;
+    }
+#endif
+
+    template<PixelCopyKernel Kernel, int SrcCh, int DstCh>
+    void copy_pixels_with(const unsigned char *src, unsigned char *dst, size_t elements) {
+        if constexpr (SrcCh == DstCh) {
+            std::memcpy(dst, src, elements * SrcCh);
+        } else {
+            size_t done = 0;
+#ifdef PIXEL_COPY_X86
+            if constexpr (Kernel == PixelCopyKernel::Ssse3)
+                done = shuffle_blocks_ssse3<SrcCh, DstCh, false>(PIXEL_SHUFFLE<SrcCh, DstCh>, src, dst, elements);
+            if constexpr (Kernel == PixelCopyKernel::Avx2)
+                done = shuffle_blocks_avx2<SrcCh, DstCh, false>(PIXEL_SHUFFLE<SrcCh, DstCh>, src, dst, elements);
+#endif
+#ifdef PIXEL_COPY_NEON
+            if constexpr (Kernel == PixelCopyKernel::Neon)
+                done = copy_blocks_neon<SrcCh, DstCh>(src, dst, elements);
+#endif
+            copy_pixels<SrcCh, DstCh>(src + done * SrcCh, dst + done * DstCh, elements - done);
+        }
+    }
+
+    template<PixelCopyKernel Kernel, int SrcCh, int DstCh>
+    void copy_channels_with(
+            const unsigned char *src, unsigned char *dst, size_t elements, const ChannelArray &mapping
+    ) {
+        size_t done = 0;
+        if constexpr (Kernel != PixelCopyKernel::Scalar) {
+            // built for every call, it's tiny next to the images worth converting with SIMD
+            const auto shuffle = block_shuffle<SrcCh, DstCh>(mapping, {-1, -1, -1, -1});
+#ifdef PIXEL_COPY_X86
+            if constexpr (Kernel == PixelCopyKernel::Ssse3)
+                done = shuffle_blocks_ssse3<SrcCh, DstCh, true>(shuffle, src, dst, elements);
+            if constexpr (Kernel == PixelCopyKernel::Avx2)
+                done = shuffle_blocks_avx2<SrcCh, DstCh, true>(shuffle, src, dst, elements);
+#endif
+#ifdef PIXEL_COPY_NEON
+            if constexpr (Kernel == PixelCopyKernel::Neon)
+                done = shuffle_blocks_neon<SrcCh, DstCh, true>(shuffle, src, dst, elements);
+#endif
+        }
+        copy_channels<SrcCh, DstCh>(src + done * SrcCh, dst + done * DstCh, elements - done, mapping);
+    }
+
+    template<PixelCopyKernel Kernel, int Channels>
+    void fill_pixels_with(unsigned char *pixels, size_t elements, const ChannelArray &fill) {
+        size_t done = 0;
+        if constexpr (Kernel != PixelCopyKernel::Scalar) {
+            const auto block = block_fill<Channels>(fill);
+#ifdef PIXEL_COPY_X86
+            done = fill_blocks_sse2<Channels>(block, pixels, elements);
+#endif
+#ifdef PIXEL_COPY_NEON
+            done = fill_blocks_neon<Channels>(block, pixels, elements);
+#endif
+        }
+        fill_pixels<Channels>(pixels + done * Channels, elements - done, fill);
+    }
+
+    // Indexed by the kernel and (src_channels - 1) + 4 * (dst_channels - 1). The kernels of other architectures are
+    // scalar, they are never used.
+    template<PixelCopyKernel Kernel, size_t... I>
+    constexpr std::array<CopyFunction, 16> copy_functions(std::index_sequence<I...>) {
+        return {&copy_pixels_with<Kernel, I % 4 + 1, I / 4 + 1>...};
+    }
+
+    template<PixelCopyKernel Kernel, size_t... I>
+    constexpr std::array<ChannelFunction, 16> channel_functions(std::index_sequence<I...>) {
+        return {&copy_channels_with<Kernel, I % 4 + 1, I / 4 + 1>...};
+    }
+
+    // Indexed by the kernel and channels - 1
+    template<PixelCopyKernel Kernel, size_t... I>
+    constexpr std::array<FillFunction, 4> fill_functions(std::index_sequence<I...>) {
+        return {&fill_pixels_with<Kernel, I + 1>...};
+    }
+
+    constexpr std::array COPY_FUNCTIONS = {
+        copy_functions<PixelCopyKernel::Scalar>(std::make_index_sequence<16>()),
+        copy_functions<PixelCopyKernel::Ssse3>(std::make_index_sequence<16>()),
+        copy_functions<PixelCopyKernel::Avx2>(std::make_index_sequence<16>()),
+        copy_functions<PixelCopyKernel::Neon>(std::make_index_sequence<16>()),
+    };
+
+    constexpr std::array CHANNEL_FUNCTIONS = {
+        channel_functions<PixelCopyKernel::Scalar>(std::make_index_sequence<16>()),
+        channel_functions<PixelCopyKernel::Ssse3>(std::make_index_sequence<16>()),
+        channel_functions<PixelCopyKernel::Avx2>(std::make_index_sequence<16>()),
+        channel_functions<PixelCopyKernel::Neon>(std::make_index_sequence<16>()),
+    };
+
+    constexpr std::array FILL_FUNCTIONS = {
+        fill_functions<PixelCopyKernel::Scalar>(std::make_index_sequence<4>()),
+        fill_functions<PixelCopyKernel::Ssse3>(std::make_index_sequence<4>()),
+        fill_functions<PixelCopyKernel::Avx2>(std::make_index_sequence<4>()),
+        fill_functions<PixelCopyKernel::Neon>(std::make_index_sequence<4>()),
+    };
+
+    void check_channels(int channels) {
+        if (channels < 1 || channels > 4)
+            Logger::panic(std::format("Pixels of {} channels aren't supported", channels));
+    }
+
+    size_t kernel_index(PixelCopyKernel kernel) {
+        if (!pixelCopyKernelSupported(kernel))
+            Logger::panic("The pixel copy kernel isn't supported by this CPU");
+        return static_cast<size_t>(kernel);
+    }
+
+    // Calls convert(begin, end) for all elements, in chunks on the global thread pool for large images
+    template<typename F>
+    void convert_chunks(size_t elements, bool parallel, F &&convert) {
+        if (parallel && elements >= PARALLEL_MIN_PIXELS)
+            util::parallel_for(elements, PARALLEL_GRAIN, convert);
+        else
+            convert(size_t{0}, elements);
+    }
+} // namespace
+
+bool pixelCopyKernelSupported(PixelCopyKernel kernel) {
+    switch (kernel) {
+        case PixelCopyKernel::Scalar:
+            return true;
+#ifdef PIXEL_COPY_X86
+        case PixelCopyKernel::Ssse3: {
+            static const bool supported = cpu_supports_ssse3();
+            return supported;
+        }
+        case PixelCopyKernel::Avx2: {
+            static const bool supported = cpu_supports_avx2();
+            return supported;
+        }
+#endif
+#ifdef PIXEL_COPY_NEON
+        // part of every AArch64 CPU
+        case PixelCopyKernel::Neon:
+            return true;
+#endif
+        default:
+            return false;
+    }
+}
+
+PixelCopyKernel bestPixelCopyKernel() {
+    static const PixelCopyKernel best = [] {
+        for (auto kernel: {PixelCopyKernel::Avx2, PixelCopyKernel::Ssse3, PixelCopyKernel::Neon}) {
+            if (pixelCopyKernelSupported(kernel))
+                return kernel;
+        }
+        return PixelCopyKernel::Scalar;
+    }();
+    return best;
+}
+
+void copyPixels(
+        const unsigned char *src, int src_channels, unsigned char *dst, int dst_channels, size_t elements, bool parallel
+) {
+    check_channels(src_channels);
+    check_channels(dst_channels);
+    const CopyFunction copy =
+            COPY_FUNCTIONS[kernel_index(bestPixelCopyKernel())][(src_channels - 1) + 4 * (dst_channels - 1)];
+    convert_chunks(elements, parallel, [&](size_t begin, size_t end) {
+        copy(src + begin * src_channels, dst + begin * dst_channels, end - begin);
+    });
+}
+
+void copyPixels(
+        PixelCopyKernel kernel, const unsigned char *src, int src_channels, unsigned char *dst, int dst_channels,
+        size_t elements
+) {
+    check_channels(src_channels);
+    check_channels(dst_channels);
+    COPY_FUNCTIONS[kernel_index(kernel)][(src_channels - 1) + 4 * (dst_channels - 1)](src, dst, elements);
+}
+
+void copyPixelChannels(
+        const unsigned char *src, int src_channels, unsigned char *dst, int dst_channels, size_t elements,
+        std::span<const int> mapping, bool parallel
+) {
+    check_channels(src_channels);
+    check_channels(dst_channels);
+    if (mapping.size() != static_cast<size_t>(src_channels))
+        Logger::panic(std::format("Channel mapping of {} channels for pixels of {}", mapping.size(), src_channels));
+    ChannelArray channel_mapping = {-1, -1, -1, -1};
+    for (size_t sc = 0; sc < mapping.size(); sc++) {
+        if (mapping[sc] < -1 || mapping[sc] >= dst_channels)
+            Logger::panic(std::format("Can't map to channel {} of pixels of {} channels", mapping[sc], dst_channels));
+        channel_mapping[sc] = mapping[sc];
+    }
+
+    const ChannelFunction copy =
+            CHANNEL_FUNCTIONS[kernel_index(bestPixelCopyKernel())][(src_channels - 1) + 4 * (dst_channels - 1)];
+    convert_chunks(elements, parallel, [&](size_t begin, size_t end) {
+        copy(src + begin * src_channels, dst + begin * dst_channels, end - begin, channel_mapping);
+    });
+}
+
+void fillPixelChannels(
+        unsigned char *pixels, int pixel_channels, size_t elements, std::span<const int> channels,
+        std::span<const unsigned char> values, bool parallel
+) {
+    check_channels(pixel_channels);
+    if (channels.size() != values.size())
+        Logger::panic(std::format("{} channels to fill with {} values", channels.size(), values.size()));
+    ChannelArray fill = {-1, -1, -1, -1};
+    for (size_t i = 0; i < channels.size(); i++) {
+        if (channels[i] < 0 || channels[i] >= pixel_channels)
+            Logger::panic(std::format("Can't fill channel {} of pixels of {} channels", channels[i], pixel_channels));
+        fill[channels[i]] = values[i];
+    }
+
+    const FillFunction fill_range = FILL_FUNCTIONS[kernel_index(bestPixelCopyKernel())][pixel_channels - 1];
+    convert_chunks(elements, parallel, [&](size_t begin, size_t end) {
+        fill_range(pixels + begin * pixel_channels, end - begin, fill);
+    });
+}
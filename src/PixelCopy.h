@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+#include <span>
+
+// The implementations of the pixel conversions, each but Scalar needs the instruction set of the same name
+enum class PixelCopyKernel { Scalar, Ssse3, Avx2, Neon };
+
+bool pixelCopyKernelSupported(PixelCopyKernel kernel);
+
+// The fastest kernel this CPU supports, detected on the first call
+PixelCopyKernel bestPixelCopyKernel();
+
+/**
+ * Converts elements pixels of 1 to 4 8-bit channels, extra channels are dropped and missing ones become 0, alpha 255.
+ * Uses the best kernel of this CPU, src and dst must not overlap.
+ * @param parallel split large images into chunks on the global thread pool
+ */
+void copyPixels(
+        const unsigned char *src, int src_channels, unsigned char *dst, int dst_channels, size_t elements,
+        bool parallel = true
+);
+
+// Single threaded copyPixels with the given kernel, which has to be supported. For comparing the kernels.
+void copyPixels(
+        PixelCopyKernel kernel, const unsigned char *src, int src_channels, unsigned char *dst, int dst_channels,
+        size_t elements
+);
+
+/**
+ * Copies channel sc of each src pixel to channel mapping[sc] of the dst pixel, the other dst channels are kept.
+ * @param mapping a dst channel for every src channel, -1 skips it
+ * @param parallel split large images into chunks on the global thread pool
+ */
+void copyPixelChannels(
+        const unsigned char *src, int src_channels, unsigned char *dst, int dst_channels, size_t elements,
+        std::span<const int> mapping, bool parallel = true
+);
+
+// Sets channel channels[i] of every pixel to values[i]
+void fillPixelChannels(
+        unsigned char *pixels, int pixel_channels, size_t elements, std::span<const int> channels,
+        std::span<const unsigned char> values, bool parallel = true
+);
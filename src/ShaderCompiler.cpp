@@ -74,8 +74,12 @@ std::vector<uint32_t> ShaderCompiler::compile(
 ) const {
     shaderc::CompileOptions options = {};
 
+    // the subgroup operations need SPIR-V 1.3
+    options.SetTargetEnvironment(shaderc_target_env_vulkan, shaderc_env_version_vulkan_1_3);
     if (opt.debug)
         options.SetGenerateDebugInfo();
+    for (const auto &definition: opt.definitions)
+        options.AddMacroDefinition(definition);
 
     options.SetIncluder(std::make_unique<ShaderIncluder>());
 
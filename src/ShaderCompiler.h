@@ -1,6 +1,7 @@
 #pragma once
 #include <filesystem>
 #include <memory>
+#include <string>
 #include <vector>
 
 namespace vk {
@@ -15,6 +16,8 @@ struct ShaderCompileOptions {
     bool optimize = false;
     bool debug = false;
     bool print = false;
+    // defined as macros without a value
+    std::vector<std::string> definitions = {};
 };
 
 class ShaderCompiler {
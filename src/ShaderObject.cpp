@@ -128,10 +128,18 @@ Shader::Shader(
 void Shader::bindDescriptorSet(
         vk::CommandBuffer command_buffer, int index, vk::DescriptorSet set, vk::ArrayProxy<const uint32_t> const &dynamicOffsets
 ) const {
-    command_buffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *pipeline_layout, index, set, dynamicOffsets);
+    command_buffer.bindDescriptorSets(bindPoint(), *pipeline_layout, index, set, dynamicOffsets);
 }
 
-ShaderStage ShaderLoader::load(const std::filesystem::path &path, vk::ShaderCreateFlagBitsEXT flags) const {
+void Shader::pushDescriptorSet(
+        vk::CommandBuffer command_buffer, int index, vk::ArrayProxy<const vk::WriteDescriptorSet> const &writes
+) const {
+    command_buffer.pushDescriptorSetKHR(bindPoint(), *pipeline_layout, index, writes);
+}
+
+ShaderStage ShaderLoader::load(
+        const std::filesystem::path &path, vk::ShaderCreateFlagBitsEXT flags, std::vector<std::string> definitions
+) const {
     vk::ShaderStageFlagBits stage;
     auto ext = path.extension().string().substr(1);
     if (ext == "vert")
@@ -149,6 +157,6 @@ ShaderStage ShaderLoader::load(const std::filesystem::path &path, vk::ShaderCrea
     else
         Logger::panic("Unknown shader type: " + path.string());
 
-    auto binary = compiler->compile(path, stage, {optimize, debug, print});
+    auto binary = compiler->compile(path, stage, {optimize, debug, print, std::move(definitions)});
     return {path.filename().string(), stage, flags, std::move(binary)};
 }
@@ -139,12 +139,22 @@ public:
 
     [[nodiscard]] vk::PipelineLayout pipelineLayout() const { return *pipeline_layout; }
 
+    [[nodiscard]] vk::PipelineBindPoint bindPoint() const {
+        return stageFlags_ & vk::ShaderStageFlagBits::eCompute ? vk::PipelineBindPoint::eCompute
+                                                               : vk::PipelineBindPoint::eGraphics;
+    }
+
     void bindDescriptorSet(
             vk::CommandBuffer command_buffer,
             int index,
             vk::DescriptorSet set,
             vk::ArrayProxy<const uint32_t> const &dynamicOffsets = {}
     ) const;
+
+    // The set has to be created with ePushDescriptorKHR, needs VK_KHR_push_descriptor
+    void pushDescriptorSet(
+            vk::CommandBuffer command_buffer, int index, vk::ArrayProxy<const vk::WriteDescriptorSet> const &writes
+    ) const;
 };
 
 class ShaderLoader {
@@ -158,5 +168,8 @@ public:
 
     ShaderLoader() { compiler = std::make_unique<ShaderCompiler>(); }
 
-    [[nodiscard]] ShaderStage load(const std::filesystem::path &path, vk::ShaderCreateFlagBitsEXT flags = {}) const;
+    [[nodiscard]] ShaderStage load(
+            const std::filesystem::path &path, vk::ShaderCreateFlagBitsEXT flags = {},
+            std::vector<std::string> definitions = {}
+    ) const;
 };
@@ -1,103 +1,131 @@
 #include "StagingBuffer.h"
 
+#include <algorithm>
 #include <cstring>
 #include <format>
 #include <utility>
 
 #include "CommandPool.h"
 #include "Logger.h"
+#include "debug/Tracy.h"
 
-void IStagingBuffer::copyAndDiscard(Commands &commands, vk::Buffer staging, vk::Buffer dst, size_t size) {
-    commands->copyBuffer(staging, dst, vk::BufferCopy{.size = size});
-    commands.trash += staging;
+namespace {
+    // offsets are a multiple of the largest texel block, so images can be copied from anywhere in the ring
+    constexpr size_t ALIGNMENT = 16;
+
+    size_t align_offset(size_t offset) { return (offset + ALIGNMENT - 1) & -ALIGNMENT; }
+
+    std::pair<vma::UniqueBuffer, vma::UniqueAllocation> create_host_visible_buffer(
+            const vma::Allocator &allocator, size_t size, vma::AllocationInfo *result_info
+    ) {
+        return allocator.createBufferUnique(
+                {
+                    .size = size,
+                    .usage = vk::BufferUsageFlagBits::eTransferSrc,
+                },
+                {.flags = vma::AllocationCreateFlagBits::eHostAccessSequentialWrite |
+                          vma::AllocationCreateFlagBits::eMapped,
+                 .usage = vma::MemoryUsage::eAuto,
+                 .requiredFlags = vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent},
+                result_info
+        );
+    }
+} // namespace
+
+void IStagingBuffer::copy(
+        Commands &commands, vk::Buffer staging, vk::DeviceSize staging_offset, vk::Buffer dst,
+        vk::DeviceSize dst_offset, size_t size
+) {
+    commands->copyBuffer(staging, dst, vk::BufferCopy{.srcOffset = staging_offset, .dstOffset = dst_offset, .size = size});
 }
 
-std::tuple<vk::Buffer, void *> IStagingBuffer::upload(Commands &commands, size_t size, const void *data) {
+std::tuple<vk::Buffer, vk::DeviceSize, void *> IStagingBuffer::upload(
+        Commands &commands, size_t size, const void *data
+) {
     auto result = allocate(commands, size);
-    std::memcpy(std::get<1>(result), data, size);
+    std::memcpy(std::get<2>(result), data, size);
     return result;
 }
 
-std::pair<vma::UniqueBuffer, vma::UniqueAllocation> DoubleStagingBuffer::createHostVisibleBuffer(
-        size_t size, vma::AllocationInfo *result_info, bool canAlias
-) const {
-    vma::AllocationCreateFlags flags = vma::AllocationCreateFlagBits::eHostAccessSequentialWrite |
-                                       vma::AllocationCreateFlagBits::eMapped;
-    if (canAlias)
-        flags |= vma::AllocationCreateFlagBits::eCanAlias;
-    return allocator_.createBufferUnique(
-            {
-                .size = size,
-                .usage = vk::BufferUsageFlagBits::eTransferSrc,
-            },
-            {.flags = flags,
-             .usage = vma::MemoryUsage::eAuto,
-             .requiredFlags = vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent},
-            result_info
-    );
+double StagingStats::bytesPerSecond() const {
+    if (elapsed.count() == 0)
+        return 0.0;
+    return static_cast<double>(bytes) / std::chrono::duration<double>(elapsed).count();
 }
 
-DoubleStagingBuffer::DoubleStagingBuffer(const vma::Allocator &allocator, const vk::Device &device, size_t capacity)
-    : allocator_(allocator), capacity_(capacity) {
+RingStagingBuffer::RingStagingBuffer(const vma::Allocator &allocator, size_t capacity, uint32_t segment_count)
+    : allocator_(allocator) {
+    if (segment_count < 2)
+        Logger::panic("A staging ring needs at least two segments");
+    segmentSize_ = align_offset(capacity / segment_count);
+    capacity_ = segmentSize_ * segment_count;
+    segmentValues_.resize(segment_count, 0);
+
     vma::AllocationInfo allocation_result = {};
-    bool first = true;
-    for (auto &buffer: buffers_) {
-        buffer.fence =
-                device.createFenceUnique({.flags = first ? vk::FenceCreateFlags{} : vk::FenceCreateFlagBits::eSignaled});
-        std::tie(buffer.buffer, buffer.allocation) = createHostVisibleBuffer(capacity, &allocation_result, true);
-        buffer.data = allocation_result.pMappedData;
-        first = false;
-
-        const auto memReq = device.getBufferMemoryRequirements(*buffer.buffer);
-        alignment_ = std::max(alignment_, memReq.alignment);
+    std::tie(buffer_, allocation_) = create_host_visible_buffer(allocator_, capacity_, &allocation_result);
+    data_ = static_cast<unsigned char *>(allocation_result.pMappedData);
+}
+
+void RingStagingBuffer::acquire(Commands &commands, size_t segment) {
+    const uint64_t value = segmentValues_[segment];
+    const bool recorded = value == commands.pendingValue();
+    if (!recorded && value <= commands.completedValue())
+        return;
+
+    ZoneScopedN("Staging Stall");
+    const auto start = std::chrono::steady_clock::now();
+    if (recorded) {
+        // the ring wrapped around within the commands being recorded, they have to run before it is overwritten
+        const uint64_t submitted = commands.submitAsync();
+        commands.begin();
+        commands.waitValue(submitted);
+    } else {
+        commands.waitValue(value);
     }
+    stats_.stalls++;
+    stats_.stallTime += std::chrono::steady_clock::now() - start;
 }
 
-void DoubleStagingBuffer::swap(const Commands &commands) {
-    index_ = (index_ + 1) % buffers_.size();
-    current_ = &buffers_[index_];
-    commands.wait(*current_->fence, true);
-    commands.free(std::exchange(current_->pendingCommandBuffer, {}));
-    current_->offset = 0;
+std::tuple<vk::Buffer, vk::DeviceSize, void *> RingStagingBuffer::allocateOversize(Commands &commands, size_t size) {
+    Logger::warning(std::format(
+            "Allocation larger than staging capacity; performance suboptimal; {} bytes over {}", size - capacity_, capacity_
+    ));
+    const auto completed = commands.completedValue();
+    std::erase_if(oversizeBuffers_, [completed](const auto &buffer) { return buffer.value <= completed; });
+
+    vma::AllocationInfo allocation_result = {};
+    auto [buffer, allocation] = create_host_visible_buffer(allocator_, size, &allocation_result);
+    std::tuple result = {*buffer, vk::DeviceSize{0}, allocation_result.pMappedData};
+    oversizeBuffers_.push_back({std::move(buffer), std::move(allocation), commands.pendingValue()});
+    return result;
 }
 
-// https://stackoverflow.com/a/9194117/7448536
-size_t DoubleStagingBuffer::alignOffset(size_t offset) const { return (offset + alignment_ - 1) & -alignment_; }
-
-std::tuple<vk::Buffer, void *> DoubleStagingBuffer::allocate(Commands &commands, size_t size) {
-    // handle oversize case
-    if (size > capacity_) {
-        Logger::warning(std::format(
-                "Allocation larger than staging capacity; performance suboptimal; {} bytes over {}", size - capacity_, capacity_
-        ));
-        // Make sure the old allocation is not in use
-        if (oversizeBufferAllocation_) {
-            commands.submit();
-            commands.begin();
-        }
-        vma::AllocationInfo allocation_result = {};
-        auto [buffer, alloc] = createHostVisibleBuffer(size, &allocation_result, false);
-        oversizeBufferAllocation_ = std::move(alloc);
-        return {buffer.release(), allocation_result.pMappedData};
-    }
+std::tuple<vk::Buffer, vk::DeviceSize, void *> RingStagingBuffer::allocate(Commands &commands, size_t size) {
+    const auto now = std::chrono::steady_clock::now();
+    if (stats_.bytes == 0)
+        firstAllocation_ = now;
+    stats_.bytes += size;
+    stats_.elapsed = now - firstAllocation_;
 
-    // swap if remaining space is too small
-    if (size > capacity_ - current_->offset) {
-        current_->pendingCommandBuffer = commands.submit(*current_->fence);
-        swap(commands);
-        commands.begin();
+    if (size > capacity_)
+        return allocateOversize(commands, size);
+
+    size_t offset = align_offset(head_);
+    const bool wrapped = offset + size > capacity_;
+    if (wrapped)
+        offset = 0;
+    // the segment the last allocation ended in is held by the commands already, unless the ring wrapped around
+    const size_t held = head_ == 0 || wrapped ? segmentValues_.size() : (head_ - 1) / segmentSize_;
+    const size_t first = offset / segmentSize_;
+    const size_t last = (offset + std::max<size_t>(size, 1) - 1) / segmentSize_;
+    for (size_t segment = first; segment <= last; segment++) {
+        if (segment != held)
+            acquire(commands, segment);
     }
+    // after acquiring, which may have submitted the commands
+    for (size_t segment = first; segment <= last; segment++)
+        segmentValues_[segment] = commands.pendingValue();
 
-    std::tuple result = {
-        allocator_.createAliasingBuffer2(
-                *current_->allocation, current_->offset,
-                {
-                    .size = size,
-                    .usage = vk::BufferUsageFlagBits::eTransferSrc,
-                }
-        ),
-        static_cast<unsigned char *>(current_->data) + current_->offset
-    };
-    current_->offset = alignOffset(current_->offset + size);
-    return result;
+    head_ = offset + size;
+    return {*buffer_, offset, data_ + offset};
 }
@@ -1,6 +1,7 @@
 #pragma once
-#include <array>
+#include <chrono>
 #include <tuple>
+#include <vector>
 #include <vulkan-memory-allocator-hpp/vk_mem_alloc.hpp>
 #include <vulkan/vulkan.hpp>
 
@@ -9,65 +10,92 @@
 class Commands;
 
 class IStagingBuffer {
-    static void copyAndDiscard(Commands &commands, vk::Buffer staging, vk::Buffer dst, size_t size);
+    static void copy(
+            Commands &commands, vk::Buffer staging, vk::DeviceSize staging_offset, vk::Buffer dst,
+            vk::DeviceSize dst_offset, size_t size
+    );
 
 public:
     virtual ~IStagingBuffer() = default;
 
-    [[nodiscard]] virtual std::tuple<vk::Buffer, void *> allocate(Commands &commands, size_t size) = 0;
+    // The buffer the bytes are staged in, their offset in it and where they are mapped. They stay valid until the
+    // commands they are read by completed. Allocating may submit the commands to make room and begin new ones.
+    [[nodiscard]] virtual std::tuple<vk::Buffer, vk::DeviceSize, void *> allocate(Commands &commands, size_t size) = 0;
 
-    [[nodiscard]] std::tuple<vk::Buffer, void *> upload(Commands &commands, size_t size, const void *data);
+    [[nodiscard]] std::tuple<vk::Buffer, vk::DeviceSize, void *> upload(
+            Commands &commands, size_t size, const void *data
+    );
 
     template<std::ranges::contiguous_range R>
-    [[nodiscard]] std::tuple<vk::Buffer, void *> upload(Commands &commands, R &&data) {
+    [[nodiscard]] std::tuple<vk::Buffer, vk::DeviceSize, void *> upload(Commands &commands, R &&data) {
         using T = std::ranges::range_value_t<R>;
         return upload(commands, data.size() * sizeof(T), data.data());
     }
 
+    // Copies data to dst at dst_offset bytes
     template<std::ranges::contiguous_range R>
-    void upload(Commands &commands, R &&data, vk::Buffer dst) {
+    void upload(Commands &commands, R &&data, vk::Buffer dst, vk::DeviceSize dst_offset = 0) {
         using T = std::ranges::range_value_t<R>;
-        auto [buffer, ptr] = upload(commands, std::forward<R>(data));
-        copyAndDiscard(commands, buffer, dst, data.size() * sizeof(T));
+        auto [buffer, offset, ptr] = upload(commands, std::forward<R>(data));
+        copy(commands, buffer, offset, dst, dst_offset, data.size() * sizeof(T));
     }
 
     [[nodiscard]] virtual vma::Allocator allocator() const = 0;
 };
 
-class DoubleStagingBuffer : public IStagingBuffer {
-    struct Buffer {
-        vma::UniqueBuffer buffer = {};
-        vma::UniqueAllocation allocation = {};
-        void *data = nullptr;
-        size_t offset = 0;
-        std::vector<vk::UniqueBuffer> buffers;
-        vk::UniqueFence fence = {};
-        vk::CommandBuffer pendingCommandBuffer = {};
-    };
+// What a staging buffer went through so far
+struct StagingStats {
+    uint64_t bytes = 0;
+    // allocations that waited for the device to release a segment
+    uint32_t stalls = 0;
+    std::chrono::nanoseconds stallTime = {};
+    // from the first to the latest allocation
+    std::chrono::nanoseconds elapsed = {};
+
+    [[nodiscard]] double bytesPerSecond() const;
+};
 
-    vma::UniqueAllocation oversizeBufferAllocation_ = {};
+/**
+ * Stages in one persistently mapped buffer, used as a ring of segments. Each segment is tagged with the timeline value
+ * of the Commands submission that last read it and is reused once that value is reached, so allocating only waits
+ * when the device is a whole ring behind. Allocations can span several segments, ones larger than the ring get a
+ * buffer of their own. Always has to be used with the same Commands, their timeline values tag the segments.
+ */
+class RingStagingBuffer : public IStagingBuffer {
+    struct OversizeBuffer {
+        vma::UniqueBuffer buffer;
+        vma::UniqueAllocation allocation;
+        uint64_t value;
+    };
 
     vma::Allocator allocator_ = {};
+    vma::UniqueBuffer buffer_ = {};
+    vma::UniqueAllocation allocation_ = {};
+    unsigned char *data_ = nullptr;
     size_t capacity_ = 0;
-    size_t index_ = 0;
-    std::array<Buffer, 2> buffers_ = {};
-    Buffer *current_ = &buffers_[0];
-    vk::DeviceSize alignment_ = 0;
-
-    [[nodiscard]] std::pair<vma::UniqueBuffer, vma::UniqueAllocation> createHostVisibleBuffer(
-            size_t size, vma::AllocationInfo *result_info, bool canAlias
-    ) const;
+    size_t segmentSize_ = 0;
+    // the timeline value of the submission that last read each segment, 0 if none did yet
+    std::vector<uint64_t> segmentValues_;
+    // end of the last allocation
+    size_t head_ = 0;
+    std::vector<OversizeBuffer> oversizeBuffers_;
+    StagingStats stats_ = {};
+    std::chrono::steady_clock::time_point firstAllocation_ = {};
 
-    void swap(const Commands &commands);
+    // Waits until the device is done with the segment, submits the commands first if they read it themselves
+    void acquire(Commands &commands, size_t segment);
 
-    size_t alignOffset(size_t offset) const;
+    [[nodiscard]] std::tuple<vk::Buffer, vk::DeviceSize, void *> allocateOversize(Commands &commands, size_t size);
 
 public:
-    ~DoubleStagingBuffer() override = default;
+    // The capacity is split into segment_count segments
+    RingStagingBuffer(const vma::Allocator &allocator, size_t capacity, uint32_t segment_count = 8);
 
-    DoubleStagingBuffer(const vma::Allocator &allocator, const vk::Device &device, size_t capacity);
+    ~RingStagingBuffer() override = default;
 
-    [[nodiscard]] std::tuple<vk::Buffer, void *> allocate(Commands &commands, size_t size) override;
+    [[nodiscard]] std::tuple<vk::Buffer, vk::DeviceSize, void *> allocate(Commands &commands, size_t size) override;
 
     [[nodiscard]] vma::Allocator allocator() const override { return allocator_; }
+
+    [[nodiscard]] const StagingStats &stats() const { return stats_; }
 };
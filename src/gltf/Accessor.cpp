@@ -0,0 +1,219 @@
+#include "Accessor.h"
+
+#include <algorithm>
+#include <cstring>
+#include <format>
+#include <limits>
+#include <type_traits>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define GLTF_ACCESSOR_SSE2
+#include <emmintrin.h>
+#endif
+
+#include "../Logger.h"
+#include "Glb.h"
+
+namespace gltf {
+    namespace {
+        // Copies count float elements of the given component count from a strided source into a packed destination
+        void deinterleave_scalar(const uint8_t *src, size_t stride, size_t count, uint32_t components, float *dst) {
+            const size_t element_size = components * sizeof(float);
+            for (size_t i = 0; i < count; i++)
+                std::memcpy(dst + i * components, src + i * stride, element_size);
+        }
+
+#ifdef GLTF_ACCESSOR_SSE2
+        void deinterleave_vec2(const uint8_t *src, size_t stride, size_t count, float *dst) {
+            size_t i = 0;
+            for (; i + 2 <= count; i += 2) {
+                __m128d e0 = _mm_load_sd(reinterpret_cast<const double *>(src + i * stride));
+                __m128d e01 = _mm_loadh_pd(e0, reinterpret_cast<const double *>(src + (i + 1) * stride));
+                _mm_storeu_pd(reinterpret_cast<double *>(dst + i * 2), e01);
+            }
+            deinterleave_scalar(src + i * stride, stride, count - i, 2, dst + i * 2);
+        }
+
+        // Requires a stride of at least 16 bytes, every element except the last one is loaded as 4 floats
+        void deinterleave_vec3(const uint8_t *src, size_t stride, size_t count, float *dst) {
+            size_t i = 0;
+            // the last element is never part of a wide load, it might end right at the end of the buffer
+            for (; i + 4 < count; i += 4) {
+                __m128 v0 = _mm_loadu_ps(reinterpret_cast<const float *>(src + (i + 0) * stride));
+                __m128 v1 = _mm_loadu_ps(reinterpret_cast<const float *>(src + (i + 1) * stride));
+                __m128 v2 = _mm_loadu_ps(reinterpret_cast<const float *>(src + (i + 2) * stride));
+                __m128 v3 = _mm_loadu_ps(reinterpret_cast<const float *>(src + (i + 3) * stride));
+
+                // (x0 y0 z0 x1)
+                __m128 t0 = _mm_shuffle_ps(v0, v1, _MM_SHUFFLE(0, 0, 2, 2));
+                __m128 a = _mm_shuffle_ps(v0, t0, _MM_SHUFFLE(2, 0, 1, 0));
+                // (y1 z1 x2 y2)
+                __m128 b = _mm_shuffle_ps(v1, v2, _MM_SHUFFLE(1, 0, 2, 1));
+                // (z2 x3 y3 z3)
+                __m128 t1 = _mm_shuffle_ps(v2, v3, _MM_SHUFFLE(0, 0, 2, 2));
+                __m128 c = _mm_shuffle_ps(t1, v3, _MM_SHUFFLE(2, 1, 2, 0));
+
+                float *out = dst + i * 3;
+                _mm_storeu_ps(out + 0, a);
+                _mm_storeu_ps(out + 4, b);
+                _mm_storeu_ps(out + 8, c);
+            }
+            deinterleave_scalar(src + i * stride, stride, count - i, 3, dst + i * 3);
+        }
+
+        void deinterleave_vec4(const uint8_t *src, size_t stride, size_t count, float *dst) {
+            for (size_t i = 0; i < count; i++) {
+                _mm_storeu_ps(dst + i * 4, _mm_loadu_ps(reinterpret_cast<const float *>(src + i * stride)));
+            }
+        }
+#endif
+
+        void deinterleave(const uint8_t *src, size_t stride, size_t count, uint32_t components, float *dst) {
+#ifdef GLTF_ACCESSOR_SSE2
+            if (components == 2)
+                return deinterleave_vec2(src, stride, count, dst);
+            if (components == 3 && stride >= 16)
+                return deinterleave_vec3(src, stride, count, dst);
+            if (components == 4)
+                return deinterleave_vec4(src, stride, count, dst);
+#endif
+            deinterleave_scalar(src, stride, count, components, dst);
+        }
+
+        // Dequantizes according to the glTF spec, normalized signed values are clamped to -1
+        template<typename T>
+        float dequantize(T value, bool normalized) {
+            if (!normalized)
+                return static_cast<float>(value);
+            constexpr auto max = static_cast<float>(std::numeric_limits<T>::max());
+            if constexpr (std::is_signed_v<T>)
+                return std::max(static_cast<float>(value) / max, -1.0f);
+            else
+                return static_cast<float>(value) / max;
+        }
+
+        template<typename T>
+        void convert(
+                const uint8_t *src, size_t stride, size_t count, uint32_t components, bool normalized, float *dst
+        ) {
+            for (size_t i = 0; i < count; i++) {
+                const uint8_t *element = src + i * stride;
+                for (uint32_t c = 0; c < components; c++) {
+                    T value;
+                    std::memcpy(&value, element + c * sizeof(T), sizeof(T));
+                    dst[i * components + c] = dequantize(value, normalized);
+                }
+            }
+        }
+    } // namespace
+
+    void readAccessor(const GlbFile &glb, int accessor_index, std::span<float> dst) {
+        const auto &accessor = glb.accessors.at(accessor_index);
+        if (dst.size() != accessor.count * accessor.components)
+            Logger::panic(std::format(
+                    "Accessor {} has {} elements with {} components, expected {} values", accessor_index,
+                    accessor.count, accessor.components, dst.size()
+            ));
+        if (accessor.count == 0)
+            return;
+
+        const auto src = glb.accessorBytes(accessor_index);
+        const size_t stride = glb.accessorStride(accessor_index);
+        const size_t count = accessor.count;
+        const uint32_t components = accessor.components;
+
+        switch (accessor.componentType) {
+            case ComponentType::Float:
+                if (stride == components * sizeof(float))
+                    std::memcpy(dst.data(), src.data(), dst.size_bytes());
+                else
+                    deinterleave(src.data(), stride, count, components, dst.data());
+                break;
+            case ComponentType::Byte:
+                convert<int8_t>(src.data(), stride, count, components, accessor.normalized, dst.data());
+                break;
+            case ComponentType::UnsignedByte:
+                convert<uint8_t>(src.data(), stride, count, components, accessor.normalized, dst.data());
+                break;
+            case ComponentType::Short:
+                convert<int16_t>(src.data(), stride, count, components, accessor.normalized, dst.data());
+                break;
+            case ComponentType::UnsignedShort:
+                convert<uint16_t>(src.data(), stride, count, components, accessor.normalized, dst.data());
+                break;
+            default:
+                Logger::panic(std::format(
+                        "Unsupported attribute component type {}", static_cast<uint32_t>(accessor.componentType)
+                ));
+        }
+    }
+
+    template<typename D>
+    static void readIndicesAs(const GlbFile &glb, int accessor_index, size_t vertex_count, std::span<D> dst) {
+        const auto &accessor = glb.accessors.at(accessor_index);
+        if (accessor.components != 1)
+            Logger::panic(std::format("Index accessor {} must be scalar", accessor_index));
+        if (dst.size() != accessor.count)
+            Logger::panic(std::format(
+                    "Index accessor {} has {} elements, expected {}", accessor_index, accessor.count, dst.size()
+            ));
+        if (accessor.count == 0)
+            return;
+
+        const auto src = glb.accessorBytes(accessor_index);
+        const size_t stride = glb.accessorStride(accessor_index);
+        if (stride != componentSize(accessor.componentType))
+            Logger::panic(std::format("Index accessor {} must be tightly packed", accessor_index));
+
+        // plain loops, they get vectorized
+        const auto convert = [&]<typename S>() {
+            S max_index = 0;
+            if constexpr (std::is_same_v<S, D>) {
+                std::memcpy(dst.data(), src.data(), dst.size_bytes());
+                max_index = std::ranges::max(dst);
+            } else {
+                for (size_t i = 0; i < dst.size(); i++) {
+                    S index;
+                    std::memcpy(&index, src.data() + i * sizeof(S), sizeof(S));
+                    max_index = std::max(max_index, index);
+                    dst[i] = static_cast<D>(index);
+                }
+            }
+            if constexpr (sizeof(S) > sizeof(D)) {
+                if (max_index > std::numeric_limits<D>::max())
+                    Logger::panic(std::format("Index accessor {} does not fit into 16-bit indices", accessor_index));
+            }
+            // the draws would read past the primitive's vertices into the next one's, or past the buffer
+            if (max_index >= vertex_count)
+                Logger::panic(std::format(
+                        "Index accessor {} refers to vertex {}, the primitive has {}", accessor_index, max_index,
+                        vertex_count
+                ));
+        };
+
+        switch (accessor.componentType) {
+            case ComponentType::UnsignedByte:
+                convert.template operator()<uint8_t>();
+                break;
+            case ComponentType::UnsignedShort:
+                convert.template operator()<uint16_t>();
+                break;
+            case ComponentType::UnsignedInt:
+                convert.template operator()<uint32_t>();
+                break;
+            default:
+                Logger::panic(std::format(
+                        "Index component type must be unsigned byte, short or int, got {}",
+                        static_cast<uint32_t>(accessor.componentType)
+                ));
+        }
+    }
+
+    void readIndices(const GlbFile &glb, int accessor_index, size_t vertex_count, std::span<uint32_t> dst) {
+        readIndicesAs(glb, accessor_index, vertex_count, dst);
+    }
+
+    void readIndices(const GlbFile &glb, int accessor_index, size_t vertex_count, std::span<uint16_t> dst) {
+        readIndicesAs(glb, accessor_index, vertex_count, dst);
+    }
+} // namespace gltf
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+
+namespace gltf {
+    class GlbFile;
+
+    /**
+     * Reads the accessor's elements into dst as tightly packed floats.
+     * Handles any byte offset and stride (interleaved vertex data) as well as normalized and non-normalized integer
+     * component types (KHR_mesh_quantization).
+     * @param dst must hold exactly count * components floats
+     */
+    void readAccessor(const GlbFile &glb, int accessor_index, std::span<float> dst);
+
+    /**
+     * Reads the index accessor's elements into dst, widening them to 32-bit.
+     * Panics if an index is out of range of the primitive's vertices.
+     * @param dst must hold exactly count indices
+     */
+    void readIndices(const GlbFile &glb, int accessor_index, size_t vertex_count, std::span<uint32_t> dst);
+
+    /**
+     * Reads the index accessor's elements into dst as 16-bit indices.
+     * Panics if a 32-bit source index does not fit or an index is out of range of the primitive's vertices.
+     * @param dst must hold exactly count indices
+     */
+    void readIndices(const GlbFile &glb, int accessor_index, size_t vertex_count, std::span<uint16_t> dst);
+} // namespace gltf
@@ -0,0 +1,170 @@
+#include "Bounds.h"
+
+#include <algorithm>
+#include <cmath>
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+#include <limits>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define GLTF_BOUNDS_SSE2
+#include <xmmintrin.h>
+#endif
+
+#include "../Logger.h"
+#include "../util/thread_pool.h"
+#include "Gltf.h"
+
+namespace gltf {
+    namespace {
+        // most primitives are small, so they are handed out in batches
+        constexpr size_t PARALLEL_GRAIN = 16;
+
+#ifdef GLTF_BOUNDS_SSE2
+        // Splits four tightly packed positions into their x, y and z components
+        void load_positions(const float *positions, __m128 &x, __m128 &y, __m128 &z) {
+            const __m128 a = _mm_loadu_ps(positions); // x0 y0 z0 x1
+            const __m128 b = _mm_loadu_ps(positions + 4); // y1 z1 x2 y2
+            const __m128 c = _mm_loadu_ps(positions + 8); // z2 x3 y3 z3
+            const __m128 x01 = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 3, 0)); // x0 x1 y1 x2
+            const __m128 x23 = _mm_shuffle_ps(b, c, _MM_SHUFFLE(1, 0, 3, 2)); // x2 y2 z2 x3
+            const __m128 yz01 = _mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 0, 2, 1)); // y0 z0 y1 z1
+            const __m128 y23 = _mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 1, 0, 3)); // y2 y1 x3 y3
+            x = _mm_shuffle_ps(x01, x23, _MM_SHUFFLE(3, 0, 1, 0));
+            y = _mm_shuffle_ps(yz01, y23, _MM_SHUFFLE(3, 0, 2, 0));
+            z = _mm_shuffle_ps(yz01, c, _MM_SHUFFLE(3, 0, 3, 1));
+        }
+
+        float horizontal_min(__m128 v) {
+            v = _mm_min_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+            v = _mm_min_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+            return _mm_cvtss_f32(v);
+        }
+
+        float horizontal_max(__m128 v) {
+            v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+            v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+            return _mm_cvtss_f32(v);
+        }
+#endif
+
+        void compute_aabb(const float *positions, size_t count, glm::vec3 &aabb_min, glm::vec3 &aabb_max) {
+            aabb_min = glm::vec3(std::numeric_limits<float>::max());
+            aabb_max = glm::vec3(std::numeric_limits<float>::lowest());
+            size_t i = 0;
+#ifdef GLTF_BOUNDS_SSE2
+            if (count >= 4) {
+                __m128 min_x = _mm_set1_ps(aabb_min.x), min_y = min_x, min_z = min_x;
+                __m128 max_x = _mm_set1_ps(aabb_max.x), max_y = max_x, max_z = max_x;
+                for (; i + 4 <= count; i += 4) {
+                    __m128 x, y, z;
+                    load_positions(positions + i * 3, x, y, z);
+                    min_x = _mm_min_ps(min_x, x);
+                    min_y = _mm_min_ps(min_y, y);
+                    min_z = _mm_min_ps(min_z, z);
+                    max_x = _mm_max_ps(max_x, x);
+                    max_y = _mm_max_ps(max_y, y);
+                    max_z = _mm_max_ps(max_z, z);
+                }
+                aabb_min = {horizontal_min(min_x), horizontal_min(min_y), horizontal_min(min_z)};
+                aabb_max = {horizontal_max(max_x), horizontal_max(max_y), horizontal_max(max_z)};
+            }
+#endif
+            for (; i < count; i++) {
+                const glm::vec3 position(positions[i * 3], positions[i * 3 + 1], positions[i * 3 + 2]);
+                aabb_min = glm::min(aabb_min, position);
+                aabb_max = glm::max(aabb_max, position);
+            }
+        }
+
+        float compute_radius(const float *positions, size_t count, const glm::vec3 &center) {
+            float radius2 = 0.0f;
+            size_t i = 0;
+#ifdef GLTF_BOUNDS_SSE2
+            if (count >= 4) {
+                const __m128 center_x = _mm_set1_ps(center.x);
+                const __m128 center_y = _mm_set1_ps(center.y);
+                const __m128 center_z = _mm_set1_ps(center.z);
+                __m128 max_distance2 = _mm_setzero_ps();
+                for (; i + 4 <= count; i += 4) {
+                    __m128 x, y, z;
+                    load_positions(positions + i * 3, x, y, z);
+                    x = _mm_sub_ps(x, center_x);
+                    y = _mm_sub_ps(y, center_y);
+                    z = _mm_sub_ps(z, center_z);
+                    const __m128 distance2 =
+                            _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z));
+                    max_distance2 = _mm_max_ps(max_distance2, distance2);
+                }
+                radius2 = horizontal_max(max_distance2);
+            }
+#endif
+            for (; i < count; i++) {
+                const glm::vec3 position(positions[i * 3], positions[i * 3 + 1], positions[i * 3 + 2]);
+                const glm::vec3 offset = position - center;
+                radius2 = std::max(radius2, glm::dot(offset, offset));
+            }
+            return std::sqrt(radius2);
+        }
+    } // namespace
+
+    void computePrimitiveBounds(SceneData &scene_data, bool parallel) {
+        Logger::check(scene_data.vertex_format == VertexFormat::Float, "Bounds are computed from float positions");
+        const size_t primitive_count = scene_data.primitives.size();
+        auto &bounds = scene_data.primitive_bounds;
+        bounds.resize(primitive_count);
+
+        const auto *positions = reinterpret_cast<const float *>(scene_data.vertex_position_data.data());
+        const auto compute_primitives = [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                const auto &primitive = scene_data.primitives[i];
+                if (primitive.vertexCount == 0) {
+                    bounds.aabbMins[i] = bounds.aabbMaxs[i] = glm::vec3(0.0f);
+                    bounds.spheres[i] = glm::vec4(0.0f);
+                    continue;
+                }
+                const float *primitive_positions = positions + static_cast<size_t>(primitive.vertexOffset) * 3;
+                compute_aabb(primitive_positions, primitive.vertexCount, bounds.aabbMins[i], bounds.aabbMaxs[i]);
+                const glm::vec3 center = (bounds.aabbMins[i] + bounds.aabbMaxs[i]) * 0.5f;
+                bounds.spheres[i] = glm::vec4(center, compute_radius(primitive_positions, primitive.vertexCount, center));
+            }
+        };
+        if (parallel)
+            util::parallel_for(primitive_count, PARALLEL_GRAIN, compute_primitives);
+        else
+            compute_primitives(0, primitive_count);
+    }
+
+    void updateInstanceBounds(SceneData &scene_data, size_t instance_index) {
+        auto &instance = scene_data.instances[instance_index];
+        const auto &primitive = scene_data.primitives[instance.primitive];
+        const auto &object = scene_data.primitive_bounds;
+        auto &world = scene_data.instance_bounds;
+        const auto &m = instance.transformation;
+
+        // the extent of the transformed box along each axis is the sum of the absolute projections of its half sides
+        const glm::vec3 center = (object.aabbMins[instance.primitive] + object.aabbMaxs[instance.primitive]) * 0.5f;
+        const glm::vec3 extent = (object.aabbMaxs[instance.primitive] - object.aabbMins[instance.primitive]) * 0.5f;
+        const glm::vec3 world_center = glm::vec3(m * glm::vec4(center, 1.0f));
+        const glm::vec3 world_extent = glm::abs(glm::vec3(m[0])) * extent.x + glm::abs(glm::vec3(m[1])) * extent.y +
+                                       glm::abs(glm::vec3(m[2])) * extent.z;
+        world.aabbMins[instance_index] = world_center - world_extent;
+        world.aabbMaxs[instance_index] = world_center + world_extent;
+
+        const glm::vec4 &sphere = object.spheres[instance.primitive];
+        const float scale =
+                std::max({glm::length(glm::vec3(m[0])), glm::length(glm::vec3(m[1])), glm::length(glm::vec3(m[2]))});
+        world.spheres[instance_index] = glm::vec4(glm::vec3(m * glm::vec4(glm::vec3(sphere), 1.0f)), sphere.w * scale);
+
+        instance.lodCount = primitive.lodCount;
+        instance.lods = primitive.lods;
+        for (auto &lod: instance.lods)
+            lod.error *= scale;
+    }
+
+    void computeInstanceBounds(SceneData &scene_data) {
+        scene_data.instance_bounds.resize(scene_data.instances.size());
+        for (size_t i = 0; i < scene_data.instances.size(); i++)
+            updateInstanceBounds(scene_data, i);
+    }
+} // namespace gltf
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstddef>
+
+namespace gltf {
+    struct SceneData;
+
+    /**
+     * Computes the object space AABB of every primitive from its float positions, and the bounding sphere around the
+     * AABB's center that contains all of them.
+     * @param parallel process the primitives concurrently on the global thread pool
+     */
+    void computePrimitiveBounds(SceneData &scene_data, bool parallel = true);
+
+    // Transforms the primitive's bounds and LOD errors into world space with the instance's transformation
+    void updateInstanceBounds(SceneData &scene_data, size_t instance);
+
+    // Sizes SceneData::instance_bounds to the instances and updates all of them
+    void computeInstanceBounds(SceneData &scene_data);
+} // namespace gltf
@@ -0,0 +1,450 @@
+#include "Glb.h"
+
+#include <cstring>
+#include <format>
+#include <nlohmann/json.hpp>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "../Logger.h"
+#include "../util/thread_pool.h"
+#include "Meshopt.h"
+
+namespace gltf {
+#ifdef _WIN32
+    MappedFile::MappedFile(const std::filesystem::path &path, bool copy_on_write) : copyOnWrite_(copy_on_write) {
+        HANDLE file = CreateFileW(
+                path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr
+        );
+        if (file == INVALID_HANDLE_VALUE)
+            Logger::panic("Failed to open file: " + path.string());
+        file_ = file;
+
+        LARGE_INTEGER size = {};
+        GetFileSizeEx(file, &size);
+        size_ = static_cast<size_t>(size.QuadPart);
+        if (size_ == 0)
+            return;
+
+        mapping_ = CreateFileMappingW(file, nullptr, copy_on_write ? PAGE_WRITECOPY : PAGE_READONLY, 0, 0, nullptr);
+        if (mapping_ == nullptr)
+            Logger::panic("Failed to map file: " + path.string());
+        data_ = static_cast<uint8_t *>(MapViewOfFile(mapping_, copy_on_write ? FILE_MAP_COPY : FILE_MAP_READ, 0, 0, 0));
+        if (data_ == nullptr)
+            Logger::panic("Failed to map file: " + path.string());
+    }
+
+    MappedFile::~MappedFile() {
+        if (data_)
+            UnmapViewOfFile(data_);
+        if (mapping_)
+            CloseHandle(mapping_);
+        if (file_)
+            CloseHandle(file_);
+    }
+#else
+    MappedFile::MappedFile(const std::filesystem::path &path, bool copy_on_write) : copyOnWrite_(copy_on_write) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            Logger::panic("Failed to open file: " + path.string());
+
+        struct stat st = {};
+        if (fstat(fd, &st) != 0) {
+            ::close(fd);
+            Logger::panic("Failed to stat file: " + path.string());
+        }
+        size_ = static_cast<size_t>(st.st_size);
+        if (size_ == 0) {
+            ::close(fd);
+            return;
+        }
+
+        // a private mapping never writes back to the file, writes only copy the pages
+        const int protection = copy_on_write ? PROT_READ | PROT_WRITE : PROT_READ;
+        void *data = mmap(nullptr, size_, protection, MAP_PRIVATE, fd, 0);
+        // the mapping keeps its own reference to the file
+        ::close(fd);
+        if (data == MAP_FAILED)
+            Logger::panic("Failed to map file: " + path.string());
+        // the loader streams over the attribute data front to back
+        madvise(data, size_, MADV_SEQUENTIAL);
+        data_ = static_cast<uint8_t *>(data);
+    }
+
+    MappedFile::~MappedFile() {
+        if (data_)
+            munmap(data_, size_);
+    }
+#endif
+
+    std::span<uint8_t> MappedFile::writableBytes() const {
+        if (!copyOnWrite_)
+            Logger::panic("Writing to a read-only file mapping");
+        return {data_, size_};
+    }
+
+    namespace {
+        constexpr uint32_t GLB_MAGIC = 0x46546C67; // "glTF"
+        constexpr uint32_t GLB_CHUNK_JSON = 0x4E4F534A; // "JSON"
+        constexpr uint32_t GLB_CHUNK_BIN = 0x004E4942; // "BIN\0"
+
+        uint32_t read_u32(std::span<const uint8_t> bytes, size_t offset) {
+            uint32_t value;
+            std::memcpy(&value, bytes.data() + offset, sizeof(value));
+            return value;
+        }
+
+        template<size_t N>
+        std::array<float, N> read_floats(const nlohmann::json &array) {
+            std::array<float, N> result = {};
+            if (array.size() != N)
+                Logger::panic(std::format("Expected {} elements", N));
+            for (size_t i = 0; i < N; i++)
+                result[i] = array[i].get<float>();
+            return result;
+        }
+
+        uint32_t accessor_components(const std::string &type) {
+            if (type == "SCALAR")
+                return 1;
+            if (type == "VEC2")
+                return 2;
+            if (type == "VEC3")
+                return 3;
+            if (type == "VEC4")
+                return 4;
+            if (type == "MAT2")
+                return 4;
+            if (type == "MAT3")
+                return 9;
+            if (type == "MAT4")
+                return 16;
+            Logger::panic("Unknown accessor type: " + type);
+        }
+
+        // Returns the array stored under key, or an empty array. Avoids the copy json::value would make.
+        const nlohmann::json &items(const nlohmann::json &json, const char *key) {
+            static const nlohmann::json empty = nlohmann::json::array();
+            auto it = json.find(key);
+            return it == json.end() ? empty : *it;
+        }
+
+        // Returns the object stored under key, or an empty object
+        const nlohmann::json &object(const nlohmann::json &json, const char *key) {
+            static const nlohmann::json empty = nlohmann::json::object();
+            auto it = json.find(key);
+            return it == json.end() ? empty : *it;
+        }
+
+        doc::MeshoptMode meshopt_mode(const std::string &mode) {
+            if (mode == "ATTRIBUTES")
+                return doc::MeshoptMode::Attributes;
+            if (mode == "TRIANGLES")
+                return doc::MeshoptMode::Triangles;
+            if (mode == "INDICES")
+                return doc::MeshoptMode::Indices;
+            Logger::panic("Unknown meshopt compression mode: " + mode);
+        }
+
+        doc::MeshoptFilter meshopt_filter(const std::string &filter) {
+            if (filter == "NONE")
+                return doc::MeshoptFilter::None;
+            if (filter == "OCTAHEDRAL")
+                return doc::MeshoptFilter::Octahedral;
+            if (filter == "QUATERNION")
+                return doc::MeshoptFilter::Quaternion;
+            if (filter == "EXPONENTIAL")
+                return doc::MeshoptFilter::Exponential;
+            Logger::panic("Unknown meshopt compression filter: " + filter);
+        }
+
+        std::optional<doc::MeshoptCompression> parse_meshopt_compression(const nlohmann::json &view) {
+            const auto &extensions = object(view, "extensions");
+            if (!extensions.contains("EXT_meshopt_compression"))
+                return std::nullopt;
+            const auto &j = extensions["EXT_meshopt_compression"];
+            return doc::MeshoptCompression{
+                .buffer = j.value("buffer", -1),
+                .byteOffset = j.value("byteOffset", size_t{0}),
+                .byteLength = j.value("byteLength", size_t{0}),
+                .byteStride = j.value("byteStride", size_t{0}),
+                .count = j.value("count", size_t{0}),
+                .mode = meshopt_mode(j.value("mode", std::string{})),
+                .filter = meshopt_filter(j.value("filter", std::string{"NONE"})),
+            };
+        }
+
+        doc::TextureInfo parse_texture_info(const nlohmann::json &json, const char *key, const char *scale_key) {
+            doc::TextureInfo info = {};
+            if (!json.contains(key))
+                return info;
+            const auto &tex = json[key];
+            info.index = tex.value("index", -1);
+            if (scale_key)
+                info.scale = tex.value(scale_key, 1.0f);
+            return info;
+        }
+
+        void parse_document(GlbFile &glb, const nlohmann::json &json) {
+            glb.defaultScene = json.value("scene", 0);
+
+            // Draco is only supported as an optional extension, the primitives' own accessors are used instead
+            for (const auto &j: items(json, "extensionsRequired")) {
+                if (j.get<std::string>() == "KHR_draco_mesh_compression")
+                    Logger::panic("Draco compressed meshes are not supported");
+            }
+
+            for (const auto &j: items(json, "buffers")) {
+                const auto &meshopt = object(object(j, "extensions"), "EXT_meshopt_compression");
+                glb.buffers.push_back({
+                    .byteLength = j.value("byteLength", size_t{0}),
+                    .uri = j.value("uri", std::string{}),
+                    .fallback = meshopt.value("fallback", false),
+                });
+            }
+
+            for (const auto &j: items(json, "bufferViews")) {
+                glb.bufferViews.push_back({
+                    .buffer = j.value("buffer", -1),
+                    .byteOffset = j.value("byteOffset", size_t{0}),
+                    .byteLength = j.value("byteLength", size_t{0}),
+                    .byteStride = j.value("byteStride", size_t{0}),
+                    .meshopt = parse_meshopt_compression(j),
+                });
+            }
+
+            for (const auto &j: items(json, "accessors")) {
+                if (j.contains("sparse"))
+                    Logger::panic("Sparse accessors are not supported");
+                glb.accessors.push_back({
+                    .bufferView = j.value("bufferView", -1),
+                    .byteOffset = j.value("byteOffset", size_t{0}),
+                    .componentType = static_cast<ComponentType>(j.value("componentType", 0u)),
+                    .normalized = j.value("normalized", false),
+                    .count = j.value("count", size_t{0}),
+                    .components = accessor_components(j.value("type", std::string{})),
+                });
+            }
+
+            for (const auto &j: items(json, "meshes")) {
+                auto &mesh = glb.meshes.emplace_back();
+                for (const auto &jp: items(j, "primitives")) {
+                    auto &prim = mesh.primitives.emplace_back();
+                    const auto &attributes = object(jp, "attributes");
+                    prim.position = attributes.value("POSITION", -1);
+                    prim.normal = attributes.value("NORMAL", -1);
+                    prim.tangent = attributes.value("TANGENT", -1);
+                    prim.texcoord = attributes.value("TEXCOORD_0", -1);
+                    prim.indices = jp.value("indices", -1);
+                    prim.material = jp.value("material", -1);
+                    prim.mode = jp.value("mode", doc::MODE_TRIANGLES);
+                }
+            }
+
+            for (const auto &j: items(json, "nodes")) {
+                auto &node = glb.nodes.emplace_back();
+                node.mesh = j.value("mesh", -1);
+                node.children = j.value("children", std::vector<int>{});
+                if (j.contains("matrix"))
+                    node.matrix = read_floats<16>(j["matrix"]);
+                if (j.contains("translation"))
+                    node.translation = read_floats<3>(j["translation"]);
+                if (j.contains("rotation"))
+                    node.rotation = read_floats<4>(j["rotation"]);
+                if (j.contains("scale"))
+                    node.scale = read_floats<3>(j["scale"]);
+            }
+
+            for (const auto &j: items(json, "scenes")) {
+                glb.scenes.push_back({.nodes = j.value("nodes", std::vector<int>{})});
+            }
+
+            for (const auto &j: items(json, "materials")) {
+                auto &mat = glb.materials.emplace_back();
+                const auto &pbr = object(j, "pbrMetallicRoughness");
+                if (pbr.contains("baseColorFactor"))
+                    mat.baseColorFactor = read_floats<4>(pbr["baseColorFactor"]);
+                mat.metallicFactor = pbr.value("metallicFactor", 1.0f);
+                mat.roughnessFactor = pbr.value("roughnessFactor", 1.0f);
+                mat.baseColorTexture = parse_texture_info(pbr, "baseColorTexture", nullptr);
+                mat.metallicRoughnessTexture = parse_texture_info(pbr, "metallicRoughnessTexture", nullptr);
+                mat.normalTexture = parse_texture_info(j, "normalTexture", "scale");
+                mat.occlusionTexture = parse_texture_info(j, "occlusionTexture", "strength");
+            }
+
+            for (const auto &j: items(json, "textures")) {
+                // KHR_texture_basisu images are always Basis Universal supercompressed, which needs a transcoder
+                if (object(object(j, "extensions"), "KHR_texture_basisu").contains("source"))
+                    Logger::warning(std::format(
+                            "Texture {} has a KHR_texture_basisu image, which isn't supported, its source is used",
+                            glb.textures.size()
+                    ));
+                glb.textures.push_back({.source = j.value("source", -1)});
+            }
+
+            for (const auto &j: items(json, "images")) {
+                glb.images.push_back({
+                    .bufferView = j.value("bufferView", -1),
+                    .mimeType = j.value("mimeType", std::string{}),
+                    .uri = j.value("uri", std::string{}),
+                });
+            }
+        }
+    } // namespace
+
+    GlbFile GlbFile::open(const std::filesystem::path &path) {
+        GlbFile glb;
+        glb.file_ = std::make_unique<MappedFile>(path);
+        const auto bytes = glb.file_->bytes();
+
+        if (bytes.size() < 20 || read_u32(bytes, 0) != GLB_MAGIC)
+            Logger::panic("Not a GLB file: " + path.string());
+        if (read_u32(bytes, 4) != 2)
+            Logger::panic("Unsupported GLB version: " + std::to_string(read_u32(bytes, 4)));
+        size_t length = std::min<size_t>(read_u32(bytes, 8), bytes.size());
+
+        std::span<const uint8_t> json_chunk = {};
+        std::span<const uint8_t> bin_chunk = {};
+        // chunks are 4 byte aligned and follow the 12 byte header
+        for (size_t offset = 12; offset + 8 <= length;) {
+            size_t chunk_length = read_u32(bytes, offset);
+            uint32_t chunk_type = read_u32(bytes, offset + 4);
+            if (offset + 8 + chunk_length > length)
+                Logger::panic("GLB chunk exceeds file size");
+            auto chunk = bytes.subspan(offset + 8, chunk_length);
+            if (chunk_type == GLB_CHUNK_JSON && json_chunk.empty())
+                json_chunk = chunk;
+            else if (chunk_type == GLB_CHUNK_BIN && bin_chunk.empty())
+                bin_chunk = chunk;
+            offset += 8 + chunk_length;
+        }
+        if (json_chunk.empty())
+            Logger::panic("GLB file has no JSON chunk");
+
+        auto json = nlohmann::json::parse(json_chunk.begin(), json_chunk.end());
+        parse_document(glb, json);
+
+        glb.bufferData_.resize(glb.buffers.size());
+        for (size_t i = 0; i < glb.buffers.size(); i++) {
+            const auto &buffer = glb.buffers[i];
+            if (buffer.fallback && buffer.uri.empty()) {
+                // nothing to map, the compressed views decode into their own memory
+                continue;
+            }
+            if (buffer.uri.empty()) {
+                // Only the first buffer may refer to the BIN chunk
+                if (i != 0)
+                    Logger::panic("Only the first buffer may omit its uri");
+                if (buffer.byteLength > bin_chunk.size())
+                    Logger::panic("Buffer is larger than the BIN chunk");
+                glb.bufferData_[i] = bin_chunk.first(buffer.byteLength);
+            } else if (buffer.uri.starts_with("data:")) {
+                Logger::panic("Data URI buffers are not supported");
+            } else {
+                auto &external = glb.externalFiles_.emplace_back(
+                        std::make_unique<MappedFile>(path.parent_path() / buffer.uri)
+                );
+                if (buffer.byteLength > external->size())
+                    Logger::panic("Buffer is larger than its file");
+                glb.bufferData_[i] = external->bytes().first(buffer.byteLength);
+            }
+        }
+
+        glb.decodedViews_.resize(glb.bufferViews.size());
+        return glb;
+    }
+
+    void GlbFile::decodeCompressedViews(bool parallel) {
+        std::vector<size_t> compressed;
+        for (size_t i = 0; i < bufferViews.size(); i++) {
+            if (bufferViews[i].meshopt && decodedViews_[i].empty())
+                compressed.push_back(i);
+        }
+
+        // Every view decodes into its own memory, gltfpack emits one view per attribute stream
+        const auto decode_views = [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                const auto &view = bufferViews[compressed[i]];
+                const auto &compression = *view.meshopt;
+                const auto &buffer = bufferData_.at(compression.buffer);
+                if (compression.byteOffset + compression.byteLength > buffer.size())
+                    Logger::panic("Compressed buffer view exceeds buffer");
+                if (compression.count * compression.byteStride > view.byteLength)
+                    Logger::panic("Compressed buffer view decodes to more than its byteLength");
+                // the view may be longer than the decoded data, the rest reads as zeros
+                auto &decoded = decodedViews_[compressed[i]];
+                decoded.resize(view.byteLength);
+                decodeMeshopt(
+                        compression, buffer.subspan(compression.byteOffset, compression.byteLength),
+                        std::span(decoded).first(compression.count * compression.byteStride)
+                );
+            }
+        };
+        if (parallel)
+            util::parallel_for(compressed.size(), 1, decode_views);
+        else
+            decode_views(0, compressed.size());
+    }
+
+    void GlbFile::releaseDecodedViews() {
+        std::vector<bool> keep(bufferViews.size());
+        for (const auto &image: images) {
+            if (image.bufferView != -1)
+                keep.at(image.bufferView) = true;
+        }
+        for (size_t i = 0; i < decodedViews_.size(); i++) {
+            if (!keep[i])
+                decodedViews_[i] = {};
+        }
+    }
+
+    std::span<const uint8_t> GlbFile::bufferViewBytes(int index) const {
+        const auto &view = bufferViews.at(index);
+        if (view.meshopt) {
+            const auto &decoded = decodedViews_.at(index);
+            if (decoded.size() != view.byteLength)
+                Logger::panic("Compressed buffer view read before it was decoded");
+            return decoded;
+        }
+        const auto &buffer = bufferData_.at(view.buffer);
+        if (view.byteOffset + view.byteLength > buffer.size())
+            Logger::panic("Buffer view exceeds buffer");
+        return buffer.subspan(view.byteOffset, view.byteLength);
+    }
+
+    std::span<const uint8_t> GlbFile::accessorBytes(int index) const {
+        const auto &accessor = accessors.at(index);
+        if (accessor.count == 0)
+            return {};
+        const auto view_bytes = bufferViewBytes(accessor.bufferView);
+        size_t element_size = componentSize(accessor.componentType) * accessor.components;
+        size_t size = accessorStride(index) * (accessor.count - 1) + element_size;
+        if (accessor.byteOffset + size > view_bytes.size())
+            Logger::panic("Accessor exceeds buffer view");
+        return view_bytes.subspan(accessor.byteOffset, size);
+    }
+
+    size_t GlbFile::accessorStride(int index) const {
+        const auto &accessor = accessors.at(index);
+        const auto &view = bufferViews.at(accessor.bufferView);
+        if (view.byteStride != 0)
+            return view.byteStride;
+        return componentSize(accessor.componentType) * accessor.components;
+    }
+
+    std::span<const uint8_t> GlbFile::imageBytes(int index) const {
+        const auto &image = images.at(index);
+        if (image.bufferView == -1)
+            Logger::panic("Only images embedded in buffer views are supported");
+        return bufferViewBytes(image.bufferView);
+    }
+} // namespace gltf
@@ -0,0 +1,222 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace gltf {
+    // Read-only memory mapping of a whole file. Pages are only faulted in when they are touched.
+    class MappedFile {
+        uint8_t *data_ = nullptr;
+        size_t size_ = 0;
+        bool copyOnWrite_ = false;
+#ifdef _WIN32
+        void *file_ = nullptr;
+        void *mapping_ = nullptr;
+#endif
+
+    public:
+        MappedFile() = default;
+
+        // A copy on write mapping can be written to, the written pages are copied and the file stays unchanged
+        explicit MappedFile(const std::filesystem::path &path, bool copy_on_write = false);
+
+        ~MappedFile();
+
+        MappedFile(const MappedFile &other) = delete;
+
+        MappedFile &operator=(const MappedFile &other) = delete;
+
+        [[nodiscard]] std::span<const uint8_t> bytes() const { return {data_, size_}; }
+
+        // Only for copy on write mappings, writing to a read-only one would crash
+        [[nodiscard]] std::span<uint8_t> writableBytes() const;
+
+        [[nodiscard]] size_t size() const { return size_; }
+
+        explicit operator bool() const { return data_ != nullptr; }
+    };
+
+    enum class ComponentType : uint32_t {
+        Byte = 5120,
+        UnsignedByte = 5121,
+        Short = 5122,
+        UnsignedShort = 5123,
+        UnsignedInt = 5125,
+        Float = 5126,
+    };
+
+    [[nodiscard]] constexpr size_t componentSize(ComponentType type) {
+        switch (type) {
+            case ComponentType::Byte:
+            case ComponentType::UnsignedByte:
+                return 1;
+            case ComponentType::Short:
+            case ComponentType::UnsignedShort:
+                return 2;
+            case ComponentType::UnsignedInt:
+            case ComponentType::Float:
+                return 4;
+        }
+        return 0;
+    }
+
+    namespace doc {
+        constexpr int MODE_TRIANGLES = 4;
+
+        struct Buffer {
+            size_t byteLength = 0;
+            std::string uri;
+            // EXT_meshopt_compression placeholder without data, only compressed views refer to it
+            bool fallback = false;
+        };
+
+        enum class MeshoptMode {
+            Attributes,
+            Triangles,
+            Indices,
+        };
+
+        enum class MeshoptFilter {
+            None,
+            Octahedral,
+            Quaternion,
+            Exponential,
+        };
+
+        // EXT_meshopt_compression of a buffer view, the view itself describes the decoded data
+        struct MeshoptCompression {
+            int buffer = -1;
+            size_t byteOffset = 0;
+            size_t byteLength = 0;
+            size_t byteStride = 0;
+            size_t count = 0;
+            MeshoptMode mode = MeshoptMode::Attributes;
+            MeshoptFilter filter = MeshoptFilter::None;
+        };
+
+        struct BufferView {
+            int buffer = -1;
+            size_t byteOffset = 0;
+            size_t byteLength = 0;
+            size_t byteStride = 0;
+            std::optional<MeshoptCompression> meshopt;
+        };
+
+        struct Accessor {
+            int bufferView = -1;
+            size_t byteOffset = 0;
+            ComponentType componentType = ComponentType::Float;
+            bool normalized = false;
+            size_t count = 0;
+            // number of components per element, e.g. 3 for VEC3
+            uint32_t components = 1;
+        };
+
+        struct Primitive {
+            int position = -1;
+            int normal = -1;
+            int tangent = -1;
+            int texcoord = -1;
+            int indices = -1;
+            int material = -1;
+            int mode = MODE_TRIANGLES;
+        };
+
+        struct Mesh {
+            std::vector<Primitive> primitives;
+        };
+
+        struct Node {
+            int mesh = -1;
+            std::vector<int> children;
+            std::optional<std::array<float, 16>> matrix;
+            std::optional<std::array<float, 3>> translation;
+            std::optional<std::array<float, 4>> rotation;
+            std::optional<std::array<float, 3>> scale;
+        };
+
+        struct Scene {
+            std::vector<int> nodes;
+        };
+
+        struct TextureInfo {
+            int index = -1;
+            // normalTexture.scale or occlusionTexture.strength
+            float scale = 1.0f;
+        };
+
+        struct Material {
+            std::array<float, 4> baseColorFactor = {1.0f, 1.0f, 1.0f, 1.0f};
+            float metallicFactor = 1.0f;
+            float roughnessFactor = 1.0f;
+            TextureInfo baseColorTexture;
+            TextureInfo metallicRoughnessTexture;
+            TextureInfo normalTexture;
+            TextureInfo occlusionTexture;
+        };
+
+        struct Texture {
+            // PNG, JPEG or a KTX2 image with BCn levels, -1 if the texture has none of them
+            int source = -1;
+        };
+
+        struct Image {
+            int bufferView = -1;
+            std::string mimeType;
+            std::string uri;
+        };
+    } // namespace doc
+
+    /**
+     * A parsed glTF binary (GLB) backed by a memory mapping.
+     * All byte spans handed out point straight into the mapped BIN chunk (or mapped external buffer files),
+     * nothing is copied during parsing. The spans stay valid as long as the GlbFile is alive.
+     * Views compressed with EXT_meshopt_compression are the exception, they are decoded into memory of their own.
+     */
+    class GlbFile {
+        std::unique_ptr<MappedFile> file_;
+        std::vector<std::unique_ptr<MappedFile>> externalFiles_;
+        std::vector<std::span<const uint8_t>> bufferData_;
+        // by buffer view, empty unless the view is compressed and decoded
+        std::vector<std::vector<uint8_t>> decodedViews_;
+
+    public:
+        std::vector<doc::Buffer> buffers;
+        std::vector<doc::BufferView> bufferViews;
+        std::vector<doc::Accessor> accessors;
+        std::vector<doc::Mesh> meshes;
+        std::vector<doc::Node> nodes;
+        std::vector<doc::Scene> scenes;
+        std::vector<doc::Material> materials;
+        std::vector<doc::Texture> textures;
+        std::vector<doc::Image> images;
+        int defaultScene = 0;
+
+        static GlbFile open(const std::filesystem::path &path);
+
+        // The raw bytes of the whole file
+        [[nodiscard]] std::span<const uint8_t> fileBytes() const { return file_->bytes(); }
+
+        // Decodes every compressed buffer view, in parallel across views. Must be called before their bytes are read.
+        void decodeCompressedViews(bool parallel = true);
+
+        // Frees the decoded views once the geometry has been copied out, the ones images refer to are kept
+        void releaseDecodedViews();
+
+        [[nodiscard]] std::span<const uint8_t> bufferViewBytes(int index) const;
+
+        // The bytes covered by the accessor, starting at its first element and ending after its last element.
+        // The accessor's view may be interleaved, use `accessorStride` to step between elements.
+        [[nodiscard]] std::span<const uint8_t> accessorBytes(int index) const;
+
+        [[nodiscard]] size_t accessorStride(int index) const;
+
+        [[nodiscard]] std::span<const uint8_t> imageBytes(int index) const;
+    };
+} // namespace gltf
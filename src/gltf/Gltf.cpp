@@ -1,13 +1,30 @@
 #include "Gltf.h"
 
+#include <algorithm>
+#include <format>
 #include <glm/fwd.hpp>
+#include <glm/geometric.hpp>
 #include <glm/gtc/quaternion.hpp>
 #include <glm/gtc/type_ptr.hpp>
-#include <tiny_gltf.h>
-
+#include <glm/matrix.hpp>
+#include <limits>
+#include <memory>
+#include <stb_image.h>
+#include <utility>
+#include <vulkan/utility/vk_format_utils.h>
+
+#include "../BlockCompression.h"
 #include "../GraphicsBackend.h"
 #include "../Image.h"
 #include "../Logger.h"
+#include "../util/thread_pool.h"
+#include "Accessor.h"
+#include "Bounds.h"
+#include "Glb.h"
+#include "Ktx2.h"
+#include "NodeHierarchy.h"
+#include "SceneCache.h"
+#include "VertexQuantization.h"
 
 namespace gltf {
     template<typename D>
@@ -20,283 +37,316 @@ namespace gltf {
         return std::span(reinterpret_cast<D *>(byte_span.data()), byte_span.size() / sizeof(D));
     }
 
-    // loads the node's transformation information into a single glm::mat4
-    glm::mat4 loadNodeTransform(const tinygltf::Node &node) {
-        auto transform = glm::mat4(1.0);
+    // Splits the node's transformation into translation, rotation and scale. Matrices with shear lose the shear.
+    void loadNodeTransform(const doc::Node &node, glm::vec3 &translation, glm::quat &rotation, glm::vec3 &scale) {
         // A Node can have either a full transformation matrix or individual scale, rotation and translatin components
-
-        // Check if matrix is present
-        if (node.matrix.size() == 16) {
-            transform = glm::make_mat4(node.matrix.data());
-        } else {
-            // Check if scale is present
-            if (node.scale.size() == 3) {
-                transform = glm::scale(transform, {node.scale[0], node.scale[1], node.scale[2]});
+        if (node.matrix) {
+            const glm::mat4 matrix = glm::make_mat4(node.matrix->data());
+            translation = glm::vec3(matrix[3]);
+            glm::mat3 basis = glm::mat3(matrix);
+            scale = {glm::length(basis[0]), glm::length(basis[1]), glm::length(basis[2])};
+            // a mirroring matrix is a rotation with a negative scale
+            if (glm::determinant(basis) < 0.0f)
+                scale.x = -scale.x;
+            for (int i = 0; i < 3; i++) {
+                if (scale[i] != 0.0f)
+                    basis[i] /= scale[i];
             }
-            // Check if rotation is present
-            if (node.rotation.size() == 4) {
-                glm::quat quat = glm::make_quat(node.rotation.data());
-                transform = glm::mat4_cast(quat) * transform;
-            }
-            // Check if translation is present
-            if (node.translation.size() == 3) {
-                glm::mat4 mat =
-                        glm::translate(glm::mat4(1.0), {node.translation[0], node.translation[1], node.translation[2]});
-                transform = mat * transform;
+            rotation = glm::normalize(glm::quat_cast(basis));
+            return;
+        }
+        translation = node.translation ? glm::make_vec3(node.translation->data()) : glm::vec3(0.0f);
+        rotation = node.rotation ? glm::make_quat(node.rotation->data()) : glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+        scale = node.scale ? glm::make_vec3(node.scale->data()) : glm::vec3(1.0f);
+    }
+
+    // Flattens the nodes below the scene's roots breadth first, which sorts them by depth.
+    // Returns the glTF node index of every flattened node.
+    std::vector<int> loadNodeHierarchy(const GlbFile &glb, const doc::Scene &scene, NodeHierarchy &nodes) {
+        std::vector<int> node_order(scene.nodes.begin(), scene.nodes.end());
+        nodes.parents.assign(node_order.size(), -1);
+        nodes.levelOffsets = {0};
+        std::vector<bool> visited(glb.nodes.size());
+        for (size_t level_begin = 0; level_begin < node_order.size();) {
+            const size_t level_end = node_order.size();
+            for (size_t i = level_begin; i < level_end; i++) {
+                const int node_index = node_order[i];
+                // also stops cycles, which would grow node_order forever
+                if (visited.at(node_index))
+                    Logger::panic(std::format("Node {} has more than one parent", node_index));
+                visited[node_index] = true;
+                for (const int child: glb.nodes[node_index].children) {
+                    node_order.push_back(child);
+                    nodes.parents.push_back(static_cast<int32_t>(i));
+                }
             }
+            nodes.levelOffsets.push_back(static_cast<uint32_t>(node_order.size()));
+            level_begin = level_end;
         }
-        return transform;
+
+        const size_t node_count = node_order.size();
+        nodes.translations.resize(node_count);
+        nodes.rotations.resize(node_count);
+        nodes.scales.resize(node_count);
+        for (size_t i = 0; i < node_count; i++)
+            loadNodeTransform(glb.nodes[node_order[i]], nodes.translations[i], nodes.rotations[i], nodes.scales[i]);
+        nodes.worldMatrices.assign(node_count, glm::mat4(1.0f));
+        nodes.dirty.assign(node_count, true);
+        nodes.moved.assign(node_count, false);
+        return node_order;
     }
 
-    struct PrimitiveInfo {
-        uint32_t indexOffset;
-        uint32_t indexCount;
-        int32_t vertexOffset;
-    };
-
-    void loadMeshes(
-            const tinygltf::Model &model,
-            std::vector<uint8_t> &vertex_positions,
-            std::vector<uint8_t> &vertex_normals,
-            std::vector<uint8_t> &vertex_tangents,
-            std::vector<uint8_t> &vertex_texcoords,
-            std::vector<uint8_t> &vertex_indices,
-            std::vector<PrimitiveInfo> &primitive_infos,
-            std::vector<uint32_t> &mesh_primitive_indices
+    // Reads the attribute straight from the mapped file into the stream, starting at the given vertex
+    void loadAttribute(
+            const GlbFile &glb,
+            int accessor_index,
+            uint32_t components,
+            size_t vertex_offset,
+            std::vector<uint8_t> &stream
     ) {
-        using namespace tinygltf;
-
-        size_t index_index = 0;
-        size_t counted_verts = 0;
+        const auto &accessor = glb.accessors[accessor_index];
+        Logger::check(
+                accessor.components == components,
+                std::format("Attribute accessor {} must have {} components", accessor_index, components)
+        );
+        auto dst = cast_span<float>(std::span(stream)).subspan(vertex_offset * components, accessor.count * components);
+        readAccessor(glb, accessor_index, dst);
+    }
 
-        auto vertex_indices_view = cast_span<uint32_t>(std::span(vertex_indices));
+    // Computes the output ranges of every primitive from the accessor counts, the same way the streams are sized.
+    // Returns the primitives in output order.
+    std::vector<const doc::Primitive *> layoutPrimitives(
+            const GlbFile &glb,
+            std::vector<Primitive> &primitive_infos,
+            std::vector<uint32_t> &mesh_primitive_indices,
+            size_t &index_bytes,
+            size_t &vertex_count
+    ) {
+        std::vector<const doc::Primitive *> primitives;
+        index_bytes = 0;
+        vertex_count = 0;
 
-        for (size_t i = 0; i < model.meshes.size(); i++) {
-            const auto &mesh = model.meshes[i];
+        for (size_t i = 0; i < glb.meshes.size(); i++) {
+            const auto &mesh = glb.meshes[i];
             mesh_primitive_indices[i] = static_cast<uint32_t>(primitive_infos.size());
 
             for (const auto &prim: mesh.primitives) {
-                Logger::check(
-                        prim.mode == TINYGLTF_MODE_TRIANGLES, "Unsupported primitive mode: " + std::to_string(prim.mode)
-                );
-
-                int position_access_i = -1;
-                int normal_access_i = -1;
-                int tangent_access_i = -1;
-                int texcoord_access_i = -1;
-
-                for (auto &[key, j]: prim.attributes) {
-                    if (key == "POSITION") {
-                        position_access_i = j;
-                    } else if (key == "NORMAL") {
-                        normal_access_i = j;
-                    } else if (key == "TANGENT") {
-                        tangent_access_i = j;
-                    } else if (key == "TEXCOORD_0") {
-                        texcoord_access_i = j;
-                    }
-                }
-
-                const Accessor &position_access = model.accessors[position_access_i];
-                const Accessor &normal_access = model.accessors[normal_access_i];
-                const Accessor &tangent_access = model.accessors[tangent_access_i];
-                const Accessor &texcoord_access = model.accessors[texcoord_access_i];
-                const Accessor &index_access = model.accessors[prim.indices];
-
-                Logger::check(position_access.byteOffset == 0, "Position accessor byte offset must be 0");
-                Logger::check(normal_access.byteOffset == 0, "Normal accessor byte offset must be 0");
-                Logger::check(tangent_access.byteOffset == 0, "Tangent accessor byte offset must be 0");
-                Logger::check(texcoord_access.byteOffset == 0, "Texcoord accessor byte offset must be 0");
-                Logger::check(index_access.byteOffset == 0, "Index accessor byte offset must be 0");
-
-                const BufferView &position_view = model.bufferViews[position_access.bufferView];
-                const BufferView &normal_view = model.bufferViews[normal_access.bufferView];
-                const BufferView &tangent_view = model.bufferViews[tangent_access.bufferView];
-                const BufferView &texcoord_view = model.bufferViews[texcoord_access.bufferView];
-                const BufferView &index_view = model.bufferViews[index_access.bufferView];
-
-                Logger::check(position_view.byteStride == 0, "Position buffer must be tightly packed");
-                Logger::check(normal_view.byteStride == 0, "Normal buffer must be tightly packed");
-                Logger::check(tangent_view.byteStride == 0, "Tangent buffer must be tightly packed");
-                Logger::check(texcoord_view.byteStride == 0, "Texcoord buffer must be tightly packed");
-                Logger::check(index_view.byteStride == 0, "Index buffer must be tightly packed");
-
-                const Buffer &position_buffer = model.buffers[position_view.buffer];
-                const Buffer &normal_buffer = model.buffers[normal_view.buffer];
-                const Buffer &tangent_buffer = model.buffers[tangent_view.buffer];
-                const Buffer &texcoord_buffer = model.buffers[texcoord_view.buffer];
-                const Buffer &index_buffer = model.buffers[index_view.buffer];
-
-                const auto position_span = std::span(
-                        position_buffer.data.cbegin() + static_cast<ptrdiff_t>(position_view.byteOffset), position_view.byteLength
-                );
-                const auto normal_span = std::span(
-                        normal_buffer.data.cbegin() + static_cast<ptrdiff_t>(normal_view.byteOffset), normal_view.byteLength
-                );
-                const auto tangent_span = std::span(
-                        tangent_buffer.data.cbegin() + static_cast<ptrdiff_t>(tangent_view.byteOffset), tangent_view.byteLength
-                );
-                const auto texcoord_span = std::span(
-                        texcoord_buffer.data.cbegin() + static_cast<ptrdiff_t>(texcoord_view.byteOffset), texcoord_view.byteLength
-                );
-                vertex_positions.insert(vertex_positions.end(), position_span.begin(), position_span.end());
-                vertex_normals.insert(vertex_normals.end(), normal_span.begin(), normal_span.end());
-                vertex_tangents.insert(vertex_tangents.end(), tangent_span.begin(), tangent_span.end());
-                vertex_texcoords.insert(vertex_texcoords.end(), texcoord_span.begin(), texcoord_span.end());
+                if (prim.mode != doc::MODE_TRIANGLES)
+                    Logger::panic("Unsupported primitive mode: " + std::to_string(prim.mode));
+                if (prim.position == -1 || prim.normal == -1 || prim.tangent == -1 || prim.texcoord == -1 ||
+                    prim.indices == -1)
+                    Logger::panic("Primitive must have indices, positions, normals, tangents and texcoords");
+                const size_t prim_vertex_count = glb.accessors.at(prim.position).count;
+                if (glb.accessors.at(prim.normal).count != prim_vertex_count ||
+                    glb.accessors.at(prim.tangent).count != prim_vertex_count ||
+                    glb.accessors.at(prim.texcoord).count != prim_vertex_count)
+                    Logger::panic("Primitive attributes must have the same element count");
+
+                const size_t prim_index_count = glb.accessors.at(prim.indices).count;
+                const bool short_indices = prim_vertex_count <= std::numeric_limits<uint16_t>::max() + size_t{1};
+                const size_t index_size = short_indices ? sizeof(uint16_t) : sizeof(uint32_t);
+                // the index buffer is bound at offset 0, so every range must be aligned to its own index size
+                index_bytes = (index_bytes + index_size - 1) & ~(index_size - 1);
 
                 primitive_infos.emplace_back() = {
-                    .indexOffset = static_cast<uint32_t>(index_index),
-                    .indexCount = static_cast<uint32_t>(index_access.count),
-                    .vertexOffset = static_cast<int32_t>(counted_verts),
+                    .indexOffset = static_cast<uint32_t>(index_bytes / index_size),
+                    .indexCount = static_cast<uint32_t>(prim_index_count),
+                    .vertexOffset = static_cast<int32_t>(vertex_count),
+                    .vertexCount = static_cast<uint32_t>(prim_vertex_count),
+                    .indexType = short_indices ? vk::IndexType::eUint16 : vk::IndexType::eUint32,
                 };
+                primitives.push_back(&prim);
 
-                const auto index_span = std::span(
-                        index_buffer.data.cbegin() + static_cast<ptrdiff_t>(index_view.byteOffset), index_view.byteLength
-                );
-
-                if (index_access.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT) {
-                    Logger::check(
-                            reinterpret_cast<std::uintptr_t>(index_span.data()) % alignof(uint16_t) == 0,
-                            "Index data is not aligned to uint16"
-                    );
-                    auto indices_as_shorts = cast_span<const uint16_t>(index_span);
-                    for (uint16_t index_short: indices_as_shorts) {
-                        vertex_indices_view[index_index++] = static_cast<uint32_t>(index_short);
-                    }
-                } else if (index_access.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT) {
-                    auto indices_as_ints = cast_span<const uint32_t>(index_span);
-                    for (uint32_t index_int: indices_as_ints) {
-                        vertex_indices_view[index_index++] = index_int;
-                    }
-                } else {
-                    Logger::check(false, "Index component type must be unsigned short or int");
-                }
-                counted_verts += position_access.count;
+                index_bytes += prim_index_count * index_size;
+                vertex_count += prim_vertex_count;
             }
         }
+        return primitives;
     }
 
-    SceneData load(const std::filesystem::path &path) {
-        using namespace tinygltf;
-
-        Model model;
-        TinyGLTF loader;
-        std::string err;
-        std::string warn;
-
-        bool ret = loader.LoadBinaryFromFile(&model, &err, &warn, path.string());
-
-        if (!warn.empty()) {
-            Logger::warning("GLTF: " + warn);
-        }
-
-        if (!err.empty()) {
-            Logger::error("GLTF: " + err);
+    // Copies the primitive's attributes and indices into its range of the (already sized) streams
+    void loadPrimitive(
+            const GlbFile &glb, const doc::Primitive &prim, const Primitive &info, SceneData &scene_data
+    ) {
+        const size_t vertex_offset = info.vertexOffset;
+        loadAttribute(glb, prim.position, 3, vertex_offset, scene_data.vertex_position_data);
+        loadAttribute(glb, prim.normal, 3, vertex_offset, scene_data.vertex_normal_data);
+        loadAttribute(glb, prim.tangent, 4, vertex_offset, scene_data.vertex_tangent_data);
+        loadAttribute(glb, prim.texcoord, 2, vertex_offset, scene_data.vertex_texcoord_data);
+
+        if (info.indexType == vk::IndexType::eUint16) {
+            auto dst = cast_span<uint16_t>(std::span(scene_data.index_data)).subspan(info.indexOffset, info.indexCount);
+            readIndices(glb, prim.indices, info.vertexCount, dst);
+        } else {
+            auto dst = cast_span<uint32_t>(std::span(scene_data.index_data)).subspan(info.indexOffset, info.indexCount);
+            readIndices(glb, prim.indices, info.vertexCount, dst);
         }
+    }
 
-        if (!ret) {
-            Logger::panic("failed to load GLTF");
+    // Decodes the image straight into the channel layout of the format. stb only converts the channels the same way
+    // PlainImageData::create does when it expands RGB to RGBA, it turns RGB into grey for one or two channels. The
+    // remaining cases decode with the native channel count and copy once.
+    PlainImageData decodeImage(const GlbFile &glb, int image_index, vk::Format format) {
+        const auto bytes = glb.imageBytes(image_index);
+        const int size = static_cast<int>(bytes.size());
+        const bool is_16_bit = stbi_is_16_bit_from_memory(bytes.data(), size);
+        Logger::check(!is_16_bit, "Only 8-bit images are supported");
+
+        int width = 0;
+        int height = 0;
+        int components = 0;
+        if (!stbi_info_from_memory(bytes.data(), size, &width, &height, &components))
+            Logger::panic(std::format("Failed to decode image {}: {}", image_index, stbi_failure_reason()));
+        const int channels = static_cast<int>(vkuFormatComponentCount(static_cast<VkFormat>(format)));
+        const bool direct = channels == components || (channels == 4 && components == 3);
+
+        const int requested = direct ? channels : 0;
+        stbi_uc *pixels = stbi_load_from_memory(bytes.data(), size, &width, &height, &components, requested);
+        if (!pixels)
+            Logger::panic(std::format("Failed to decode image {}: {}", image_index, stbi_failure_reason()));
+        if (direct) {
+            // stb allocates with malloc, which is what PlainImageData frees with
+            return {std::unique_ptr<unsigned char>(pixels),
+                    static_cast<size_t>(width) * height * channels,
+                    static_cast<uint32_t>(width),
+                    static_cast<uint32_t>(height),
+                    format};
         }
+        const std::unique_ptr<stbi_uc, decltype(&stbi_image_free)> native(pixels, &stbi_image_free);
+        return PlainImageData::create(format, width, height, components, native.get());
+    }
 
+    // Whether the GPU generates the image's mip chain, only its header is read for the size
+    bool gpuGeneratesMipmaps(const GlbFile &glb, int image_index, vk::Format format, const LoadOptions &options) {
+        if (!std::ranges::contains(options.gpuMipmapFormats, format))
+            return false;
+        const auto bytes = glb.imageBytes(image_index);
+        int width = 0;
+        int height = 0;
+        int components = 0;
+        // decodeImage reports the images stb can't read
+        if (!stbi_info_from_memory(bytes.data(), static_cast<int>(bytes.size()), &width, &height, &components))
+            return false;
+        return static_cast<uint32_t>(std::max(width, height)) <= options.gpuMipmapMaxSize;
+    }
 
-        Scene &scene = model.scenes[model.defaultScene];
-
-        size_t index_count = 0;
+    SceneData loadGlb(std::shared_ptr<GlbFile> source, const LoadOptions &options) {
+        // the compressed geometry is decoded once up front, the primitives then read it like any other view
+        source->decodeCompressedViews(options.parallel);
+        const GlbFile &glb = *source;
+        SceneData scene_data = {};
+        auto &primitive_infos = scene_data.primitives;
+        std::vector<uint32_t> mesh_primitive_indices(glb.meshes.size());
+        size_t index_bytes = 0;
         size_t vertex_count = 0;
-        for (auto node_i: scene.nodes) {
-            for (const auto &prim: model.meshes[model.nodes[node_i].mesh].primitives) {
-                index_count += model.accessors[prim.indices].count;
-                vertex_count += model.accessors[prim.attributes.at("POSITION")].count;
+        // Size all streams up front, so the attribute data is copied exactly once from the mapped file
+        const auto primitives =
+                layoutPrimitives(glb, primitive_infos, mesh_primitive_indices, index_bytes, vertex_count);
+
+        scene_data.vertex_position_data.resize(vertex_count * sizeof(Vertex::pos));
+        scene_data.vertex_normal_data.resize(vertex_count * sizeof(Vertex::normal));
+        scene_data.vertex_tangent_data.resize(vertex_count * sizeof(Vertex::tangent));
+        scene_data.vertex_texcoord_data.resize(vertex_count * sizeof(Vertex::texCoord));
+        scene_data.index_data.resize(index_bytes);
+
+        // Every primitive writes to its own disjoint ranges, so they can be extracted in any order
+        const auto load_primitives = [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++)
+                loadPrimitive(glb, *primitives[i], primitive_infos[i], scene_data);
+        };
+        if (options.parallel)
+            util::parallel_for(primitives.size(), 1, load_primitives);
+        else
+            load_primitives(0, primitives.size());
+        source->releaseDecodedViews();
+
+        // The textures are only described here, materializeImage decodes them once they are needed
+        scene_data.images.resize(glb.textures.size());
+        // KTX2 images are recognized by their content, glTF has no extension for plain BCn ones
+        const auto is_ktx2 = [&glb](int texture_index) {
+            const int source = glb.textures[texture_index].source;
+            return source != -1 && isKtx2(glb.imageBytes(source));
+        };
+        auto load_texture = [&scene_data, &glb, &options, &is_ktx2](int texture_index, vk::Format format) {
+            auto &image = scene_data.images[texture_index];
+            if (image) {
+                Logger::check(image.format == format, "Image loaded in different formats");
             }
-        }
-
-        SceneData scene_data = {};
-        scene_data.vertex_position_data.reserve(vertex_count * sizeof(Vertex::pos));
-        scene_data.vertex_normal_data.reserve(vertex_count * sizeof(Vertex::normal));
-        scene_data.vertex_tangent_data.reserve(vertex_count * sizeof(Vertex::tangent));
-        scene_data.vertex_texcoord_data.reserve(vertex_count * sizeof(Vertex::texCoord));
-        scene_data.index_data.resize(index_count * sizeof(uint32_t));
-
-        std::vector<PrimitiveInfo> primitive_infos;
-        std::vector<uint32_t> mesh_primitive_indices(model.meshes.size());
-
-        loadMeshes(
-                model, scene_data.vertex_position_data, scene_data.vertex_normal_data, scene_data.vertex_tangent_data,
-                scene_data.vertex_texcoord_data, scene_data.index_data, primitive_infos, mesh_primitive_indices
-        );
-
-        scene_data.images.resize(model.textures.size());
-        auto load_texture = [&scene_data, &model](int texture_index, int image_index, vk::Format format) {
-            if (scene_data.images[texture_index]) {
-                Logger::check(scene_data.images[texture_index].format == format, "Image loaded in different formats");
+            image.format = format;
+            image.image = glb.textures[texture_index].source;
+            if (!options.ktx2Textures && is_ktx2(texture_index)) {
+                Logger::warning(
+                        std::format("Texture {} is a KTX2 image, which can't be used, it is left out", texture_index)
+                );
+                image.image = -1;
             }
-
-            const auto &image = model.images[image_index];
-            Logger::check(image.bits == 8, "Only 8-bit images are supported");
-            scene_data.images[texture_index] =
-                    PlainImageData::create(format, image.width, image.height, image.component, image.image.data());
+            image.compressedFormat = options.compressTextures ? blockCompressedFormat(format) : vk::Format::eUndefined;
+            // the GPU can't fill in the levels of compressed images
+            image.generateMipmaps = image.image == -1 || image.compressedFormat != vk::Format::eUndefined ||
+                                    !gpuGeneratesMipmaps(glb, image.image, format, options);
         };
 
-        for (const auto &material: model.materials) {
+        for (const auto &material: glb.materials) {
             Material &mat = scene_data.materials.emplace_back();
             mat.index = static_cast<uint32_t>(scene_data.materials.size()) - 1;
-            mat.albedoFactor = glm::vec4(
-                    material.pbrMetallicRoughness.baseColorFactor.at(0),
-                    material.pbrMetallicRoughness.baseColorFactor.at(1),
-                    material.pbrMetallicRoughness.baseColorFactor.at(2),
-                    material.pbrMetallicRoughness.baseColorFactor.at(3)
-            );
-            mat.metaillicFactor = static_cast<float>(material.pbrMetallicRoughness.metallicFactor);
-            mat.roughnessFactor = static_cast<float>(material.pbrMetallicRoughness.roughnessFactor);
-            mat.normalFactor = static_cast<float>(material.normalTexture.scale);
-            int albedo_index = material.pbrMetallicRoughness.baseColorTexture.index;
+            mat.albedoFactor = glm::make_vec4(material.baseColorFactor.data());
+            mat.metaillicFactor = material.metallicFactor;
+            mat.roughnessFactor = material.roughnessFactor;
+            mat.normalFactor = material.normalTexture.scale;
+            int albedo_index = material.baseColorTexture.index;
             if (albedo_index != -1) {
-                const auto &albedo_texture = model.textures[albedo_index];
-                load_texture(albedo_index, albedo_texture.source, vk::Format::eR8G8B8A8Srgb);
+                load_texture(albedo_index, vk::Format::eR8G8B8A8Srgb);
                 mat.albedo = albedo_index;
             }
             int o_index = material.occlusionTexture.index;
-            PlainImageData *omr_image_data = nullptr;
+            int mr_index = material.metallicRoughnessTexture.index;
+            // textures without an image, e.g. KHR_texture_basisu only ones, have nothing to merge
+            if (o_index != -1 && glb.textures[o_index].source == -1)
+                o_index = -1;
+            if (mr_index != -1 && glb.textures[mr_index].source == -1)
+                mr_index = -1;
+            // a packed occlusion-roughness-metallic texture already is what the merge makes
+            if (o_index == mr_index)
+                o_index = -1;
+            // merging and filling decode the occlusion, KTX2 images stay block compressed. Metallic and roughness
+            // matter more.
+            if (o_index != -1 && (is_ktx2(o_index) || (mr_index != -1 && is_ktx2(mr_index)))) {
+                Logger::warning(std::format(
+                        "Material {} has a KTX2 occlusion or metallic-roughness texture that can't be merged, "
+                        "the occlusion is left out",
+                        mat.index
+                ));
+                o_index = -1;
+            }
             if (o_index != -1) {
-                const auto &o_texture = model.textures[o_index];
-                load_texture(o_index, o_texture.source, vk::Format::eR8G8B8A8Unorm);
-                omr_image_data = &scene_data.images[o_index];
+                load_texture(o_index, vk::Format::eR8G8B8A8Unorm);
                 mat.omr = o_index;
             }
-            int mr_index = material.pbrMetallicRoughness.metallicRoughnessTexture.index;
             if (mr_index != -1) {
-                const auto &mr_texture = model.textures[mr_index];
-                const auto &mr_image = model.images[mr_texture.source];
-                // TODO: This is untested, and I think its wrong
-                if (omr_image_data) {
-                    Logger::check(
-                            mr_image.width == omr_image_data->width && mr_image.height == omr_image_data->height,
-                            "Occlusion texture size doesn't match metalness-roughness texture size"
-                    );
-                    PlainImageData mr_data = PlainImageData::create(
-                            vk::Format::eR8G8Unorm, mr_image.width, mr_image.height, mr_image.component,
-                            mr_image.image.data()
-                    );
-                    mr_data.copyChannels(*omr_image_data, {-1, 1, 2});
+                if (o_index != -1) {
+                    scene_data.images[o_index].mergedImage = glb.textures[mr_index].source;
                 } else {
-                    load_texture(mr_index, mr_texture.source, vk::Format::eR8G8B8A8Unorm);
+                    load_texture(mr_index, vk::Format::eR8G8B8A8Unorm);
                     mat.omr = mr_index;
                 }
             }
-            if (o_index != -1 && mr_index == -1 && omr_image_data) {
-                omr_image_data->fill({1, 2}, {0xff, 0xff});
+            if (o_index != -1 && mr_index == -1) {
+                scene_data.images[o_index].fillGreenBlue = true;
             }
             int normal_index = material.normalTexture.index;
             if (normal_index != -1) {
-                const auto &normal_texture = model.textures[normal_index];
-                load_texture(normal_index, normal_texture.source, vk::Format::eR8G8Unorm);
+                load_texture(normal_index, vk::Format::eR8G8Unorm);
                 mat.normal = normal_index;
             }
         }
 
-        for (const int node_i: scene.nodes) {
-            Node &node = model.nodes[node_i];
-            Mesh &mesh = model.meshes[node.mesh];
+        const auto node_order = loadNodeHierarchy(glb, glb.scenes.at(glb.defaultScene), scene_data.nodes);
+        updateWorldTransforms(scene_data.nodes, options.parallel);
+        for (uint32_t node_i = 0; node_i < node_order.size(); node_i++) {
+            const auto &node = glb.nodes[node_order[node_i]];
+            if (node.mesh == -1)
+                continue;
+            const auto &mesh = glb.meshes[node.mesh];
             for (size_t i = 0; i < mesh.primitives.size(); i++) {
                 const auto &prim = mesh.primitives[i];
                 const auto &prim_data = primitive_infos[mesh_primitive_indices[node.mesh] + i];
@@ -305,15 +355,147 @@ namespace gltf {
                     .indexOffset = static_cast<uint32_t>(prim_data.indexOffset),
                     .indexCount = static_cast<uint32_t>(prim_data.indexCount),
                     .vertexOffset = static_cast<int32_t>(prim_data.vertexOffset),
-                    .transformation = loadNodeTransform(node),
+                    .indexType = prim_data.indexType,
+                    .primitive = mesh_primitive_indices[node.mesh] + static_cast<uint32_t>(i),
+                    .node = node_i,
+                    .transformation = scene_data.nodes.worldMatrices[node_i],
                     .material = material
                 };
             }
         }
 
-        scene_data.index_count = scene_data.index_data.size() / sizeof(uint32_t);
-        scene_data.vertex_count = scene_data.vertex_position_data.size() / sizeof(Vertex::pos);
+        // from the float positions, before they might be quantized
+        computePrimitiveBounds(scene_data, options.parallel);
+        computeInstanceBounds(scene_data);
+
+        if (options.vertexFormat == VertexFormat::Quantized)
+            quantizeVertices(scene_data, options.parallel);
+
+        size_t short_index_count = 0;
+        for (const auto &prim: scene_data.primitives) {
+            scene_data.index_count += prim.indexCount;
+            if (prim.indexType == vk::IndexType::eUint16)
+                short_index_count += prim.indexCount;
+        }
+        scene_data.vertex_count = vertex_count;
+        Logger::info(std::format(
+                "Loaded {} indices in {} bytes, {} of {} primitives use 16-bit indices, saving {} bytes",
+                scene_data.index_count, scene_data.index_data.size(),
+                std::ranges::count(scene_data.primitives, vk::IndexType::eUint16, &Primitive::indexType),
+                scene_data.primitives.size(), short_index_count * (sizeof(uint32_t) - sizeof(uint16_t))
+        ));
+
+        scene_data.source_file = std::move(source);
+
+        return scene_data;
+    }
+
+    SceneData load(const std::filesystem::path &path, const LoadOptions &options) {
+        if (options.cacheDirectory.empty())
+            return loadGlb(std::make_shared<GlbFile>(GlbFile::open(path)), options);
+
+        const auto cache_path = options.cacheDirectory / (path.filename().string() + ".scene");
+        const uint64_t cache_key = sceneCacheKey(MappedFile(path).bytes(), options);
+        if (auto cached = readSceneCache(cache_path, cache_key)) {
+            Logger::info(std::format("Loaded {} from scene cache {}", path.string(), cache_path.string()));
+            return std::move(*cached);
+        }
 
+        SceneData scene_data = loadGlb(std::make_shared<GlbFile>(GlbFile::open(path)), options);
+        writeSceneCache(cache_path, cache_key, scene_data, options.parallel);
+        // writing the cache decoded every image, use the written pixels instead of decoding them again for the upload
+        if (auto cached = readSceneCache(cache_path, cache_key))
+            return std::move(*cached);
         return scene_data;
     }
+
+    PlainImageData materializeImage(const SceneData &scene_data, size_t index) {
+        const auto &image = scene_data.images.at(index);
+        // the pixels are in a copy on write mapping, writing to them leaves the cache file as it is
+        if (!image.decoded.empty())
+            return {image.decoded, image.width, image.height, image.format, image.mipLevels};
+        if (image.image == -1)
+            return {};
+
+        if (scene_data.source_file == nullptr)
+            Logger::panic("Lazy image without a source file");
+        const GlbFile &glb = *scene_data.source_file;
+        if (isKtx2(glb.imageBytes(image.image))) {
+            // loadGlb leaves out the KTX2 images it would have to merge or fill, that needs uncompressed pixels
+            if (image.mergedImage != -1 || image.fillGreenBlue)
+                Logger::panic(std::format("KTX2 image {} can't be merged or filled", image.image));
+            auto ktx2 = loadKtx2(glb.imageBytes(image.image), image.format);
+            if (!ktx2)
+                Logger::panic(
+                        std::format("KTX2 image {} can't be used as {}", image.image, vk::to_string(image.format))
+                );
+            return std::move(*ktx2);
+        }
+        PlainImageData result = decodeImage(glb, image.image, image.format);
+        if (image.mergedImage != -1) {
+            // roughness and metallic are in green and blue, they stay there next to the occlusion in red
+            const PlainImageData mr_data = decodeImage(glb, image.mergedImage, vk::Format::eR8G8B8A8Unorm);
+            if (mr_data.width != result.width || mr_data.height != result.height)
+                Logger::panic("Occlusion texture size doesn't match metalness-roughness texture size");
+            mr_data.copyChannels(result, {-1, 1, 2, -1});
+        }
+        if (image.fillGreenBlue)
+            result.fill({1, 2}, {0xff, 0xff});
+        // made here on the worker threads, so the whole chain is uploaded in one copy. Kaiser keeps the small levels
+        // sharper than a box filter, which matters most for the detail in albedo and normal maps.
+        if (image.generateMipmaps)
+            result = result.generateMipmaps(MipFilter::Kaiser);
+        if (image.compressedFormat != vk::Format::eUndefined)
+            result = compressBlocks(result, image.compressedFormat);
+        return result;
+    }
+
+    void forEachImage(
+            const SceneData &scene_data, const std::function<void(size_t, PlainImageData &)> &consume, bool parallel,
+            const std::stop_token &stop
+    ) {
+        const size_t batch_size = parallel ? util::ThreadPool::global().size() + 1 : 1;
+        std::vector<PlainImageData> batch(batch_size);
+        for (size_t first = 0; first < scene_data.images.size(); first += batch_size) {
+            const size_t count = std::min(batch_size, scene_data.images.size() - first);
+            const auto materialize = [&](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; i++)
+                    batch[i] = materializeImage(scene_data, first + i);
+            };
+            if (parallel)
+                util::parallel_for(count, 1, materialize);
+            else
+                materialize(0, count);
+
+            for (size_t i = 0; i < count; i++) {
+                if (stop.stop_requested())
+                    return;
+                consume(first + i, batch[i]);
+                batch[i] = {};
+            }
+        }
+    }
+
+    std::vector<uint32_t> readPrimitiveIndices(const SceneData &scene_data, const Primitive &primitive) {
+        std::vector<uint32_t> indices(primitive.indexCount);
+        if (primitive.indexType == vk::IndexType::eUint16) {
+            const auto *src = reinterpret_cast<const uint16_t *>(scene_data.index_data.data()) + primitive.indexOffset;
+            std::copy_n(src, indices.size(), indices.data());
+        } else {
+            const auto *src = reinterpret_cast<const uint32_t *>(scene_data.index_data.data()) + primitive.indexOffset;
+            std::copy_n(src, indices.size(), indices.data());
+        }
+        return indices;
+    }
+
+    void writePrimitiveIndices(SceneData &scene_data, const Primitive &primitive, std::span<const uint32_t> indices) {
+        Logger::check(indices.size() == primitive.indexCount, "Index count of primitive must not change");
+        if (primitive.indexType == vk::IndexType::eUint16) {
+            auto *dst = reinterpret_cast<uint16_t *>(scene_data.index_data.data()) + primitive.indexOffset;
+            std::ranges::transform(indices, dst, [](uint32_t index) { return static_cast<uint16_t>(index); });
+        } else {
+            auto *dst = reinterpret_cast<uint32_t *>(scene_data.index_data.data()) + primitive.indexOffset;
+            std::ranges::copy(indices, dst);
+        }
+    }
 } // namespace gltf
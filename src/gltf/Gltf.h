@@ -1,10 +1,16 @@
 #pragma once
 #include <array>
 #include <filesystem>
+#include <functional>
 #include <glm/fwd.hpp>
+#include <glm/gtc/quaternion.hpp>
 #include <glm/mat4x4.hpp>
 #include <glm/vec2.hpp>
 #include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <memory>
+#include <span>
+#include <stop_token>
 #include <vector>
 #include <vulkan/vulkan.hpp>
 
@@ -12,6 +18,9 @@ class PlainImageData;
 class GraphicsBackend;
 
 namespace gltf {
+    class MappedFile;
+    class GlbFile;
+
     struct Vertex {
         alignas(8) glm::vec3 pos;
         alignas(8) glm::vec3 normal;
@@ -62,6 +71,105 @@ namespace gltf {
         };
     };
 
+    // Compact encoding of Vertex, 20 instead of 48 bytes per vertex
+    struct QuantizedVertex {
+        // normalized to the primitive's bounding box, see Primitive::quantizationOffset, w is padding
+        alignas(8) std::array<uint16_t, 4> pos;
+        // octahedral encoded
+        alignas(4) std::array<int16_t, 2> normal;
+        // octahedral encoded, y is remapped to [0, 1] and carries the bitangent sign
+        alignas(4) std::array<int16_t, 2> tangent;
+        // half floats
+        alignas(4) std::array<uint16_t, 2> texCoord;
+
+        static constexpr std::array bindingDescriptors{
+            vk::VertexInputBindingDescription2EXT{
+                .binding = 0,
+                .stride = sizeof(QuantizedVertex::pos),
+                .inputRate = vk::VertexInputRate::eVertex,
+                .divisor = 1
+            },
+            vk::VertexInputBindingDescription2EXT{
+                .binding = 1,
+                .stride = sizeof(QuantizedVertex::normal),
+                .inputRate = vk::VertexInputRate::eVertex,
+                .divisor = 1
+            },
+            vk::VertexInputBindingDescription2EXT{
+                .binding = 2,
+                .stride = sizeof(QuantizedVertex::tangent),
+                .inputRate = vk::VertexInputRate::eVertex,
+                .divisor = 1
+            },
+            vk::VertexInputBindingDescription2EXT{
+                .binding = 3,
+                .stride = sizeof(QuantizedVertex::texCoord),
+                .inputRate = vk::VertexInputRate::eVertex,
+                .divisor = 1
+            }
+        };
+
+        static constexpr std::array attributeDescriptors{
+            vk::VertexInputAttributeDescription2EXT{
+                .location = 0,
+                .binding = 0,
+                .format = vk::Format::eR16G16B16A16Unorm,
+                .offset = 0,
+            },
+            vk::VertexInputAttributeDescription2EXT{
+                .location = 1,
+                .binding = 1,
+                .format = vk::Format::eR16G16Snorm,
+                .offset = 0,
+            },
+            vk::VertexInputAttributeDescription2EXT{
+                .location = 2,
+                .binding = 2,
+                .format = vk::Format::eR16G16Snorm,
+                .offset = 0,
+            },
+            vk::VertexInputAttributeDescription2EXT{
+                .location = 3,
+                .binding = 3,
+                .format = vk::Format::eR16G16Sfloat,
+                .offset = 0,
+            }
+        };
+    };
+
+    enum class VertexFormat {
+        // Vertex
+        Float,
+        // QuantizedVertex
+        Quantized,
+    };
+
+    /**
+     * A texture that is only decoded when materializeImage asks for it, so not every texture has to be in memory at
+     * once. Either it points at already decoded pixels or it describes how to decode it from the source file.
+     */
+    struct LazyImage {
+        vk::Format format = vk::Format::eUndefined;
+        // embedded image of SceneData::source_file, -1 if there is nothing to decode
+        int image = -1;
+        // image whose first two channels are copied into green and blue, metalness-roughness merged into occlusion
+        int mergedImage = -1;
+        // sets green and blue to 0xff, occlusion without metalness-roughness
+        bool fillGreenBlue = false;
+        // the decoded image and its mip chain are encoded to this block compressed format, unless it is eUndefined
+        vk::Format compressedFormat = vk::Format::eUndefined;
+        // the mip chain is filtered on the CPU, otherwise the image only has its first level for the GPU to fill
+        bool generateMipmaps = true;
+        // already decoded pixels in the format, e.g. in the copy on write mapping of the scene cache
+        std::span<unsigned char> decoded;
+        uint32_t width = 0;
+        uint32_t height = 0;
+        uint32_t mipLevels = 1;
+
+        // false for texture slots that no material uses
+        explicit operator bool() const { return image != -1 || !decoded.empty(); }
+    };
+
     struct Material {
         uint32_t index = -1u;
         int albedo = -1;
@@ -73,28 +181,196 @@ namespace gltf {
         float normalFactor = 1.0;
     };
 
+    // Maximum number of simplified index ranges per primitive, in addition to the full detail one
+    constexpr uint32_t MAX_LODS = 5;
+
+    // A simplified index range of a primitive, it uses the same vertices and index type as the full detail one
+    struct Lod {
+        // in elements of the primitive's indexType
+        uint32_t indexOffset = 0;
+        uint32_t indexCount = 0;
+        // distance from the simplified to the original surface, in object space for primitives and world space for
+        // instances
+        float error = 0.0f;
+    };
+
+    // A range of the vertex and index streams, indices are relative to vertexOffset
+    struct Primitive {
+        // in elements of indexType
+        uint32_t indexOffset = 0;
+        uint32_t indexCount = 0;
+        int32_t vertexOffset = 0;
+        uint32_t vertexCount = 0;
+        // 16-bit if all vertices of the primitive can be addressed with it
+        vk::IndexType indexType = vk::IndexType::eUint32;
+        // range of SceneData::meshlets, empty until they are built
+        uint32_t meshletOffset = 0;
+        uint32_t meshletCount = 0;
+        // with increasing error, empty until they are generated
+        uint32_t lodCount = 0;
+        std::array<Lod, MAX_LODS> lods = {};
+        // dequantizes QuantizedVertex::pos to object space: offset + pos * scale
+        glm::vec3 quantizationOffset = glm::vec3(0.0);
+        glm::vec3 quantizationScale = glm::vec3(1.0);
+    };
+
+    // A bounded cluster of a primitive's triangles, std430 compatible so the table can be uploaded as is
+    struct Meshlet {
+        // bounding sphere, xyz is the center and w the radius
+        glm::vec4 sphere = {};
+        // normal cone, xyz is the axis and w the cutoff. The whole cluster faces away from the eye if
+        // dot(center - eye, axis) >= cutoff * length(center - eye) + radius, a cutoff of 1 never culls.
+        glm::vec4 cone = {};
+        // into SceneData::meshlet_vertex_data
+        uint32_t vertexOffset = 0;
+        // into SceneData::meshlet_triangle_data
+        uint32_t triangleOffset = 0;
+        uint32_t vertexCount = 0;
+        uint32_t triangleCount = 0;
+    };
+
+    /**
+     * The scene's node hierarchy flattened into parallel arrays and sorted by depth, every parent comes before its
+     * children. The nodes of one depth level are contiguous, so the world matrices can be computed a level at a time.
+     */
+    struct NodeHierarchy {
+        // index of the parent node, -1 for the roots
+        std::vector<int32_t> parents;
+        // local transformation, decomposed from the node's matrix if it has one
+        std::vector<glm::vec3> translations;
+        std::vector<glm::quat> rotations;
+        std::vector<glm::vec3> scales;
+        std::vector<glm::mat4> worldMatrices;
+        // first node of every depth level, followed by the node count
+        std::vector<uint32_t> levelOffsets;
+        // the local transformation changed since the last updateWorldTransforms
+        std::vector<uint8_t> dirty;
+        // the world matrix changed in the last updateWorldTransforms
+        std::vector<uint8_t> moved;
+
+        [[nodiscard]] size_t size() const { return parents.size(); }
+
+        void setLocalTransform(
+                uint32_t node, const glm::vec3 &translation, const glm::quat &rotation, const glm::vec3 &scale
+        ) {
+            translations[node] = translation;
+            rotations[node] = rotation;
+            scales[node] = scale;
+            dirty[node] = true;
+        }
+    };
+
+    // Bounding volumes in parallel arrays, so culling only streams through the ones it tests
+    struct Bounds {
+        std::vector<glm::vec3> aabbMins;
+        std::vector<glm::vec3> aabbMaxs;
+        // xyz is the center and w the radius
+        std::vector<glm::vec4> spheres;
+
+        [[nodiscard]] size_t size() const { return spheres.size(); }
+
+        void resize(size_t count) {
+            aabbMins.resize(count);
+            aabbMaxs.resize(count);
+            spheres.resize(count);
+        }
+    };
+
     struct Instance {
+        // in elements of indexType
         uint32_t indexOffset = 0;
         uint32_t indexCount = 0;
         int32_t vertexOffset = 0;
+        vk::IndexType indexType = vk::IndexType::eUint32;
+        // index into SceneData::primitives
+        uint32_t primitive = 0;
+        // index into SceneData::nodes, transformation is a copy of its world matrix
+        uint32_t node = 0;
         glm::mat4 transformation = glm::mat4(1.0);
         Material material = {};
+        // world space copies of the primitive's LODs
+        uint32_t lodCount = 0;
+        std::array<Lod, MAX_LODS> lods = {};
     };
 
     struct SceneData {
         size_t index_count = 0;
         size_t vertex_count = 0;
+        // encoding of the vertex streams, the mesh processing passes need float vertices
+        VertexFormat vertex_format = VertexFormat::Float;
 
         std::vector<unsigned char> vertex_position_data;
         std::vector<unsigned char> vertex_normal_data;
         std::vector<unsigned char> vertex_tangent_data;
         std::vector<unsigned char> vertex_texcoord_data;
+        // 16-bit and 32-bit indices mixed, the 32-bit ranges are 4 byte aligned
         std::vector<unsigned char> index_data;
-        std::vector<PlainImageData> images;
+        // indexed by texture
+        std::vector<LazyImage> images;
         std::vector<Material> materials;
 
+        std::vector<Primitive> primitives;
+        NodeHierarchy nodes;
         std::vector<Instance> instances;
+        // object space, indexed like primitives
+        Bounds primitive_bounds;
+        // world space, indexed like instances
+        Bounds instance_bounds;
+
+        std::vector<Meshlet> meshlets;
+        // vertices of the meshlets, relative to the primitive's vertexOffset like the indices
+        std::vector<uint32_t> meshlet_vertex_data;
+        // triangles of the meshlets, three 8-bit indices into the meshlet's vertices packed into the low 24 bits
+        std::vector<uint32_t> meshlet_triangle_data;
+
+        // set when loaded from the scene cache, the decoded image pixels point into this mapping
+        std::shared_ptr<const MappedFile> backing_file;
+        // set when loaded from the glTF file, the lazy images are decoded from it
+        std::shared_ptr<const GlbFile> source_file;
+    };
+
+    struct LoadOptions {
+        // Extract the primitives concurrently on the global thread pool
+        bool parallel = true;
+        // Quantized encodes the streams right after loading, optimizeMeshes, buildMeshlets and generateLods can't run
+        // on them then. Call quantizeVertices after those passes instead.
+        VertexFormat vertexFormat = VertexFormat::Float;
+        // The loaded scene is cached in this directory and reused while the source file and options stay the same.
+        // Empty disables the cache.
+        std::filesystem::path cacheDirectory = "cache";
+        // Encode the PNG and JPEG textures to BC7, or BC5 for normal maps, with mip levels made on the CPU.
+        // This is slow, so better keep the cache enabled.
+        bool compressTextures = true;
+        // Use the textures whose image is a KTX2 file with BCn levels. Turn it off together with compressTextures
+        // when the device can't sample BC formats, those textures are left out then.
+        bool ktx2Textures = true;
+        // The mip chains of the uncompressed textures in these formats and no larger than gpuMipmapMaxSize are left to
+        // the GPU, e.g. ComputeMipGenerator. The CPU filters those of all other textures while materializing them.
+        std::vector<vk::Format> gpuMipmapFormats;
+        uint32_t gpuMipmapMaxSize = 0;
     };
 
-    SceneData load(const std::filesystem::path &path);
+    SceneData load(const std::filesystem::path &path, const LoadOptions &options = {});
+
+    // Copies the primitive's indices out of the mixed index stream, widened to 32-bit
+    std::vector<uint32_t> readPrimitiveIndices(const SceneData &scene_data, const Primitive &primitive);
+
+    // Decodes the texture with its full mip chain, unless LazyImage::generateMipmaps is false, or wraps its already
+    // decoded pixels without copying them. Safe to call concurrently.
+    PlainImageData materializeImage(const SceneData &scene_data, size_t index);
+
+    /**
+     * Materializes all textures in order and hands them to consume on the calling thread. A batch of one texture per
+     * core is decoded at a time, so at most one batch is in memory.
+     * @param consume called with the texture index and the image, which is empty for unused textures
+     * @param parallel decode each batch concurrently on the global thread pool
+     * @param stop checked before each image is consumed, the remaining ones are skipped once it is requested
+     */
+    void forEachImage(
+            const SceneData &scene_data, const std::function<void(size_t, PlainImageData &)> &consume,
+            bool parallel = true, const std::stop_token &stop = {}
+    );
+
+    // Writes indices.size() == primitive.indexCount indices into the primitive's range, narrowing them to its indexType
+    void writePrimitiveIndices(SceneData &scene_data, const Primitive &primitive, std::span<const uint32_t> indices);
 } // namespace gltf
@@ -0,0 +1,126 @@
+#include "Ktx2.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdlib>
+#include <cstring>
+#include <format>
+#include <memory>
+#include <vector>
+#include <vulkan/utility/vk_format_utils.h>
+
+#include "../Image.h"
+#include "../Logger.h"
+
+namespace gltf {
+    namespace {
+        constexpr std::array<uint8_t, 12> KTX2_IDENTIFIER = {
+            0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A
+        };
+        constexpr uint32_t SUPERCOMPRESSION_NONE = 0;
+
+        struct Ktx2Header {
+            std::array<uint8_t, 12> identifier;
+            uint32_t vkFormat;
+            uint32_t typeSize;
+            uint32_t pixelWidth;
+            uint32_t pixelHeight;
+            uint32_t pixelDepth;
+            uint32_t layerCount;
+            uint32_t faceCount;
+            uint32_t levelCount;
+            uint32_t supercompressionScheme;
+            uint32_t dfdByteOffset;
+            uint32_t dfdByteLength;
+            uint32_t kvdByteOffset;
+            uint32_t kvdByteLength;
+            uint64_t sgdByteOffset;
+            uint64_t sgdByteLength;
+        };
+        static_assert(sizeof(Ktx2Header) == 80);
+
+        // Follows the header, indexed by level with the largest level first
+        struct Ktx2Level {
+            uint64_t byteOffset;
+            uint64_t byteLength;
+            uint64_t uncompressedByteLength;
+        };
+
+        // The BCn formats the renderer samples from, all of them decode to the leading channels of the expected format
+        bool is_usable_format(vk::Format format, vk::Format expected) {
+            const auto actual = static_cast<VkFormat>(format);
+            const auto wanted = static_cast<VkFormat>(expected);
+            if (format == expected)
+                return true;
+            if (!vkuFormatIsCompressed_BC(actual) || vkuFormatIsSFLOAT(actual) || vkuFormatIsUFLOAT(actual))
+                return false;
+            // an opaque albedo is fine without alpha. SNORM decodes differently, e.g. BC5 normal maps have to be UNORM.
+            return vkuFormatIsSRGB(actual) == vkuFormatIsSRGB(wanted) &&
+                   vkuFormatIsSNORM(actual) == vkuFormatIsSNORM(wanted) &&
+                   vkuFormatComponentCount(actual) >= std::min(vkuFormatComponentCount(wanted), 3u);
+        }
+    } // namespace
+
+    bool isKtx2(std::span<const uint8_t> bytes) {
+        return bytes.size() >= KTX2_IDENTIFIER.size() &&
+               std::equal(KTX2_IDENTIFIER.begin(), KTX2_IDENTIFIER.end(), bytes.begin());
+    }
+
+    std::optional<PlainImageData> loadKtx2(std::span<const uint8_t> bytes, vk::Format format) {
+        Ktx2Header header = {};
+        if (!isKtx2(bytes) || bytes.size() < sizeof(header))
+            Logger::panic("Not a KTX2 image or its header is truncated");
+        std::memcpy(&header, bytes.data(), sizeof(header));
+
+        const auto image_format = static_cast<vk::Format>(header.vkFormat);
+        if (header.supercompressionScheme != SUPERCOMPRESSION_NONE || image_format == vk::Format::eUndefined) {
+            Logger::warning(std::format(
+                    "KTX2 image with supercompression scheme {} and format {} needs transcoding, which isn't supported",
+                    header.supercompressionScheme, vk::to_string(image_format)
+            ));
+            return std::nullopt;
+        }
+        if (!is_usable_format(image_format, format)) {
+            Logger::warning(std::format(
+                    "KTX2 image format {} can't be used as {}", vk::to_string(image_format), vk::to_string(format)
+            ));
+            return std::nullopt;
+        }
+        if (header.pixelDepth > 1 || header.layerCount > 1 || header.faceCount != 1)
+            Logger::panic("Only 2D KTX2 images without layers or faces are supported");
+        if (header.pixelWidth == 0 || header.pixelHeight == 0)
+            Logger::panic("KTX2 image without pixels");
+
+        // a level count of 0 asks for the mip levels to be generated, only the base level is stored then
+        const uint32_t level_count = std::max(header.levelCount, 1u);
+        if (level_count > static_cast<uint32_t>(std::bit_width(std::max(header.pixelWidth, header.pixelHeight))))
+            Logger::panic(std::format("KTX2 image has {} levels, more than its size allows", level_count));
+        if ((bytes.size() - sizeof(header)) / sizeof(Ktx2Level) < level_count)
+            Logger::panic("KTX2 level index is truncated");
+        std::vector<Ktx2Level> levels(level_count);
+        std::memcpy(levels.data(), bytes.data() + sizeof(header), level_count * sizeof(Ktx2Level));
+        size_t size = 0;
+        for (uint32_t level = 0; level < level_count; level++) {
+            const auto &entry = levels[level];
+            const size_t level_size =
+                    PlainImageData::levelSize(image_format, header.pixelWidth, header.pixelHeight, level);
+            if (entry.byteLength != level_size || entry.byteOffset > bytes.size() ||
+                entry.byteLength > bytes.size() - entry.byteOffset)
+                Logger::panic(std::format("KTX2 level {} has an unexpected size or is out of bounds", level));
+            size += entry.byteLength;
+        }
+
+        // the file stores the smallest level first, PlainImageData the largest
+        auto *pixels = static_cast<unsigned char *>(std::malloc(size));
+        size_t offset = 0;
+        for (const auto &entry: levels) {
+            std::memcpy(pixels + offset, bytes.data() + entry.byteOffset, entry.byteLength);
+            offset += entry.byteLength;
+        }
+        return PlainImageData(
+                std::unique_ptr<unsigned char>(pixels), size, header.pixelWidth, header.pixelHeight, image_format,
+                level_count
+        );
+    }
+} // namespace gltf
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <vulkan/vulkan.hpp>
+
+class PlainImageData;
+
+namespace gltf {
+    // Whether the bytes start with the KTX2 file identifier
+    bool isKtx2(std::span<const uint8_t> bytes);
+
+    /**
+     * Copies the mip chain of a KTX2 image with BCn levels as is, no decoding happens.
+     * Basis Universal payloads (BasisLZ or UASTC) and supercompressed levels would need a transcoder, for them and for
+     * formats that don't fit the expected one a warning is logged and nullopt returned. Malformed files panic, the
+     * header and level index are checked before anything is read through them.
+     * @param format the format the material expects, the image must have the same color space and enough channels
+     */
+    std::optional<PlainImageData> loadKtx2(std::span<const uint8_t> bytes, vk::Format format);
+} // namespace gltf
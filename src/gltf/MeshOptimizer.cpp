@@ -0,0 +1,440 @@
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstring>
+#include <format>
+#include <functional>
+#include <glm/geometric.hpp>
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <numeric>
+#include <vector>
+
+#include "../Logger.h"
+#include "../util/thread_pool.h"
+#include "Gltf.h"
+
+namespace gltf {
+    namespace {
+        // A primitive copied out of the scene streams, indices are relative to its first vertex
+        struct MeshData {
+            std::vector<glm::vec3> positions;
+            std::vector<glm::vec3> normals;
+            std::vector<glm::vec4> tangents;
+            std::vector<glm::vec2> texcoords;
+            std::vector<uint32_t> indices;
+
+            [[nodiscard]] uint32_t vertexCount() const { return static_cast<uint32_t>(positions.size()); }
+
+            // Moves vertex i to remap[i], vertices with a remap of -1u are dropped. Several vertices may map to the
+            // same target, if they are equal.
+            void remapVertices(std::span<const uint32_t> remap, uint32_t new_vertex_count) {
+                const auto apply = [&]<typename T>(std::vector<T> &stream) {
+                    std::vector<T> result(new_vertex_count);
+                    for (size_t i = 0; i < stream.size(); i++) {
+                        if (remap[i] != -1u)
+                            result[remap[i]] = stream[i];
+                    }
+                    stream = std::move(result);
+                };
+                apply(positions);
+                apply(normals);
+                apply(tangents);
+                apply(texcoords);
+                for (auto &index: indices)
+                    index = remap[index];
+            }
+        };
+
+        template<typename T>
+        std::span<T> stream_span(std::vector<unsigned char> &data, size_t offset, size_t count) {
+            return {reinterpret_cast<T *>(data.data()) + offset, count};
+        }
+
+        template<typename T>
+        std::span<const T> stream_span(const std::vector<unsigned char> &data, size_t offset, size_t count) {
+            return {reinterpret_cast<const T *>(data.data()) + offset, count};
+        }
+
+        MeshData extract(const SceneData &scene_data, const Primitive &primitive) {
+            const size_t offset = primitive.vertexOffset;
+            const size_t count = primitive.vertexCount;
+            const auto positions = stream_span<glm::vec3>(scene_data.vertex_position_data, offset, count);
+            const auto normals = stream_span<glm::vec3>(scene_data.vertex_normal_data, offset, count);
+            const auto tangents = stream_span<glm::vec4>(scene_data.vertex_tangent_data, offset, count);
+            const auto texcoords = stream_span<glm::vec2>(scene_data.vertex_texcoord_data, offset, count);
+            return {
+                .positions = {positions.begin(), positions.end()},
+                .normals = {normals.begin(), normals.end()},
+                .tangents = {tangents.begin(), tangents.end()},
+                .texcoords = {texcoords.begin(), texcoords.end()},
+                .indices = readPrimitiveIndices(scene_data, primitive),
+            };
+        }
+
+        // The 12 floats of all four attributes, compared bitwise
+        using VertexKey = std::array<uint32_t, 12>;
+
+        VertexKey vertex_key(const MeshData &mesh, uint32_t vertex) {
+            VertexKey key;
+            std::memcpy(key.data() + 0, &mesh.positions[vertex], sizeof(glm::vec3));
+            std::memcpy(key.data() + 3, &mesh.normals[vertex], sizeof(glm::vec3));
+            std::memcpy(key.data() + 6, &mesh.tangents[vertex], sizeof(glm::vec4));
+            std::memcpy(key.data() + 10, &mesh.texcoords[vertex], sizeof(glm::vec2));
+            return key;
+        }
+
+        uint32_t hash_key(const VertexKey &key) {
+            uint32_t hash = 0x811c9dc5;
+            for (const uint32_t word: key) {
+                hash = (hash ^ word) * 0x5bd1e995;
+                hash ^= hash >> 15;
+            }
+            return hash;
+        }
+
+        // Merges bitwise equal vertices, the unique ones keep the order of their first occurrence
+        void weld(MeshData &mesh) {
+            const uint32_t vertex_count = mesh.vertexCount();
+            // open addressing with linear probing, the load factor stays below 0.8
+            const size_t table_size = std::bit_ceil(std::max<size_t>(16, vertex_count + vertex_count / 4));
+            const size_t mask = table_size - 1;
+            std::vector<uint32_t> table(table_size, -1u);
+            std::vector<VertexKey> keys(vertex_count);
+            std::vector<uint32_t> remap(vertex_count);
+            uint32_t unique_count = 0;
+
+            for (uint32_t v = 0; v < vertex_count; v++) {
+                keys[v] = vertex_key(mesh, v);
+                for (size_t slot = hash_key(keys[v]) & mask;; slot = (slot + 1) & mask) {
+                    const uint32_t other = table[slot];
+                    if (other == -1u) {
+                        table[slot] = v;
+                        remap[v] = unique_count++;
+                        break;
+                    }
+                    if (keys[other] == keys[v]) {
+                        remap[v] = remap[other];
+                        break;
+                    }
+                }
+            }
+
+            if (unique_count != vertex_count)
+                mesh.remapVertices(remap, unique_count);
+        }
+
+        /**
+         * Simulates a FIFO cache, a vertex stays cached until cache_size other vertices were transformed after it.
+         * Starting a new timestamp epoch (time += cache_size + 1) flushes the cache.
+         */
+        struct FifoCache {
+            std::vector<uint32_t> timestamps;
+            uint32_t time;
+            uint32_t size;
+
+            FifoCache(uint32_t vertex_count, uint32_t cache_size)
+                : timestamps(vertex_count, 0), time(cache_size + 1), size(cache_size) {}
+
+            // Returns true on a miss
+            bool access(uint32_t vertex) {
+                if (time - timestamps[vertex] <= size)
+                    return false;
+                timestamps[vertex] = time++;
+                return true;
+            }
+
+            void flush() { time += size + 1; }
+        };
+
+        /**
+         * Tipsify from "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw" (Sander et al. 2007).
+         * Emits the triangles around a fanning vertex, then continues with the adjacent vertex which will still be
+         * cached after its remaining triangles are emitted, falling back to recently used vertices on dead ends.
+         */
+        std::vector<uint32_t> tipsify(std::span<const uint32_t> indices, uint32_t vertex_count, uint32_t cache_size) {
+            const size_t triangle_count = indices.size() / 3;
+
+            // vertex to triangle adjacency in compressed sparse row form
+            std::vector<uint32_t> live(vertex_count, 0);
+            for (const uint32_t index: indices)
+                live[index]++;
+            std::vector<uint32_t> adjacency_offsets(vertex_count + 1, 0);
+            std::inclusive_scan(live.begin(), live.end(), adjacency_offsets.begin() + 1);
+            std::vector<uint32_t> adjacency(indices.size());
+            {
+                std::vector<uint32_t> cursor(adjacency_offsets.begin(), adjacency_offsets.end() - 1);
+                for (size_t i = 0; i < indices.size(); i++)
+                    adjacency[cursor[indices[i]]++] = static_cast<uint32_t>(i / 3);
+            }
+
+            std::vector<uint32_t> result;
+            result.reserve(indices.size());
+            std::vector<bool> emitted(triangle_count, false);
+            std::vector<uint32_t> dead_end;
+            dead_end.reserve(indices.size());
+            std::vector<uint32_t> candidates;
+            FifoCache cache(vertex_count, cache_size);
+            uint32_t scan_cursor = 0;
+
+            uint32_t fan = vertex_count > 0 ? 0 : -1u;
+            while (fan != -1u) {
+                candidates.clear();
+                for (uint32_t a = adjacency_offsets[fan]; a < adjacency_offsets[fan + 1]; a++) {
+                    const uint32_t triangle = adjacency[a];
+                    if (emitted[triangle])
+                        continue;
+                    emitted[triangle] = true;
+                    for (uint32_t k = 0; k < 3; k++) {
+                        const uint32_t v = indices[triangle * 3 + k];
+                        result.push_back(v);
+                        dead_end.push_back(v);
+                        candidates.push_back(v);
+                        live[v]--;
+                        cache.access(v);
+                    }
+                }
+
+                // prefer the oldest candidate which survives emitting all of its remaining triangles
+                uint32_t next = -1u;
+                int64_t best_priority = -1;
+                for (const uint32_t v: candidates) {
+                    if (live[v] == 0)
+                        continue;
+                    const int64_t age = cache.time - cache.timestamps[v];
+                    const int64_t priority = age + 2 * live[v] <= cache_size ? age : 0;
+                    if (priority > best_priority) {
+                        best_priority = priority;
+                        next = v;
+                    }
+                }
+                while (next == -1u && !dead_end.empty()) {
+                    const uint32_t v = dead_end.back();
+                    dead_end.pop_back();
+                    if (live[v] > 0)
+                        next = v;
+                }
+                for (; next == -1u && scan_cursor < vertex_count; scan_cursor++) {
+                    if (live[scan_cursor] > 0)
+                        next = scan_cursor;
+                }
+                fan = next;
+            }
+            return result;
+        }
+
+        /**
+         * Overdraw part of Sander et al.: the cache optimized order is split into clusters at the points where the
+         * cache is cold anyway, and where the ACMR of a cluster is already close to the ACMR of the whole mesh.
+         * The clusters are then sorted so the ones facing away from the mesh center, which are likely in front of
+         * the others, are drawn first.
+         */
+        void optimize_overdraw(
+                std::vector<uint32_t> &indices, std::span<const glm::vec3> positions, uint32_t cache_size,
+                float threshold
+        ) {
+            const size_t triangle_count = indices.size() / 3;
+            if (triangle_count < 2)
+                return;
+            const auto vertex_count = static_cast<uint32_t>(positions.size());
+
+            // hard boundaries, triangles which miss the cache with all three vertices
+            std::vector<size_t> hard_boundaries;
+            {
+                FifoCache cache(vertex_count, cache_size);
+                for (size_t t = 0; t < triangle_count; t++) {
+                    uint32_t misses = 0;
+                    for (uint32_t k = 0; k < 3; k++)
+                        misses += cache.access(indices[t * 3 + k]);
+                    if (misses == 3 || t == 0)
+                        hard_boundaries.push_back(t);
+                }
+                hard_boundaries.push_back(triangle_count);
+            }
+
+            // soft boundaries, split a hard cluster once it has an ACMR close to the one of the whole hard cluster
+            std::vector<size_t> boundaries;
+            FifoCache cache(vertex_count, cache_size);
+            for (size_t c = 0; c + 1 < hard_boundaries.size(); c++) {
+                const size_t begin = hard_boundaries[c];
+                const size_t end = hard_boundaries[c + 1];
+
+                cache.flush();
+                size_t cluster_misses = 0;
+                for (size_t i = begin * 3; i < end * 3; i++)
+                    cluster_misses += cache.access(indices[i]);
+                const double max_acmr =
+                        threshold * static_cast<double>(cluster_misses) / static_cast<double>(end - begin);
+
+                cache.flush();
+                boundaries.push_back(begin);
+                size_t start = begin;
+                size_t misses = 0;
+                for (size_t t = begin; t + 1 < end; t++) {
+                    for (uint32_t k = 0; k < 3; k++)
+                        misses += cache.access(indices[t * 3 + k]);
+                    if (static_cast<double>(misses) <= max_acmr * static_cast<double>(t + 1 - start)) {
+                        boundaries.push_back(t + 1);
+                        cache.flush();
+                        start = t + 1;
+                        misses = 0;
+                    }
+                }
+            }
+            boundaries.push_back(triangle_count);
+
+            struct Cluster {
+                size_t begin;
+                size_t end;
+                float sortKey;
+            };
+            std::vector<Cluster> clusters(boundaries.size() - 1);
+            std::vector<glm::vec3> cluster_normals(clusters.size());
+            std::vector<glm::vec3> cluster_centroids(clusters.size());
+            glm::dvec3 mesh_centroid_sum = {};
+            double mesh_area = 0.0;
+            for (size_t c = 0; c < clusters.size(); c++) {
+                clusters[c] = {.begin = boundaries[c], .end = boundaries[c + 1], .sortKey = 0.0f};
+                glm::vec3 centroid_sum = {};
+                glm::vec3 normal_sum = {};
+                float area_sum = 0.0f;
+                for (size_t t = clusters[c].begin; t < clusters[c].end; t++) {
+                    const glm::vec3 p0 = positions[indices[t * 3 + 0]];
+                    const glm::vec3 p1 = positions[indices[t * 3 + 1]];
+                    const glm::vec3 p2 = positions[indices[t * 3 + 2]];
+                    const glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+                    const float area = glm::length(normal);
+                    centroid_sum += (p0 + p1 + p2) * (area / 3.0f);
+                    normal_sum += normal;
+                    area_sum += area;
+                }
+                cluster_centroids[c] =
+                        area_sum > 0.0f ? centroid_sum / area_sum : positions[indices[clusters[c].begin * 3]];
+                const float normal_length = glm::length(normal_sum);
+                cluster_normals[c] = normal_length > 0.0f ? normal_sum / normal_length : glm::vec3(0.0f);
+                mesh_centroid_sum += glm::dvec3(centroid_sum);
+                mesh_area += area_sum;
+            }
+            if (mesh_area <= 0.0)
+                return;
+
+            const auto mesh_centroid = glm::vec3(mesh_centroid_sum / mesh_area);
+            for (size_t c = 0; c < clusters.size(); c++)
+                clusters[c].sortKey = glm::dot(cluster_centroids[c] - mesh_centroid, cluster_normals[c]);
+            std::ranges::stable_sort(clusters, std::greater{}, &Cluster::sortKey);
+
+            std::vector<uint32_t> result;
+            result.reserve(indices.size());
+            for (const auto &cluster: clusters)
+                result.insert(result.end(), indices.begin() + cluster.begin * 3, indices.begin() + cluster.end * 3);
+            indices = std::move(result);
+        }
+
+        // Renumbers the vertices in the order of their first use, so they are fetched sequentially
+        void optimize_vertex_fetch(MeshData &mesh) {
+            std::vector<uint32_t> remap(mesh.vertexCount(), -1u);
+            uint32_t next = 0;
+            for (const uint32_t index: mesh.indices) {
+                if (remap[index] == -1u)
+                    remap[index] = next++;
+            }
+            mesh.remapVertices(remap, next);
+        }
+    } // namespace
+
+    VertexCacheStatistics
+    analyzeVertexCache(std::span<const uint32_t> indices, uint32_t vertex_count, uint32_t cache_size) {
+        VertexCacheStatistics statistics = {.triangles = indices.size() / 3, .vertices = vertex_count};
+        FifoCache cache(vertex_count, cache_size);
+        for (const uint32_t index: indices)
+            statistics.transformed += cache.access(index);
+        return statistics;
+    }
+
+    MeshOptimizeResult optimizeMeshes(SceneData &scene_data, const MeshOptimizeOptions &options) {
+        const size_t primitive_count = scene_data.primitives.size();
+        Logger::check(scene_data.vertex_format == VertexFormat::Float, "Mesh optimization needs float vertices");
+        for (const auto &primitive: scene_data.primitives)
+            Logger::check(primitive.lodCount == 0, "Meshes must be optimized before their LODs are generated");
+        std::vector<MeshData> meshes(primitive_count);
+        std::vector<VertexCacheStatistics> before(primitive_count);
+        std::vector<VertexCacheStatistics> after(primitive_count);
+
+        // Index ranges are disjoint and keep their size, so they are written back right away
+        const auto optimize_primitives = [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                const auto &primitive = scene_data.primitives[i];
+                MeshData &mesh = meshes[i] = extract(scene_data, primitive);
+                before[i] = analyzeVertexCache(mesh.indices, mesh.vertexCount(), options.cacheSize);
+
+                if (options.weld)
+                    weld(mesh);
+                if (options.vertexCache) {
+                    mesh.indices = tipsify(mesh.indices, mesh.vertexCount(), options.cacheSize);
+                    if (options.overdraw)
+                        optimize_overdraw(mesh.indices, mesh.positions, options.cacheSize, options.overdrawThreshold);
+                }
+                if (options.vertexFetch)
+                    optimize_vertex_fetch(mesh);
+
+                after[i] = analyzeVertexCache(mesh.indices, mesh.vertexCount(), options.cacheSize);
+                writePrimitiveIndices(scene_data, primitive, mesh.indices);
+            }
+        };
+        if (options.parallel)
+            util::parallel_for(primitive_count, 1, optimize_primitives);
+        else
+            optimize_primitives(0, primitive_count);
+
+        // Compact the vertex streams, the primitives keep their order
+        size_t vertex_count = 0;
+        for (size_t i = 0; i < primitive_count; i++) {
+            auto &primitive = scene_data.primitives[i];
+            primitive.vertexOffset = static_cast<int32_t>(vertex_count);
+            primitive.vertexCount = meshes[i].vertexCount();
+            vertex_count += primitive.vertexCount;
+        }
+        std::vector<unsigned char> positions(vertex_count * sizeof(glm::vec3));
+        std::vector<unsigned char> normals(vertex_count * sizeof(glm::vec3));
+        std::vector<unsigned char> tangents(vertex_count * sizeof(glm::vec4));
+        std::vector<unsigned char> texcoords(vertex_count * sizeof(glm::vec2));
+        const auto copy_streams = [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                const auto &mesh = meshes[i];
+                const size_t offset = scene_data.primitives[i].vertexOffset;
+                const size_t count = mesh.vertexCount();
+                std::ranges::copy(mesh.positions, stream_span<glm::vec3>(positions, offset, count).begin());
+                std::ranges::copy(mesh.normals, stream_span<glm::vec3>(normals, offset, count).begin());
+                std::ranges::copy(mesh.tangents, stream_span<glm::vec4>(tangents, offset, count).begin());
+                std::ranges::copy(mesh.texcoords, stream_span<glm::vec2>(texcoords, offset, count).begin());
+            }
+        };
+        if (options.parallel)
+            util::parallel_for(primitive_count, 1, copy_streams);
+        else
+            copy_streams(0, primitive_count);
+        scene_data.vertex_position_data = std::move(positions);
+        scene_data.vertex_normal_data = std::move(normals);
+        scene_data.vertex_tangent_data = std::move(tangents);
+        scene_data.vertex_texcoord_data = std::move(texcoords);
+        scene_data.vertex_count = vertex_count;
+
+        for (auto &instance: scene_data.instances)
+            instance.vertexOffset = scene_data.primitives[instance.primitive].vertexOffset;
+
+        MeshOptimizeResult result = {};
+        for (size_t i = 0; i < primitive_count; i++) {
+            result.before += before[i];
+            result.after += after[i];
+        }
+        Logger::info(std::format(
+                "Optimized {} primitives: {} -> {} vertices, ACMR {:.3f} -> {:.3f}, ATVR {:.3f} -> {:.3f}",
+                primitive_count, result.before.vertices, result.after.vertices, result.before.acmr(),
+                result.after.acmr(), result.before.atvr(), result.after.atvr()
+        ));
+        return result;
+    }
+} // namespace gltf
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+namespace gltf {
+    struct SceneData;
+
+    // Post-transform vertex cache statistics of a simulated FIFO cache
+    struct VertexCacheStatistics {
+        size_t triangles = 0;
+        size_t vertices = 0;
+        // vertex shader invocations
+        size_t transformed = 0;
+
+        // average cache miss ratio, transformed vertices per triangle: 3 is the worst, ~0.5 the optimum
+        [[nodiscard]] double acmr() const { return triangles ? static_cast<double>(transformed) / triangles : 0.0; }
+
+        // average transform to vertex ratio: 1 is the optimum
+        [[nodiscard]] double atvr() const { return vertices ? static_cast<double>(transformed) / vertices : 0.0; }
+
+        VertexCacheStatistics &operator+=(const VertexCacheStatistics &other) {
+            triangles += other.triangles;
+            vertices += other.vertices;
+            transformed += other.transformed;
+            return *this;
+        }
+    };
+
+    struct MeshOptimizeOptions {
+        // Merge vertices which are bitwise equal in all four attribute streams
+        bool weld = true;
+        // Reorder the triangles for the post-transform vertex cache (Tipsify)
+        bool vertexCache = true;
+        // Sort clusters of the cache optimized triangles so outward facing ones are drawn first, needs vertexCache
+        bool overdraw = true;
+        // Reorder the vertices by their first use and drop unreferenced ones
+        bool vertexFetch = true;
+        // Optimize the primitives concurrently on the global thread pool
+        bool parallel = true;
+        // FIFO cache size used for the optimization and the statistics
+        uint32_t cacheSize = 16;
+        // How much the overdraw clusters may increase the ACMR of the cache optimized order
+        float overdrawThreshold = 1.05f;
+    };
+
+    struct MeshOptimizeResult {
+        VertexCacheStatistics before;
+        VertexCacheStatistics after;
+    };
+
+    VertexCacheStatistics
+    analyzeVertexCache(std::span<const uint32_t> indices, uint32_t vertex_count, uint32_t cache_size);
+
+    /**
+     * Optimizes every primitive of the scene in place and compacts the vertex streams.
+     * The index ranges and index types stay the same, vertex offsets of the primitives and instances are updated.
+     */
+    MeshOptimizeResult optimizeMeshes(SceneData &scene_data, const MeshOptimizeOptions &options = {});
+} // namespace gltf
@@ -0,0 +1,297 @@
+#include "Meshlets.h"
+
+#include <algorithm>
+#include <cmath>
+#include <format>
+#include <glm/geometric.hpp>
+#include <limits>
+#include <numeric>
+#include <span>
+#include <vector>
+
+#include "../Logger.h"
+#include "../util/thread_pool.h"
+#include "Gltf.h"
+
+namespace gltf {
+    namespace {
+        // A contiguous range of one primitive's triangles, built independently of the others
+        struct MeshletTask {
+            uint32_t primitive;
+            size_t firstTriangle;
+            size_t triangleCount;
+        };
+
+        // The meshlets of one task, offsets are relative to the task's own vertex and triangle data
+        struct MeshletTaskResult {
+            std::vector<Meshlet> meshlets;
+            std::vector<uint32_t> vertices;
+            std::vector<uint32_t> triangles;
+        };
+
+        constexpr uint8_t NO_SLOT = 0xff;
+
+        Meshlet compute_bounds(
+                std::span<const uint32_t> vertices, std::span<const uint32_t> triangles,
+                std::span<const glm::vec3> positions
+        ) {
+            glm::vec3 min = positions[vertices[0]];
+            glm::vec3 max = min;
+            for (const uint32_t v: vertices) {
+                min = glm::min(min, positions[v]);
+                max = glm::max(max, positions[v]);
+            }
+            const glm::vec3 center = (min + max) * 0.5f;
+            float radius = 0.0f;
+            for (const uint32_t v: vertices)
+                radius = std::max(radius, glm::distance(center, positions[v]));
+
+            glm::vec3 normal_sum = {};
+            std::vector<glm::vec3> normals;
+            normals.reserve(triangles.size());
+            for (const uint32_t triangle: triangles) {
+                const glm::vec3 p0 = positions[vertices[triangle & 0xff]];
+                const glm::vec3 p1 = positions[vertices[(triangle >> 8) & 0xff]];
+                const glm::vec3 p2 = positions[vertices[(triangle >> 16) & 0xff]];
+                const glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+                const float length = glm::length(normal);
+                if (length <= 0.0f)
+                    continue;
+                normals.push_back(normal / length);
+                normal_sum += normals.back();
+            }
+
+            // cutoff 1 disables culling, used when the normals spread too far
+            glm::vec4 cone = {0.0f, 0.0f, 1.0f, 1.0f};
+            const float axis_length = glm::length(normal_sum);
+            if (axis_length > 0.0f) {
+                const glm::vec3 axis = normal_sum / axis_length;
+                float min_dot = 1.0f;
+                for (const auto &normal: normals)
+                    min_dot = std::min(min_dot, glm::dot(axis, normal));
+                if (min_dot > 0.1f)
+                    cone = glm::vec4(axis, std::sqrt(1.0f - min_dot * min_dot));
+            }
+
+            return {.sphere = glm::vec4(center, radius), .cone = cone};
+        }
+
+        void build_task(
+                std::span<const uint32_t> indices, std::span<const glm::vec3> positions, const MeshletOptions &options,
+                MeshletTaskResult &result
+        ) {
+            const size_t triangle_count = indices.size() / 3;
+
+            // dense ids for the vertices used by this task, so the scratch arrays stay small
+            std::vector<uint32_t> task_vertices(indices.begin(), indices.end());
+            std::ranges::sort(task_vertices);
+            task_vertices.erase(std::ranges::unique(task_vertices).begin(), task_vertices.end());
+            const auto vertex_count = static_cast<uint32_t>(task_vertices.size());
+            std::vector<uint32_t> local_indices(indices.size());
+            for (size_t i = 0; i < indices.size(); i++) {
+                const auto it = std::ranges::lower_bound(task_vertices, indices[i]);
+                local_indices[i] = static_cast<uint32_t>(it - task_vertices.begin());
+            }
+
+            // vertex to triangle adjacency in compressed sparse row form
+            std::vector<uint32_t> adjacency_offsets(vertex_count + 1, 0);
+            for (const uint32_t v: local_indices)
+                adjacency_offsets[v + 1]++;
+            std::inclusive_scan(adjacency_offsets.begin(), adjacency_offsets.end(), adjacency_offsets.begin());
+            std::vector<uint32_t> adjacency(local_indices.size());
+            {
+                std::vector<uint32_t> cursor(adjacency_offsets.begin(), adjacency_offsets.end() - 1);
+                for (size_t i = 0; i < local_indices.size(); i++)
+                    adjacency[cursor[local_indices[i]]++] = static_cast<uint32_t>(i / 3);
+            }
+
+            std::vector<glm::vec3> centroids(triangle_count);
+            for (size_t t = 0; t < triangle_count; t++) {
+                centroids[t] = (positions[indices[t * 3 + 0]] + positions[indices[t * 3 + 1]] +
+                                positions[indices[t * 3 + 2]]) /
+                               3.0f;
+            }
+
+            std::vector<bool> used(triangle_count, false);
+            std::vector<bool> is_candidate(triangle_count, false);
+            // slot of the vertex in the current meshlet
+            std::vector<uint8_t> slots(vertex_count, NO_SLOT);
+            std::vector<uint32_t> candidates;
+            // primitive relative vertex ids for the output, dense task ids to reset the slots
+            std::vector<uint32_t> meshlet_vertices;
+            std::vector<uint32_t> meshlet_local_vertices;
+            std::vector<uint32_t> meshlet_triangles;
+            glm::vec3 centroid_sum = {};
+            size_t scan_cursor = 0;
+
+            const auto new_vertices = [&](uint32_t triangle) {
+                const uint32_t a = local_indices[triangle * 3 + 0];
+                const uint32_t b = local_indices[triangle * 3 + 1];
+                const uint32_t c = local_indices[triangle * 3 + 2];
+                return (slots[a] == NO_SLOT) + (slots[b] == NO_SLOT && b != a) +
+                       (slots[c] == NO_SLOT && c != a && c != b);
+            };
+
+            const auto flush = [&] {
+                if (meshlet_triangles.empty())
+                    return;
+                Meshlet meshlet = compute_bounds(meshlet_vertices, meshlet_triangles, positions);
+                meshlet.vertexOffset = static_cast<uint32_t>(result.vertices.size());
+                meshlet.triangleOffset = static_cast<uint32_t>(result.triangles.size());
+                meshlet.vertexCount = static_cast<uint32_t>(meshlet_vertices.size());
+                meshlet.triangleCount = static_cast<uint32_t>(meshlet_triangles.size());
+                result.meshlets.push_back(meshlet);
+                result.vertices.insert(result.vertices.end(), meshlet_vertices.begin(), meshlet_vertices.end());
+                result.triangles.insert(result.triangles.end(), meshlet_triangles.begin(), meshlet_triangles.end());
+
+                for (const uint32_t v: meshlet_local_vertices)
+                    slots[v] = NO_SLOT;
+                meshlet_vertices.clear();
+                meshlet_local_vertices.clear();
+                meshlet_triangles.clear();
+                for (const uint32_t triangle: candidates)
+                    is_candidate[triangle] = false;
+                candidates.clear();
+                centroid_sum = {};
+            };
+
+            const auto add = [&](uint32_t triangle) {
+                used[triangle] = true;
+                uint32_t packed = 0;
+                for (uint32_t k = 0; k < 3; k++) {
+                    const uint32_t v = local_indices[triangle * 3 + k];
+                    if (slots[v] == NO_SLOT) {
+                        slots[v] = static_cast<uint8_t>(meshlet_vertices.size());
+                        meshlet_vertices.push_back(task_vertices[v]);
+                        meshlet_local_vertices.push_back(v);
+                        for (uint32_t a = adjacency_offsets[v]; a < adjacency_offsets[v + 1]; a++) {
+                            const uint32_t adjacent = adjacency[a];
+                            if (!used[adjacent] && !is_candidate[adjacent]) {
+                                is_candidate[adjacent] = true;
+                                candidates.push_back(adjacent);
+                            }
+                        }
+                    }
+                    packed |= static_cast<uint32_t>(slots[v]) << (k * 8);
+                }
+                meshlet_triangles.push_back(packed);
+                centroid_sum += centroids[triangle];
+            };
+
+            for (size_t emitted = 0; emitted < triangle_count; emitted++) {
+                // the adjacent triangle adding the fewest vertices, ties go to the one closest to the meshlet
+                uint32_t best = -1u;
+                int best_new_vertices = 4;
+                float best_distance = std::numeric_limits<float>::max();
+                const glm::vec3 centroid =
+                        centroid_sum / std::max(1.0f, static_cast<float>(meshlet_triangles.size()));
+                std::erase_if(candidates, [&](uint32_t triangle) { return used[triangle]; });
+                for (const uint32_t triangle: candidates) {
+                    const int new_vertex_count = new_vertices(triangle);
+                    if (new_vertex_count > best_new_vertices)
+                        continue;
+                    const glm::vec3 offset = centroids[triangle] - centroid;
+                    const float distance = glm::dot(offset, offset);
+                    if (new_vertex_count < best_new_vertices || distance < best_distance) {
+                        best = triangle;
+                        best_new_vertices = new_vertex_count;
+                        best_distance = distance;
+                    }
+                }
+
+                // nothing adjacent left, continue with the next triangle in index order which tends to be close by
+                if (best == -1u) {
+                    while (used[scan_cursor])
+                        scan_cursor++;
+                    best = static_cast<uint32_t>(scan_cursor);
+                    best_new_vertices = new_vertices(best);
+                }
+
+                if (meshlet_vertices.size() + best_new_vertices > options.maxVertices ||
+                    meshlet_triangles.size() + 1 > options.maxTriangles)
+                    flush();
+                add(best);
+            }
+            flush();
+        }
+    } // namespace
+
+    void buildMeshlets(SceneData &scene_data, const MeshletOptions &options) {
+        Logger::check(
+                options.maxVertices >= 3 && options.maxVertices <= NO_SLOT && options.maxTriangles >= 1,
+                "Meshlets need 3 to 255 vertices and at least one triangle"
+        );
+        Logger::check(scene_data.vertex_format == VertexFormat::Float, "Meshlet building needs float vertices");
+        const uint32_t chunk_triangles = std::max(options.chunkTriangles, options.maxTriangles);
+
+        std::vector<MeshletTask> tasks;
+        for (uint32_t p = 0; p < scene_data.primitives.size(); p++) {
+            const size_t triangle_count = scene_data.primitives[p].indexCount / 3;
+            for (size_t first = 0; first < triangle_count; first += chunk_triangles)
+                tasks.push_back(
+                        {.primitive = p,
+                         .firstTriangle = first,
+                         .triangleCount = std::min<size_t>(chunk_triangles, triangle_count - first)}
+                );
+        }
+
+        std::vector<MeshletTaskResult> results(tasks.size());
+        const auto build_tasks = [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                const auto &task = tasks[i];
+                const auto &primitive = scene_data.primitives[task.primitive];
+                Primitive chunk = primitive;
+                chunk.indexOffset += static_cast<uint32_t>(task.firstTriangle * 3);
+                chunk.indexCount = static_cast<uint32_t>(task.triangleCount * 3);
+                const auto indices = readPrimitiveIndices(scene_data, chunk);
+                const auto positions = std::span(
+                        reinterpret_cast<const glm::vec3 *>(scene_data.vertex_position_data.data()) +
+                                primitive.vertexOffset,
+                        primitive.vertexCount
+                );
+                build_task(indices, positions, options, results[i]);
+            }
+        };
+        if (options.parallel)
+            util::parallel_for(tasks.size(), 1, build_tasks);
+        else
+            build_tasks(0, tasks.size());
+
+        // Concatenate in task order, which keeps the output independent of the scheduling
+        scene_data.meshlets.clear();
+        scene_data.meshlet_vertex_data.clear();
+        scene_data.meshlet_triangle_data.clear();
+        for (auto &primitive: scene_data.primitives)
+            primitive.meshletOffset = primitive.meshletCount = 0;
+        for (size_t i = 0; i < tasks.size(); i++) {
+            auto &result = results[i];
+            auto &primitive = scene_data.primitives[tasks[i].primitive];
+            if (primitive.meshletCount == 0)
+                primitive.meshletOffset = static_cast<uint32_t>(scene_data.meshlets.size());
+            primitive.meshletCount += static_cast<uint32_t>(result.meshlets.size());
+
+            const auto vertex_base = static_cast<uint32_t>(scene_data.meshlet_vertex_data.size());
+            const auto triangle_base = static_cast<uint32_t>(scene_data.meshlet_triangle_data.size());
+            for (auto &meshlet: result.meshlets) {
+                meshlet.vertexOffset += vertex_base;
+                meshlet.triangleOffset += triangle_base;
+            }
+            scene_data.meshlets.insert(scene_data.meshlets.end(), result.meshlets.begin(), result.meshlets.end());
+            scene_data.meshlet_vertex_data.insert(
+                    scene_data.meshlet_vertex_data.end(), result.vertices.begin(), result.vertices.end()
+            );
+            scene_data.meshlet_triangle_data.insert(
+                    scene_data.meshlet_triangle_data.end(), result.triangles.begin(), result.triangles.end()
+            );
+            result = {};
+        }
+
+        const auto meshlet_count = static_cast<double>(std::max<size_t>(1, scene_data.meshlets.size()));
+        Logger::info(std::format(
+                "Built {} meshlets for {} primitives, {:.1f} vertices and {:.1f} triangles per meshlet on average",
+                scene_data.meshlets.size(), scene_data.primitives.size(),
+                static_cast<double>(scene_data.meshlet_vertex_data.size()) / meshlet_count,
+                static_cast<double>(scene_data.meshlet_triangle_data.size()) / meshlet_count
+        ));
+    }
+} // namespace gltf
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdint>
+
+namespace gltf {
+    struct SceneData;
+
+    struct MeshletOptions {
+        uint32_t maxVertices = 64;
+        // at most 124 so that the packed triangles of a meshlet fit into mesh shader output limits
+        uint32_t maxTriangles = 124;
+        // Large primitives are split into independently built chunks of this many triangles, so they are built in
+        // parallel as well. The chunks are fixed, the result does not depend on the thread count.
+        uint32_t chunkTriangles = 1u << 16;
+        // Build the chunks concurrently on the global thread pool
+        bool parallel = true;
+    };
+
+    /**
+     * Splits every primitive into meshlets and fills SceneData::meshlets, meshlet_vertex_data and
+     * meshlet_triangle_data as well as the meshlet range of each primitive. Previously built meshlets are replaced.
+     * Meshlets are grown greedily over shared vertices, preferring triangles that add the fewest new vertices and lie
+     * closest to the meshlet. Run it after optimizeMeshes, the vertex cache order gives better seeds.
+     */
+    void buildMeshlets(SceneData &scene_data, const MeshletOptions &options = {});
+} // namespace gltf
@@ -0,0 +1,459 @@
+#include "Meshopt.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstring>
+#include <format>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define GLTF_MESHOPT_SSE2
+#include <emmintrin.h>
+#endif
+
+#include "../Logger.h"
+
+namespace gltf {
+    namespace {
+        // the high nibble of the first byte identifies the codec, the low one its version
+        constexpr uint8_t VERTEX_HEADER = 0xa0;
+        constexpr uint8_t TRIANGLE_HEADER = 0xe0;
+        constexpr uint8_t SEQUENCE_HEADER = 0xd0;
+
+        // the vertex codec splits the vertices into blocks of at most this many bytes and vertices
+        constexpr size_t VERTEX_BLOCK_SIZE_BYTES = 8192;
+        constexpr size_t VERTEX_BLOCK_MAX_SIZE = 256;
+        // every byte of a block's vertices is encoded separately in groups of this many vertices
+        constexpr size_t BYTE_GROUP_SIZE = 16;
+        // the first vertex is stored at the end of the stream, padded to at least this size
+        constexpr size_t VERTEX_TAIL_MIN_SIZE = 32;
+        // the triangle codec stores its table of the 16 most common auxiliary codes at the end of the stream
+        constexpr size_t TRIANGLE_CODEAUX_SIZE = 16;
+        // the sequence codec pads the stream with this many bytes, so a varint can be read without bounds checks
+        constexpr size_t SEQUENCE_TAIL_SIZE = 4;
+
+        void check_remaining(const uint8_t *data, const uint8_t *end, size_t size) {
+            if (static_cast<size_t>(end - data) < size)
+                Logger::panic("Truncated meshopt buffer view");
+        }
+
+        uint8_t unzigzag8(uint8_t value) { return static_cast<uint8_t>(-(value & 1) ^ (value >> 1)); }
+
+        uint32_t unzigzag32(uint32_t value) { return (value >> 1) ^ (0u - (value & 1)); }
+
+        // Unpacks 16 values of bits each, the first value is in the highest bits of the first byte
+        void unpack_group(const uint8_t *packed, uint32_t bits, uint8_t *out) {
+#ifdef GLTF_MESHOPT_SSE2
+            __m128i values;
+            if (bits == 2) {
+                uint32_t word;
+                std::memcpy(&word, packed, sizeof(word));
+                const __m128i bytes = _mm_cvtsi32_si128(static_cast<int>(word));
+                const __m128i mask = _mm_set1_epi8(3);
+                const __m128i a = _mm_and_si128(_mm_srli_epi16(bytes, 6), mask);
+                const __m128i b = _mm_and_si128(_mm_srli_epi16(bytes, 4), mask);
+                const __m128i c = _mm_and_si128(_mm_srli_epi16(bytes, 2), mask);
+                const __m128i d = _mm_and_si128(bytes, mask);
+                values = _mm_unpacklo_epi16(_mm_unpacklo_epi8(a, b), _mm_unpacklo_epi8(c, d));
+            } else {
+                const __m128i bytes = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(packed));
+                const __m128i mask = _mm_set1_epi8(15);
+                values = _mm_unpacklo_epi8(_mm_and_si128(_mm_srli_epi16(bytes, 4), mask), _mm_and_si128(bytes, mask));
+            }
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out), values);
+#else
+            const uint32_t per_byte = 8 / bits;
+            const uint8_t mask = static_cast<uint8_t>((1u << bits) - 1);
+            for (size_t i = 0; i < BYTE_GROUP_SIZE; i++) {
+                const uint32_t shift = 8 - bits * (i % per_byte + 1);
+                out[i] = static_cast<uint8_t>((packed[i / per_byte] >> shift) & mask);
+            }
+#endif
+        }
+
+        // Decodes 16 bytes in the given mode: zero, 2-bit, 4-bit or raw. The packed values with all bits set are
+        // escapes for a full byte, which follow the packed ones in order.
+        const uint8_t *decode_byte_group(const uint8_t *data, const uint8_t *end, uint8_t *out, uint32_t mode) {
+            if (mode == 0) {
+                std::memset(out, 0, BYTE_GROUP_SIZE);
+                return data;
+            }
+            if (mode == 3) {
+                check_remaining(data, end, BYTE_GROUP_SIZE);
+                std::memcpy(out, data, BYTE_GROUP_SIZE);
+                return data + BYTE_GROUP_SIZE;
+            }
+
+            const uint32_t bits = mode == 1 ? 2 : 4;
+            const size_t packed_size = BYTE_GROUP_SIZE * bits / 8;
+            check_remaining(data, end, packed_size);
+            unpack_group(data, bits, out);
+            const uint8_t *escapes = data + packed_size;
+            const auto escape = static_cast<uint8_t>((1u << bits) - 1);
+#ifdef GLTF_MESHOPT_SSE2
+            const __m128i values = _mm_loadu_si128(reinterpret_cast<const __m128i *>(out));
+            auto escaped = static_cast<uint32_t>(
+                    _mm_movemask_epi8(_mm_cmpeq_epi8(values, _mm_set1_epi8(static_cast<char>(escape))))
+            );
+            check_remaining(escapes, end, std::popcount(escaped));
+            for (; escaped != 0; escaped &= escaped - 1)
+                out[std::countr_zero(escaped)] = *escapes++;
+#else
+            for (size_t i = 0; i < BYTE_GROUP_SIZE; i++) {
+                if (out[i] != escape)
+                    continue;
+                check_remaining(escapes, end, 1);
+                out[i] = *escapes++;
+            }
+#endif
+            return escapes;
+        }
+
+        // Decodes the zigzag encoded deltas of one byte of every vertex in the block, padded to whole groups.
+        // A 2-bit mode per group precedes them.
+        const uint8_t *decode_bytes(const uint8_t *data, const uint8_t *end, uint8_t *out, size_t group_count) {
+            const size_t header_size = (group_count + 3) / 4;
+            check_remaining(data, end, header_size);
+            const uint8_t *header = data;
+            data += header_size;
+            for (size_t i = 0; i < group_count; i++) {
+                const uint32_t mode = (header[i / 4] >> ((i % 4) * 2)) & 3;
+                data = decode_byte_group(data, end, out + i * BYTE_GROUP_SIZE, mode);
+            }
+            return data;
+        }
+
+        // Adds up the deltas of one byte of the block's vertices, starting at the value of the previous vertex, and
+        // writes them strided into the vertices
+        void write_byte_channel(const uint8_t *deltas, size_t count, size_t stride, uint8_t previous, uint8_t *out) {
+            size_t i = 0;
+#ifdef GLTF_MESHOPT_SSE2
+            alignas(16) std::array<uint8_t, BYTE_GROUP_SIZE> values = {};
+            for (; i + BYTE_GROUP_SIZE <= count; i += BYTE_GROUP_SIZE) {
+                const __m128i encoded = _mm_loadu_si128(reinterpret_cast<const __m128i *>(deltas + i));
+                // unzigzag: (v >> 1) ^ -(v & 1), there are no 8-bit shifts
+                const __m128i sign = _mm_sub_epi8(_mm_setzero_si128(), _mm_and_si128(encoded, _mm_set1_epi8(1)));
+                const __m128i half = _mm_and_si128(_mm_srli_epi16(encoded, 1), _mm_set1_epi8(0x7f));
+                __m128i sum = _mm_xor_si128(half, sign);
+                // prefix sum over the 16 lanes
+                sum = _mm_add_epi8(sum, _mm_slli_si128(sum, 1));
+                sum = _mm_add_epi8(sum, _mm_slli_si128(sum, 2));
+                sum = _mm_add_epi8(sum, _mm_slli_si128(sum, 4));
+                sum = _mm_add_epi8(sum, _mm_slli_si128(sum, 8));
+                sum = _mm_add_epi8(sum, _mm_set1_epi8(static_cast<char>(previous)));
+                _mm_store_si128(reinterpret_cast<__m128i *>(values.data()), sum);
+                for (size_t j = 0; j < BYTE_GROUP_SIZE; j++)
+                    out[(i + j) * stride] = values[j];
+                previous = values[BYTE_GROUP_SIZE - 1];
+            }
+#endif
+            for (; i < count; i++) {
+                previous = static_cast<uint8_t>(previous + unzigzag8(deltas[i]));
+                out[i * stride] = previous;
+            }
+        }
+
+        void decode_vertices(std::span<const uint8_t> src, size_t count, size_t stride, uint8_t *dst) {
+            if (stride == 0 || stride > 256 || stride % 4 != 0)
+                Logger::panic(std::format(
+                        "meshopt attribute stride must be a multiple of 4 up to 256, got {}", stride
+                ));
+            const size_t tail_size = std::max(stride, VERTEX_TAIL_MIN_SIZE);
+            if (src.size() < 1 + tail_size || (src[0] & 0xf0) != VERTEX_HEADER)
+                Logger::panic("Invalid meshopt vertex stream");
+            if ((src[0] & 0x0f) != 0)
+                Logger::panic(std::format("Unsupported meshopt vertex codec version {}", src[0] & 0x0f));
+
+            const uint8_t *data = src.data() + 1;
+            const uint8_t *end = src.data() + src.size() - tail_size;
+            // the deltas of the first block start at the first vertex
+            std::array<uint8_t, 256> last_vertex = {};
+            std::memcpy(last_vertex.data(), src.data() + src.size() - stride, stride);
+
+            const size_t block_size =
+                    std::min((VERTEX_BLOCK_SIZE_BYTES / stride) & ~(BYTE_GROUP_SIZE - 1), VERTEX_BLOCK_MAX_SIZE);
+            std::array<uint8_t, VERTEX_BLOCK_MAX_SIZE> deltas = {};
+            for (size_t first = 0; first < count; first += block_size) {
+                const size_t block_count = std::min(block_size, count - first);
+                const size_t group_count = (block_count + BYTE_GROUP_SIZE - 1) / BYTE_GROUP_SIZE;
+                uint8_t *block = dst + first * stride;
+                for (size_t k = 0; k < stride; k++) {
+                    data = decode_bytes(data, end, deltas.data(), group_count);
+                    write_byte_channel(deltas.data(), block_count, stride, last_vertex[k], block + k);
+                }
+                std::memcpy(last_vertex.data(), block + (block_count - 1) * stride, stride);
+            }
+            if (data != end)
+                Logger::panic("meshopt vertex stream has trailing bytes");
+        }
+
+        // LEB128 style, 7 bits per byte with the high bit set on all but the last byte
+        uint32_t decode_varint(const uint8_t *&data) {
+            const uint8_t lead = *data++;
+            if (lead < 128)
+                return lead;
+            uint32_t result = lead & 127;
+            uint32_t shift = 7;
+            for (int i = 0; i < 4; i++) {
+                const uint8_t group = *data++;
+                result |= static_cast<uint32_t>(group & 127) << shift;
+                shift += 7;
+                if (group < 128)
+                    break;
+            }
+            return result;
+        }
+
+        void write_index(uint8_t *dst, size_t i, size_t index_size, uint32_t index) {
+            if (index_size == sizeof(uint16_t)) {
+                const auto narrow = static_cast<uint16_t>(index);
+                std::memcpy(dst + i * sizeof(uint16_t), &narrow, sizeof(narrow));
+            } else {
+                std::memcpy(dst + i * sizeof(uint32_t), &index, sizeof(index));
+            }
+        }
+
+        // The most recent edges and vertices of the triangle codec, the codes refer to them by age
+        struct TriangleFifos {
+            std::array<std::array<uint32_t, 2>, 16> edges;
+            std::array<uint32_t, 16> vertices;
+            size_t edgeOffset = 0;
+            size_t vertexOffset = 0;
+
+            TriangleFifos() {
+                for (auto &edge: edges)
+                    edge = {~0u, ~0u};
+                vertices.fill(~0u);
+            }
+
+            // age 0 is the last pushed edge
+            [[nodiscard]] const std::array<uint32_t, 2> &edge(size_t age) const {
+                return edges[(edgeOffset - 1 - age) & 15];
+            }
+
+            [[nodiscard]] uint32_t vertex(size_t age) const { return vertices[(vertexOffset - 1 - age) & 15]; }
+
+            void pushEdge(uint32_t a, uint32_t b) {
+                edges[edgeOffset] = {a, b};
+                edgeOffset = (edgeOffset + 1) & 15;
+            }
+
+            // the slot is always written, but only kept if push is set
+            void pushVertex(uint32_t v, bool push = true) {
+                vertices[vertexOffset] = v;
+                vertexOffset = (vertexOffset + push) & 15;
+            }
+        };
+
+        void decode_triangles(std::span<const uint8_t> src, size_t index_count, size_t index_size, uint8_t *dst) {
+            if (index_count % 3 != 0)
+                Logger::panic("meshopt triangle stream must hold whole triangles");
+            if (src.size() < 1 + index_count / 3 + TRIANGLE_CODEAUX_SIZE || (src[0] & 0xf0) != TRIANGLE_HEADER)
+                Logger::panic("Invalid meshopt triangle stream");
+            const int version = src[0] & 0x0f;
+            if (version > 1)
+                Logger::panic(std::format("Unsupported meshopt triangle codec version {}", version));
+            // version 1 turned the two oldest vertex fifo entries into +-1 deltas to the last free index
+            const uint32_t fifo_codes = version >= 1 ? 13 : 15;
+
+            const uint8_t *codes = src.data() + 1;
+            const uint8_t *data = codes + index_count / 3;
+            // every triangle reads at most 16 bytes, the codeaux table after the data keeps the reads in bounds
+            const uint8_t *data_end = src.data() + src.size() - TRIANGLE_CODEAUX_SIZE;
+            const uint8_t *codeaux_table = data_end;
+
+            TriangleFifos fifos;
+            uint32_t next = 0;
+            uint32_t last = 0;
+            for (size_t i = 0; i < index_count; i += 3) {
+                if (data > data_end)
+                    Logger::panic("Truncated meshopt triangle stream");
+                const uint8_t code = codes[i / 3];
+                uint32_t a, b, c;
+                if (code < 0xf0) {
+                    // the triangle shares an edge from the fifo, the third vertex is new, in the fifo or free
+                    const auto &edge = fifos.edge(code >> 4);
+                    a = edge[0];
+                    b = edge[1];
+                    const uint32_t fec = code & 15;
+                    if (fec < fifo_codes) {
+                        c = fec == 0 ? next++ : fifos.vertex(fec);
+                        fifos.pushVertex(c, fec == 0);
+                    } else {
+                        // 13 and 14 decode to -1 and +1
+                        c = last = fec == 15 ? last + unzigzag32(decode_varint(data)) : last + (fec == 13 ? -1 : 1);
+                        fifos.pushVertex(c);
+                    }
+                    fifos.pushEdge(c, b);
+                    fifos.pushEdge(a, c);
+                } else {
+                    // no shared edge. a is new or free, b and c are new, in the fifo or free
+                    uint32_t codeaux;
+                    uint32_t fea = 0;
+                    if (code < 0xfe) {
+                        codeaux = codeaux_table[code & 15];
+                    } else {
+                        codeaux = *data++;
+                        fea = code == 0xfe ? 0 : 15;
+                        // a zero codeaux that isn't from the table restarts the new vertices
+                        if (codeaux == 0)
+                            next = 0;
+                    }
+                    const uint32_t feb = codeaux >> 4;
+                    const uint32_t fec = codeaux & 15;
+                    // new vertices are numbered in order before the free ones are read
+                    a = fea == 0 ? next++ : 0;
+                    b = feb == 0 ? next++ : fifos.vertex(feb - 1);
+                    c = fec == 0 ? next++ : fifos.vertex(fec - 1);
+                    if (fea == 15)
+                        last = a = last + unzigzag32(decode_varint(data));
+                    if (feb == 15)
+                        last = b = last + unzigzag32(decode_varint(data));
+                    if (fec == 15)
+                        last = c = last + unzigzag32(decode_varint(data));
+
+                    fifos.pushVertex(a);
+                    fifos.pushVertex(b, feb == 0 || feb == 15);
+                    fifos.pushVertex(c, fec == 0 || fec == 15);
+                    fifos.pushEdge(b, a);
+                    fifos.pushEdge(c, b);
+                    fifos.pushEdge(a, c);
+                }
+                write_index(dst, i + 0, index_size, a);
+                write_index(dst, i + 1, index_size, b);
+                write_index(dst, i + 2, index_size, c);
+            }
+            if (data != data_end)
+                Logger::panic("meshopt triangle stream has trailing bytes");
+        }
+
+        void decode_sequence(std::span<const uint8_t> src, size_t index_count, size_t index_size, uint8_t *dst) {
+            if (src.size() < 1 + index_count + SEQUENCE_TAIL_SIZE || (src[0] & 0xf0) != SEQUENCE_HEADER)
+                Logger::panic("Invalid meshopt index sequence");
+            const int version = src[0] & 0x0f;
+            if (version > 1)
+                Logger::panic(std::format("Unsupported meshopt sequence codec version {}", version));
+
+            const uint8_t *data = src.data() + 1;
+            const uint8_t *data_end = src.data() + src.size() - SEQUENCE_TAIL_SIZE;
+            // deltas are relative to one of two baselines, the low bit picks it
+            std::array<uint32_t, 2> last = {};
+            for (size_t i = 0; i < index_count; i++) {
+                if (data >= data_end)
+                    Logger::panic("Truncated meshopt index sequence");
+                const uint32_t value = decode_varint(data);
+                const uint32_t baseline = value & 1;
+                last[baseline] += unzigzag32(value >> 1);
+                write_index(dst, i, index_size, last[baseline]);
+            }
+            if (data != data_end)
+                Logger::panic("meshopt index sequence has trailing bytes");
+        }
+
+        int rounded(float value) { return static_cast<int>(value + (value >= 0.0f ? 0.5f : -0.5f)); }
+
+        // Unit vectors as octahedral x and y, z holds the value that represents 1. w is kept as is.
+        template<typename T>
+        void filter_octahedral(uint8_t *data, size_t count) {
+            constexpr auto max = static_cast<float>((1 << (sizeof(T) * 8 - 1)) - 1);
+            for (size_t i = 0; i < count; i++) {
+                std::array<T, 4> v;
+                std::memcpy(v.data(), data + i * sizeof(v), sizeof(v));
+                float x = v[0];
+                float y = v[1];
+                const float z = static_cast<float>(v[2]) - std::abs(x) - std::abs(y);
+                // fold the lower hemisphere back
+                const float t = std::min(z, 0.0f);
+                x += x >= 0.0f ? t : -t;
+                y += y >= 0.0f ? t : -t;
+                const float scale = max / std::sqrt(x * x + y * y + z * z);
+                v[0] = static_cast<T>(rounded(x * scale));
+                v[1] = static_cast<T>(rounded(y * scale));
+                v[2] = static_cast<T>(rounded(z * scale));
+                std::memcpy(data + i * sizeof(v), v.data(), sizeof(v));
+            }
+        }
+
+        // Unit quaternions as their three smallest components, the low two bits of w pick the dropped one and the
+        // rest of w is the scale of the other three
+        void filter_quaternion(uint8_t *data, size_t count) {
+            const float scale = 1.0f / std::sqrt(2.0f);
+            for (size_t i = 0; i < count; i++) {
+                std::array<int16_t, 4> v;
+                std::memcpy(v.data(), data + i * sizeof(v), sizeof(v));
+                const float component_scale = scale / static_cast<float>(v[3] | 3);
+                const float x = v[0] * component_scale;
+                const float y = v[1] * component_scale;
+                const float z = v[2] * component_scale;
+                const float w = std::sqrt(std::max(1.0f - x * x - y * y - z * z, 0.0f));
+                const int dropped = v[3] & 3;
+                std::array<int16_t, 4> q;
+                q[(dropped + 1) & 3] = static_cast<int16_t>(rounded(x * 32767.0f));
+                q[(dropped + 2) & 3] = static_cast<int16_t>(rounded(y * 32767.0f));
+                q[(dropped + 3) & 3] = static_cast<int16_t>(rounded(z * 32767.0f));
+                q[dropped] = static_cast<int16_t>(rounded(w * 32767.0f));
+                std::memcpy(data + i * sizeof(q), q.data(), sizeof(q));
+            }
+        }
+
+        // Floats as a 24-bit signed mantissa and an 8-bit signed exponent
+        void filter_exponential(uint8_t *data, size_t count) {
+            for (size_t i = 0; i < count; i++) {
+                uint32_t v;
+                std::memcpy(&v, data + i * sizeof(v), sizeof(v));
+                const int32_t mantissa = static_cast<int32_t>(v << 8) >> 8;
+                const int32_t exponent = static_cast<int32_t>(v) >> 24;
+                const float value = std::ldexp(static_cast<float>(mantissa), exponent);
+                std::memcpy(data + i * sizeof(value), &value, sizeof(value));
+            }
+        }
+    } // namespace
+
+    void decodeMeshopt(
+            const doc::MeshoptCompression &compression, std::span<const uint8_t> src, std::span<uint8_t> dst
+    ) {
+        const size_t count = compression.count;
+        const size_t stride = compression.byteStride;
+        if (dst.size() != count * stride)
+            Logger::panic("meshopt destination must hold count * byteStride bytes");
+        if (count == 0)
+            return;
+
+        using Mode = doc::MeshoptMode;
+        using Filter = doc::MeshoptFilter;
+        if (compression.mode == Mode::Attributes) {
+            decode_vertices(src, count, stride, dst.data());
+        } else {
+            if (stride != 2 && stride != 4)
+                Logger::panic("meshopt indices must be 16 or 32-bit");
+            if (compression.filter != Filter::None)
+                Logger::panic("meshopt filters only apply to attributes");
+            if (compression.mode == Mode::Triangles)
+                decode_triangles(src, count, stride, dst.data());
+            else
+                decode_sequence(src, count, stride, dst.data());
+        }
+
+        switch (compression.filter) {
+            case Filter::None:
+                break;
+            case Filter::Octahedral:
+                if (stride != 4 && stride != 8)
+                    Logger::panic("meshopt octahedral filter needs a stride of 4 or 8");
+                if (stride == 4)
+                    filter_octahedral<int8_t>(dst.data(), count);
+                else
+                    filter_octahedral<int16_t>(dst.data(), count);
+                break;
+            case Filter::Quaternion:
+                if (stride != 8)
+                    Logger::panic("meshopt quaternion filter needs a stride of 8");
+                filter_quaternion(dst.data(), count);
+                break;
+            case Filter::Exponential:
+                filter_exponential(dst.data(), count * stride / sizeof(uint32_t));
+                break;
+        }
+    }
+} // namespace gltf
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+
+#include "Glb.h"
+
+namespace gltf {
+    /**
+     * Decodes a buffer view compressed with EXT_meshopt_compression: the vertex codec for attributes, the triangle
+     * codec for triangle lists and the sequence codec for other indices, followed by the view's filter.
+     * @param src the compressed bytes, byteLength bytes at byteOffset of the compression's buffer
+     * @param dst must hold exactly count * byteStride bytes
+     */
+    void decodeMeshopt(
+            const doc::MeshoptCompression &compression, std::span<const uint8_t> src, std::span<uint8_t> dst
+    );
+} // namespace gltf
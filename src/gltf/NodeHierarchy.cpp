@@ -0,0 +1,97 @@
+#include "NodeHierarchy.h"
+
+#include <algorithm>
+#include <atomic>
+#include <glm/gtc/quaternion.hpp>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define GLTF_TRANSFORM_SSE2
+#include <xmmintrin.h>
+#endif
+
+#include "../util/thread_pool.h"
+#include "Bounds.h"
+#include "Gltf.h"
+
+namespace gltf {
+    namespace {
+        // smaller levels are not worth waking up the pool for
+        constexpr size_t PARALLEL_GRAIN = 1024;
+
+        glm::mat4 compose_transform(const glm::vec3 &translation, const glm::quat &rotation, const glm::vec3 &scale) {
+            glm::mat4 result = glm::mat4_cast(rotation);
+            result[0] *= scale.x;
+            result[1] *= scale.y;
+            result[2] *= scale.z;
+            result[3] = glm::vec4(translation, 1.0f);
+            return result;
+        }
+
+        // result = a * b for column major matrices, every result column is a linear combination of a's columns
+        void multiply_transforms(const glm::mat4 &a, const glm::mat4 &b, glm::mat4 &result) {
+#ifdef GLTF_TRANSFORM_SSE2
+            const __m128 a0 = _mm_loadu_ps(&a[0][0]);
+            const __m128 a1 = _mm_loadu_ps(&a[1][0]);
+            const __m128 a2 = _mm_loadu_ps(&a[2][0]);
+            const __m128 a3 = _mm_loadu_ps(&a[3][0]);
+            for (int column = 0; column < 4; column++) {
+                const __m128 b_column = _mm_loadu_ps(&b[column][0]);
+                __m128 sum = _mm_mul_ps(a0, _mm_shuffle_ps(b_column, b_column, _MM_SHUFFLE(0, 0, 0, 0)));
+                sum = _mm_add_ps(sum, _mm_mul_ps(a1, _mm_shuffle_ps(b_column, b_column, _MM_SHUFFLE(1, 1, 1, 1))));
+                sum = _mm_add_ps(sum, _mm_mul_ps(a2, _mm_shuffle_ps(b_column, b_column, _MM_SHUFFLE(2, 2, 2, 2))));
+                sum = _mm_add_ps(sum, _mm_mul_ps(a3, _mm_shuffle_ps(b_column, b_column, _MM_SHUFFLE(3, 3, 3, 3))));
+                _mm_storeu_ps(&result[column][0], sum);
+            }
+#else
+            result = a * b;
+#endif
+        }
+    } // namespace
+
+    size_t updateWorldTransforms(NodeHierarchy &nodes, bool parallel) {
+        std::ranges::fill(nodes.moved, uint8_t{0});
+        if (std::ranges::none_of(nodes.dirty, [](uint8_t dirty) { return dirty != 0; }))
+            return 0;
+
+        std::atomic<size_t> updated = 0;
+        for (size_t level = 0; level + 1 < nodes.levelOffsets.size(); level++) {
+            const size_t level_begin = nodes.levelOffsets[level];
+            const size_t level_end = nodes.levelOffsets[level + 1];
+            // the parents are all on the previous level, which is done, so the nodes of a level are independent
+            const auto update_nodes = [&](size_t begin, size_t end) {
+                size_t count = 0;
+                for (size_t i = level_begin + begin; i < level_begin + end; i++) {
+                    const int32_t parent = nodes.parents[i];
+                    if (!nodes.dirty[i] && (parent < 0 || !nodes.moved[parent]))
+                        continue;
+                    const glm::mat4 local =
+                            compose_transform(nodes.translations[i], nodes.rotations[i], nodes.scales[i]);
+                    if (parent < 0)
+                        nodes.worldMatrices[i] = local;
+                    else
+                        multiply_transforms(nodes.worldMatrices[parent], local, nodes.worldMatrices[i]);
+                    nodes.dirty[i] = false;
+                    nodes.moved[i] = true;
+                    count++;
+                }
+                updated += count;
+            };
+            if (parallel)
+                util::parallel_for(level_end - level_begin, PARALLEL_GRAIN, update_nodes);
+            else
+                update_nodes(0, level_end - level_begin);
+        }
+        return updated;
+    }
+
+    void updateInstanceTransforms(SceneData &scene_data) {
+        const auto &nodes = scene_data.nodes;
+        for (size_t i = 0; i < scene_data.instances.size(); i++) {
+            auto &instance = scene_data.instances[i];
+            if (!nodes.moved[instance.node])
+                continue;
+            instance.transformation = nodes.worldMatrices[instance.node];
+            updateInstanceBounds(scene_data, i);
+        }
+    }
+} // namespace gltf
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstddef>
+
+namespace gltf {
+    struct NodeHierarchy;
+    struct SceneData;
+
+    /**
+     * Recomputes the world matrices of the dirty nodes and of everything below them, one depth level after the other.
+     * Clears the dirty flags and flags exactly the recomputed nodes as moved.
+     * @param parallel split large levels across the global thread pool
+     * @return the number of recomputed nodes
+     */
+    size_t updateWorldTransforms(NodeHierarchy &nodes, bool parallel = true);
+
+    // Copies the world matrices of the moved nodes to their instances and updates the instances' bounds
+    void updateInstanceTransforms(SceneData &scene_data);
+} // namespace gltf
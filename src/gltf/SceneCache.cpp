@@ -0,0 +1,353 @@
+#include "SceneCache.h"
+
+#include <array>
+#include <bit>
+#include <cstring>
+#include <format>
+#include <fstream>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+#include "../Image.h"
+#include "../Logger.h"
+#include "Glb.h"
+
+namespace gltf {
+    namespace {
+        constexpr uint32_t CACHE_MAGIC = 0x4E435347; // "GSCN"
+        // blobs start on page boundaries, so they can be mapped and uploaded without touching their neighbours
+        constexpr uint64_t CACHE_ALIGNMENT = 4096;
+
+        enum Section : uint32_t {
+            PositionSection,
+            NormalSection,
+            TangentSection,
+            TexcoordSection,
+            IndexSection,
+            MaterialSection,
+            PrimitiveSection,
+            InstanceSection,
+            NodeParentSection,
+            NodeTranslationSection,
+            NodeRotationSection,
+            NodeScaleSection,
+            NodeWorldMatrixSection,
+            NodeLevelSection,
+            MeshletSection,
+            MeshletVertexSection,
+            MeshletTriangleSection,
+            PrimitiveAabbMinSection,
+            PrimitiveAabbMaxSection,
+            PrimitiveSphereSection,
+            InstanceAabbMinSection,
+            InstanceAabbMaxSection,
+            InstanceSphereSection,
+            // table of ImageEntry, the pixels are in blobs of their own
+            ImageSection,
+            SectionCount,
+        };
+
+        struct Blob {
+            uint64_t offset = 0;
+            uint64_t size = 0;
+        };
+
+        struct CacheHeader {
+            uint32_t magic = CACHE_MAGIC;
+            uint32_t version = SCENE_CACHE_VERSION;
+            uint64_t key = 0;
+            uint64_t indexCount = 0;
+            uint64_t vertexCount = 0;
+            VertexFormat vertexFormat = VertexFormat::Float;
+            uint32_t sectionCount = SectionCount;
+            std::array<Blob, SectionCount> sections = {};
+        };
+
+        struct ImageEntry {
+            uint32_t width = 0;
+            uint32_t height = 0;
+            vk::Format format = vk::Format::eUndefined;
+            uint32_t mipLevels = 1;
+            // empty for texture slots without an image
+            Blob pixels = {};
+        };
+
+        static_assert(std::is_trivially_copyable_v<Material>);
+        static_assert(std::is_trivially_copyable_v<Primitive>);
+        static_assert(std::is_trivially_copyable_v<Instance>);
+        static_assert(std::is_trivially_copyable_v<Meshlet>);
+
+        constexpr uint64_t PRIME_1 = 0x9E3779B185EBCA87ull;
+        constexpr uint64_t PRIME_2 = 0xC2B2AE3D27D4EB4Full;
+        constexpr uint64_t PRIME_3 = 0x165667B19E3779F9ull;
+
+        uint64_t hash_round(uint64_t accumulator, uint64_t value) {
+            return std::rotl(accumulator + value * PRIME_2, 31) * PRIME_1;
+        }
+
+        uint64_t read_u64(const uint8_t *bytes) {
+            uint64_t value;
+            std::memcpy(&value, bytes, sizeof(value));
+            return value;
+        }
+
+        // Four independent lanes of multiply-rotate rounds, so the multiplications overlap. Runs at memory speed,
+        // which matters because every start hashes the whole source file.
+        uint64_t hash_bytes(std::span<const uint8_t> bytes) {
+            std::array<uint64_t, 4> lanes = {PRIME_1 + PRIME_2, PRIME_2, 0, -PRIME_1};
+            size_t i = 0;
+            for (; i + 32 <= bytes.size(); i += 32) {
+                for (size_t lane = 0; lane < 4; lane++)
+                    lanes[lane] = hash_round(lanes[lane], read_u64(bytes.data() + i + lane * 8));
+            }
+            uint64_t hash = std::rotl(lanes[0], 1) + std::rotl(lanes[1], 7) + std::rotl(lanes[2], 12) +
+                            std::rotl(lanes[3], 18) + bytes.size();
+            for (; i + 8 <= bytes.size(); i += 8)
+                hash = std::rotl(hash ^ hash_round(0, read_u64(bytes.data() + i)), 27) * PRIME_1 + PRIME_3;
+            for (; i < bytes.size(); i++)
+                hash = std::rotl(hash ^ (bytes[i] * PRIME_3), 11) * PRIME_1;
+
+            hash ^= hash >> 33;
+            hash *= PRIME_2;
+            hash ^= hash >> 29;
+            hash *= PRIME_3;
+            hash ^= hash >> 32;
+            return hash;
+        }
+
+        class CacheWriter {
+            std::ofstream out_;
+            uint64_t offset_ = 0;
+
+        public:
+            explicit CacheWriter(const std::filesystem::path &path) : out_(path, std::ios::binary | std::ios::trunc) {}
+
+            [[nodiscard]] bool good() const { return out_.good(); }
+
+            void write(const void *data, size_t size) {
+                out_.write(static_cast<const char *>(data), static_cast<std::streamsize>(size));
+                offset_ += size;
+            }
+
+            void seekStart() { out_.seekp(0); }
+
+            Blob writeBlob(const void *data, size_t size) {
+                static constexpr std::array<char, CACHE_ALIGNMENT> zeros = {};
+                write(zeros.data(), (CACHE_ALIGNMENT - offset_ % CACHE_ALIGNMENT) % CACHE_ALIGNMENT);
+                Blob blob = {.offset = offset_, .size = size};
+                write(data, size);
+                return blob;
+            }
+
+            template<typename T>
+            Blob writeBlob(const std::vector<T> &values) {
+                return writeBlob(values.data(), values.size() * sizeof(T));
+            }
+        };
+
+        // Views the blob as an array of T, empty if it is out of bounds or not a whole number of elements
+        template<typename T>
+        std::optional<std::span<const T>> blob_span(const MappedFile &file, const Blob &blob) {
+            if (blob.offset > file.size() || blob.size > file.size() - blob.offset || blob.size % sizeof(T) != 0 ||
+                blob.offset % alignof(T) != 0)
+                return std::nullopt;
+            return std::span(reinterpret_cast<const T *>(file.bytes().data() + blob.offset), blob.size / sizeof(T));
+        }
+
+        template<typename T>
+        bool copy_blob(const MappedFile &file, const Blob &blob, std::vector<T> &dst) {
+            auto src = blob_span<T>(file, blob);
+            if (!src)
+                return false;
+            dst.assign(src->begin(), src->end());
+            return true;
+        }
+
+        // The three sections of the bounds starting at first, which must all have the same length
+        bool copy_bounds(
+                const MappedFile &file, const std::array<Blob, SectionCount> &sections, Section first, Bounds &bounds
+        ) {
+            return copy_blob(file, sections[first], bounds.aabbMins) &&
+                   copy_blob(file, sections[first + 1], bounds.aabbMaxs) &&
+                   copy_blob(file, sections[first + 2], bounds.spheres) && bounds.aabbMins.size() == bounds.size() &&
+                   bounds.aabbMaxs.size() == bounds.size();
+        }
+    } // namespace
+
+    uint64_t sceneCacheKey(std::span<const uint8_t> source, const LoadOptions &options) {
+        // options.parallel doesn't change the result
+        const auto &gpu_formats = options.gpuMipmapFormats;
+        const uint64_t gpu_formats_hash = hash_bytes(std::span(
+                reinterpret_cast<const uint8_t *>(gpu_formats.data()), gpu_formats.size() * sizeof(vk::Format)
+        ));
+        const std::array<uint64_t, 11> parameters = {
+            SCENE_CACHE_VERSION, static_cast<uint64_t>(options.vertexFormat),
+            options.compressTextures, options.ktx2Textures,
+            gpu_formats_hash,    options.gpuMipmapMaxSize,
+            sizeof(Material),    sizeof(Primitive),
+            sizeof(Instance),    sizeof(Meshlet),
+            hash_bytes(source),
+        };
+        return hash_bytes(std::span(reinterpret_cast<const uint8_t *>(parameters.data()), sizeof(parameters)));
+    }
+
+    std::optional<SceneData> readSceneCache(const std::filesystem::path &path, uint64_t key) {
+        std::error_code error;
+        if (!std::filesystem::is_regular_file(path, error))
+            return std::nullopt;
+
+        // the image pixels are uploaded straight from the mapping, copy on write lets them be used as mutable images
+        auto file = std::make_shared<const MappedFile>(path, true);
+        CacheHeader header = {};
+        if (file->size() < sizeof(header))
+            return std::nullopt;
+        std::memcpy(&header, file->bytes().data(), sizeof(header));
+        if (header.magic != CACHE_MAGIC || header.version != SCENE_CACHE_VERSION || header.sectionCount != SectionCount)
+            return std::nullopt;
+        if (header.key != key) {
+            Logger::info(std::format("Scene cache {} is stale", path.string()));
+            return std::nullopt;
+        }
+
+        SceneData scene_data = {};
+        scene_data.index_count = header.indexCount;
+        scene_data.vertex_count = header.vertexCount;
+        scene_data.vertex_format = header.vertexFormat;
+        const auto &sections = header.sections;
+        const auto images = blob_span<ImageEntry>(*file, sections[ImageSection]);
+        bool valid = images && copy_blob(*file, sections[PositionSection], scene_data.vertex_position_data) &&
+                     copy_blob(*file, sections[NormalSection], scene_data.vertex_normal_data) &&
+                     copy_blob(*file, sections[TangentSection], scene_data.vertex_tangent_data) &&
+                     copy_blob(*file, sections[TexcoordSection], scene_data.vertex_texcoord_data) &&
+                     copy_blob(*file, sections[IndexSection], scene_data.index_data) &&
+                     copy_blob(*file, sections[MaterialSection], scene_data.materials) &&
+                     copy_blob(*file, sections[PrimitiveSection], scene_data.primitives) &&
+                     copy_blob(*file, sections[InstanceSection], scene_data.instances) &&
+                     copy_blob(*file, sections[NodeParentSection], scene_data.nodes.parents) &&
+                     copy_blob(*file, sections[NodeTranslationSection], scene_data.nodes.translations) &&
+                     copy_blob(*file, sections[NodeRotationSection], scene_data.nodes.rotations) &&
+                     copy_blob(*file, sections[NodeScaleSection], scene_data.nodes.scales) &&
+                     copy_blob(*file, sections[NodeWorldMatrixSection], scene_data.nodes.worldMatrices) &&
+                     copy_blob(*file, sections[NodeLevelSection], scene_data.nodes.levelOffsets) &&
+                     copy_blob(*file, sections[MeshletSection], scene_data.meshlets) &&
+                     copy_blob(*file, sections[MeshletVertexSection], scene_data.meshlet_vertex_data) &&
+                     copy_blob(*file, sections[MeshletTriangleSection], scene_data.meshlet_triangle_data) &&
+                     copy_bounds(*file, sections, PrimitiveAabbMinSection, scene_data.primitive_bounds) &&
+                     copy_bounds(*file, sections, InstanceAabbMinSection, scene_data.instance_bounds);
+
+        const size_t node_count = scene_data.nodes.size();
+        valid = valid && scene_data.nodes.translations.size() == node_count &&
+                scene_data.nodes.rotations.size() == node_count && scene_data.nodes.scales.size() == node_count &&
+                scene_data.nodes.worldMatrices.size() == node_count &&
+                scene_data.primitive_bounds.size() == scene_data.primitives.size() &&
+                scene_data.instance_bounds.size() == scene_data.instances.size();
+        if (valid) {
+            // the world matrices are cached up to date
+            scene_data.nodes.dirty.assign(node_count, false);
+            scene_data.nodes.moved.assign(node_count, false);
+            scene_data.images.reserve(images->size());
+            for (const auto &entry: *images) {
+                auto &image = scene_data.images.emplace_back();
+                if (entry.pixels.size == 0)
+                    continue;
+                if (!blob_span<uint8_t>(*file, entry.pixels)) {
+                    valid = false;
+                    break;
+                }
+                image = {
+                    .format = entry.format,
+                    .decoded = file->writableBytes().subspan(entry.pixels.offset, entry.pixels.size),
+                    .width = entry.width,
+                    .height = entry.height,
+                    .mipLevels = entry.mipLevels,
+                };
+            }
+        }
+        if (!valid) {
+            Logger::warning(std::format("Scene cache {} is corrupted", path.string()));
+            return std::nullopt;
+        }
+
+        scene_data.backing_file = std::move(file);
+        return scene_data;
+    }
+
+    void writeSceneCache(const std::filesystem::path &path, uint64_t key, const SceneData &scene_data, bool parallel) {
+        std::error_code error;
+        if (path.has_parent_path())
+            std::filesystem::create_directories(path.parent_path(), error);
+
+        auto temp_path = path;
+        temp_path += ".tmp";
+        {
+            CacheWriter writer(temp_path);
+            CacheHeader header = {
+                .key = key,
+                .indexCount = scene_data.index_count,
+                .vertexCount = scene_data.vertex_count,
+                .vertexFormat = scene_data.vertex_format,
+            };
+            // the header is rewritten with the section offsets at the end
+            writer.write(&header, sizeof(header));
+
+            auto &sections = header.sections;
+            sections[PositionSection] = writer.writeBlob(scene_data.vertex_position_data);
+            sections[NormalSection] = writer.writeBlob(scene_data.vertex_normal_data);
+            sections[TangentSection] = writer.writeBlob(scene_data.vertex_tangent_data);
+            sections[TexcoordSection] = writer.writeBlob(scene_data.vertex_texcoord_data);
+            sections[IndexSection] = writer.writeBlob(scene_data.index_data);
+            sections[MaterialSection] = writer.writeBlob(scene_data.materials);
+            sections[PrimitiveSection] = writer.writeBlob(scene_data.primitives);
+            sections[InstanceSection] = writer.writeBlob(scene_data.instances);
+            sections[NodeParentSection] = writer.writeBlob(scene_data.nodes.parents);
+            sections[NodeTranslationSection] = writer.writeBlob(scene_data.nodes.translations);
+            sections[NodeRotationSection] = writer.writeBlob(scene_data.nodes.rotations);
+            sections[NodeScaleSection] = writer.writeBlob(scene_data.nodes.scales);
+            sections[NodeWorldMatrixSection] = writer.writeBlob(scene_data.nodes.worldMatrices);
+            sections[NodeLevelSection] = writer.writeBlob(scene_data.nodes.levelOffsets);
+            sections[MeshletSection] = writer.writeBlob(scene_data.meshlets);
+            sections[MeshletVertexSection] = writer.writeBlob(scene_data.meshlet_vertex_data);
+            sections[MeshletTriangleSection] = writer.writeBlob(scene_data.meshlet_triangle_data);
+            sections[PrimitiveAabbMinSection] = writer.writeBlob(scene_data.primitive_bounds.aabbMins);
+            sections[PrimitiveAabbMaxSection] = writer.writeBlob(scene_data.primitive_bounds.aabbMaxs);
+            sections[PrimitiveSphereSection] = writer.writeBlob(scene_data.primitive_bounds.spheres);
+            sections[InstanceAabbMinSection] = writer.writeBlob(scene_data.instance_bounds.aabbMins);
+            sections[InstanceAabbMaxSection] = writer.writeBlob(scene_data.instance_bounds.aabbMaxs);
+            sections[InstanceSphereSection] = writer.writeBlob(scene_data.instance_bounds.spheres);
+
+            // decodes lazy images a batch at a time, so they are never all in memory
+            std::vector<ImageEntry> images(scene_data.images.size());
+            forEachImage(
+                    scene_data,
+                    [&](size_t index, PlainImageData &image) {
+                        if (!image)
+                            return;
+                        images[index] = {
+                            .width = image.width,
+                            .height = image.height,
+                            .format = image.format,
+                            .mipLevels = image.mipLevels,
+                            .pixels = writer.writeBlob(image.pixels.data(), image.pixels.size_bytes()),
+                        };
+                    },
+                    parallel
+            );
+            sections[ImageSection] = writer.writeBlob(images);
+
+            writer.seekStart();
+            writer.write(&header, sizeof(header));
+            if (!writer.good()) {
+                Logger::warning(std::format("Failed to write scene cache {}", temp_path.string()));
+                std::filesystem::remove(temp_path, error);
+                return;
+            }
+        }
+
+        std::filesystem::rename(temp_path, path, error);
+        if (error) {
+            Logger::warning(std::format("Failed to replace scene cache {}: {}", path.string(), error.message()));
+            std::filesystem::remove(temp_path, error);
+        }
+    }
+} // namespace gltf
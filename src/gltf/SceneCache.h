@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <span>
+
+#include "Gltf.h"
+
+namespace gltf {
+    // Bump whenever the file layout or the way the cached data is made changes, the cached structs are covered by their
+    // sizes in the key
+    constexpr uint32_t SCENE_CACHE_VERSION = 5;
+
+    // Identifies the scene loaded from the source bytes with the options, everything that changes the result goes in
+    uint64_t sceneCacheKey(std::span<const uint8_t> source, const LoadOptions &options);
+
+    /**
+     * Maps a cache file written by writeSceneCache. Every blob in it starts on its own page.
+     * The streams and tables are copied out of the mapping, since the mesh passes modify them. The images are views
+     * into it, SceneData::backing_file keeps the mapping alive.
+     * @return nullopt if the file is missing, was written by another version or for another key
+     */
+    std::optional<SceneData> readSceneCache(const std::filesystem::path &path, uint64_t key);
+
+    /**
+     * Writes a temporary file next to path and renames it, failures are only logged since the cache is optional.
+     * Decodes the lazy images.
+     * @param parallel decode the images concurrently on the global thread pool
+     */
+    void writeSceneCache(
+            const std::filesystem::path &path, uint64_t key, const SceneData &scene_data, bool parallel = true
+    );
+} // namespace gltf
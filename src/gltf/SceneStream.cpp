@@ -0,0 +1,121 @@
+#include "SceneStream.h"
+
+#include <chrono>
+#include <utility>
+
+namespace gltf {
+    namespace {
+        // how long a stage sleeps while the queue it waits on is full or empty
+        constexpr auto STAGE_BACKOFF = std::chrono::milliseconds(1);
+
+        // Retries until the queue has room, false if the stage was stopped first
+        template<typename T>
+        bool push(const std::stop_token &stop, util::SpscQueue<T> &queue, T &&value) {
+            while (!queue.tryPush(std::move(value))) {
+                if (stop.stop_requested())
+                    return false;
+                std::this_thread::sleep_for(STAGE_BACKOFF);
+            }
+            return true;
+        }
+
+        // Retries until the queue has an item, nothing if the stage was stopped first
+        template<typename T>
+        std::optional<T> pop(const std::stop_token &stop, util::SpscQueue<T> &queue) {
+            while (!stop.stop_requested()) {
+                if (auto item = queue.tryPop())
+                    return item;
+                std::this_thread::sleep_for(STAGE_BACKOFF);
+            }
+            return std::nullopt;
+        }
+    } // namespace
+
+    SceneStream::SceneStream(std::filesystem::path path, LoadOptions options, Process process) {
+        parser_ = std::jthread(
+                [this, path = std::move(path), options, process = std::move(process)](std::stop_token stop) {
+                    parse(std::move(stop), path, options, process);
+                }
+        );
+        decoder_ = std::jthread([this, parallel = options.parallel](std::stop_token stop) {
+            decode(std::move(stop), parallel);
+        });
+    }
+
+    std::optional<SceneData> SceneStream::pollScene() {
+        rethrowError();
+        return scenes_.tryPop();
+    }
+
+    std::optional<StreamedTexture> SceneStream::pollTexture() {
+        rethrowError();
+        return textures_.tryPop();
+    }
+
+    bool SceneStream::finished() const {
+        // the last texture was pushed before decoded_ was set, so an empty queue after it is final
+        return decoded_.load(std::memory_order_acquire) && textures_.empty();
+    }
+
+    void SceneStream::parse(
+            std::stop_token stop, const std::filesystem::path &path, const LoadOptions &options,
+            const Process &process
+    ) {
+        runStage([&] {
+            SceneData scene_data = load(path, options);
+
+            // process may change everything but the textures, so the decode stage gets its own copy of them
+            auto texture_source = std::make_shared<SceneData>();
+            texture_source->images = scene_data.images;
+            texture_source->backing_file = scene_data.backing_file;
+            texture_source->source_file = scene_data.source_file;
+            if (!push(stop, textureSources_, std::shared_ptr<const SceneData>(std::move(texture_source))))
+                return;
+
+            if (process)
+                process(scene_data);
+            push(stop, scenes_, std::move(scene_data));
+        });
+    }
+
+    void SceneStream::decode(std::stop_token stop, bool parallel) {
+        runStage([&] {
+            const auto source = pop(stop, textureSources_);
+            if (!source)
+                return;
+            const SceneData &scene_data = **source;
+
+            // the textures are handed on as soon as their batch is done
+            forEachImage(
+                    scene_data,
+                    [&](size_t index, PlainImageData &image) {
+                        if (!image.pixels.empty())
+                            push(stop, textures_, StreamedTexture{index, std::exchange(image, {})});
+                    },
+                    parallel, stop
+            );
+            if (stop.stop_requested())
+                return;
+            decoded_.store(true, std::memory_order_release);
+        });
+    }
+
+    template<typename F>
+    void SceneStream::runStage(F &&stage) {
+        try {
+            stage();
+        } catch (...) {
+            std::lock_guard lock(errorMutex_);
+            if (!error_)
+                error_ = std::current_exception();
+            failed_.store(true, std::memory_order_release);
+        }
+    }
+
+    void SceneStream::rethrowError() {
+        if (!failed_.load(std::memory_order_acquire))
+            return;
+        std::lock_guard lock(errorMutex_);
+        std::rethrow_exception(error_);
+    }
+} // namespace gltf
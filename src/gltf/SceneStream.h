@@ -0,0 +1,88 @@
+#pragma once
+
+#include <atomic>
+#include <exception>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stop_token>
+#include <thread>
+
+#include "../Image.h"
+#include "../util/spsc_queue.h"
+#include "Gltf.h"
+
+namespace gltf {
+    // A texture of SceneData::images that the decode stage materialized
+    struct StreamedTexture {
+        size_t index = 0;
+        PlainImageData image;
+    };
+
+    /**
+     * Loads a scene in the background, so the caller can keep rendering while it fills in. The pipeline has three
+     * overlapping stages connected by bounded lock-free queues:
+     * - parse: loads the file and runs process on it, e.g. the mesh passes
+     * - decode: materializes the textures, it starts as soon as the file is loaded and runs alongside process
+     * - upload: the caller, it polls the processed scene and then the textures as they land
+     * A full queue holds back the stage feeding it, so at most a queue's worth of decoded textures is in memory.
+     */
+    class SceneStream {
+    public:
+        using Process = std::function<void(SceneData &)>;
+
+        SceneStream(std::filesystem::path path, LoadOptions options, Process process = {});
+
+        // Stops the stages, waiting for the step they are in to finish, e.g. loading the file or decoding a batch
+        ~SceneStream() = default;
+
+        SceneStream(const SceneStream &other) = delete;
+
+        SceneStream &operator=(const SceneStream &other) = delete;
+
+        // The loaded and processed scene, exactly once. Rethrows the exception of a failed stage.
+        std::optional<SceneData> pollScene();
+
+        // The next decoded texture, unused textures are skipped. Rethrows the exception of a failed stage.
+        std::optional<StreamedTexture> pollTexture();
+
+        // Every texture has been polled
+        [[nodiscard]] bool finished() const;
+
+    private:
+        // the decoded textures waiting for the upload, they are large
+        static constexpr size_t TEXTURE_QUEUE_CAPACITY = 8;
+
+        // the image descriptions and the files they decode from, parse -> decode
+        util::SpscQueue<std::shared_ptr<const SceneData>> textureSources_{1};
+        // parse -> upload
+        util::SpscQueue<SceneData> scenes_{1};
+        // decode -> upload
+        util::SpscQueue<StreamedTexture> textures_{TEXTURE_QUEUE_CAPACITY};
+        // the decode stage pushed its last texture
+        std::atomic<bool> decoded_ = false;
+
+        std::atomic<bool> failed_ = false;
+        std::mutex errorMutex_;
+        std::exception_ptr error_;
+
+        // last, so they are stopped and joined before the queues go away
+        std::jthread parser_;
+        std::jthread decoder_;
+
+        void parse(
+                std::stop_token stop, const std::filesystem::path &path, const LoadOptions &options,
+                const Process &process
+        );
+
+        void decode(std::stop_token stop, bool parallel);
+
+        // Runs the stage and keeps its exception for the caller, the other stages are stopped with the stream
+        template<typename F>
+        void runStage(F &&stage);
+
+        void rethrowError();
+    };
+} // namespace gltf
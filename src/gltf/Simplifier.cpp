@@ -0,0 +1,343 @@
+#include "Simplifier.h"
+
+#include <algorithm>
+#include <cmath>
+#include <format>
+#include <glm/geometric.hpp>
+#include <limits>
+#include <numeric>
+#include <span>
+#include <vector>
+
+#include "../Logger.h"
+#include "../util/thread_pool.h"
+#include "Bounds.h"
+
+namespace gltf {
+    namespace {
+        // Sum of squared distances to a set of planes, weighted by the area of the triangles they came from
+        struct Quadric {
+            // symmetric 3x3 matrix
+            double a00 = 0.0, a01 = 0.0, a02 = 0.0, a11 = 0.0, a12 = 0.0, a22 = 0.0;
+            double b0 = 0.0, b1 = 0.0, b2 = 0.0;
+            double c = 0.0;
+            // total area, turns the sum back into a mean squared distance
+            double weight = 0.0;
+
+            static Quadric fromTriangle(glm::vec3 p0, glm::vec3 p1, glm::vec3 p2) {
+                const glm::dvec3 cross = glm::cross(glm::dvec3(p1 - p0), glm::dvec3(p2 - p0));
+                const double length = glm::length(cross);
+                if (length <= 0.0)
+                    return {};
+                const glm::dvec3 n = cross / length;
+                const double d = -glm::dot(n, glm::dvec3(p0));
+                const double w = length * 0.5;
+                return {
+                    .a00 = w * n.x * n.x,
+                    .a01 = w * n.x * n.y,
+                    .a02 = w * n.x * n.z,
+                    .a11 = w * n.y * n.y,
+                    .a12 = w * n.y * n.z,
+                    .a22 = w * n.z * n.z,
+                    .b0 = w * d * n.x,
+                    .b1 = w * d * n.y,
+                    .b2 = w * d * n.z,
+                    .c = w * d * d,
+                    .weight = w,
+                };
+            }
+
+            Quadric &operator+=(const Quadric &other) {
+                a00 += other.a00, a01 += other.a01, a02 += other.a02;
+                a11 += other.a11, a12 += other.a12, a22 += other.a22;
+                b0 += other.b0, b1 += other.b1, b2 += other.b2;
+                c += other.c;
+                weight += other.weight;
+                return *this;
+            }
+
+            Quadric operator+(const Quadric &other) const {
+                Quadric result = *this;
+                return result += other;
+            }
+
+            // mean squared distance of the point to the planes
+            [[nodiscard]] double error(glm::vec3 point) const {
+                if (weight <= 0.0)
+                    return 0.0;
+                const double x = point.x, y = point.y, z = point.z;
+                const double cost = a00 * x * x + a11 * y * y + a22 * z * z +
+                                    2.0 * (a01 * x * y + a02 * x * z + a12 * y * z) + 2.0 * (b0 * x + b1 * y + b2 * z) +
+                                    c;
+                return std::max(0.0, cost / weight);
+            }
+        };
+
+        /**
+         * Half edge collapse simplifier, a vertex is always merged into one of its neighbours.
+         * Every pass collects the edges of the current triangles, sorts them by error and collapses as many
+         * independent ones as possible. Collapses that flip a triangle are rejected.
+         */
+        class Simplifier {
+            std::span<const glm::vec3> positions_;
+            std::vector<Quadric> quadrics_;
+            std::vector<bool> locked_;
+            std::vector<uint32_t> indices_;
+            double squaredError_ = 0.0;
+
+            static uint64_t edge_key(uint32_t a, uint32_t b) {
+                return static_cast<uint64_t>(std::min(a, b)) << 32 | std::max(a, b);
+            }
+
+            [[nodiscard]] std::vector<uint64_t> collectEdges() const {
+                std::vector<uint64_t> edges;
+                edges.reserve(indices_.size());
+                for (size_t t = 0; t < indices_.size(); t += 3) {
+                    for (size_t k = 0; k < 3; k++) {
+                        const uint32_t a = indices_[t + k];
+                        const uint32_t b = indices_[t + (k + 1) % 3];
+                        if (a != b)
+                            edges.push_back(edge_key(a, b));
+                    }
+                }
+                std::ranges::sort(edges);
+                return edges;
+            }
+
+            [[nodiscard]] bool flips(std::span<const uint32_t> triangles, uint32_t from, uint32_t to) const {
+                for (const uint32_t t: triangles) {
+                    const uint32_t *triangle = &indices_[t * 3];
+                    if (triangle[0] == to || triangle[1] == to || triangle[2] == to)
+                        continue; // collapses to a degenerate triangle
+                    glm::vec3 p[3];
+                    glm::vec3 q[3];
+                    for (int k = 0; k < 3; k++) {
+                        p[k] = positions_[triangle[k]];
+                        q[k] = positions_[triangle[k] == from ? to : triangle[k]];
+                    }
+                    const glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+                    const glm::vec3 after = glm::cross(q[1] - q[0], q[2] - q[0]);
+                    // also rejects triangles that turn by more than ~75 degrees, they are close to flipping
+                    if (glm::dot(before, after) <= 0.25f * glm::length(before) * glm::length(after))
+                        return true;
+                }
+                return false;
+            }
+
+        public:
+            Simplifier(std::span<const glm::vec3> positions, std::vector<uint32_t> indices)
+                : positions_(positions), quadrics_(positions.size()), locked_(positions.size(), false),
+                  indices_(std::move(indices)) {
+                for (size_t t = 0; t < indices_.size(); t += 3) {
+                    const Quadric quadric = Quadric::fromTriangle(
+                            positions_[indices_[t]], positions_[indices_[t + 1]], positions_[indices_[t + 2]]
+                    );
+                    for (size_t k = 0; k < 3; k++)
+                        quadrics_[indices_[t + k]] += quadric;
+                }
+
+                // Edges without exactly two triangles are borders, which include attribute seams since the vertices
+                // are split there. Moving their vertices would open cracks.
+                const auto edges = collectEdges();
+                for (size_t i = 0; i < edges.size();) {
+                    size_t end = i + 1;
+                    while (end < edges.size() && edges[end] == edges[i])
+                        end++;
+                    if (end - i != 2) {
+                        locked_[edges[i] >> 32] = true;
+                        locked_[edges[i] & 0xffffffff] = true;
+                    }
+                    i = end;
+                }
+            }
+
+            [[nodiscard]] const std::vector<uint32_t> &indices() const { return indices_; }
+
+            // largest collapse error so far, as distance
+            [[nodiscard]] float error() const { return static_cast<float>(std::sqrt(squaredError_)); }
+
+            // Collapses edges until at most target_index_count indices are left or none within max_error is possible
+            void simplify(size_t target_index_count, float max_error) {
+                const double max_squared_error = static_cast<double>(max_error) * max_error;
+                const auto vertex_count = static_cast<uint32_t>(positions_.size());
+
+                struct Collapse {
+                    uint32_t from;
+                    uint32_t to;
+                    double error;
+                };
+                std::vector<Collapse> collapses;
+                std::vector<uint32_t> remap(vertex_count);
+                std::vector<bool> touched(vertex_count);
+                std::vector<uint32_t> adjacency_offsets(vertex_count + 1);
+                std::vector<uint32_t> adjacency;
+
+                while (indices_.size() > target_index_count) {
+                    auto edges = collectEdges();
+                    edges.erase(std::ranges::unique(edges).begin(), edges.end());
+
+                    collapses.clear();
+                    for (const uint64_t edge: edges) {
+                        const auto a = static_cast<uint32_t>(edge >> 32);
+                        const auto b = static_cast<uint32_t>(edge & 0xffffffff);
+                        const Quadric quadric = quadrics_[a] + quadrics_[b];
+                        Collapse best = {.from = a, .to = b, .error = std::numeric_limits<double>::infinity()};
+                        if (!locked_[a])
+                            best.error = quadric.error(positions_[b]);
+                        if (!locked_[b]) {
+                            const double error = quadric.error(positions_[a]);
+                            if (error < best.error)
+                                best = {.from = b, .to = a, .error = error};
+                        }
+                        if (best.error <= max_squared_error)
+                            collapses.push_back(best);
+                    }
+                    if (collapses.empty())
+                        break;
+                    std::ranges::stable_sort(collapses, {}, &Collapse::error);
+
+                    // vertex to triangle adjacency in compressed sparse row form
+                    std::ranges::fill(adjacency_offsets, 0);
+                    for (const uint32_t index: indices_)
+                        adjacency_offsets[index + 1]++;
+                    std::inclusive_scan(adjacency_offsets.begin(), adjacency_offsets.end(), adjacency_offsets.begin());
+                    adjacency.resize(indices_.size());
+                    {
+                        std::vector<uint32_t> cursor(adjacency_offsets.begin(), adjacency_offsets.end() - 1);
+                        for (size_t i = 0; i < indices_.size(); i++)
+                            adjacency[cursor[indices_[i]]++] = static_cast<uint32_t>(i / 3);
+                    }
+
+                    std::iota(remap.begin(), remap.end(), 0);
+                    touched.assign(vertex_count, false);
+                    const size_t removable_triangles = (indices_.size() - target_index_count + 2) / 3;
+                    size_t removed_triangles = 0;
+                    for (const auto &collapse: collapses) {
+                        if (removed_triangles >= removable_triangles)
+                            break;
+                        if (touched[collapse.from] || touched[collapse.to])
+                            continue;
+                        const auto triangles = std::span(adjacency).subspan(
+                                adjacency_offsets[collapse.from],
+                                adjacency_offsets[collapse.from + 1] - adjacency_offsets[collapse.from]
+                        );
+                        if (flips(triangles, collapse.from, collapse.to))
+                            continue;
+
+                        // the triangles around the collapsed vertex change, none of their vertices may move this pass
+                        for (const uint32_t t: triangles) {
+                            const uint32_t *triangle = &indices_[t * 3];
+                            touched[triangle[0]] = touched[triangle[1]] = touched[triangle[2]] = true;
+                            removed_triangles += triangle[0] == collapse.to || triangle[1] == collapse.to ||
+                                                 triangle[2] == collapse.to;
+                        }
+                        remap[collapse.from] = collapse.to;
+                        quadrics_[collapse.to] += quadrics_[collapse.from];
+                        squaredError_ = std::max(squaredError_, collapse.error);
+                    }
+                    if (removed_triangles == 0)
+                        break;
+
+                    size_t write = 0;
+                    for (size_t t = 0; t < indices_.size(); t += 3) {
+                        const uint32_t a = remap[indices_[t]];
+                        const uint32_t b = remap[indices_[t + 1]];
+                        const uint32_t c = remap[indices_[t + 2]];
+                        if (a == b || b == c || a == c)
+                            continue;
+                        indices_[write++] = a;
+                        indices_[write++] = b;
+                        indices_[write++] = c;
+                    }
+                    indices_.resize(write);
+                }
+            }
+        };
+
+        struct PrimitiveLods {
+            std::vector<std::vector<uint32_t>> levels;
+            std::vector<float> errors;
+        };
+
+        PrimitiveLods generate(const SceneData &scene_data, size_t primitive_index, const LodOptions &options) {
+            PrimitiveLods result;
+            const auto &primitive = scene_data.primitives[primitive_index];
+            const auto *vertex_positions = reinterpret_cast<const glm::vec3 *>(scene_data.vertex_position_data.data());
+            const auto positions = std::span(vertex_positions + primitive.vertexOffset, primitive.vertexCount);
+            if (positions.empty())
+                return result;
+
+            const float radius = scene_data.primitive_bounds.spheres[primitive_index].w;
+
+            const size_t min_index_count = static_cast<size_t>(options.minTriangles) * 3;
+            Simplifier simplifier(positions, readPrimitiveIndices(scene_data, primitive));
+            size_t previous_count = primitive.indexCount;
+            for (uint32_t level = 0; level < std::min(options.levels, MAX_LODS); level++) {
+                const auto target = static_cast<size_t>(static_cast<double>(previous_count) * options.ratio) / 3 * 3;
+                if (target < min_index_count)
+                    break;
+                simplifier.simplify(target, options.maxError * radius);
+                const size_t count = simplifier.indices().size();
+                // stuck on the error limit or the locked vertices
+                if (count > previous_count - previous_count / 10)
+                    break;
+                result.levels.push_back(simplifier.indices());
+                result.errors.push_back(simplifier.error());
+                previous_count = count;
+            }
+            return result;
+        }
+    } // namespace
+
+    void generateLods(SceneData &scene_data, const LodOptions &options) {
+        Logger::check(scene_data.vertex_format == VertexFormat::Float, "LOD generation needs float vertices");
+        const size_t primitive_count = scene_data.primitives.size();
+        std::vector<PrimitiveLods> lods(primitive_count);
+        const auto generate_primitives = [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++)
+                lods[i] = generate(scene_data, i, options);
+        };
+        if (options.parallel)
+            util::parallel_for(primitive_count, 1, generate_primitives);
+        else
+            generate_primitives(0, primitive_count);
+
+        // Append the levels behind the existing indices, with the same alignment rules
+        size_t index_bytes = scene_data.index_data.size();
+        size_t lod_count = 0;
+        for (size_t i = 0; i < primitive_count; i++) {
+            auto &primitive = scene_data.primitives[i];
+            const size_t index_size =
+                    primitive.indexType == vk::IndexType::eUint16 ? sizeof(uint16_t) : sizeof(uint32_t);
+            primitive.lodCount = static_cast<uint32_t>(lods[i].levels.size());
+            for (uint32_t level = 0; level < primitive.lodCount; level++) {
+                index_bytes = (index_bytes + index_size - 1) / index_size * index_size;
+                primitive.lods[level] = {
+                    .indexOffset = static_cast<uint32_t>(index_bytes / index_size),
+                    .indexCount = static_cast<uint32_t>(lods[i].levels[level].size()),
+                    .error = lods[i].errors[level],
+                };
+                index_bytes += lods[i].levels[level].size() * index_size;
+            }
+            lod_count += primitive.lodCount;
+        }
+        const size_t previous_bytes = scene_data.index_data.size();
+        scene_data.index_data.resize(index_bytes);
+        for (size_t i = 0; i < primitive_count; i++) {
+            const auto &primitive = scene_data.primitives[i];
+            for (uint32_t level = 0; level < primitive.lodCount; level++) {
+                Primitive range = primitive;
+                range.indexOffset = primitive.lods[level].indexOffset;
+                range.indexCount = primitive.lods[level].indexCount;
+                writePrimitiveIndices(scene_data, range, lods[i].levels[level]);
+            }
+        }
+
+        computeInstanceBounds(scene_data);
+
+        Logger::info(std::format(
+                "Generated {} LODs for {} primitives in {} additional index bytes", lod_count, primitive_count,
+                index_bytes - previous_bytes
+        ));
+    }
+} // namespace gltf
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdint>
+
+#include "Gltf.h"
+
+namespace gltf {
+    struct LodOptions {
+        // number of simplified levels per primitive, at most MAX_LODS
+        uint32_t levels = MAX_LODS;
+        // index count of a level relative to the previous one
+        float ratio = 0.5f;
+        // collapses with a larger error, relative to the primitive's bounding sphere radius, are not done
+        float maxError = 0.05f;
+        // levels with fewer triangles are not generated
+        uint32_t minTriangles = 32;
+        // Simplify the primitives concurrently on the global thread pool
+        bool parallel = true;
+    };
+
+    /**
+     * Generates simplified index ranges for every primitive with quadric error edge collapses and appends them to
+     * SceneData::index_data. Vertices are only collapsed onto other existing vertices, so the vertex streams are
+     * reused as is. Border and attribute seam vertices are never moved, the simplified meshes stay crack free.
+     * The levels are copied to the instances with their errors scaled to world space.
+     * Run it after optimizeMeshes, which does not know about the LOD ranges.
+     */
+    void generateLods(SceneData &scene_data, const LodOptions &options = {});
+} // namespace gltf
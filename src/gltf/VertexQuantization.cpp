@@ -0,0 +1,299 @@
+#include "VertexQuantization.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstring>
+#include <format>
+#include <glm/common.hpp>
+#include <span>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define GLTF_QUANTIZATION_SSE2
+#include <emmintrin.h>
+#endif
+#if defined(__F16C__) || defined(__AVX2__)
+#define GLTF_QUANTIZATION_F16C
+#include <immintrin.h>
+#endif
+
+#include "../Logger.h"
+#include "../util/thread_pool.h"
+#include "Gltf.h"
+
+namespace gltf {
+    namespace {
+        // Scalar reference encodings, the SIMD loops use them for their remainders
+
+        uint16_t quantize_unorm16(float value) {
+            return static_cast<uint16_t>(std::clamp(value, 0.0f, 1.0f) * 65535.0f + 0.5f);
+        }
+
+        int16_t quantize_snorm16(float value) {
+            return static_cast<int16_t>(std::lround(std::clamp(value, -1.0f, 1.0f) * 32767.0f));
+        }
+
+        // Maps the unit sphere onto the [-1, 1] square
+        glm::vec2 encode_octahedral(glm::vec3 n) {
+            const float l1 = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+            glm::vec2 p = l1 > 0.0f ? glm::vec2(n.x, n.y) / l1 : glm::vec2(0.0f);
+            if (n.z < 0.0f) {
+                const glm::vec2 sign = {std::signbit(p.x) ? -1.0f : 1.0f, std::signbit(p.y) ? -1.0f : 1.0f};
+                p = (glm::vec2(1.0f) - glm::vec2(std::abs(p.y), std::abs(p.x))) * sign;
+            }
+            return p;
+        }
+
+        // The bitangent sign is stored as the sign of y, which is remapped to [0, 1] and kept away from zero
+        glm::vec2 fold_tangent_sign(glm::vec2 octahedral, float sign) {
+            const float y = std::max(octahedral.y * 0.5f + 0.5f, 1.0f / 32767.0f);
+            return {octahedral.x, sign < 0.0f ? -y : y};
+        }
+
+        // IEEE 754 binary16 with round to nearest even
+        uint16_t float_to_half(float value) {
+            uint32_t bits = std::bit_cast<uint32_t>(value);
+            const auto sign = static_cast<uint16_t>((bits >> 16) & 0x8000);
+            bits &= 0x7fffffff;
+            if (bits >= 0x7f800000) // inf and nan
+                return sign | 0x7c00 | (bits > 0x7f800000 ? 0x200 : 0);
+            if (bits >= 0x477ff000) // rounds to inf
+                return sign | 0x7c00;
+            if (bits < 0x38800000) { // subnormal half
+                if (bits < 0x33000000)
+                    return sign;
+                const uint32_t shift = 126 - (bits >> 23);
+                const uint32_t mantissa = (bits & 0x7fffff) | 0x800000;
+                uint32_t half = mantissa >> shift;
+                const uint32_t remainder = mantissa & ((1u << shift) - 1);
+                const uint32_t halfway = 1u << (shift - 1);
+                if (remainder > halfway || (remainder == halfway && (half & 1)))
+                    half++;
+                return static_cast<uint16_t>(sign | half);
+            }
+            // rebias the exponent, a carry out of the mantissa correctly increments it
+            uint32_t half = (bits - 0x38000000) >> 13;
+            const uint32_t remainder = bits & 0x1fff;
+            if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1)))
+                half++;
+            return static_cast<uint16_t>(sign | half);
+        }
+
+#ifdef GLTF_QUANTIZATION_SSE2
+        // Loads 4 packed vec3 as x, y and z vectors
+        void load_vec3x4(const float *src, __m128 &x, __m128 &y, __m128 &z) {
+            // (x0 y0 z0 x1) (y1 z1 x2 y2) (z2 x3 y3 z3)
+            const __m128 a = _mm_loadu_ps(src);
+            const __m128 b = _mm_loadu_ps(src + 4);
+            const __m128 c = _mm_loadu_ps(src + 8);
+            x = _mm_shuffle_ps(a, _mm_shuffle_ps(b, c, _MM_SHUFFLE(1, 1, 2, 2)), _MM_SHUFFLE(2, 0, 3, 0));
+            y = _mm_shuffle_ps(
+                    _mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 1, 1)), _mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 2, 3, 3)),
+                    _MM_SHUFFLE(2, 0, 2, 0)
+            );
+            z = _mm_shuffle_ps(
+                    _mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 1, 2, 2)), _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 3, 0, 0)),
+                    _MM_SHUFFLE(2, 0, 2, 0)
+            );
+        }
+
+        void encode_octahedral_x4(__m128 x, __m128 y, __m128 z, __m128 &ox, __m128 &oy) {
+            const __m128 sign_mask = _mm_set1_ps(-0.0f);
+            const __m128 one = _mm_set1_ps(1.0f);
+            const __m128 l1 = _mm_add_ps(
+                    _mm_add_ps(_mm_andnot_ps(sign_mask, x), _mm_andnot_ps(sign_mask, y)), _mm_andnot_ps(sign_mask, z)
+            );
+            // zero vectors end up at (0, 0) instead of nan
+            const __m128 valid = _mm_cmpgt_ps(l1, _mm_setzero_ps());
+            const __m128 inv_l1 = _mm_and_ps(valid, _mm_div_ps(one, _mm_max_ps(l1, _mm_set1_ps(1e-30f))));
+            const __m128 px = _mm_mul_ps(x, inv_l1);
+            const __m128 py = _mm_mul_ps(y, inv_l1);
+
+            const __m128 sign_x = _mm_or_ps(one, _mm_and_ps(px, sign_mask));
+            const __m128 sign_y = _mm_or_ps(one, _mm_and_ps(py, sign_mask));
+            const __m128 fx = _mm_mul_ps(_mm_sub_ps(one, _mm_andnot_ps(sign_mask, py)), sign_x);
+            const __m128 fy = _mm_mul_ps(_mm_sub_ps(one, _mm_andnot_ps(sign_mask, px)), sign_y);
+            const __m128 lower = _mm_cmplt_ps(z, _mm_setzero_ps());
+            ox = _mm_or_ps(_mm_and_ps(lower, fx), _mm_andnot_ps(lower, px));
+            oy = _mm_or_ps(_mm_and_ps(lower, fy), _mm_andnot_ps(lower, py));
+        }
+
+        // Stores x and y as 4 interleaved snorm16 pairs
+        void store_snorm16x2x4(__m128 x, __m128 y, int16_t *dst) {
+            const __m128 scale = _mm_set1_ps(32767.0f);
+            const __m128i xi = _mm_cvtps_epi32(_mm_mul_ps(x, scale));
+            const __m128i yi = _mm_cvtps_epi32(_mm_mul_ps(y, scale));
+            // (x0 x1 x2 x3 y0 y1 y2 y3) to (x0 y0 x1 y1 ...)
+            const __m128i packed = _mm_packs_epi32(xi, yi);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dst), _mm_unpacklo_epi16(packed, _mm_srli_si128(packed, 8)));
+        }
+#endif
+
+        void encode_positions(std::span<const glm::vec3> src, glm::vec3 offset, glm::vec3 inv_extent, uint16_t *dst) {
+            size_t i = 0;
+#ifdef GLTF_QUANTIZATION_SSE2
+            const __m128 offset4 = _mm_setr_ps(offset.x, offset.y, offset.z, 0.0f);
+            // w is scaled by zero, the padding ends up as zero
+            const __m128 scale4 =
+                    _mm_mul_ps(_mm_setr_ps(inv_extent.x, inv_extent.y, inv_extent.z, 0.0f), _mm_set1_ps(65535.0f));
+            const __m128 max4 = _mm_set1_ps(65535.0f);
+            const __m128i bias = _mm_set1_epi32(32768);
+            const __m128i bias16 = _mm_set1_epi16(static_cast<int16_t>(0x8000));
+            // the last element is never part of a wide load, it might end right at the end of the stream
+            for (; i + 1 < src.size(); i++) {
+                const __m128 v = _mm_loadu_ps(&src[i].x);
+                __m128 q = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(v, offset4), scale4), _mm_set1_ps(0.5f));
+                q = _mm_min_ps(_mm_max_ps(q, _mm_setzero_ps()), max4);
+                // SSE2 has no unsigned saturating pack, shift into the signed range and back
+                const __m128i qi = _mm_sub_epi32(_mm_cvttps_epi32(q), bias);
+                const __m128i packed = _mm_xor_si128(_mm_packs_epi32(qi, qi), bias16);
+                _mm_storel_epi64(reinterpret_cast<__m128i *>(dst + i * 4), packed);
+            }
+#endif
+            for (; i < src.size(); i++) {
+                const glm::vec3 t = (src[i] - offset) * inv_extent;
+                dst[i * 4 + 0] = quantize_unorm16(t.x);
+                dst[i * 4 + 1] = quantize_unorm16(t.y);
+                dst[i * 4 + 2] = quantize_unorm16(t.z);
+                dst[i * 4 + 3] = 0;
+            }
+        }
+
+        void encode_normals(std::span<const glm::vec3> src, int16_t *dst) {
+            size_t i = 0;
+#ifdef GLTF_QUANTIZATION_SSE2
+            for (; i + 4 <= src.size(); i += 4) {
+                __m128 x, y, z, ox, oy;
+                load_vec3x4(&src[i].x, x, y, z);
+                encode_octahedral_x4(x, y, z, ox, oy);
+                store_snorm16x2x4(ox, oy, dst + i * 2);
+            }
+#endif
+            for (; i < src.size(); i++) {
+                const glm::vec2 p = encode_octahedral(src[i]);
+                dst[i * 2 + 0] = quantize_snorm16(p.x);
+                dst[i * 2 + 1] = quantize_snorm16(p.y);
+            }
+        }
+
+        void encode_tangents(std::span<const glm::vec4> src, int16_t *dst) {
+            size_t i = 0;
+#ifdef GLTF_QUANTIZATION_SSE2
+            for (; i + 4 <= src.size(); i += 4) {
+                __m128 x = _mm_loadu_ps(&src[i + 0].x);
+                __m128 y = _mm_loadu_ps(&src[i + 1].x);
+                __m128 z = _mm_loadu_ps(&src[i + 2].x);
+                __m128 w = _mm_loadu_ps(&src[i + 3].x);
+                _MM_TRANSPOSE4_PS(x, y, z, w);
+                __m128 ox, oy;
+                encode_octahedral_x4(x, y, z, ox, oy);
+                const __m128 half = _mm_set1_ps(0.5f);
+                const __m128 folded =
+                        _mm_max_ps(_mm_add_ps(_mm_mul_ps(oy, half), half), _mm_set1_ps(1.0f / 32767.0f));
+                const __m128 negative = _mm_cmplt_ps(w, _mm_setzero_ps());
+                oy = _mm_xor_ps(folded, _mm_and_ps(negative, _mm_set1_ps(-0.0f)));
+                store_snorm16x2x4(ox, oy, dst + i * 2);
+            }
+#endif
+            for (; i < src.size(); i++) {
+                const glm::vec2 p = fold_tangent_sign(encode_octahedral(glm::vec3(src[i])), src[i].w);
+                dst[i * 2 + 0] = quantize_snorm16(p.x);
+                dst[i * 2 + 1] = quantize_snorm16(p.y);
+            }
+        }
+
+        void encode_texcoords(std::span<const glm::vec2> src, uint16_t *dst) {
+            size_t i = 0;
+#ifdef GLTF_QUANTIZATION_F16C
+            for (; i + 4 <= src.size(); i += 4) {
+                const __m128i lo = _mm_cvtps_ph(_mm_loadu_ps(&src[i].x), _MM_FROUND_TO_NEAREST_INT);
+                const __m128i hi = _mm_cvtps_ph(_mm_loadu_ps(&src[i + 2].x), _MM_FROUND_TO_NEAREST_INT);
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i * 2), _mm_unpacklo_epi64(lo, hi));
+            }
+#endif
+            for (; i < src.size(); i++) {
+                dst[i * 2 + 0] = float_to_half(src[i].x);
+                dst[i * 2 + 1] = float_to_half(src[i].y);
+            }
+        }
+
+        template<typename T>
+        std::span<const T> stream_span(const std::vector<unsigned char> &data, size_t offset, size_t count) {
+            return {reinterpret_cast<const T *>(data.data()) + offset, count};
+        }
+
+        template<typename T>
+        T *stream_data(std::vector<unsigned char> &data, size_t offset) {
+            return reinterpret_cast<T *>(data.data()) + offset;
+        }
+    } // namespace
+
+    void quantizeVertices(SceneData &scene_data, bool parallel) {
+        if (scene_data.vertex_format == VertexFormat::Quantized)
+            return;
+
+        const size_t vertex_count = scene_data.vertex_position_data.size() / sizeof(Vertex::pos);
+        std::vector<unsigned char> positions(vertex_count * sizeof(QuantizedVertex::pos));
+        std::vector<unsigned char> normals(vertex_count * sizeof(QuantizedVertex::normal));
+        std::vector<unsigned char> tangents(vertex_count * sizeof(QuantizedVertex::tangent));
+        std::vector<unsigned char> texcoords(vertex_count * sizeof(QuantizedVertex::texCoord));
+
+        const auto encode_primitives = [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                auto &primitive = scene_data.primitives[i];
+                const size_t offset = primitive.vertexOffset;
+                const size_t count = primitive.vertexCount;
+                if (count == 0)
+                    continue;
+
+                const auto src_positions = stream_span<glm::vec3>(scene_data.vertex_position_data, offset, count);
+                glm::vec3 min = src_positions[0];
+                glm::vec3 max = src_positions[0];
+                for (const auto &position: src_positions) {
+                    min = glm::min(min, position);
+                    max = glm::max(max, position);
+                }
+                const glm::vec3 extent = max - min;
+                const glm::vec3 inv_extent = {
+                    extent.x > 0.0f ? 1.0f / extent.x : 0.0f,
+                    extent.y > 0.0f ? 1.0f / extent.y : 0.0f,
+                    extent.z > 0.0f ? 1.0f / extent.z : 0.0f,
+                };
+                primitive.quantizationOffset = min;
+                primitive.quantizationScale = extent;
+
+                encode_positions(src_positions, min, inv_extent, stream_data<uint16_t>(positions, offset * 4));
+                encode_normals(
+                        stream_span<glm::vec3>(scene_data.vertex_normal_data, offset, count),
+                        stream_data<int16_t>(normals, offset * 2)
+                );
+                encode_tangents(
+                        stream_span<glm::vec4>(scene_data.vertex_tangent_data, offset, count),
+                        stream_data<int16_t>(tangents, offset * 2)
+                );
+                encode_texcoords(
+                        stream_span<glm::vec2>(scene_data.vertex_texcoord_data, offset, count),
+                        stream_data<uint16_t>(texcoords, offset * 2)
+                );
+            }
+        };
+        if (parallel)
+            util::parallel_for(scene_data.primitives.size(), 1, encode_primitives);
+        else
+            encode_primitives(0, scene_data.primitives.size());
+
+        const size_t float_bytes = scene_data.vertex_position_data.size() + scene_data.vertex_normal_data.size() +
+                                   scene_data.vertex_tangent_data.size() + scene_data.vertex_texcoord_data.size();
+        const size_t quantized_bytes = positions.size() + normals.size() + tangents.size() + texcoords.size();
+        scene_data.vertex_position_data = std::move(positions);
+        scene_data.vertex_normal_data = std::move(normals);
+        scene_data.vertex_tangent_data = std::move(tangents);
+        scene_data.vertex_texcoord_data = std::move(texcoords);
+        scene_data.vertex_format = VertexFormat::Quantized;
+
+        Logger::info(std::format(
+                "Quantized {} vertices from {} to {} bytes ({:.1f}%)", vertex_count, float_bytes, quantized_bytes,
+                100.0 * static_cast<double>(quantized_bytes) / static_cast<double>(std::max<size_t>(1, float_bytes))
+        ));
+    }
+} // namespace gltf
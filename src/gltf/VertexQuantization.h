@@ -0,0 +1,12 @@
+#pragma once
+
+namespace gltf {
+    struct SceneData;
+
+    /**
+     * Encodes the float vertex streams as QuantizedVertex, the vertex offsets stay the same.
+     * Sets the dequantization offset and scale of every primitive. Does nothing if the streams already are quantized.
+     * @param parallel encode the primitives concurrently on the global thread pool
+     */
+    void quantizeVertices(SceneData &scene_data, bool parallel = true);
+} // namespace gltf
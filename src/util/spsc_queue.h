@@ -0,0 +1,79 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <memory>
+#include <optional>
+
+namespace util {
+    /**
+     * Bounded lock-free queue between exactly one producer thread and one consumer thread. Neither side ever blocks,
+     * a full or empty queue is reported and the caller decides how to wait.
+     * @tparam T default constructible, the slots are allocated up front
+     */
+    template<typename T>
+    class SpscQueue {
+        // the two threads write their index on separate cache lines, so they don't keep stealing them from each other
+        static constexpr size_t CACHE_LINE = 64;
+
+        std::unique_ptr<T[]> slots_;
+        size_t mask_ = 0;
+        // next item to pop, only written by the consumer
+        alignas(CACHE_LINE) std::atomic<size_t> head_ = 0;
+        // the consumer's last look at tail_, it only reloads it once it caught up
+        size_t cachedTail_ = 0;
+        // next item to push, only written by the producer
+        alignas(CACHE_LINE) std::atomic<size_t> tail_ = 0;
+        // the producer's last look at head_, it only reloads it once the queue looks full
+        size_t cachedHead_ = 0;
+
+    public:
+        // The capacity is rounded up to a power of two
+        explicit SpscQueue(size_t capacity) {
+            capacity = std::bit_ceil(std::max<size_t>(capacity, 1));
+            slots_ = std::make_unique<T[]>(capacity);
+            mask_ = capacity - 1;
+        }
+
+        SpscQueue(const SpscQueue &other) = delete;
+
+        SpscQueue &operator=(const SpscQueue &other) = delete;
+
+        [[nodiscard]] size_t capacity() const { return mask_ + 1; }
+
+        // Producer only. Returns false if the queue is full, value is only moved from if it was pushed.
+        bool tryPush(T &&value) {
+            const size_t tail = tail_.load(std::memory_order_relaxed);
+            if (tail - cachedHead_ > mask_) {
+                cachedHead_ = head_.load(std::memory_order_acquire);
+                if (tail - cachedHead_ > mask_)
+                    return false;
+            }
+            slots_[tail & mask_] = std::move(value);
+            tail_.store(tail + 1, std::memory_order_release);
+            return true;
+        }
+
+        // Consumer only. Returns nothing if the queue is empty.
+        std::optional<T> tryPop() {
+            const size_t head = head_.load(std::memory_order_relaxed);
+            if (head == cachedTail_) {
+                cachedTail_ = tail_.load(std::memory_order_acquire);
+                if (head == cachedTail_)
+                    return std::nullopt;
+            }
+            std::optional<T> result = std::move(slots_[head & mask_]);
+            // the slot would otherwise hold on to what the item owns until it is reused
+            slots_[head & mask_] = T{};
+            head_.store(head + 1, std::memory_order_release);
+            return result;
+        }
+
+        // Only a hint while the other thread is active
+        [[nodiscard]] bool empty() const {
+            return head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_acquire);
+        }
+    };
+} // namespace util
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace util {
+    class ThreadPool {
+        std::vector<std::jthread> workers_;
+        std::deque<std::function<void()>> queue_;
+        std::mutex mutex_;
+        std::condition_variable condition_;
+        bool stopping_ = false;
+
+        void work() {
+            while (true) {
+                std::function<void()> task;
+                {
+                    std::unique_lock lock(mutex_);
+                    condition_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+                    if (queue_.empty())
+                        return;
+                    task = std::move(queue_.front());
+                    queue_.pop_front();
+                }
+                task();
+            }
+        }
+
+    public:
+        explicit ThreadPool(size_t threads) {
+            workers_.reserve(threads);
+            for (size_t i = 0; i < threads; i++)
+                workers_.emplace_back([this] { work(); });
+        }
+
+        ~ThreadPool() {
+            {
+                std::lock_guard lock(mutex_);
+                stopping_ = true;
+            }
+            condition_.notify_all();
+            // jthread joins on destruction, the remaining queue is drained first
+        }
+
+        ThreadPool(const ThreadPool &other) = delete;
+
+        ThreadPool &operator=(const ThreadPool &other) = delete;
+
+        [[nodiscard]] size_t size() const { return workers_.size(); }
+
+        template<typename F>
+        auto submit(F &&task) -> std::future<std::invoke_result_t<F>> {
+            using R = std::invoke_result_t<F>;
+            auto packaged = std::make_shared<std::packaged_task<R()>>(std::forward<F>(task));
+            auto future = packaged->get_future();
+            {
+                std::lock_guard lock(mutex_);
+                queue_.emplace_back([packaged] { (*packaged)(); });
+            }
+            condition_.notify_one();
+            return future;
+        }
+
+        // Shared pool for CPU bound work, sized so that together with the calling thread every core is busy
+        static ThreadPool &global() {
+            static ThreadPool pool(std::max(1u, std::thread::hardware_concurrency()) - 1);
+            return pool;
+        }
+    };
+
+    /**
+     * Calls fn(begin, end) for consecutive chunks of [0, count) on the global thread pool.
+     * The calling thread works on chunks as well, so nested calls from pool threads cannot dead lock.
+     * Returns once all chunks are done. The first exception thrown by fn is rethrown on the calling thread.
+     * @param grain the minimum number of elements per chunk
+     */
+    template<typename F>
+    void parallel_for(size_t count, size_t grain, F &&fn) {
+        if (count == 0)
+            return;
+        grain = std::max<size_t>(grain, 1);
+
+        auto &pool = ThreadPool::global();
+        size_t chunk_size = std::max(grain, count / ((pool.size() + 1) * 4) + 1);
+        size_t chunks = (count + chunk_size - 1) / chunk_size;
+        if (chunks <= 1 || pool.size() == 0) {
+            fn(size_t{0}, count);
+            return;
+        }
+
+        struct State {
+            std::atomic<size_t> next = 0;
+            std::atomic<size_t> done = 0;
+            std::mutex exception_mutex;
+            std::exception_ptr exception;
+        };
+        auto state = std::make_shared<State>();
+
+        // Helpers may start after all chunks are taken, they must not touch fn in that case
+        auto run = [state, chunks, chunk_size, count, &fn] {
+            while (true) {
+                size_t chunk = state->next.fetch_add(1);
+                if (chunk >= chunks)
+                    return;
+                try {
+                    size_t begin = chunk * chunk_size;
+                    fn(begin, std::min(begin + chunk_size, count));
+                } catch (...) {
+                    std::lock_guard lock(state->exception_mutex);
+                    if (!state->exception)
+                        state->exception = std::current_exception();
+                }
+                if (state->done.fetch_add(1) + 1 == chunks)
+                    state->done.notify_all();
+            }
+        };
+
+        size_t helpers = std::min(pool.size(), chunks - 1);
+        for (size_t i = 0; i < helpers; i++)
+            (void) pool.submit(run);
+        run();
+
+        for (size_t done = state->done.load(); done != chunks; done = state->done.load())
+            state->done.wait(done);
+
+        if (state->exception)
+            std::rethrow_exception(state->exception);
+    }
+} // namespace util
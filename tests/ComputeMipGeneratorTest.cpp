@@ -0,0 +1,184 @@
+// Generates the mip chains of a few images with ComputeMipGenerator on a headless device and compares them with
+// PlainImageData::generateMipmaps. The upload, the generation and the readback are submitted like in Application:
+// without waiting, each queue waits for the timeline value of the previous step. Skipped without a Vulkan device or
+// when it can't run the generator, a software implementation like lavapipe is enough.
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <memory>
+#include <span>
+#include <vector>
+
+#include "CommandPool.h"
+#include "ComputeMipGenerator.h"
+#include "GraphicsBackend.h"
+#include "Image.h"
+#include "ShaderObject.h"
+#include "StagingBuffer.h"
+
+namespace {
+    // ctest's SKIP_RETURN_CODE of the tests
+    constexpr int SKIP = 77;
+    // the shader keeps the levels as floats, the CPU rounds each one to 8 bits before filtering the next
+    constexpr int MAX_DIFFERENCE = 2;
+
+    struct TestImage {
+        vk::Format format;
+        uint32_t width;
+        uint32_t height;
+        int channels;
+    };
+
+    // one of each format the generator takes, and sizes that run out in one dimension first
+    constexpr std::array TEST_IMAGES = {
+        TestImage{vk::Format::eR8G8B8A8Unorm, 256, 256, 4},
+        TestImage{vk::Format::eR8G8B8A8Srgb, 128, 64, 4},
+        TestImage{vk::Format::eR8G8Unorm, 64, 64, 2},
+        TestImage{vk::Format::eR8Unorm, 32, 128, 1},
+    };
+
+    // A gradient with some noise, so the small levels still differ between texels
+    PlainImageData test_image(const TestImage &test) {
+        std::vector<unsigned char> pixels(static_cast<size_t>(test.width) * test.height * test.channels);
+        uint32_t state = 0x12345678;
+        for (uint32_t y = 0; y < test.height; y++) {
+            for (uint32_t x = 0; x < test.width; x++) {
+                for (int c = 0; c < test.channels; c++) {
+                    state = state * 1664525u + 1013904223u;
+                    const int value = (x * (c + 1) + y * (3 - c)) / 2 + static_cast<int>(state >> 28);
+                    pixels[(static_cast<size_t>(y) * test.width + x) * test.channels + c] =
+                            static_cast<unsigned char>(value);
+                }
+            }
+        }
+        return PlainImageData::create(
+                test.format, static_cast<int>(test.width), static_cast<int>(test.height), test.channels, pixels.data()
+        );
+    }
+
+    // Whether the levels read back match the CPU ones, prints the levels that don't
+    bool matches(const PlainImageData &expected, const unsigned char *actual) {
+        bool result = true;
+        for (uint32_t level = 0; level < expected.mipLevels; level++) {
+            const size_t offset = expected.levelOffset(level);
+            const size_t size = PlainImageData::levelSize(expected.format, expected.width, expected.height, level);
+            int difference = 0;
+            for (size_t i = offset; i < offset + size; i++)
+                difference = std::max(difference, std::abs(expected.pixels[i] - actual[i]));
+            if (difference > MAX_DIFFERENCE) {
+                std::fprintf(
+                        stderr, "%s %ux%u level %u differs by up to %d\n", vk::to_string(expected.format).c_str(),
+                        expected.width, expected.height, level, difference
+                );
+                result = false;
+            }
+        }
+        return result;
+    }
+} // namespace
+
+int main() {
+    std::unique_ptr<DeviceContext> ctx;
+    try {
+        ctx = std::make_unique<DeviceContext>(true);
+    } catch (const std::exception &e) {
+        std::printf("No usable Vulkan device, skipped: %s\n", e.what());
+        return SKIP;
+    }
+    const ShaderLoader loader;
+    auto generator = ComputeMipGenerator::create(*ctx, loader);
+    if (!generator) {
+        std::printf("The device can't run the ComputeMipGenerator, skipped\n");
+        return SKIP;
+    }
+    const auto device = ctx->get();
+    const auto &allocator = *ctx->allocator;
+
+    std::vector<PlainImageData> sources;
+    std::vector<Image> images;
+    for (const auto &test: TEST_IMAGES) {
+        auto source = test_image(test);
+        const auto info = ImageCreateInfo::from(source);
+        if (!generator->supports(info)) {
+            std::printf("%s isn't supported by the device, skipped\n", vk::to_string(test.format).c_str());
+            continue;
+        }
+        images.push_back(Image::create(allocator, generator->prepare(info)));
+        sources.push_back(std::move(source));
+    }
+    if (images.empty())
+        return SKIP;
+
+    // the same commands upload on the main queue and read back, after the compute queue generated the levels
+    Commands commands(device, ctx->mainQueue, ctx->mainQueueFamily, Commands::UseMode::Single);
+    Commands mip_commands(device, generator->queue(), generator->queueFamily(), Commands::UseMode::Single);
+    RingStagingBuffer staging(allocator, 1 << 20);
+
+    commands.begin();
+    for (auto &image: images)
+        image.barrier(*commands, ImageResourceAccess::TransferWrite);
+    for (size_t i = 0; i < images.size(); i++) {
+        auto [buffer, offset, ptr] = staging.upload(commands, sources[i].pixels.size_bytes(), sources[i].pixels.data());
+        images[i].load(*commands, 0, {}, buffer, offset);
+    }
+    const uint64_t upload_value = commands.submitAsync();
+
+    std::vector<Image *> generated;
+    for (auto &image: images)
+        generated.push_back(&image);
+    mip_commands.begin();
+    generator->generate(*mip_commands, generated, mip_commands.trash);
+    const auto upload_wait = commands.waitInfo(upload_value, vk::PipelineStageFlagBits2::eAllCommands);
+    const uint64_t mip_value = mip_commands.submitAsync(std::span(&upload_wait, 1));
+
+    std::vector<PlainImageData> expected;
+    std::vector<size_t> readback_offsets;
+    size_t readback_size = 0;
+    for (const auto &source: sources) {
+        expected.push_back(source.generateMipmaps(MipFilter::Box, false));
+        readback_offsets.push_back(readback_size);
+        readback_size += expected.back().pixels.size_bytes();
+    }
+    vma::AllocationInfo readback_info = {};
+    auto [readback, readback_allocation] = allocator.createBufferUnique(
+            {.size = readback_size, .usage = vk::BufferUsageFlagBits::eTransferDst},
+            {.flags = vma::AllocationCreateFlagBits::eHostAccessRandom | vma::AllocationCreateFlagBits::eMapped,
+             .usage = vma::MemoryUsage::eAuto,
+             .requiredFlags = vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent},
+            &readback_info
+    );
+
+    commands.begin();
+    for (size_t i = 0; i < images.size(); i++) {
+        const auto &info = images[i].createInfo();
+        if (info.mip_levels != expected[i].mipLevels) {
+            std::fprintf(stderr, "%u levels instead of %u\n", info.mip_levels, expected[i].mipLevels);
+            return EXIT_FAILURE;
+        }
+        images[i].barrier(*commands, ImageResourceAccess::TransferRead);
+        for (uint32_t level = 0; level < info.mip_levels; level++) {
+            commands->copyImageToBuffer(
+                    images[i].getImage(), vk::ImageLayout::eTransferSrcOptimal, *readback,
+                    vk::BufferImageCopy{
+                        .bufferOffset = readback_offsets[i] + expected[i].levelOffset(level),
+                        .imageSubresource = {
+                            .aspectMask = vk::ImageAspectFlagBits::eColor, .mipLevel = level, .layerCount = 1
+                        },
+                        .imageExtent = {std::max(info.width >> level, 1u), std::max(info.height >> level, 1u), 1},
+                    }
+            );
+        }
+    }
+    const auto mip_wait = mip_commands.waitInfo(mip_value, vk::PipelineStageFlagBits2::eAllCommands);
+    commands.submit(std::span(&mip_wait, 1));
+
+    bool passed = true;
+    const auto *read = static_cast<const unsigned char *>(readback_info.pMappedData);
+    for (size_t i = 0; i < images.size(); i++)
+        passed = matches(expected[i], read + readback_offsets[i]) && passed;
+    std::printf("%zu images %s\n", images.size(), passed ? "match" : "differ");
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
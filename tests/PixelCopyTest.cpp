@@ -0,0 +1,68 @@
+// Compares every pixel copy kernel this CPU supports with the scalar one, for all channel counts and for lengths that
+// end in the middle of a SIMD block, so the tails are covered as well. Fails with the first difference.
+
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#include "PixelCopy.h"
+
+namespace {
+    constexpr std::array KERNELS = {PixelCopyKernel::Ssse3, PixelCopyKernel::Avx2, PixelCopyKernel::Neon};
+    constexpr std::array KERNEL_NAMES = {"Ssse3", "Avx2", "Neon"};
+    // around the 16 and 32 byte registers and a large odd count
+    constexpr std::array<size_t, 14> ELEMENT_COUNTS = {0, 1, 3, 4, 5, 7, 8, 15, 16, 17, 31, 32, 33, 4093};
+    // written to dst first, so bytes a kernel writes but shouldn't show up
+    constexpr unsigned char CANARY = 0xcd;
+
+    std::vector<unsigned char> random_bytes(size_t size) {
+        std::vector<unsigned char> bytes(size);
+        uint32_t state = 0x2545f491;
+        for (auto &byte: bytes) {
+            state = state * 1664525u + 1013904223u;
+            byte = static_cast<unsigned char>(state >> 24);
+        }
+        return bytes;
+    }
+
+    // Whether the kernel matches the scalar one, prints the first difference otherwise
+    bool matches_scalar(PixelCopyKernel kernel, const char *name, int src_channels, int dst_channels, size_t elements) {
+        const auto src = random_bytes(elements * src_channels);
+        // one pixel more than needed, it has to stay untouched
+        std::vector<unsigned char> expected((elements + 1) * dst_channels, CANARY);
+        std::vector<unsigned char> dst((elements + 1) * dst_channels, CANARY);
+        copyPixels(PixelCopyKernel::Scalar, src.data(), src_channels, expected.data(), dst_channels, elements);
+        copyPixels(kernel, src.data(), src_channels, dst.data(), dst_channels, elements);
+        for (size_t i = 0; i < dst.size(); i++) {
+            if (dst[i] != expected[i]) {
+                std::fprintf(
+                        stderr, "%s, %d to %d channels, %zu elements: byte %zu is %d instead of %d\n", name,
+                        src_channels, dst_channels, elements, i, dst[i], expected[i]
+                );
+                return false;
+            }
+        }
+        return true;
+    }
+} // namespace
+
+int main() {
+    int failures = 0;
+    for (size_t k = 0; k < KERNELS.size(); k++) {
+        if (!pixelCopyKernelSupported(KERNELS[k])) {
+            std::printf("%s isn't supported by this CPU, skipped\n", KERNEL_NAMES[k]);
+            continue;
+        }
+        for (int src_channels = 1; src_channels <= 4; src_channels++) {
+            for (int dst_channels = 1; dst_channels <= 4; dst_channels++) {
+                for (const size_t elements: ELEMENT_COUNTS) {
+                    if (!matches_scalar(KERNELS[k], KERNEL_NAMES[k], src_channels, dst_channels, elements))
+                        failures++;
+                }
+            }
+        }
+        std::printf("%s checked\n", KERNEL_NAMES[k]);
+    }
+    return failures == 0 ? 0 : 1;
+}